@@ -0,0 +1,136 @@
+//
+// AssetStreamer.cpp
+//
+
+#include "AssetStreamer.h"
+
+AssetStreamer::AssetStreamer(IGpuFence& uploadFence) :
+	mUploadFence(uploadFence),
+	mLoading(false),
+	mRunning(true),
+	mStarted(false)
+{
+	mThread = std::thread([this]()
+	{
+		Run();
+	});
+}
+
+AssetStreamer::~AssetStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRunning = false;
+	}
+	mWake.notify_all();
+	mThread.join();
+}
+
+void AssetStreamer::Load(LoadFunction load, ReadyFunction ready)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mStarted)
+		{
+			mFirstLoad = Clock::now();
+			mStarted = true;
+		}
+		// Streaming stopped after a failed load.
+		if (!mRunning)
+			return;
+		mRequests.push_back({ std::move(load), std::move(ready) });
+	}
+	mWake.notify_one();
+}
+
+size_t AssetStreamer::Update()
+{
+	std::vector<ReadyFunction> ready;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mError)
+		{
+			std::exception_ptr error = mError;
+			mError = nullptr;
+			std::rethrow_exception(error);
+		}
+
+		if (mUploads.empty())
+			return 0;
+
+		uint64_t completed = mUploadFence.GetCompletedFence();
+		while (!mUploads.empty() && mUploads.front().Fence <= completed)
+		{
+			ready.push_back(std::move(mUploads.front().Ready));
+			mUploads.pop_front();
+		}
+	}
+
+	// Outside the lock, swapping in may take a moment.
+	for (auto& function : ready)
+		function();
+
+	if (!ready.empty())
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStats.Loaded += ready.size();
+		mStats.LastReadySeconds = std::chrono::duration<double>(Clock::now() - mFirstLoad).count();
+	}
+	return ready.size();
+}
+
+size_t AssetStreamer::GetPending()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mRequests.size() + mUploads.size() + (mLoading ? 1 : 0);
+}
+
+AssetStreamer::Stats AssetStreamer::GetStats()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void AssetStreamer::Run()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;)
+	{
+		mWake.wait(lock, [this]()
+		{
+			return !mRunning || !mRequests.empty();
+		});
+		if (!mRunning)
+			return;
+
+		Request request = std::move(mRequests.front());
+		mRequests.pop_front();
+		mLoading = true;
+		lock.unlock();
+
+		auto start = Clock::now();
+		uint64_t fence = 0;
+		std::exception_ptr error;
+		try
+		{
+			fence = request.Load();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		lock.lock();
+		mLoading = false;
+		mStats.LoadSeconds += seconds;
+		if (error)
+		{
+			mError = error;
+			mRequests.clear();
+			mRunning = false;
+			return;
+		}
+		mUploads.push_back({ fence, std::move(request.Ready) });
+	}
+}
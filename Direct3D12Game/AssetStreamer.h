@@ -0,0 +1,95 @@
+//
+// AssetStreamer.h - Background asset loading with fenced swap-in on the render thread
+//
+
+#pragma once
+
+#include "FrameRing.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Loads assets on a streaming thread while the render thread keeps drawing with
+// placeholders. An asset is a pair of functions:
+//
+//   load   runs on the streaming thread. It decodes the asset, submits its copies to
+//          the upload queue and returns the fence value that completes them (0 when
+//          nothing is left on the GPU).
+//   ready  runs on the render thread from Update, once the fence passed. It swaps
+//          the asset in, e.g. writes the real descriptor and points the draws at it.
+//
+// Assets load one at a time in request order and are swapped in in the same order.
+// Exceptions thrown by a load stop the streaming and are rethrown from Update; requests
+// made after that are dropped.
+//
+// Usage:
+//     streamer.Load([=]() { ...decode, upload...; return fence; },
+//                   [=]() { ...swap in... });
+//     streamer.Update();    // once per frame on the render thread
+class AssetStreamer
+{
+public:
+	using LoadFunction = std::function<uint64_t()>;
+	using ReadyFunction = std::function<void()>;
+
+	explicit AssetStreamer(IGpuFence& uploadFence);
+	// Stops after the asset that is loading; assets not swapped in yet are dropped.
+	~AssetStreamer();
+
+	AssetStreamer(const AssetStreamer&) = delete;
+	AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+	void Load(LoadFunction load, ReadyFunction ready);
+
+	// Render thread: swap in the assets whose uploads completed. Returns how many.
+	size_t Update();
+
+	// Assets requested but not swapped in yet.
+	size_t GetPending()const;
+
+	struct Stats
+	{
+		uint64_t Loaded = 0;			// assets swapped in
+		double LoadSeconds = 0.0;		// streaming thread time spent in load functions
+		double LastReadySeconds = 0.0;	// from the first Load until the last swap-in
+	};
+	Stats GetStats()const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Request
+	{
+		LoadFunction Load;
+		ReadyFunction Ready;
+	};
+
+	struct Upload
+	{
+		uint64_t Fence;
+		ReadyFunction Ready;
+	};
+
+	void Run();
+
+	IGpuFence& mUploadFence;
+	std::thread mThread;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mWake;
+	std::deque<Request> mRequests;		// waiting for the streaming thread
+	std::deque<Upload> mUploads;		// loaded, waiting for their fence
+	bool mLoading;
+	bool mRunning;
+	std::exception_ptr mError;
+
+	Clock::time_point mFirstLoad;
+	bool mStarted;
+	Stats mStats;
+};
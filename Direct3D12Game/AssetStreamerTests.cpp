@@ -0,0 +1,135 @@
+//
+// AssetStreamerTests.cpp
+//
+
+#include "AssetStreamer.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Polls until the condition holds, for at most a second.
+	template<typename F>
+	bool WaitFor(const F& condition)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (!condition())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::yield();
+		}
+		return true;
+	}
+}
+
+SELF_TEST(AssetStreamer, SwapsInInOrderOnceTheCopiesComplete)
+{
+	// The fence stands in for the copy queue: each load submits one copy.
+	ManualGpuFence copyQueue;
+	AssetStreamer streamer(copyQueue);
+
+	std::atomic<int> loaded(0);
+	std::vector<int> swappedIn;
+	for (int asset = 0; asset < 3; ++asset)
+	{
+		streamer.Load([&]() { loaded++; return copyQueue.Signal(); },
+			[&swappedIn, asset]() { swappedIn.push_back(asset); });
+	}
+	SELF_CHECK(WaitFor([&]() { return loaded == 3; }));
+
+	// Nothing is swapped in while the copies run, then each asset as its fence passes.
+	SELF_CHECK(streamer.Update() == 0);
+	SELF_CHECK(streamer.GetPending() == 3);
+	copyQueue.Complete(2);
+	SELF_CHECK(streamer.Update() == 2);
+	SELF_CHECK(streamer.Update() == 0);
+	copyQueue.Complete(3);
+	SELF_CHECK(streamer.Update() == 1);
+	SELF_CHECK(swappedIn == std::vector<int>({ 0, 1, 2 }));
+	SELF_CHECK(streamer.GetPending() == 0);
+	SELF_CHECK(streamer.GetStats().Loaded == 3);
+
+	// An asset with nothing left on the GPU is swapped in by the next Update.
+	streamer.Load([]() { return uint64_t(0); }, [&swappedIn]() { swappedIn.push_back(3); });
+	SELF_CHECK(WaitFor([&]() { return streamer.Update() == 1; }));
+	SELF_CHECK(swappedIn.back() == 3);
+}
+
+SELF_TEST(AssetStreamer, RenderThreadNeverWaitsForLoads)
+{
+	// Decoding takes 30 ms per asset; frames keep coming meanwhile and the placeholder
+	// is drawn until the copy completed.
+	ManualGpuFence copyQueue;
+	AssetStreamer streamer(copyQueue);
+	bool swapped = false;
+	auto start = std::chrono::steady_clock::now();
+	for (int asset = 0; asset < 2; ++asset)
+	{
+		streamer.Load([&]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(30));
+			return copyQueue.Signal();
+		}, [&swapped]() { swapped = true; });
+	}
+
+	int frames = 0;
+	double firstFrame = -1.0;
+	double slowestUpdate = 0.0;
+	while (streamer.GetPending() > 0 && frames < 100000)
+	{
+		auto frameStart = std::chrono::steady_clock::now();
+		streamer.Update();
+		slowestUpdate = std::max(slowestUpdate, std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+		if (firstFrame < 0.0)
+			firstFrame = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// The copy queue finishes whatever was submitted by the end of each frame.
+		copyQueue.Complete(copyQueue.GetSignaledFence());
+		frames++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	AssetStreamer::Stats stats = streamer.GetStats();
+	context.Log("first frame after %.2f ms, assets in after %.1f ms and %d frames, slowest Update %.3f ms",
+		firstFrame * 1000.0, stats.LastReadySeconds * 1000.0, frames, slowestUpdate * 1000.0);
+	SELF_CHECK(swapped);
+	SELF_CHECK(stats.Loaded == 2);
+	SELF_CHECK(stats.LoadSeconds >= 0.06);
+	SELF_CHECK(firstFrame < 0.03);
+	SELF_CHECK(frames > 10);
+}
+
+SELF_TEST(AssetStreamer, LoadErrorsReachTheRenderThread)
+{
+	ManualGpuFence copyQueue;
+	AssetStreamer streamer(copyQueue);
+	bool swapped = false;
+	streamer.Load([]() -> uint64_t { throw std::runtime_error("corrupt texture"); }, [&swapped]() { swapped = true; });
+	streamer.Load([&]() { return copyQueue.Signal(); }, [&swapped]() { swapped = true; });
+
+	// The failure stops the streaming: later requests are dropped.
+	bool threw = false;
+	SELF_CHECK(WaitFor([&]()
+	{
+		try
+		{
+			streamer.Update();
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+		return threw;
+	}));
+	SELF_CHECK(!swapped);
+	SELF_CHECK(streamer.GetPending() == 0);
+	SELF_CHECK(copyQueue.GetSignaledFence() == 0);
+	SELF_CHECK(streamer.Update() == 0);
+}
@@ -3,10 +3,200 @@
 //***************************************************************************************
 
 #include "Camera.h"
-#include "pch.h"
+#include "TemporalAA.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(_XM_SSE_INTRINSICS_)
+#include <emmintrin.h>
+#endif
 
 using namespace DirectX;
 
+namespace
+{
+	inline XMFLOAT3 RelativeTo(const WorldPosition& p, const WorldPosition& origin)
+	{
+		return XMFLOAT3(
+			static_cast<float>(p.x - origin.x),
+			static_cast<float>(p.y - origin.y),
+			static_cast<float>(p.z - origin.z));
+	}
+
+	inline XMMATRIX XM_CALLCONV RelativeWorld(FXMMATRIX rotationScale, const WorldPosition& p, const WorldPosition& origin)
+	{
+		XMFLOAT3 t = RelativeTo(p, origin);
+		XMMATRIX M = rotationScale;
+		M.r[3] = XMVectorSet(t.x, t.y, t.z, 1.0f);
+		return M;
+	}
+
+	inline size_t CountBits(uint32_t bits)
+	{
+		size_t n = 0;
+		for (; bits; bits &= bits - 1)
+			++n;
+		return n;
+	}
+
+	// Shared batch kernel for spheres (ex = radius) and AABBs (ex/ey/ez = half extents).
+	// Each block of volumes is tested against all six planes; a volume is rejected as
+	// soon as its center lies further than its projected radius behind any plane.
+	template<bool IsBox>
+	size_t CullKernel(const XMFLOAT4 planes[6],
+		const float* cx, const float* cy, const float* cz,
+		const float* ex, const float* ey, const float* ez,
+		size_t count, uint32_t* visibleMask)
+	{
+		memset(visibleMask, 0, ((count + 31) / 32) * sizeof(uint32_t));
+
+		size_t visible = 0;
+		size_t i = 0;
+
+#if defined(__AVX2__)
+		{
+			const __m256 signMask = _mm256_set1_ps(-0.0f);
+			__m256 pa[6], pb[6], pc[6], pd[6];
+			for (int p = 0; p < 6; ++p)
+			{
+				pa[p] = _mm256_set1_ps(planes[p].x);
+				pb[p] = _mm256_set1_ps(planes[p].y);
+				pc[p] = _mm256_set1_ps(planes[p].z);
+				pd[p] = _mm256_set1_ps(planes[p].w);
+			}
+
+			for (; i + 8 <= count; i += 8)
+			{
+				__m256 x = _mm256_loadu_ps(cx + i);
+				__m256 y = _mm256_loadu_ps(cy + i);
+				__m256 z = _mm256_loadu_ps(cz + i);
+				__m256 rx = _mm256_loadu_ps(ex + i);
+				__m256 ry = IsBox ? _mm256_loadu_ps(ey + i) : rx;
+				__m256 rz = IsBox ? _mm256_loadu_ps(ez + i) : rx;
+
+				__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (int p = 0; p < 6; ++p)
+				{
+					// Multiply and add like the SSE path; FMA is a CPU feature of its own
+					// that __AVX2__ does not imply.
+					__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa[p], x), _mm256_mul_ps(pb[p], y)),
+						_mm256_add_ps(_mm256_mul_ps(pc[p], z), pd[p]));
+					__m256 r = rx;
+					if (IsBox)
+					{
+						r = _mm256_add_ps(_mm256_add_ps(
+							_mm256_mul_ps(_mm256_andnot_ps(signMask, pa[p]), rx),
+							_mm256_mul_ps(_mm256_andnot_ps(signMask, pb[p]), ry)),
+							_mm256_mul_ps(_mm256_andnot_ps(signMask, pc[p]), rz));
+					}
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, _mm256_xor_ps(r, signMask), _CMP_GE_OQ));
+				}
+
+				uint32_t bits = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+				visibleMask[i >> 5] |= bits << (i & 31);
+				visible += CountBits(bits);
+			}
+		}
+#endif
+
+#if defined(_XM_SSE_INTRINSICS_)
+		{
+			const __m128 signMask = _mm_set1_ps(-0.0f);
+			__m128 pa[6], pb[6], pc[6], pd[6];
+			for (int p = 0; p < 6; ++p)
+			{
+				pa[p] = _mm_set1_ps(planes[p].x);
+				pb[p] = _mm_set1_ps(planes[p].y);
+				pc[p] = _mm_set1_ps(planes[p].z);
+				pd[p] = _mm_set1_ps(planes[p].w);
+			}
+
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128 x = _mm_loadu_ps(cx + i);
+				__m128 y = _mm_loadu_ps(cy + i);
+				__m128 z = _mm_loadu_ps(cz + i);
+				__m128 rx = _mm_loadu_ps(ex + i);
+				__m128 ry = IsBox ? _mm_loadu_ps(ey + i) : rx;
+				__m128 rz = IsBox ? _mm_loadu_ps(ez + i) : rx;
+
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int p = 0; p < 6; ++p)
+				{
+					__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p], x), _mm_mul_ps(pb[p], y)),
+						_mm_add_ps(_mm_mul_ps(pc[p], z), pd[p]));
+					__m128 r = rx;
+					if (IsBox)
+					{
+						r = _mm_add_ps(_mm_add_ps(
+							_mm_mul_ps(_mm_andnot_ps(signMask, pa[p]), rx),
+							_mm_mul_ps(_mm_andnot_ps(signMask, pb[p]), ry)),
+							_mm_mul_ps(_mm_andnot_ps(signMask, pc[p]), rz));
+					}
+					inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, _mm_xor_ps(r, signMask)));
+				}
+
+				uint32_t bits = static_cast<uint32_t>(_mm_movemask_ps(inside));
+				visibleMask[i >> 5] |= bits << (i & 31);
+				visible += CountBits(bits);
+			}
+		}
+#endif
+
+		// Scalar fallback, also handles the tail of the SIMD loops.
+		for (; i < count; ++i)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; ++p)
+			{
+				const XMFLOAT4& pl = planes[p];
+				float dist = pl.x * cx[i] + pl.y * cy[i] + pl.z * cz[i] + pl.w;
+				float r = IsBox ?
+					fabsf(pl.x) * ex[i] + fabsf(pl.y) * ey[i] + fabsf(pl.z) * ez[i] :
+					ex[i];
+				inside = dist >= -r;
+			}
+
+			if (inside)
+			{
+				visibleMask[i >> 5] |= 1u << (i & 31);
+				++visible;
+			}
+		}
+
+		return visible;
+	}
+}
+
+size_t CameraSnapshot::CullSpheres(const float* centerX, const float* centerY, const float* centerZ,
+	const float* radius, size_t count, uint32_t* visibleMask)const
+{
+	return CullKernel<false>(FrustumPlanes, centerX, centerY, centerZ,
+		radius, nullptr, nullptr, count, visibleMask);
+}
+
+size_t CameraSnapshot::CullAABBs(const float* centerX, const float* centerY, const float* centerZ,
+	const float* extentX, const float* extentY, const float* extentZ,
+	size_t count, uint32_t* visibleMask)const
+{
+	return CullKernel<true>(FrustumPlanes, centerX, centerY, centerZ,
+		extentX, extentY, extentZ, count, visibleMask);
+}
+
+XMFLOAT3 CameraSnapshot::ToCameraRelative(const WorldPosition& p)const
+{
+	return RelativeTo(p, Origin);
+}
+
+XMMATRIX XM_CALLCONV CameraSnapshot::GetCameraRelativeWorld(FXMMATRIX rotationScale, const WorldPosition& p)const
+{
+	return RelativeWorld(rotationScale, p, Origin);
+}
+
 Camera::Camera()
 {
 	SetLens(0.25f*DirectX::XM_PI, 1.0f, 1.0f, 1000.0f);
@@ -68,6 +258,27 @@ XMFLOAT3 Camera::GetLook3f()const
 	return mLook;
 }
 
+XMVECTOR Camera::GetOrientation()const
+{
+	XMMATRIX M(
+		XMLoadFloat3(&mRight),
+		XMLoadFloat3(&mUp),
+		XMLoadFloat3(&mLook),
+		g_XMIdentityR3);
+	return XMQuaternionNormalize(XMQuaternionRotationMatrix(M));
+}
+
+void Camera::SetOrientation(FXMVECTOR q)
+{
+	XMMATRIX M = XMMatrixRotationQuaternion(XMQuaternionNormalize(q));
+
+	XMStoreFloat3(&mRight, M.r[0]);
+	XMStoreFloat3(&mUp, M.r[1]);
+	XMStoreFloat3(&mLook, M.r[2]);
+
+	mViewDirty = true;
+}
+
 float Camera::GetNearZ()const
 {
 	return mNearZ;
@@ -127,6 +338,8 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf)
 
 	XMMATRIX P = XMMatrixPerspectiveFovLH(mFovY, mAspect, mNearZ, mFarZ);
 	XMStoreFloat4x4(&mProj, P);
+
+	UpdateDerivedMatrices();
 }
 
 void Camera::LookAt(FXMVECTOR pos, FXMVECTOR target, FXMVECTOR worldUp)
@@ -177,6 +390,165 @@ XMFLOAT4X4 Camera::GetProj4x4f()const
 	return mProj;
 }
 
+XMMATRIX Camera::GetViewProj()const
+{
+	assert(!mViewDirty);
+	return XMLoadFloat4x4(&mViewProj);
+}
+
+XMMATRIX Camera::GetInvView()const
+{
+	assert(!mViewDirty);
+	return XMLoadFloat4x4(&mInvView);
+}
+
+XMMATRIX Camera::GetInvViewProj()const
+{
+	assert(!mViewDirty);
+	return XMLoadFloat4x4(&mInvViewProj);
+}
+
+uint64_t Camera::GetVersion()const
+{
+	return mVersion;
+}
+
+void Camera::AdvanceTemporalFrame(uint32_t width, uint32_t height, uint32_t sampleCount)
+{
+	assert(!mViewDirty);
+
+	if (mTemporalFrame == 0)
+	{
+		mFrameViewProj = mViewProj;
+		mFrameOrigin = mOrigin;
+	}
+
+	mPrevViewProj = mFrameViewProj;
+	mPrevOrigin = mFrameOrigin;
+	mFrameViewProj = mViewProj;
+	mFrameOrigin = mOrigin;
+
+	mJitter = TemporalAA::GetJitter(mTemporalFrame++, sampleCount);
+	mJitterWidth = width;
+	mJitterHeight = height;
+}
+
+XMFLOAT2 Camera::GetJitter()const
+{
+	return mJitter;
+}
+
+XMMATRIX Camera::GetJitteredProj()const
+{
+	XMMATRIX P = XMLoadFloat4x4(&mProj);
+	if (mJitterWidth == 0 || mJitterHeight == 0)
+		return P;
+
+	return TemporalAA::JitterProjection(P, mJitter, mJitterWidth, mJitterHeight);
+}
+
+XMMATRIX Camera::GetPrevViewProj()const
+{
+	// current relative -> previous relative is a translation by (origin - previous origin).
+	XMMATRIX T = XMMatrixTranslation(
+		float(mOrigin.x - mPrevOrigin.x),
+		float(mOrigin.y - mPrevOrigin.y),
+		float(mOrigin.z - mPrevOrigin.z));
+	return XMMatrixMultiply(T, XMLoadFloat4x4(&mPrevViewProj));
+}
+
+CameraSnapshot Camera::GetSnapshot()const
+{
+	assert(!mViewDirty);
+
+	CameraSnapshot snapshot;
+	snapshot.Position = mPosition;
+	snapshot.Right = mRight;
+	snapshot.Up = mUp;
+	snapshot.Look = mLook;
+	snapshot.View = mView;
+	snapshot.Proj = mProj;
+	snapshot.ViewProj = mViewProj;
+	snapshot.InvViewProj = mInvViewProj;
+	for (int i = 0; i < 6; ++i)
+		snapshot.FrustumPlanes[i] = mFrustumPlanes[i];
+	XMStoreFloat4x4(&snapshot.JitteredProj, GetJitteredProj());
+	XMStoreFloat4x4(&snapshot.PrevViewProj, GetPrevViewProj());
+	snapshot.Jitter = mJitter;
+	snapshot.Version = mVersion;
+	snapshot.Origin = mOrigin;
+	return snapshot;
+}
+
+void Camera::SetLargeWorldCoordinates(bool enable)
+{
+	mLargeWorld = enable;
+	mViewDirty = true;
+}
+
+bool Camera::GetLargeWorldCoordinates()const
+{
+	return mLargeWorld;
+}
+
+WorldPosition Camera::GetWorldOrigin()const
+{
+	return mOrigin;
+}
+
+WorldPosition Camera::GetWorldPosition()const
+{
+	return WorldPosition(
+		mOrigin.x + mPosition.x,
+		mOrigin.y + mPosition.y,
+		mOrigin.z + mPosition.z);
+}
+
+void Camera::SetWorldPosition(const WorldPosition& p)
+{
+	mPosition = RelativeTo(p, mOrigin);
+	if (mLargeWorld)
+	{
+		mOrigin = p;
+		mPosition = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	}
+	mViewDirty = true;
+}
+
+XMFLOAT3 Camera::ToCameraRelative(const WorldPosition& p)const
+{
+	return RelativeTo(p, mOrigin);
+}
+
+XMMATRIX XM_CALLCONV Camera::GetCameraRelativeWorld(FXMMATRIX rotationScale, const WorldPosition& p)const
+{
+	return RelativeWorld(rotationScale, p, mOrigin);
+}
+
+void Camera::GetFrustumPlanes(XMFLOAT4 planes[6])const
+{
+	assert(!mViewDirty);
+	for (int i = 0; i < 6; ++i)
+		planes[i] = mFrustumPlanes[i];
+}
+
+size_t Camera::CullSpheres(const float* centerX, const float* centerY, const float* centerZ,
+	const float* radius, size_t count, uint32_t* visibleMask)const
+{
+	assert(!mViewDirty);
+	return CullKernel<false>(mFrustumPlanes, centerX, centerY, centerZ,
+		radius, nullptr, nullptr, count, visibleMask);
+}
+
+size_t Camera::CullAABBs(const float* centerX, const float* centerY, const float* centerZ,
+	const float* extentX, const float* extentY, const float* extentZ,
+	size_t count, uint32_t* visibleMask)const
+{
+	assert(!mViewDirty);
+	return CullKernel<true>(mFrustumPlanes, centerX, centerY, centerZ,
+		extentX, extentY, extentZ, count, visibleMask);
+}
+
 void Camera::Strafe(float d)
 {
 	// mPosition += d*mRight
@@ -228,6 +600,13 @@ void Camera::UpdateViewMatrix()
 {
 	if(mViewDirty)
 	{
+		// Rebase the world origin onto the camera so the view has no translation.
+		if (mLargeWorld)
+		{
+			mOrigin = GetWorldPosition();
+			mPosition = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		}
+
 		XMVECTOR R = XMLoadFloat3(&mRight);
 		XMVECTOR U = XMLoadFloat3(&mUp);
 		XMVECTOR L = XMLoadFloat3(&mLook);
@@ -270,7 +649,57 @@ void Camera::UpdateViewMatrix()
 		mView(3, 3) = 1.0f;
 
 		mViewDirty = false;
+
+		UpdateDerivedMatrices();
 	}
 }
 
+void Camera::UpdateDerivedMatrices()
+{
+	XMMATRIX V = XMLoadFloat4x4(&mView);
+	XMMATRIX P = XMLoadFloat4x4(&mProj);
+
+	// The view matrix is a rigid transform, so its inverse is just the camera basis
+	// and position. Only the projection needs a general inverse.
+	XMMATRIX invV = XMMatrixTranspose(V);
+	invV.r[0] = XMVectorSetW(invV.r[0], 0.0f);
+	invV.r[1] = XMVectorSetW(invV.r[1], 0.0f);
+	invV.r[2] = XMVectorSetW(invV.r[2], 0.0f);
+	invV.r[3] = XMVectorSetW(XMLoadFloat3(&mPosition), 1.0f);
+
+	XMMATRIX invP = XMMatrixInverse(nullptr, P);
+
+	XMStoreFloat4x4(&mViewProj, XMMatrixMultiply(V, P));
+	XMStoreFloat4x4(&mInvView, invV);
+	XMStoreFloat4x4(&mInvViewProj, XMMatrixMultiply(invP, invV));
+
+	UpdateFrustumPlanes();
+
+	++mVersion;
+}
+
+void Camera::UpdateFrustumPlanes()
+{
+	const XMFLOAT4X4& M = mViewProj;
+
+	// Gribb/Hartmann extraction from the columns of View * Proj (row vectors, [0,1] depth).
+	XMVECTOR c0 = XMVectorSet(M(0, 0), M(1, 0), M(2, 0), M(3, 0));
+	XMVECTOR c1 = XMVectorSet(M(0, 1), M(1, 1), M(2, 1), M(3, 1));
+	XMVECTOR c2 = XMVectorSet(M(0, 2), M(1, 2), M(2, 2), M(3, 2));
+	XMVECTOR c3 = XMVectorSet(M(0, 3), M(1, 3), M(2, 3), M(3, 3));
+
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(c3, c0),		// left
+		XMVectorSubtract(c3, c0),	// right
+		XMVectorAdd(c3, c1),		// bottom
+		XMVectorSubtract(c3, c1),	// top
+		c2,							// near
+		XMVectorSubtract(c3, c2)	// far
+	};
+
+	for (int i = 0; i < 6; ++i)
+		XMStoreFloat4(&mFrustumPlanes[i], XMPlaneNormalize(planes[i]));
+}
+
 
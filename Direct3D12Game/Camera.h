@@ -11,7 +11,68 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include "pch.h"
+#include <DirectXMath.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Identity matrix for member initializers.
+inline DirectX::XMFLOAT4X4 Identity4x4()
+{
+	return DirectX::XMFLOAT4X4(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+// Double precision world space position, used for the large world coordinate mode.
+struct WorldPosition
+{
+	double x = 0.0;
+	double y = 0.0;
+	double z = 0.0;
+
+	WorldPosition() = default;
+	WorldPosition(double x_, double y_, double z_) : x(x_), y(y_), z(z_) {}
+};
+
+// Immutable copy of the camera state at one point in time. Snapshots are plain values,
+// so they can be handed to a render thread through a DX::TripleBuffer without locks.
+struct CameraSnapshot
+{
+	DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 Right = { 1.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 Up = { 0.0f, 1.0f, 0.0f };
+	DirectX::XMFLOAT3 Look = { 0.0f, 0.0f, 1.0f };
+
+	DirectX::XMFLOAT4X4 View = Identity4x4();
+	DirectX::XMFLOAT4X4 Proj = Identity4x4();
+	DirectX::XMFLOAT4X4 ViewProj = Identity4x4();
+	DirectX::XMFLOAT4X4 InvViewProj = Identity4x4();
+	DirectX::XMFLOAT4 FrustumPlanes[6] = {};
+
+	// Temporal anti-aliasing state, see Camera::AdvanceTemporalFrame.
+	DirectX::XMFLOAT4X4 JitteredProj = Identity4x4();
+	DirectX::XMFLOAT4X4 PrevViewProj = Identity4x4();
+	DirectX::XMFLOAT2 Jitter = { 0.0f, 0.0f };
+
+	// Camera::GetVersion() at the time the snapshot was taken.
+	uint64_t Version = 0;
+
+	// World origin that Position, the matrices and the planes are relative to.
+	WorldPosition Origin;
+
+	// Same as Camera::ToCameraRelative/GetCameraRelativeWorld.
+	DirectX::XMFLOAT3 ToCameraRelative(const WorldPosition& p)const;
+	DirectX::XMMATRIX XM_CALLCONV GetCameraRelativeWorld(DirectX::FXMMATRIX rotationScale, const WorldPosition& p)const;
+
+	// Same as Camera::CullSpheres/CullAABBs, using the captured frustum planes.
+	size_t CullSpheres(const float* centerX, const float* centerY, const float* centerZ,
+		const float* radius, size_t count, uint32_t* visibleMask)const;
+	size_t CullAABBs(const float* centerX, const float* centerY, const float* centerZ,
+		const float* extentX, const float* extentY, const float* extentZ,
+		size_t count, uint32_t* visibleMask)const;
+};
 
 class Camera
 {
@@ -34,6 +95,10 @@ public:
 	DirectX::XMVECTOR GetLook()const;
 	DirectX::XMFLOAT3 GetLook3f()const;
 
+	// Get/Set the camera orientation as a quaternion (rotation from view to world space).
+	DirectX::XMVECTOR GetOrientation()const;
+	void SetOrientation(DirectX::FXMVECTOR q);
+
 	// Get frustum properties.
 	float GetNearZ()const;
 	float GetFarZ()const;
@@ -61,6 +126,63 @@ public:
 	DirectX::XMFLOAT4X4 GetView4x4f()const;
 	DirectX::XMFLOAT4X4 GetProj4x4f()const;
 
+	// Get cached View * Proj and inverse matrices.
+	DirectX::XMMATRIX GetViewProj()const;
+	DirectX::XMMATRIX GetInvView()const;
+	DirectX::XMMATRIX GetInvViewProj()const;
+
+	// Incremented every time the view or projection matrix changes, so consumers
+	// can skip work (e.g. constant buffer updates) while the camera is unchanged.
+	uint64_t GetVersion()const;
+
+	// Temporal anti-aliasing.
+	// Call once per rendered frame after UpdateViewMatrix: remembers the View * Proj of the
+	// last frame and picks the next Halton(2, 3) sub-pixel jitter for a width x height
+	// target. The jitter only affects GetJitteredProj; culling, GetViewProj and the
+	// version counter keep using the unjittered projection.
+	void AdvanceTemporalFrame(uint32_t width, uint32_t height, uint32_t sampleCount = 8);
+	DirectX::XMFLOAT2 GetJitter()const;
+	DirectX::XMMATRIX GetJitteredProj()const;
+
+	// View * Proj of the previous frame, relative to the current world origin so it can
+	// reproject current camera relative positions even after the origin moved.
+	DirectX::XMMATRIX GetPrevViewProj()const;
+
+	// Capture the current camera state for use on another thread.
+	CameraSnapshot GetSnapshot()const;
+
+	// Large world coordinates.
+	// The camera keeps a double precision world origin and everything else (position,
+	// view matrix, frustum planes) is relative to it. When enabled, UpdateViewMatrix
+	// moves the origin to the camera position, so the view is always rendered from a
+	// float space centered on the camera and precision does not degrade with distance.
+	void SetLargeWorldCoordinates(bool enable);
+	bool GetLargeWorldCoordinates()const;
+	WorldPosition GetWorldOrigin()const;
+	WorldPosition GetWorldPosition()const;
+	void SetWorldPosition(const WorldPosition& p);
+
+	// Convert a world position into the float space the view matrix is relative to.
+	// The subtraction is done in double precision before rounding to float.
+	DirectX::XMFLOAT3 ToCameraRelative(const WorldPosition& p)const;
+
+	// Build a world matrix for an object at p with the given rotation/scale,
+	// translated into camera relative space.
+	DirectX::XMMATRIX XM_CALLCONV GetCameraRelativeWorld(DirectX::FXMMATRIX rotationScale, const WorldPosition& p)const;
+
+	// Get the six world space frustum planes (left, right, bottom, top, near, far).
+	// Planes are normalized and their normals point into the frustum.
+	void GetFrustumPlanes(DirectX::XMFLOAT4 planes[6])const;
+
+	// Test SoA arrays of bounding volumes against the view frustum. Bit (i % 32) of
+	// visibleMask[i / 32] is set if volume i is at least partially inside, so the mask
+	// must hold (count + 31) / 32 words. Returns the number of visible volumes.
+	size_t CullSpheres(const float* centerX, const float* centerY, const float* centerZ,
+		const float* radius, size_t count, uint32_t* visibleMask)const;
+	size_t CullAABBs(const float* centerX, const float* centerY, const float* centerZ,
+		const float* extentX, const float* extentY, const float* extentZ,
+		size_t count, uint32_t* visibleMask)const;
+
 	// Strafe/Walk the camera a distance d.
 	void Strafe(float d);
 	void Walk(float d);
@@ -74,6 +196,10 @@ public:
 
 private:
 
+	// Rebuild the matrices and frustum planes derived from mView/mProj and bump mVersion.
+	void UpdateDerivedMatrices();
+	void UpdateFrustumPlanes();
+
 	// Camera coordinate system with coordinates relative to world space.
 	DirectX::XMFLOAT3 mPosition = { 0.0f, 0.0f, 0.0f };
 	DirectX::XMFLOAT3 mRight = { 1.0f, 0.0f, 0.0f };
@@ -90,8 +216,31 @@ private:
 
 	bool mViewDirty = true;
 	// Cache View/Proj matrices.
-	DirectX::XMFLOAT4X4 mView = DirectX::SimpleMath::Matrix::Identity;
-	DirectX::XMFLOAT4X4 mProj = DirectX::SimpleMath::Matrix::Identity;
+	DirectX::XMFLOAT4X4 mView = Identity4x4();
+	DirectX::XMFLOAT4X4 mProj = Identity4x4();
+
+	// Cache matrices derived from View/Proj.
+	DirectX::XMFLOAT4X4 mViewProj = Identity4x4();
+	DirectX::XMFLOAT4X4 mInvView = Identity4x4();
+	DirectX::XMFLOAT4X4 mInvViewProj = Identity4x4();
+	uint64_t mVersion = 0;
+
+	// Temporal anti-aliasing state.
+	uint64_t mTemporalFrame = 0;
+	DirectX::XMFLOAT2 mJitter = { 0.0f, 0.0f };
+	uint32_t mJitterWidth = 0;
+	uint32_t mJitterHeight = 0;
+	DirectX::XMFLOAT4X4 mPrevViewProj = Identity4x4();
+	WorldPosition mPrevOrigin;
+	DirectX::XMFLOAT4X4 mFrameViewProj = Identity4x4();
+	WorldPosition mFrameOrigin;
+
+	// Large world coordinate state.
+	bool mLargeWorld = false;
+	WorldPosition mOrigin;
+
+	// Cache frustum planes extracted from View * Proj.
+	DirectX::XMFLOAT4 mFrustumPlanes[6];
 };
 
 #endif // CAMERA_H
\ No newline at end of file
@@ -0,0 +1,257 @@
+//
+// CameraPath.cpp
+//
+
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace DirectX;
+
+namespace
+{
+	// File layout: header followed by KeyCount packed keys of
+	// uint64 ticks, 3 x double position, 4 x float orientation (48 bytes).
+	const char c_pathMagic[4] = { 'C', 'P', 'T', 'H' };
+	const uint32_t c_pathVersion = 1;
+	const uint64_t c_pathKeySize = sizeof(uint64_t) + 3 * sizeof(double) + 4 * sizeof(float);
+
+	template<typename T>
+	void WriteValue(std::ostream& out, const T& value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	bool ReadValue(std::istream& in, T& value)
+	{
+		return !!in.read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+
+	inline double CatmullRom(double p0, double p1, double p2, double p3, double t)
+	{
+		double t2 = t * t;
+		double t3 = t2 * t;
+		return 0.5 * ((2.0 * p1) +
+			(p2 - p0) * t +
+			(2.0 * p0 - 5.0 * p1 + 4.0 * p2 - p3) * t2 +
+			(3.0 * p1 - p0 - 3.0 * p2 + p3) * t3);
+	}
+}
+
+void CameraPath::Clear()
+{
+	mKeys.clear();
+}
+
+void CameraPath::AddKey(uint64_t ticks, const Camera& camera)
+{
+	if (!mKeys.empty() && ticks <= mKeys.back().Ticks)
+		return;
+
+	CameraPathKey key;
+	key.Ticks = ticks;
+	key.Position = camera.GetWorldPosition();
+	XMStoreFloat4(&key.Orientation, camera.GetOrientation());
+	mKeys.push_back(key);
+}
+
+size_t CameraPath::GetKeyCount()const
+{
+	return mKeys.size();
+}
+
+const CameraPathKey& CameraPath::GetKey(size_t i)const
+{
+	return mKeys[i];
+}
+
+size_t CameraPath::GetSegmentCount()const
+{
+	return mKeys.size() > 1 ? mKeys.size() - 1 : 0;
+}
+
+uint64_t CameraPath::GetDuration()const
+{
+	return mKeys.size() > 1 ? mKeys.back().Ticks - mKeys.front().Ticks : 0;
+}
+
+bool CameraPath::Save(const std::string& fileName)const
+{
+	std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+
+	return Save(out);
+}
+
+bool CameraPath::Save(std::ostream& out)const
+{
+	out.write(c_pathMagic, sizeof(c_pathMagic));
+	WriteValue(out, c_pathVersion);
+	WriteValue(out, static_cast<uint32_t>(mKeys.size()));
+	WriteValue(out, uint32_t(0));
+
+	for (const CameraPathKey& key : mKeys)
+	{
+		WriteValue(out, key.Ticks);
+		WriteValue(out, key.Position.x);
+		WriteValue(out, key.Position.y);
+		WriteValue(out, key.Position.z);
+		WriteValue(out, key.Orientation.x);
+		WriteValue(out, key.Orientation.y);
+		WriteValue(out, key.Orientation.z);
+		WriteValue(out, key.Orientation.w);
+	}
+
+	return !!out;
+}
+
+bool CameraPath::Load(const std::string& fileName)
+{
+	std::ifstream in(fileName, std::ios::binary);
+	if (!in)
+		return false;
+
+	return Load(in);
+}
+
+bool CameraPath::Load(std::istream& in)
+{
+	char magic[4];
+	uint32_t version = 0;
+	uint32_t keyCount = 0;
+	uint32_t reserved = 0;
+	if (!in.read(magic, sizeof(magic)) ||
+		memcmp(magic, c_pathMagic, sizeof(magic)) != 0 ||
+		!ReadValue(in, version) || version != c_pathVersion ||
+		!ReadValue(in, keyCount) ||
+		!ReadValue(in, reserved))
+	{
+		return false;
+	}
+
+	// Check the key count against what is left of the stream before allocating for it.
+	std::istream::pos_type start = in.tellg();
+	if (start == std::istream::pos_type(-1) || !in.seekg(0, std::ios::end))
+		return false;
+	uint64_t remaining = uint64_t(in.tellg() - start);
+	if (!in.seekg(start) || uint64_t(keyCount) * c_pathKeySize > remaining)
+		return false;
+
+	std::vector<CameraPathKey> keys(keyCount);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		CameraPathKey& key = keys[i];
+		if (!ReadValue(in, key.Ticks) ||
+			!ReadValue(in, key.Position.x) ||
+			!ReadValue(in, key.Position.y) ||
+			!ReadValue(in, key.Position.z) ||
+			!ReadValue(in, key.Orientation.x) ||
+			!ReadValue(in, key.Orientation.y) ||
+			!ReadValue(in, key.Orientation.z) ||
+			!ReadValue(in, key.Orientation.w))
+		{
+			return false;
+		}
+
+		// Evaluate divides by the time between neighboring keys.
+		if (i > 0 && key.Ticks <= keys[i - 1].Ticks)
+			return false;
+	}
+
+	mKeys.swap(keys);
+	return true;
+}
+
+size_t CameraPath::Evaluate(uint64_t ticks, WorldPosition& position, XMFLOAT4& orientation)const
+{
+	assert(!mKeys.empty());
+
+	if (mKeys.size() == 1)
+	{
+		position = mKeys[0].Position;
+		orientation = mKeys[0].Orientation;
+		return 0;
+	}
+
+	uint64_t time = mKeys.front().Ticks + std::min(ticks, GetDuration());
+
+	// Find the segment [i, i + 1] containing time.
+	auto it = std::upper_bound(mKeys.begin(), mKeys.end(), time,
+		[](uint64_t t, const CameraPathKey& key) { return t < key.Ticks; });
+	size_t i = std::min(size_t(it - mKeys.begin()), mKeys.size() - 1);
+	i = i > 0 ? i - 1 : 0;
+
+	const CameraPathKey& k0 = mKeys[i > 0 ? i - 1 : i];
+	const CameraPathKey& k1 = mKeys[i];
+	const CameraPathKey& k2 = mKeys[i + 1];
+	const CameraPathKey& k3 = mKeys[std::min(i + 2, mKeys.size() - 1)];
+
+	double t = double(time - k1.Ticks) / double(k2.Ticks - k1.Ticks);
+
+	position.x = CatmullRom(k0.Position.x, k1.Position.x, k2.Position.x, k3.Position.x, t);
+	position.y = CatmullRom(k0.Position.y, k1.Position.y, k2.Position.y, k3.Position.y, t);
+	position.z = CatmullRom(k0.Position.z, k1.Position.z, k2.Position.z, k3.Position.z, t);
+
+	XMVECTOR q = XMQuaternionSlerp(XMLoadFloat4(&k1.Orientation), XMLoadFloat4(&k2.Orientation), float(t));
+	XMStoreFloat4(&orientation, XMQuaternionNormalize(q));
+
+	return i;
+}
+
+size_t CameraPath::Apply(uint64_t ticks, Camera& camera)const
+{
+	WorldPosition position;
+	XMFLOAT4 orientation;
+	size_t segment = Evaluate(ticks, position, orientation);
+
+	camera.SetWorldPosition(position);
+	camera.SetOrientation(XMLoadFloat4(&orientation));
+	return segment;
+}
+
+void CameraPathStats::Reset(size_t segmentCount)
+{
+	mSegments.assign(segmentCount, Segment());
+}
+
+void CameraPathStats::AddFrame(size_t segment, double frameSeconds)
+{
+	if (segment >= mSegments.size())
+		return;
+
+	Segment& s = mSegments[segment];
+	if (s.Frames == 0)
+	{
+		s.Min = frameSeconds;
+		s.Max = frameSeconds;
+	}
+	else
+	{
+		s.Min = std::min(s.Min, frameSeconds);
+		s.Max = std::max(s.Max, frameSeconds);
+	}
+	s.Total += frameSeconds;
+	s.Frames++;
+}
+
+std::string CameraPathStats::Report()const
+{
+	std::ostringstream out;
+	out << "segment,frames,mean_ms,min_ms,max_ms\n";
+
+	for (size_t i = 0; i < mSegments.size(); ++i)
+	{
+		const Segment& s = mSegments[i];
+		double mean = s.Frames ? s.Total / s.Frames : 0.0;
+		out << i << ',' << s.Frames << ','
+			<< mean * 1000.0 << ',' << s.Min * 1000.0 << ',' << s.Max * 1000.0 << '\n';
+	}
+
+	return out.str();
+}
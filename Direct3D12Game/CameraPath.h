@@ -0,0 +1,84 @@
+//
+// CameraPath.h - Recorded camera flythroughs for repeatable performance runs
+//
+
+#pragma once
+
+#include "Camera.h"
+
+#include <DirectXMath.h>
+#include <istream>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// One recorded camera pose. Ticks use the DX::StepTimer canonical tick format.
+struct CameraPathKey
+{
+	uint64_t Ticks = 0;
+	WorldPosition Position;
+	DirectX::XMFLOAT4 Orientation = { 0.0f, 0.0f, 0.0f, 1.0f };
+};
+
+// A sequence of camera keys that can be saved to and loaded from a compact binary
+// file and evaluated at any time with Catmull-Rom position and slerp orientation
+// interpolation. Evaluation only depends on the requested time, so replaying a path
+// under a fixed timestep gives identical camera poses on every run.
+class CameraPath
+{
+public:
+	void Clear();
+
+	// Append the camera pose at the given timer ticks. Keys must be added in
+	// increasing time; keys that do not advance time are ignored.
+	void AddKey(uint64_t ticks, const Camera& camera);
+
+	size_t GetKeyCount()const;
+	const CameraPathKey& GetKey(size_t i)const;
+
+	// Number of segments between consecutive keys.
+	size_t GetSegmentCount()const;
+
+	// Length of the path in ticks.
+	uint64_t GetDuration()const;
+
+	// Binary file I/O. Return false if the file can't be opened or is not a valid path:
+	// a bad header, fewer bytes than the key count promises, or keys that do not
+	// strictly advance in time. The path is left unchanged when loading fails.
+	bool Save(const std::string& fileName)const;
+	bool Load(const std::string& fileName);
+	bool Save(std::ostream& out)const;
+	bool Load(std::istream& in);
+
+	// Interpolate the pose at the given ticks since the first key (clamped to the
+	// path). Returns the index of the segment the time falls in.
+	size_t Evaluate(uint64_t ticks, WorldPosition& position, DirectX::XMFLOAT4& orientation)const;
+
+	// Evaluate and place the camera; call Camera::UpdateViewMatrix afterwards.
+	size_t Apply(uint64_t ticks, Camera& camera)const;
+
+private:
+	std::vector<CameraPathKey> mKeys;
+};
+
+// Frame time statistics accumulated per path segment during playback.
+class CameraPathStats
+{
+public:
+	void Reset(size_t segmentCount);
+	void AddFrame(size_t segment, double frameSeconds);
+
+	// CSV with one line per segment: segment, frames, mean/min/max frame time in ms.
+	std::string Report()const;
+
+private:
+	struct Segment
+	{
+		uint32_t Frames = 0;
+		double Total = 0.0;
+		double Min = 0.0;
+		double Max = 0.0;
+	};
+	std::vector<Segment> mSegments;
+};
@@ -0,0 +1,157 @@
+//
+// CameraPathTests.cpp
+//
+
+#include "CameraPath.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+using namespace DirectX;
+
+namespace
+{
+	const uint64_t c_ticksPerSecond = 10000000;
+
+	// Fly a curve while turning, one key every quarter second.
+	CameraPath Record(size_t keyCount)
+	{
+		Camera camera;
+		camera.SetLens(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+		camera.SetLargeWorldCoordinates(true);
+		camera.SetWorldPosition(WorldPosition(1.0e9, 20.0, -3.0e8));
+
+		CameraPath path;
+		for (size_t i = 0; i < keyCount; ++i)
+		{
+			camera.UpdateViewMatrix();
+			path.AddKey(i * c_ticksPerSecond / 4, camera);
+			camera.Walk(5.0f);
+			camera.Strafe(2.0f * sinf(0.3f * i));
+			camera.RotateY(0.1f);
+			camera.Pitch(0.02f);
+		}
+		return path;
+	}
+
+	std::string Save(const CameraPath& path)
+	{
+		std::ostringstream out(std::ios::binary);
+		path.Save(out);
+		return out.str();
+	}
+
+	bool Load(CameraPath& path, const std::string& bytes)
+	{
+		std::istringstream in(bytes, std::ios::binary);
+		return path.Load(in);
+	}
+
+	bool SameKey(const CameraPathKey& a, const CameraPathKey& b)
+	{
+		return a.Ticks == b.Ticks &&
+			a.Position.x == b.Position.x && a.Position.y == b.Position.y && a.Position.z == b.Position.z &&
+			memcmp(&a.Orientation, &b.Orientation, sizeof(a.Orientation)) == 0;
+	}
+
+	// Header: magic, version, key count, reserved.
+	const size_t c_headerSize = 16;
+	const size_t c_keySize = 48;
+}
+
+SELF_TEST(CameraPath, RoundTripsThroughStream)
+{
+	CameraPath path = Record(9);
+	std::string bytes = Save(path);
+	SELF_CHECK(bytes.size() == c_headerSize + 9 * c_keySize);
+
+	CameraPath loaded;
+	SELF_CHECK(Load(loaded, bytes));
+	SELF_CHECK(loaded.GetKeyCount() == path.GetKeyCount());
+	for (size_t i = 0; i < path.GetKeyCount(); ++i)
+		SELF_CHECK(SameKey(loaded.GetKey(i), path.GetKey(i)));
+	SELF_CHECK(loaded.GetDuration() == 2 * c_ticksPerSecond);
+}
+
+SELF_TEST(CameraPath, RejectsInvalidFiles)
+{
+	const std::string bytes = Save(Record(5));
+	CameraPath path = Record(3);
+
+	// A key count far beyond the data, which must fail before allocating for it.
+	std::string huge = bytes;
+	const uint32_t hugeCount = 0xffffffffu;
+	memcpy(&huge[8], &hugeCount, sizeof(hugeCount));
+	SELF_CHECK(!Load(path, huge));
+
+	// One byte short of the last key.
+	SELF_CHECK(!Load(path, bytes.substr(0, bytes.size() - 1)));
+
+	// Keys that repeat or go back in time.
+	for (size_t source : { 1, 0 })
+	{
+		std::string unordered = bytes;
+		memcpy(&unordered[c_headerSize + 2 * c_keySize], &bytes[c_headerSize + source * c_keySize], sizeof(uint64_t));
+		SELF_CHECK(!Load(path, unordered));
+	}
+
+	std::string badMagic = bytes;
+	badMagic[0] = 'X';
+	SELF_CHECK(!Load(path, badMagic));
+
+	// Failed loads leave the path alone.
+	SELF_CHECK(path.GetKeyCount() == 3);
+	SELF_CHECK(Load(path, bytes));
+	SELF_CHECK(path.GetKeyCount() == 5);
+}
+
+SELF_TEST(CameraPath, PlaybackHitsKeysAndRepeats)
+{
+	CameraPath path = Record(9);
+
+	// Every key is reached exactly at its time, in the segment that starts with it.
+	for (size_t i = 0; i < path.GetKeyCount(); ++i)
+	{
+		const CameraPathKey& key = path.GetKey(i);
+		WorldPosition position;
+		XMFLOAT4 orientation;
+		size_t segment = path.Evaluate(key.Ticks - path.GetKey(0).Ticks, position, orientation);
+
+		SELF_CHECK(segment == std::min(i, path.GetSegmentCount() - 1));
+		SELF_CHECK(fabs(position.x - key.Position.x) < 1e-4 && fabs(position.y - key.Position.y) < 1e-4 &&
+			fabs(position.z - key.Position.z) < 1e-4);
+		float dot = fabsf(XMVectorGetX(XMVector4Dot(XMLoadFloat4(&orientation), XMLoadFloat4(&key.Orientation))));
+		SELF_CHECK(dot > 0.99999f);
+	}
+
+	// Replaying at a fixed 60 Hz step twice gives identical views, and time past the
+	// end stays on the last key.
+	Camera first;
+	Camera second;
+	first.SetLargeWorldCoordinates(true);
+	second.SetLargeWorldCoordinates(true);
+	bool identical = true;
+	size_t lastSegment = 0;
+	for (uint64_t ticks = 0; ticks <= path.GetDuration() + c_ticksPerSecond; ticks += c_ticksPerSecond / 60)
+	{
+		lastSegment = path.Apply(ticks, first);
+		path.Apply(ticks, second);
+		first.UpdateViewMatrix();
+		second.UpdateViewMatrix();
+
+		XMFLOAT4X4 a = first.GetView4x4f();
+		XMFLOAT4X4 b = second.GetView4x4f();
+		WorldPosition pa = first.GetWorldPosition();
+		WorldPosition pb = second.GetWorldPosition();
+		identical = identical && memcmp(&a, &b, sizeof(a)) == 0 && pa.x == pb.x && pa.y == pb.y && pa.z == pb.z;
+	}
+	SELF_CHECK(identical);
+	SELF_CHECK(lastSegment == path.GetSegmentCount() - 1);
+
+	const CameraPathKey& last = path.GetKey(path.GetKeyCount() - 1);
+	WorldPosition end = first.GetWorldPosition();
+	SELF_CHECK(fabs(end.x - last.Position.x) < 1e-4 && fabs(end.z - last.Position.z) < 1e-4);
+}
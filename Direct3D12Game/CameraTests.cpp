@@ -0,0 +1,357 @@
+//
+// CameraTests.cpp
+//
+
+#include "Camera.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Bounding volumes as the culling functions take them, one array per component.
+	struct Volumes
+	{
+		std::vector<float> X, Y, Z;
+		std::vector<float> ExtentX, ExtentY, ExtentZ;	// radius in ExtentX for spheres
+
+		explicit Volumes(size_t count, uint32_t seed = 1)
+		{
+			std::mt19937 random(seed);
+			std::uniform_real_distribution<float> position(-600.0f, 600.0f);
+			std::uniform_real_distribution<float> extent(0.5f, 20.0f);
+			for (size_t i = 0; i < count; ++i)
+			{
+				X.push_back(position(random));
+				Y.push_back(position(random));
+				Z.push_back(position(random));
+				ExtentX.push_back(extent(random));
+				ExtentY.push_back(extent(random));
+				ExtentZ.push_back(extent(random));
+			}
+		}
+
+		size_t GetCount()const { return X.size(); }
+	};
+
+	Camera MakeCamera()
+	{
+		Camera camera;
+		camera.SetLens(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+		camera.LookAt(XMFLOAT3(10.0f, 20.0f, -30.0f), XMFLOAT3(40.0f, 0.0f, 100.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+		camera.UpdateViewMatrix();
+		return camera;
+	}
+
+	// Per volume, plane by plane, in double precision. Returns -1 for volumes within
+	// tolerance of a plane, which the float kernels may decide either way.
+	int ReferenceVisible(const XMFLOAT4 planes[6], const Volumes& volumes, size_t i, bool box)
+	{
+		const double tolerance = 1e-3;
+		bool inside = true;
+		bool borderline = false;
+		for (int p = 0; p < 6; ++p)
+		{
+			const XMFLOAT4& plane = planes[p];
+			double dist = double(plane.x) * volumes.X[i] + double(plane.y) * volumes.Y[i] +
+				double(plane.z) * volumes.Z[i] + plane.w;
+			double r = box ?
+				fabs(plane.x) * volumes.ExtentX[i] + fabs(plane.y) * volumes.ExtentY[i] + fabs(plane.z) * volumes.ExtentZ[i] :
+				volumes.ExtentX[i];
+			inside = inside && dist >= -r;
+			borderline = borderline || fabs(dist + r) < tolerance * std::max(1.0, r);
+		}
+		return borderline ? -1 : inside ? 1 : 0;
+	}
+
+	size_t Cull(const Camera& camera, const Volumes& volumes, size_t count, bool box, uint32_t* mask)
+	{
+		if (box)
+		{
+			return camera.CullAABBs(volumes.X.data(), volumes.Y.data(), volumes.Z.data(),
+				volumes.ExtentX.data(), volumes.ExtentY.data(), volumes.ExtentZ.data(), count, mask);
+		}
+		return camera.CullSpheres(volumes.X.data(), volumes.Y.data(), volumes.Z.data(),
+			volumes.ExtentX.data(), count, mask);
+	}
+
+	void CheckAgainstReference(SelfTest::Context& context, bool box)
+	{
+		Camera camera = MakeCamera();
+		XMFLOAT4 planes[6];
+		camera.GetFrustumPlanes(planes);
+
+		// Counts that leave a tail after the 8 and 4 wide loops, and one mask word exactly.
+		for (size_t count : { size_t(1), size_t(7), size_t(32), size_t(37), size_t(4099) })
+		{
+			Volumes volumes(count, uint32_t(count));
+			std::vector<uint32_t> mask((count + 31) / 32 + 1, 0xdeadbeef);
+			size_t visible = Cull(camera, volumes, count, box, mask.data());
+
+			size_t set = 0;
+			uint32_t mismatches = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				bool bit = (mask[i / 32] >> (i % 32)) & 1;
+				set += bit ? 1 : 0;
+				int expected = ReferenceVisible(planes, volumes, i, box);
+				if (expected >= 0 && bit != (expected == 1))
+					mismatches++;
+			}
+			SELF_CHECK(mismatches == 0);
+			SELF_CHECK(visible == set);
+			// Bits past the count are clear, words past the mask untouched.
+			SELF_CHECK(count % 32 == 0 || (mask[count / 32] >> (count % 32)) == 0);
+			SELF_CHECK(mask.back() == 0xdeadbeef);
+		}
+	}
+}
+
+SELF_TEST(Camera, CullSpheresMatchesReference)
+{
+	CheckAgainstReference(context, false);
+}
+
+SELF_TEST(Camera, CullAABBsMatchesReference)
+{
+	CheckAgainstReference(context, true);
+}
+
+SELF_TEST(Camera, SnapshotCullsLikeCamera)
+{
+	Camera camera = MakeCamera();
+	CameraSnapshot snapshot = camera.GetSnapshot();
+	Volumes volumes(1000);
+	std::vector<uint32_t> cameraMask(32), snapshotMask(32);
+
+	size_t visible = Cull(camera, volumes, volumes.GetCount(), true, cameraMask.data());
+	size_t snapshotVisible = snapshot.CullAABBs(volumes.X.data(), volumes.Y.data(), volumes.Z.data(),
+		volumes.ExtentX.data(), volumes.ExtentY.data(), volumes.ExtentZ.data(), volumes.GetCount(), snapshotMask.data());
+	SELF_CHECK(visible == snapshotVisible);
+	SELF_CHECK(cameraMask == snapshotMask);
+	SELF_CHECK(visible > 0 && visible < volumes.GetCount());
+}
+
+SELF_BENCHMARK(Camera, Culling)
+{
+	const size_t count = 100000;
+	const int rounds = 200;
+	Camera camera = MakeCamera();
+	XMFLOAT4 planes[6];
+	camera.GetFrustumPlanes(planes);
+	Volumes volumes(count);
+	std::vector<uint32_t> mask((count + 31) / 32);
+
+	for (bool box : { false, true })
+	{
+		// Baseline: one volume at a time, leaving at the first plane it is behind.
+		size_t scalarVisible = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < rounds; ++round)
+		{
+			scalarVisible = 0;
+			for (size_t i = 0; i < count; ++i)
+			{
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; ++p)
+				{
+					const XMFLOAT4& plane = planes[p];
+					float dist = plane.x * volumes.X[i] + plane.y * volumes.Y[i] + plane.z * volumes.Z[i] + plane.w;
+					float r = box ?
+						fabsf(plane.x) * volumes.ExtentX[i] + fabsf(plane.y) * volumes.ExtentY[i] + fabsf(plane.z) * volumes.ExtentZ[i] :
+						volumes.ExtentX[i];
+					inside = dist >= -r;
+				}
+				scalarVisible += inside ? 1 : 0;
+			}
+		}
+		double scalarNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		size_t visible = 0;
+		start = std::chrono::steady_clock::now();
+		for (int round = 0; round < rounds; ++round)
+			visible = Cull(camera, volumes, count, box, mask.data());
+		double batchNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+		double perVolume = batchNs / (double(count) * rounds);
+		double scalarPerVolume = scalarNs / (double(count) * rounds);
+		context.Log("%-7s %zu of %zu visible: %.2f ns/volume batched, %.2f ns/volume scalar (%.1fx)",
+			box ? "AABBs" : "spheres", visible, count, perVolume, scalarPerVolume, scalarPerVolume / perVolume);
+		SELF_CHECK(visible + count / 1000 >= scalarVisible && scalarVisible + count / 1000 >= visible);
+	}
+}
+
+namespace
+{
+	bool NearlyEqual(const XMFLOAT4X4& a, const XMFLOAT4X4& b, float tolerance)
+	{
+		for (int r = 0; r < 4; ++r)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				if (fabsf(a(r, c) - b(r, c)) > tolerance * std::max(1.0f, fabsf(b(r, c))))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	XMFLOAT4X4 ToFloat4x4(FXMMATRIX M)
+	{
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, M);
+		return m;
+	}
+}
+
+SELF_TEST(Camera, VersionTracksChanges)
+{
+	Camera camera = MakeCamera();
+	uint64_t version = camera.GetVersion();
+
+	camera.UpdateViewMatrix();
+	SELF_CHECK(camera.GetVersion() == version);
+
+	camera.Walk(1.0f);
+	SELF_CHECK(camera.GetVersion() == version);
+	camera.UpdateViewMatrix();
+	SELF_CHECK(camera.GetVersion() > version);
+	version = camera.GetVersion();
+
+	camera.SetLens(0.3f * XM_PI, 1.0f, 0.5f, 500.0f);
+	SELF_CHECK(camera.GetVersion() > version);
+}
+
+SELF_TEST(Camera, CachedMatricesMatchView)
+{
+	Camera camera = MakeCamera();
+	camera.Pitch(0.3f);
+	camera.RotateY(-1.1f);
+	camera.Strafe(7.0f);
+	camera.UpdateViewMatrix();
+
+	XMMATRIX V = camera.GetView();
+	XMMATRIX P = camera.GetProj();
+	XMMATRIX viewProj = XMMatrixMultiply(V, P);
+	SELF_CHECK(NearlyEqual(ToFloat4x4(camera.GetViewProj()), ToFloat4x4(viewProj), 1e-5f));
+	SELF_CHECK(NearlyEqual(ToFloat4x4(camera.GetInvView()), ToFloat4x4(XMMatrixInverse(nullptr, V)), 1e-4f));
+	SELF_CHECK(NearlyEqual(ToFloat4x4(XMMatrixMultiply(camera.GetInvViewProj(), viewProj)), Identity4x4(), 1e-4f));
+}
+
+SELF_BENCHMARK(Camera, MatrixCache)
+{
+	// Per frame two effects take View and Proj, and the frame needs ViewProj, InvView and
+	// InvViewProj. Without the cache every consumer derives them and uploads every frame;
+	// with it the camera derives them (and the frustum planes) once per change and the
+	// consumers upload only when the version moved.
+	const int frames = 200000;
+	struct Upload
+	{
+		XMFLOAT4X4 View, Proj, ViewProj, InvViewProj;
+	};
+	Upload uploads[2];
+	uint64_t uploaded = 0;
+
+	for (bool moving : { false, true })
+	{
+		Camera camera = MakeCamera();
+		auto start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			if (moving)
+				camera.Walk(0.01f);
+			camera.UpdateViewMatrix();
+			for (Upload& upload : uploads)
+			{
+				XMMATRIX V = camera.GetView();
+				XMMATRIX P = camera.GetProj();
+				XMMATRIX viewProj = XMMatrixMultiply(V, P);
+				XMMATRIX invView = XMMatrixInverse(nullptr, V);
+				XMStoreFloat4x4(&upload.View, V);
+				XMStoreFloat4x4(&upload.Proj, P);
+				XMStoreFloat4x4(&upload.ViewProj, viewProj);
+				XMStoreFloat4x4(&upload.InvViewProj, XMMatrixMultiply(XMMatrixInverse(nullptr, P), invView));
+				uploaded++;
+			}
+		}
+		double uncachedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames;
+
+		camera = MakeCamera();
+		uint64_t version = 0;
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			if (moving)
+				camera.Walk(0.01f);
+			camera.UpdateViewMatrix();
+			if (camera.GetVersion() == version)
+				continue;
+			for (Upload& upload : uploads)
+			{
+				XMStoreFloat4x4(&upload.View, camera.GetView());
+				XMStoreFloat4x4(&upload.Proj, camera.GetProj());
+				XMStoreFloat4x4(&upload.ViewProj, camera.GetViewProj());
+				XMStoreFloat4x4(&upload.InvViewProj, camera.GetInvViewProj());
+				uploaded++;
+			}
+			version = camera.GetVersion();
+		}
+		double cachedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames;
+
+		context.Log("%-13s %7.1f ns/frame uncached, %7.1f ns/frame cached (%.1fx)",
+			moving ? "moving camera" : "static camera", uncachedNs, cachedNs, uncachedNs / cachedNs);
+	}
+	SELF_CHECK(uploaded > 0);
+}
+
+SELF_TEST(Camera, FarOrbitJitter)
+{
+	// A camera follows a body on a 1.5e11 m orbit (the earth's around the sun) at a fixed
+	// offset; the body and a point on its surface must stay put in camera relative space,
+	// and the view must have no translation left.
+	const double orbitRadius = 1.5e11;
+	const WorldPosition offset(0.0, 2.0, -10.0);
+	const WorldPosition surface(0.37, 1.13, 0.5);
+	const int steps = 10000;
+
+	Camera camera = MakeCamera();
+	camera.SetLargeWorldCoordinates(true);
+	camera.LookAt(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, -0.2f, 1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+
+	double worstError = 0.0;
+	double worstFloatError = 0.0;
+	for (int step = 0; step < steps; ++step)
+	{
+		double angle = 2.0 * 3.14159265358979323846 * step / steps;
+		WorldPosition body(orbitRadius * cos(angle), 1.0e3 * sin(3.0 * angle), orbitRadius * sin(angle));
+		WorldPosition eye(body.x + offset.x, body.y + offset.y, body.z + offset.z);
+		camera.SetWorldPosition(eye);
+		camera.UpdateViewMatrix();
+
+		XMFLOAT3 center = camera.ToCameraRelative(body);
+		XMFLOAT3 point = camera.ToCameraRelative(WorldPosition(body.x + surface.x, body.y + surface.y, body.z + surface.z));
+		XMFLOAT4X4 world = ToFloat4x4(camera.GetCameraRelativeWorld(XMMatrixIdentity(), body));
+		XMFLOAT4X4 view = camera.GetView4x4f();
+		double error = std::max({
+			fabs(view(3, 0)), fabs(view(3, 1)), fabs(view(3, 2)),
+			fabs(center.x + offset.x), fabs(center.y + offset.y), fabs(center.z + offset.z),
+			fabs(point.x - (surface.x - offset.x)), fabs(point.y - (surface.y - offset.y)), fabs(point.z - (surface.z - offset.z)),
+			fabs(world(3, 0) - center.x), fabs(world(3, 1) - center.y), fabs(world(3, 2) - center.z) });
+		worstError = std::max(worstError, error);
+
+		// The same in single precision world space, for comparison.
+		double floatX = double(float(body.x + surface.x)) - double(float(eye.x));
+		worstFloatError = std::max(worstFloatError, fabs(floatX - (surface.x - offset.x)));
+	}
+
+	context.Log("worst camera relative error %.3g m, %.3g m with float world positions", worstError, worstFloatError);
+	SELF_CHECK(worstError < 1e-3);
+	// Otherwise the orbit would not be far enough out to need the large world mode.
+	SELF_CHECK(worstFloatError > 1.0);
+}
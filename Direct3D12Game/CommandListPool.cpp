@@ -0,0 +1,145 @@
+//
+// CommandListPool.cpp
+//
+
+#include "CommandListPool.h"
+
+#include <algorithm>
+#include <cassert>
+
+CommandListPool::CommandListPool(ICommandDevice& device, uint32_t framesInFlight, uint32_t threadCount) :
+	mDevice(device),
+	mRing(device, framesInFlight),
+	mFrames(framesInFlight),
+	mFrameIndex(framesInFlight - 1),
+	mRecording(false)
+{
+	assert(framesInFlight > 0 && threadCount > 0);
+
+	for (auto& frame : mFrames)
+		frame.Threads.resize(threadCount);
+}
+
+CommandListPool::~CommandListPool()
+{
+	// Lists and allocators may only go away once the GPU is done with them.
+	try
+	{
+		mRing.WaitForIdle();
+	}
+	catch (...)
+	{
+		// A lost device does not run anything anymore.
+	}
+}
+
+void CommandListPool::BeginFrame()
+{
+	assert(!mRecording);
+
+	mFrameIndex = mRing.BeginFrame();
+	Frame& frame = mFrames[mFrameIndex];
+
+	for (auto& thread : frame.Threads)
+	{
+		if (thread.Allocator)
+			thread.Allocator->Reset();
+		thread.UsedLists = 0;
+		thread.Open = nullptr;
+	}
+
+	mPasses.clear();
+	mRecording = true;
+}
+
+ICommandList& CommandListPool::BeginPass(uint32_t pass, uint32_t thread)
+{
+	assert(mRecording);
+
+	ThreadFrame& threadFrame = mFrames[mFrameIndex].Threads[thread];
+	if (threadFrame.Open)
+	{
+		threadFrame.Open->Close();
+		threadFrame.Open = nullptr;
+	}
+
+	if (!threadFrame.Allocator)
+		threadFrame.Allocator = mDevice.CreateAllocator();
+	if (threadFrame.UsedLists == threadFrame.Lists.size())
+		threadFrame.Lists.push_back(mDevice.CreateList(*threadFrame.Allocator));
+
+	ICommandList* list = threadFrame.Lists[threadFrame.UsedLists++].get();
+	list->Reset(*threadFrame.Allocator);
+	threadFrame.Open = list;
+
+	std::lock_guard<std::mutex> lock(mPassMutex);
+	mPasses.push_back({ pass, thread, list });
+	return *list;
+}
+
+void CommandListPool::Submit()
+{
+	assert(mRecording);
+
+	Frame& frame = mFrames[mFrameIndex];
+	for (auto& thread : frame.Threads)
+	{
+		if (thread.Open)
+		{
+			thread.Open->Close();
+			thread.Open = nullptr;
+		}
+	}
+
+	// Sort by pass, breaking ties by thread so the order never depends on timing.
+	std::sort(mPasses.begin(), mPasses.end(), [](const Pass& a, const Pass& b)
+	{
+		return a.Order != b.Order ? a.Order < b.Order : a.Thread < b.Thread;
+	});
+
+	mSubmitLists.clear();
+	for (auto& pass : mPasses)
+		mSubmitLists.push_back(pass.List);
+
+	if (!mSubmitLists.empty())
+		mDevice.Execute(mSubmitLists.data(), mSubmitLists.size());
+	mRing.EndFrame();
+
+	mStats.ListsLastFrame = mSubmitLists.size();
+	mRecording = false;
+}
+
+void CommandListPool::WaitForIdle()
+{
+	mRing.WaitForIdle();
+}
+
+CommandListPool::Stats CommandListPool::GetStats()const
+{
+	Stats stats = mStats;
+	stats.FenceWaits = mRing.GetStats().FenceWaits;
+	for (auto& frame : mFrames)
+	{
+		for (auto& thread : frame.Threads)
+		{
+			stats.Allocators += thread.Allocator ? 1 : 0;
+			stats.Lists += thread.Lists.size();
+		}
+	}
+	return stats;
+}
+
+uint32_t CommandListPool::GetFramesInFlight()const
+{
+	return uint32_t(mFrames.size());
+}
+
+uint32_t CommandListPool::GetThreadCount()const
+{
+	return uint32_t(mFrames[0].Threads.size());
+}
+
+const FrameRing& CommandListPool::GetFrameRing()const
+{
+	return mRing;
+}
@@ -0,0 +1,127 @@
+//
+// CommandListPool.h - Per-thread command list and allocator pools for parallel recording
+//
+
+#pragma once
+
+#include "FrameRing.h"
+
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+// Minimal command recording interface the pool works through. The render backends in
+// RenderDevice.h extend it with the actual commands.
+class ICommandAllocator
+{
+public:
+	virtual ~ICommandAllocator() = default;
+
+	// Release the memory of every list recorded with this allocator. The GPU must be
+	// done executing them.
+	virtual void Reset() = 0;
+};
+
+class ICommandList
+{
+public:
+	virtual ~ICommandList() = default;
+
+	// Start recording into memory from the allocator.
+	virtual void Reset(ICommandAllocator& allocator) = 0;
+	virtual void Close() = 0;
+};
+
+// A queue to execute lists on, fenced through IGpuFence.
+class ICommandDevice : public IGpuFence
+{
+public:
+	virtual std::unique_ptr<ICommandAllocator> CreateAllocator() = 0;
+	// Lists are created closed.
+	virtual std::unique_ptr<ICommandList> CreateList(ICommandAllocator& allocator) = 0;
+
+	virtual void Execute(ICommandList* const* lists, size_t count) = 0;
+};
+
+// Hands out command lists to recording threads. Each frame in flight has one allocator
+// per thread plus a growing set of lists, so threads never share an allocator and a
+// frame's memory is only reset once the GPU passed the fence of the frame that last
+// used it. The frames are tracked by a FrameRing.
+//
+// Every list belongs to a pass; Submit executes all lists of the frame with one call,
+// sorted by pass, so the GPU sees the same order however the recording was scheduled.
+//
+// Per frame:
+//     BeginFrame();
+//     BeginPass(pass, thread) on any thread, at most once per pass;
+//     Submit();
+class CommandListPool
+{
+public:
+	CommandListPool(ICommandDevice& device, uint32_t framesInFlight, uint32_t threadCount);
+	~CommandListPool();
+
+	CommandListPool(const CommandListPool&) = delete;
+	CommandListPool& operator=(const CommandListPool&) = delete;
+
+	// Move to the next frame slot, waiting for the GPU if it is still using it.
+	void BeginFrame();
+
+	// Open a list for the pass on the given thread (the caller's JobSystem thread index).
+	// A thread's previous list is closed first since its allocator can only back one
+	// recording list at a time. Thread safe for distinct threads.
+	ICommandList& BeginPass(uint32_t pass, uint32_t thread);
+
+	// Close the open lists, execute them in pass order and fence the frame.
+	void Submit();
+
+	// Wait until the GPU finished everything submitted to the queue.
+	void WaitForIdle();
+
+	struct Stats
+	{
+		size_t Allocators = 0;		// allocators in the pool
+		size_t Lists = 0;			// lists in the pool
+		size_t ListsLastFrame = 0;	// lists executed by the last Submit
+		uint64_t FenceWaits = 0;	// BeginFrame calls that had to wait for the GPU
+	};
+	Stats GetStats()const;
+
+	uint32_t GetFramesInFlight()const;
+	uint32_t GetThreadCount()const;
+	const FrameRing& GetFrameRing()const;
+
+private:
+	struct ThreadFrame
+	{
+		std::unique_ptr<ICommandAllocator> Allocator;
+		std::vector<std::unique_ptr<ICommandList>> Lists;
+		size_t UsedLists = 0;
+		ICommandList* Open = nullptr;
+	};
+
+	struct Frame
+	{
+		std::vector<ThreadFrame> Threads;
+	};
+
+	struct Pass
+	{
+		uint32_t Order;
+		uint32_t Thread;
+		ICommandList* List;
+	};
+
+	ICommandDevice& mDevice;
+	FrameRing mRing;
+	std::vector<Frame> mFrames;
+	uint32_t mFrameIndex;
+	bool mRecording;
+
+	std::mutex mPassMutex;
+	std::vector<Pass> mPasses;
+	std::vector<ICommandList*> mSubmitLists;
+
+	Stats mStats;
+};
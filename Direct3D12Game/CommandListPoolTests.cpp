@@ -0,0 +1,142 @@
+//
+// CommandListPoolTests.cpp
+//
+
+#include "CommandListPool.h"
+#include "JobSystem.h"
+#include "RecordingRenderDevice.h"
+#include "SelfTest.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Each pass records one viewport command whose width is the pass number plus one, so
+	// the executed stream shows the order the GPU would see.
+	void RecordPass(CommandListPool& pool, uint32_t pass, uint32_t thread)
+	{
+		IRenderDevice::GetRenderList(pool.BeginPass(pass, thread)).SetViewport(pass + 1, thread);
+	}
+
+	std::vector<uint32_t> ExecutedPasses(const RecordingRenderDevice& device, size_t first)
+	{
+		std::vector<uint32_t> passes;
+		const std::vector<RecordedCommand>& commands = device.GetExecutedCommands();
+		for (size_t i = first; i < commands.size(); ++i)
+		{
+			if (commands[i].Type == RecordedCommandType::SetViewport)
+				passes.push_back(commands[i].A - 1);
+		}
+		return passes;
+	}
+
+	size_t CountEntries(const RecordingRenderDevice& device, const std::string& prefix)
+	{
+		size_t count = 0;
+		for (const std::string& entry : device.GetLog())
+			count += entry.compare(0, prefix.size(), prefix) == 0 ? 1 : 0;
+		return count;
+	}
+}
+
+SELF_TEST(CommandListPool, SubmitsInPassOrder)
+{
+	RecordingRenderDevice device;
+	CommandListPool pool(device, 2, 3);
+
+	// Passes opened in any order on any thread execute sorted by pass, in one call.
+	// Thread 0 records two passes, which closes its first list.
+	pool.BeginFrame();
+	RecordPass(pool, 2, 0);
+	RecordPass(pool, 0, 2);
+	RecordPass(pool, 3, 1);
+	RecordPass(pool, 1, 0);
+	pool.Submit();
+
+	SELF_CHECK(ExecutedPasses(device, 0) == std::vector<uint32_t>({ 0, 1, 2, 3 }));
+	SELF_CHECK(CountEntries(device, "execute") == 1);
+	SELF_CHECK(device.GetStats().ListsExecuted == 4);
+	SELF_CHECK(pool.GetStats().ListsLastFrame == 4);
+
+	// A frame without passes only fences the frame.
+	pool.BeginFrame();
+	pool.Submit();
+	SELF_CHECK(CountEntries(device, "execute") == 1);
+	SELF_CHECK(pool.GetStats().ListsLastFrame == 0);
+	SELF_CHECK(pool.GetFrameRing().GetStats().Frames == 2);
+}
+
+SELF_TEST(CommandListPool, ParallelRecordingIsDeterministic)
+{
+	JobSystem jobs(3);
+	RecordingRenderDevice device;
+	CommandListPool pool(device, 3, jobs.GetThreadCount());
+
+	// Whichever thread records a pass, the submitted order is the same every frame.
+	const uint32_t passCount = 12;
+	bool ordered = true;
+	for (int frame = 0; frame < 200; ++frame)
+	{
+		size_t first = device.GetExecutedCommands().size();
+		pool.BeginFrame();
+		jobs.ParallelFor(0, passCount, 1, [&](size_t pass)
+		{
+			RecordPass(pool, uint32_t(pass), uint32_t(jobs.GetThreadIndex()));
+		});
+		pool.Submit();
+
+		std::vector<uint32_t> passes = ExecutedPasses(device, first);
+		for (uint32_t pass = 0; pass < passCount; ++pass)
+			ordered = ordered && passes.size() == passCount && passes[pass] == pass;
+	}
+	SELF_CHECK(ordered);
+
+	// Lists and allocators are pooled: allocators once per frame and thread, lists only
+	// as often as one thread recorded more passes than ever before in that frame slot.
+	CommandListPool::Stats stats = pool.GetStats();
+	context.Log("%zu allocators, %zu lists for %u frames x %u threads, %u passes per frame", stats.Allocators,
+		stats.Lists, pool.GetFramesInFlight(), pool.GetThreadCount(), passCount);
+	SELF_CHECK(stats.Allocators <= pool.GetFramesInFlight() * pool.GetThreadCount());
+	SELF_CHECK(stats.Lists <= pool.GetFramesInFlight() * pool.GetThreadCount() * passCount);
+	SELF_CHECK(CountEntries(device, "create list") == stats.Lists);
+	SELF_CHECK(device.GetStats().ListsExecuted == 200 * passCount);
+}
+
+SELF_TEST(CommandListPool, AllocatorsRecycleByFence)
+{
+	// The recording device throws if an allocator is reset before the GPU finished the
+	// frame that used it, so running without errors is part of the check.
+	for (uint32_t framesInFlight : { 1u, 2u, 3u })
+	{
+		RecordingRenderDevice device;
+		CommandListPool pool(device, framesInFlight, 2);
+
+		// A GPU that never catches up on its own: every frame past the ring waits.
+		const uint32_t frames = 10;
+		for (uint32_t frame = 0; frame < frames; ++frame)
+		{
+			pool.BeginFrame();
+			RecordPass(pool, 0, 0);
+			RecordPass(pool, 1, 1);
+			pool.Submit();
+		}
+		CommandListPool::Stats stats = pool.GetStats();
+		SELF_CHECK(stats.FenceWaits == frames - framesInFlight);
+		SELF_CHECK(stats.Allocators == framesInFlight * 2);
+		SELF_CHECK(stats.Lists == framesInFlight * 2);
+		SELF_CHECK(device.GetCompletedFence() == frames - framesInFlight);
+
+		// A GPU that keeps up never makes BeginFrame wait.
+		pool.WaitForIdle();
+		for (uint32_t frame = 0; frame < frames; ++frame)
+		{
+			pool.BeginFrame();
+			RecordPass(pool, 0, 1);
+			pool.Submit();
+			pool.WaitForIdle();
+		}
+		SELF_CHECK(pool.GetStats().FenceWaits == frames - framesInFlight);
+		SELF_CHECK(CountEntries(device, "reset allocator") > 0);
+	}
+}
@@ -0,0 +1,301 @@
+//
+// CpuProfiler.cpp
+//
+
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+using CpuProfiler::Detail::ThreadBuffer;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Registered threads; buffers live as long as the process, so a thread that exits
+	// during a capture still shows up in it.
+	std::mutex gMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> gThreads;
+
+	// Capture state, used by the controlling thread.
+	uint32_t gLastGeneration = 0;
+	uint32_t gCaptured = 0;				// generation of the last capture
+	uint64_t gStartTicks = 0;
+	uint64_t gStopTicks = 0;
+	Clock::time_point gStartTime;
+	Clock::time_point gStopTime;
+
+	std::atomic<uint32_t> gRequestedFrames(0);
+	uint32_t gCaptureFrames = 0;		// of the running capture, 0 when not frame based
+	std::vector<uint64_t> gFrameTicks;	// start of every marked frame
+	uint32_t gFrameThread = 0;
+
+	ThreadBuffer* Register()
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+		gThreads.push_back(std::make_unique<ThreadBuffer>());
+		ThreadBuffer* buffer = gThreads.back().get();
+		buffer->Id = uint32_t(gThreads.size());
+		buffer->Name = "thread " + std::to_string(buffer->Id);
+		// Up front, so the first captured frame does not pay for it.
+		buffer->Events.resize(CpuProfiler::EventsPerThread);
+		CpuProfiler::Detail::tBuffer = buffer;
+		return buffer;
+	}
+
+	void WriteString(std::ostream& out, const char* text)
+	{
+		out << '"';
+		for (const char* c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				out << '\\' << *c;
+			else if (uint8_t(*c) < 0x20)
+				out << ' ';
+			else
+				out << *c;
+		}
+		out << '"';
+	}
+
+	void WriteEvent(std::ostream& out, const char* name, uint32_t thread, double begin, double duration)
+	{
+		char times[64];
+		snprintf(times, sizeof(times), ",\"ts\":%.3f,\"dur\":%.3f}", begin, duration);
+		out << ",\n{\"name\":";
+		WriteString(out, name);
+		out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread << times;
+	}
+}
+
+namespace CpuProfiler
+{
+	namespace Detail
+	{
+		std::atomic<uint32_t> gGeneration(0);
+		thread_local ThreadBuffer* tBuffer = nullptr;
+
+		ThreadBuffer* Attach(uint32_t generation)
+		{
+			ThreadBuffer* buffer = tBuffer ? tBuffer : Register();
+			buffer->Count.store(0, std::memory_order_relaxed);
+			buffer->Dropped.store(0, std::memory_order_relaxed);
+			buffer->Generation.store(generation, std::memory_order_release);
+			return buffer;
+		}
+	}
+
+	void SetThreadName(const char* name)
+	{
+		ThreadBuffer* buffer = Detail::tBuffer ? Detail::tBuffer : Register();
+		// The thread is the only writer of its name, so it may compare without the lock.
+		if (buffer->Name == name)
+			return;
+		std::lock_guard<std::mutex> lock(gMutex);
+		buffer->Name = name;
+	}
+
+	void Start()
+	{
+		Stop();
+
+		gCaptureFrames = 0;
+		gFrameTicks.clear();
+		if (++gLastGeneration == 0)
+			gLastGeneration = 1;
+		gCaptured = gLastGeneration;
+		gStartTime = Clock::now();
+		gStartTicks = ReadTicks();
+		Detail::gGeneration.store(gCaptured, std::memory_order_relaxed);
+	}
+
+	void Stop()
+	{
+		if (!IsRecording())
+			return;
+
+		Detail::gGeneration.store(0, std::memory_order_relaxed);
+		gStopTicks = ReadTicks();
+		gStopTime = Clock::now();
+		gCaptureFrames = 0;
+	}
+
+	bool IsRecording()
+	{
+		return Detail::gGeneration.load(std::memory_order_relaxed) != 0;
+	}
+
+	void RequestCapture(uint32_t frames)
+	{
+		gRequestedFrames = frames;
+	}
+
+	bool MarkFrame()
+	{
+		// A request waits for a capture that is still running.
+		if (!IsRecording())
+		{
+			uint32_t requested = gRequestedFrames.exchange(0);
+			if (requested > 0)
+			{
+				Start();
+				gCaptureFrames = requested;
+			}
+		}
+		if (gCaptureFrames == 0)
+			return false;
+
+		ThreadBuffer* buffer = Detail::tBuffer;
+		if (!buffer || buffer->Generation.load(std::memory_order_relaxed) != gCaptured)
+			buffer = Detail::Attach(gCaptured);
+		gFrameThread = buffer->Id;
+
+		gFrameTicks.push_back(ReadTicks());
+		if (gFrameTicks.size() <= gCaptureFrames)
+			return false;
+
+		Stop();
+		return true;
+	}
+
+	uint64_t GetEventCount()
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+		uint64_t count = 0;
+		for (const auto& buffer : gThreads)
+		{
+			if (gCaptured != 0 && buffer->Generation.load(std::memory_order_acquire) == gCaptured)
+				count += buffer->Count.load(std::memory_order_acquire);
+		}
+		return count;
+	}
+
+	uint64_t GetDroppedEvents()
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+		uint64_t dropped = 0;
+		for (const auto& buffer : gThreads)
+		{
+			if (gCaptured != 0 && buffer->Generation.load(std::memory_order_acquire) == gCaptured)
+				dropped += buffer->Dropped.load(std::memory_order_relaxed);
+		}
+		return dropped;
+	}
+
+	void WriteChromeTrace(std::ostream& out)
+	{
+		assert(!IsRecording());
+
+		// The counter rate over the capture converts ticks to microseconds.
+		double microseconds = std::chrono::duration<double, std::micro>(gStopTime - gStartTime).count();
+		double ticksPerMicrosecond = gStopTicks > gStartTicks && microseconds > 0.0 ?
+			double(gStopTicks - gStartTicks) / microseconds : 1.0;
+		auto toMicroseconds = [ticksPerMicrosecond](uint64_t ticks)
+		{
+			return double(int64_t(ticks - gStartTicks)) / ticksPerMicrosecond;
+		};
+
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Direct3D12Game\"}}";
+
+		std::lock_guard<std::mutex> lock(gMutex);
+		std::vector<Event> events;
+		for (const auto& buffer : gThreads)
+		{
+			if (gCaptured == 0 || buffer->Generation.load(std::memory_order_acquire) != gCaptured)
+				continue;
+
+			out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->Id << ",\"args\":{\"name\":";
+			WriteString(out, buffer->Name.c_str());
+			out << "}}";
+
+			// Scopes end inner first; viewers want parents before their children.
+			uint32_t count = buffer->Count.load(std::memory_order_acquire);
+			events.assign(buffer->Events.begin(), buffer->Events.begin() + count);
+			std::sort(events.begin(), events.end(), [](const Event& a, const Event& b)
+			{
+				return a.Begin != b.Begin ? a.Begin < b.Begin : a.End > b.End;
+			});
+			for (const auto& event : events)
+			{
+				WriteEvent(out, event.Name, buffer->Id, toMicroseconds(event.Begin),
+					double(event.End - event.Begin) / ticksPerMicrosecond);
+			}
+		}
+
+		for (size_t frame = 0; frame + 1 < gFrameTicks.size(); frame++)
+		{
+			WriteEvent(out, "Frame", gFrameThread, toMicroseconds(gFrameTicks[frame]),
+				double(gFrameTicks[frame + 1] - gFrameTicks[frame]) / ticksPerMicrosecond);
+		}
+
+		out << "\n]}\n";
+	}
+
+	bool WriteChromeTrace(const char* fileName)
+	{
+		std::ofstream out(fileName, std::ios::trunc);
+		WriteChromeTrace(out);
+		return bool(out);
+	}
+
+	BenchmarkResult RunBenchmark(uint32_t scopes, double budgetNs)
+	{
+		// Rounds stay within a thread's buffer, so no scope takes the cheaper dropping path.
+		auto measure = [scopes](bool record, bool nested)
+		{
+			uint32_t perIteration = nested ? 2 : 1;
+			uint32_t round = EventsPerThread / 2 / perIteration;
+			double seconds = 0.0;
+			for (uint32_t done = 0; done < scopes; done += round * perIteration)
+			{
+				if (record)
+					Start();
+				auto start = Clock::now();
+				for (uint32_t i = 0; i < round; i++)
+				{
+					Scope outer("benchmark outer");
+					if (nested)
+					{
+						Scope inner("benchmark inner");
+					}
+				}
+				seconds += std::chrono::duration<double>(Clock::now() - start).count();
+				if (record)
+					Stop();
+			}
+			uint32_t measured = (scopes + round * perIteration - 1) / (round * perIteration) * round * perIteration;
+			return seconds * 1e9 / measured;
+		};
+
+		Stop();
+		BenchmarkResult result;
+		result.IdleNs = measure(false, false);
+		result.CapturingNs = measure(true, false);
+		result.NestedNs = measure(true, true);
+		result.WithinBudget = std::max(result.CapturingNs, result.NestedNs) < budgetNs;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		const char* clock = "rdtsc";
+#else
+		const char* clock = "steady_clock";
+#endif
+		char report[384];
+		snprintf(report, sizeof(report),
+			"CPU profiler, %u scopes per case, %s%s\n"
+			"  not capturing  %6.1f ns/scope\n"
+			"  capturing      %6.1f ns/scope\n"
+			"  nested         %6.1f ns/scope\n"
+			"%s the %.0f ns budget\n",
+			scopes, clock, CPU_PROFILER ? "" : ", scope macros compiled out",
+			result.IdleNs, result.CapturingNs, result.NestedNs,
+			result.WithinBudget ? "Within" : "Over", budgetNs);
+		result.Report = report;
+		return result;
+	}
+}
@@ -0,0 +1,180 @@
+//
+// CpuProfiler.h - Hierarchical CPU scope timing with Chrome trace export
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Define CPU_PROFILER as 0 to compile the scope macros out.
+#ifndef CPU_PROFILER
+#define CPU_PROFILER 1
+#endif
+
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+
+#if CPU_PROFILER
+// Times the rest of the enclosing block. The name must outlive the capture, a string
+// literal in practice.
+#define CPU_PROFILE_SCOPE(name) CpuProfiler::Scope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#define CPU_PROFILE_FUNCTION() CPU_PROFILE_SCOPE(__FUNCTION__)
+#else
+#define CPU_PROFILE_SCOPE(name) ((void)0)
+#define CPU_PROFILE_FUNCTION() ((void)0)
+#endif
+
+// Records the begin and end time of scopes on every thread while a capture runs, and
+// writes them as a Chrome trace (JSON, for chrome://tracing and Perfetto), where scopes
+// nest by time on each thread's track.
+//
+// Each thread appends to a buffer of its own that only it writes, so scopes take no
+// locks: a scope reads the time stamp counter twice (steady_clock where there is none)
+// and stores one event. Outside a capture a scope costs a relaxed atomic load. A thread
+// registers its buffer the first time it records and keeps it for the process lifetime;
+// events beyond EventsPerThread in a capture are dropped and counted.
+//
+// Per frame, on the thread that drives the frames:
+//     if (CpuProfiler::MarkFrame())        // a requested capture completed
+//         CpuProfiler::WriteChromeTrace(file);
+// Captures are requested from any thread with RequestCapture(frames), or started and
+// stopped directly. Export only between captures.
+namespace CpuProfiler
+{
+	static const uint32_t EventsPerThread = 1 << 16;
+
+	struct Event
+	{
+		const char* Name;
+		uint64_t Begin;			// ticks of ReadTicks
+		uint64_t End;
+	};
+
+	inline uint64_t ReadTicks()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	namespace Detail
+	{
+		struct ThreadBuffer
+		{
+			std::atomic<uint32_t> Generation{ 0 };	// capture the events belong to
+			std::atomic<uint32_t> Count{ 0 };
+			std::atomic<uint64_t> Dropped{ 0 };
+			std::vector<Event> Events;
+			std::string Name;
+			uint32_t Id = 0;
+		};
+
+		// Non-zero while a capture runs.
+		extern std::atomic<uint32_t> gGeneration;
+		extern thread_local ThreadBuffer* tBuffer;
+
+		// Registers the calling thread or starts its buffer over for the new capture.
+		ThreadBuffer* Attach(uint32_t generation);
+
+		// Only the owning thread appends; the release store publishes the event to the
+		// exporter.
+		inline void Append(ThreadBuffer& buffer, const char* name, uint64_t begin, uint64_t end)
+		{
+			uint32_t count = buffer.Count.load(std::memory_order_relaxed);
+			if (count < EventsPerThread)
+			{
+				buffer.Events[count] = Event{ name, begin, end };
+				buffer.Count.store(count + 1, std::memory_order_release);
+			}
+			else
+			{
+				buffer.Dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	class Scope
+	{
+	public:
+		explicit Scope(const char* name) :
+			mBuffer(nullptr)
+		{
+			uint32_t generation = Detail::gGeneration.load(std::memory_order_relaxed);
+			if (generation == 0)
+				return;
+
+			Detail::ThreadBuffer* buffer = Detail::tBuffer;
+			if (!buffer || buffer->Generation.load(std::memory_order_relaxed) != generation)
+				buffer = Detail::Attach(generation);
+			mBuffer = buffer;
+			mGeneration = generation;
+			mName = name;
+			mBegin = ReadTicks();
+		}
+
+		// A scope that began in an earlier capture is dropped: its buffer has started
+		// over since, and the event would have no begin in the new capture.
+		~Scope()
+		{
+			if (mBuffer && mBuffer->Generation.load(std::memory_order_relaxed) == mGeneration)
+				Detail::Append(*mBuffer, mName, mBegin, ReadTicks());
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		Detail::ThreadBuffer* mBuffer;	// null outside a capture
+		uint32_t mGeneration;
+		const char* mName;
+		uint64_t mBegin;
+	};
+
+	// Track name of the calling thread in the trace, "thread N" by default. Cheap when the
+	// name does not change, so it can be set every frame.
+	void SetThreadName(const char* name);
+
+	// Record from now on, dropping the last capture.
+	void Start();
+	void Stop();
+	bool IsRecording();
+
+	// Capture the next frames, from the next MarkFrame on. Thread safe.
+	void RequestCapture(uint32_t frames);
+	// Once per frame, at its start. Returns true when a requested capture completed.
+	bool MarkFrame();
+
+	// Of the last capture.
+	uint64_t GetEventCount();
+	uint64_t GetDroppedEvents();
+	// Frames show up as "Frame" scopes on the track of the thread that marked them.
+	void WriteChromeTrace(std::ostream& out);
+	bool WriteChromeTrace(const char* fileName);
+
+	struct BenchmarkResult
+	{
+		double IdleNs = 0.0;			// per scope, outside a capture
+		double CapturingNs = 0.0;
+		double NestedNs = 0.0;			// per scope, two nested ones at a time
+		bool WithinBudget = false;		// both capturing cases
+		std::string Report;
+	};
+
+	// Times scopes outside and inside a capture, flat and nested, on the calling thread.
+	// Replaces the last capture.
+	BenchmarkResult RunBenchmark(uint32_t scopes, double budgetNs);
+}
@@ -0,0 +1,125 @@
+//
+// CpuProfilerTests.cpp
+//
+
+#include "CpuProfiler.h"
+#include "SelfTest.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace
+{
+	std::string Trace()
+	{
+		std::ostringstream out;
+		CpuProfiler::WriteChromeTrace(out);
+		return out.str();
+	}
+
+	size_t Occurrences(const std::string& text, const std::string& what)
+	{
+		size_t count = 0;
+		for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1))
+			count++;
+		return count;
+	}
+}
+
+SELF_TEST(CpuProfiler, NestedScopesOnEveryThread)
+{
+	CpuProfiler::Start();
+	{
+		CPU_PROFILE_SCOPE("outer");
+		{
+			CPU_PROFILE_SCOPE("inner");
+		}
+		std::thread worker([]()
+		{
+			CpuProfiler::SetThreadName("test worker");
+			CPU_PROFILE_SCOPE("on the worker");
+		});
+		worker.join();
+	}
+	CpuProfiler::Stop();
+
+	// Scopes outside a capture record nothing.
+	{
+		CPU_PROFILE_SCOPE("after the capture");
+	}
+
+	SELF_CHECK(CpuProfiler::GetEventCount() == 3);
+	SELF_CHECK(CpuProfiler::GetDroppedEvents() == 0);
+	std::string trace = Trace();
+	SELF_CHECK(Occurrences(trace, "\"ph\":\"X\"") == 3);
+	SELF_CHECK(trace.find("\"test worker\"") != std::string::npos);
+	SELF_CHECK(trace.find("after the capture") == std::string::npos);
+	// Parents come before their children.
+	SELF_CHECK(trace.find("\"outer\"") < trace.find("\"inner\""));
+}
+
+SELF_TEST(CpuProfiler, ScopesStraddlingCapturesAreDropped)
+{
+	// A scope begun in one capture and ended in the next would be an event without a
+	// begin in the new capture, before its start and around scopes it never contained.
+	CpuProfiler::Start();
+	std::unique_ptr<CpuProfiler::Scope> straddling(new CpuProfiler::Scope("straddling"));
+	CpuProfiler::Stop();
+	CpuProfiler::Start();
+	{
+		CPU_PROFILE_SCOPE("inside");
+	}
+	straddling.reset();
+	CpuProfiler::Stop();
+
+	std::string trace = Trace();
+	SELF_CHECK(CpuProfiler::GetEventCount() == 1);
+	SELF_CHECK(trace.find("\"inside\"") != std::string::npos);
+	SELF_CHECK(trace.find("straddling") == std::string::npos);
+	SELF_CHECK(trace.find("\"ts\":-") == std::string::npos);
+
+	// Ending after the capture it began in stopped still counts for that capture.
+	CpuProfiler::Start();
+	straddling.reset(new CpuProfiler::Scope("ends after stop"));
+	CpuProfiler::Stop();
+	straddling.reset();
+	SELF_CHECK(CpuProfiler::GetEventCount() == 1);
+	SELF_CHECK(Trace().find("ends after stop") != std::string::npos);
+}
+
+SELF_TEST(CpuProfiler, FrameCapturesAndFullBuffers)
+{
+	// A requested capture starts at the next frame and completes after the frames asked for.
+	CpuProfiler::RequestCapture(3);
+	int marks = 1;
+	while (!CpuProfiler::MarkFrame() && marks < 10)
+	{
+		CPU_PROFILE_SCOPE("frame work");
+		marks++;
+	}
+	SELF_CHECK(marks == 4);
+	SELF_CHECK(!CpuProfiler::IsRecording());
+	std::string trace = Trace();
+	SELF_CHECK(Occurrences(trace, "\"Frame\"") == 3);
+	SELF_CHECK(Occurrences(trace, "\"frame work\"") == 3);
+
+	// Scopes past a thread's buffer are counted, not recorded.
+	CpuProfiler::Start();
+	for (uint32_t i = 0; i < CpuProfiler::EventsPerThread + 10; ++i)
+	{
+		CPU_PROFILE_SCOPE("filler");
+	}
+	CpuProfiler::Stop();
+	SELF_CHECK(CpuProfiler::GetEventCount() == CpuProfiler::EventsPerThread);
+	SELF_CHECK(CpuProfiler::GetDroppedEvents() == 10);
+}
+
+SELF_BENCHMARK(CpuProfiler, ScopeOverhead)
+{
+	// The same measurement as -profilebench, against the 50 ns per scope budget.
+	CpuProfiler::BenchmarkResult result = CpuProfiler::RunBenchmark(10000000, 50.0);
+	context.Log("%s", result.Report.c_str());
+	SELF_CHECK(result.WithinBudget);
+}
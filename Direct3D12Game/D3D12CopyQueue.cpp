@@ -0,0 +1,95 @@
+//
+// D3D12CopyQueue.cpp
+//
+
+#include "pch.h"
+#include "D3D12CopyQueue.h"
+
+D3D12CopyQueue::D3D12CopyQueue(ID3D12Device* device) :
+	mDevice(device),
+	mFenceValue(0),
+	mLastUpload(0)
+{
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	DX::ThrowIfFailed(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(mQueue.ReleaseAndGetAddressOf())));
+	mQueue->SetName(L"Copy queue");
+
+	DX::ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(mAllocator.ReleaseAndGetAddressOf())));
+	DX::ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, mAllocator.Get(), nullptr,
+		IID_PPV_ARGS(mList.ReleaseAndGetAddressOf())));
+	DX::ThrowIfFailed(mList->Close());
+
+	DX::ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(mFence.ReleaseAndGetAddressOf())));
+
+	mFenceEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+	if (!mFenceEvent.IsValid())
+	{
+		throw std::exception("CreateEvent");
+	}
+}
+
+D3D12CopyQueue::~D3D12CopyQueue()
+{
+	// The staging buffers and the allocator must outlive the copies.
+	if (mFence->GetCompletedValue() < mLastUpload
+		&& SUCCEEDED(mFence->SetEventOnCompletion(mLastUpload, mFenceEvent.Get())))
+	{
+		WaitForSingleObjectEx(mFenceEvent.Get(), INFINITE, FALSE);
+	}
+}
+
+uint64_t D3D12CopyQueue::UploadTexture(ID3D12Resource* dest, const D3D12_SUBRESOURCE_DATA* subresources, UINT count)
+{
+	// One allocator: the previous copy has to finish before it can be reused. Decoding
+	// the next asset usually takes longer than the copy, so this rarely waits.
+	WaitForFence(mLastUpload);
+	mStaging.clear();
+	DX::ThrowIfFailed(mAllocator->Reset());
+	DX::ThrowIfFailed(mList->Reset(mAllocator.Get(), nullptr));
+
+	UINT64 stagingSize = GetRequiredIntermediateSize(dest, 0, count);
+	CD3DX12_HEAP_PROPERTIES uploadHeap(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC stagingDesc = CD3DX12_RESOURCE_DESC::Buffer(stagingSize);
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> staging;
+	DX::ThrowIfFailed(mDevice->CreateCommittedResource(&uploadHeap, D3D12_HEAP_FLAG_NONE, &stagingDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(staging.GetAddressOf())));
+
+	UpdateSubresources(mList.Get(), dest, staging.Get(), 0, 0, count, subresources);
+	DX::ThrowIfFailed(mList->Close());
+
+	ID3D12CommandList* lists[] = { mList.Get() };
+	mQueue->ExecuteCommandLists(_countof(lists), lists);
+	mStaging.push_back(staging);
+
+	mLastUpload = Signal();
+	return mLastUpload;
+}
+
+uint64_t D3D12CopyQueue::Signal()
+{
+	DX::ThrowIfFailed(mQueue->Signal(mFence.Get(), ++mFenceValue));
+	return mFenceValue;
+}
+
+uint64_t D3D12CopyQueue::GetCompletedFence()const
+{
+	return mFence->GetCompletedValue();
+}
+
+void D3D12CopyQueue::WaitForFence(uint64_t value)
+{
+	if (mFence->GetCompletedValue() < value)
+	{
+		DX::ThrowIfFailed(mFence->SetEventOnCompletion(value, mFenceEvent.Get()));
+		WaitForSingleObjectEx(mFenceEvent.Get(), INFINITE, FALSE);
+	}
+}
+
+ID3D12Fence* D3D12CopyQueue::GetFence()const
+{
+	return mFence.Get();
+}
@@ -0,0 +1,52 @@
+//
+// D3D12CopyQueue.h - Texture uploads on a dedicated Direct3D 12 copy queue
+//
+
+#pragma once
+
+#include "pch.h"
+
+#include "FrameRing.h"
+
+#include <vector>
+
+// A copy queue with its own fence for uploading textures next to the direct queue.
+// Uploads are recorded by one thread at a time (the AssetStreamer thread); the fence
+// can be polled from any thread.
+//
+// Resources used on a copy queue decay to COMMON once the copy finished, and the direct
+// queue implicitly promotes them to a shader resource state on first use, so uploaded
+// textures need no barrier before they are sampled.
+class D3D12CopyQueue : public IGpuFence
+{
+public:
+	explicit D3D12CopyQueue(ID3D12Device* device);
+	~D3D12CopyQueue();
+
+	D3D12CopyQueue(const D3D12CopyQueue&) = delete;
+	D3D12CopyQueue& operator=(const D3D12CopyQueue&) = delete;
+
+	// Copy the subresources into dest, which must be in the COMMON or COPY_DEST state.
+	// Returns the fence value that completes the copy; the data may be freed right away.
+	uint64_t UploadTexture(ID3D12Resource* dest, const D3D12_SUBRESOURCE_DATA* subresources, UINT count);
+
+	uint64_t Signal() override;
+	uint64_t GetCompletedFence()const override;
+	void WaitForFence(uint64_t value) override;
+
+	// For other queues to wait on a copy with ID3D12CommandQueue::Wait.
+	ID3D12Fence* GetFence()const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mQueue;
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mAllocator;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mList;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	Microsoft::WRL::Wrappers::Event mFenceEvent;
+	uint64_t mFenceValue;
+	uint64_t mLastUpload;	// fence of the copy that still uses the allocator
+
+	// Staging memory of the last upload, released once its copy finished.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mStaging;
+};
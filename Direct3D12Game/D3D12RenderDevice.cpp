@@ -0,0 +1,539 @@
+//
+// D3D12RenderDevice.cpp
+//
+
+#include "pch.h"
+#include "D3D12RenderDevice.h"
+
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	D3D12_RESOURCE_STATES ToD3D12(ResourceState state)
+	{
+		switch (state)
+		{
+		case ResourceState::RenderTarget:	return D3D12_RESOURCE_STATE_RENDER_TARGET;
+		case ResourceState::DepthWrite:		return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+		case ResourceState::ShaderResource:	return D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+		case ResourceState::ResolveSource:	return D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+		case ResourceState::ResolveDest:	return D3D12_RESOURCE_STATE_RESOLVE_DEST;
+		case ResourceState::CopySource:		return D3D12_RESOURCE_STATE_COPY_SOURCE;
+		case ResourceState::CopyDest:		return D3D12_RESOURCE_STATE_COPY_DEST;
+		case ResourceState::Present:		return D3D12_RESOURCE_STATE_PRESENT;
+		default:							return D3D12_RESOURCE_STATE_COMMON;
+		}
+	}
+
+	XMMATRIX LoadMatrix(const float matrix[16])
+	{
+		return XMLoadFloat4x4(reinterpret_cast<const XMFLOAT4X4*>(matrix));
+	}
+
+	static_assert(sizeof(RenderVertex) == sizeof(VertexPositionColor), "RenderVertex must match VertexPositionColor");
+
+	// PrimitiveBatch's default vertex budget per Begin/End.
+	const size_t c_maxLineVertices = 4096;
+}
+
+//
+// Allocator
+//
+
+D3D12RenderDevice::Allocator::Allocator(ID3D12Device* device)
+{
+	DX::ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+		IID_PPV_ARGS(mAllocator.ReleaseAndGetAddressOf())));
+}
+
+void D3D12RenderDevice::Allocator::Reset()
+{
+	DX::ThrowIfFailed(mAllocator->Reset());
+}
+
+ID3D12CommandAllocator* D3D12RenderDevice::Allocator::Get()const
+{
+	return mAllocator.Get();
+}
+
+//
+// List
+//
+
+D3D12RenderDevice::List::List(D3D12RenderDevice& device, Allocator& allocator) :
+	mDevice(device),
+	mPipeline(0),
+	mSprites(nullptr),
+	mDepthBound(false),
+	mViewport{}
+{
+	DX::ThrowIfFailed(device.mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, allocator.Get(), nullptr,
+		IID_PPV_ARGS(mList.ReleaseAndGetAddressOf())));
+	DX::ThrowIfFailed(mList->Close());
+}
+
+void D3D12RenderDevice::List::Reset(ICommandAllocator& allocator)
+{
+	DX::ThrowIfFailed(mList->Reset(static_cast<Allocator&>(allocator).Get(), nullptr));
+	mPipeline = 0;
+	mDepthBound = false;
+	mStates.Reset();
+
+	if (mDevice.mHeapCount > 0)
+		mList->SetDescriptorHeaps(mDevice.mHeapCount, mDevice.mHeaps);
+}
+
+void D3D12RenderDevice::List::Close()
+{
+	EndSprites();
+	mDevice.IssueBarriers(mList.Get(), mStates.Close(), mBarriers);
+	DX::ThrowIfFailed(mList->Close());
+}
+
+void D3D12RenderDevice::List::Transition(RenderTexture texture, ResourceState after)
+{
+	assert(mDevice.GetTexture(texture).Resource);
+	mStates.Transition(texture.Id, after);
+}
+
+void D3D12RenderDevice::List::BeginTransition(RenderTexture texture, ResourceState after)
+{
+	assert(mDevice.GetTexture(texture).Resource);
+	mStates.BeginTransition(texture.Id, after);
+}
+
+void D3D12RenderDevice::List::SetRenderTargets(RenderTexture color, RenderTexture depth)
+{
+	EndSprites();
+	mStates.Use(color.Id);
+	const D3D12_CPU_DESCRIPTOR_HANDLE& rtv = mDevice.GetTexture(color).RenderTarget;
+	mDepthBound = bool(depth);
+	if (depth)
+	{
+		mStates.Use(depth.Id);
+		mList->OMSetRenderTargets(1, &rtv, FALSE, &mDevice.GetTexture(depth).DepthStencil);
+	}
+	else
+	{
+		mList->OMSetRenderTargets(1, &rtv, FALSE, nullptr);
+	}
+}
+
+void D3D12RenderDevice::List::SetViewport(uint32_t width, uint32_t height)
+{
+	EndSprites();
+	mViewport = { 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
+	D3D12_RECT scissorRect = { 0, 0, LONG(width), LONG(height) };
+	mList->RSSetViewports(1, &mViewport);
+	mList->RSSetScissorRects(1, &scissorRect);
+}
+
+void D3D12RenderDevice::List::ClearColor(RenderTexture target, const float color[4])
+{
+	EndSprites();
+	mStates.Use(target.Id);
+	FlushBarriers();
+	mList->ClearRenderTargetView(mDevice.GetTexture(target).RenderTarget, color, 0, nullptr);
+}
+
+void D3D12RenderDevice::List::ClearDepth(RenderTexture target, float depth)
+{
+	EndSprites();
+	mStates.Use(target.Id);
+	FlushBarriers();
+	mList->ClearDepthStencilView(mDevice.GetTexture(target).DepthStencil, D3D12_CLEAR_FLAG_DEPTH, depth, 0, 0, nullptr);
+}
+
+void D3D12RenderDevice::List::SetPipeline(RenderPipeline pipeline)
+{
+	assert(pipeline.Id > 0 && pipeline.Id <= mDevice.mPipelines.size());
+	mPipeline = pipeline.Id;
+}
+
+void D3D12RenderDevice::List::SetTexture(RenderTexture texture)
+{
+	assert(mPipeline > 0);
+	Pipeline& pipeline = mDevice.mPipelines[mPipeline - 1];
+	mStates.Use(texture.Id);
+	pipeline.Effect->SetTexture(mDevice.GetTexture(texture).ShaderResource, pipeline.Sampler);
+}
+
+void D3D12RenderDevice::List::SetViewProjection(const float view[16], const float projection[16])
+{
+	assert(mPipeline > 0);
+	Pipeline& pipeline = mDevice.mPipelines[mPipeline - 1];
+	if (pipeline.HasViewProjection
+		&& memcmp(pipeline.View, view, sizeof(pipeline.View)) == 0
+		&& memcmp(pipeline.Projection, projection, sizeof(pipeline.Projection)) == 0)
+	{
+		return;
+	}
+
+	pipeline.Effect->SetView(LoadMatrix(view));
+	pipeline.Effect->SetProjection(LoadMatrix(projection));
+	memcpy(pipeline.View, view, sizeof(pipeline.View));
+	memcpy(pipeline.Projection, projection, sizeof(pipeline.Projection));
+	pipeline.HasViewProjection = true;
+}
+
+void D3D12RenderDevice::List::SetWorld(const float world[16])
+{
+	assert(mPipeline > 0);
+	mDevice.mPipelines[mPipeline - 1].Effect->SetWorld(LoadMatrix(world));
+}
+
+void D3D12RenderDevice::List::DrawMesh(RenderMesh mesh)
+{
+	assert(mPipeline > 0 && mesh.Id > 0 && mesh.Id <= mDevice.mMeshes.size());
+	EndSprites();
+	FlushBarriers();
+	mDevice.mPipelines[mPipeline - 1].Effect->Apply(mList.Get());
+	mDevice.mMeshes[mesh.Id - 1]->Draw(mList.Get());
+}
+
+void D3D12RenderDevice::List::DrawLines(const RenderVertex* vertices, size_t vertexCount)
+{
+	assert(mPipeline > 0 && mDevice.mLineBatch);
+	EndSprites();
+	FlushBarriers();
+	mDevice.mPipelines[mPipeline - 1].Effect->Apply(mList.Get());
+
+	const VertexPositionColor* lineVertices = reinterpret_cast<const VertexPositionColor*>(vertices);
+	for (size_t first = 0; first < vertexCount; first += c_maxLineVertices)
+	{
+		mDevice.mLineBatch->Begin(mList.Get());
+		mDevice.mLineBatch->Draw(D3D_PRIMITIVE_TOPOLOGY_LINELIST, lineVertices + first,
+			std::min(vertexCount - first, c_maxLineVertices));
+		mDevice.mLineBatch->End();
+	}
+}
+
+void D3D12RenderDevice::List::DrawSprite(RenderTexture texture, float left, float top, float right, float bottom)
+{
+	mStates.Use(texture.Id);
+	FlushBarriers();
+	BeginSprites();
+	const TextureViews& views = mDevice.GetTexture(texture);
+	RECT dest = { LONG(left), LONG(top), LONG(right), LONG(bottom) };
+	mSprites->Draw(views.ShaderResource, GetTextureSize(views.Resource), dest);
+}
+
+void D3D12RenderDevice::List::DrawString(RenderFont font, const char* text, float x, float y)
+{
+	assert(font.Id > 0 && font.Id <= mDevice.mFonts.size());
+	FlushBarriers();
+	BeginSprites();
+
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+	std::wstring output = converter.from_bytes(text);
+	mDevice.mFonts[font.Id - 1]->DrawString(mSprites, output.c_str(), XMFLOAT2(x, y), Colors::White);
+}
+
+void D3D12RenderDevice::List::Resolve(RenderTexture dest, RenderTexture source)
+{
+	EndSprites();
+	mStates.Use(dest.Id);
+	mStates.Use(source.Id);
+	FlushBarriers();
+	const TextureViews& destViews = mDevice.GetTexture(dest);
+	mList->ResolveSubresource(destViews.Resource, 0, mDevice.GetTexture(source).Resource, 0, destViews.ResolveFormat);
+}
+
+void D3D12RenderDevice::List::Copy(RenderTexture dest, RenderTexture source)
+{
+	EndSprites();
+	mStates.Use(dest.Id);
+	mStates.Use(source.Id);
+	FlushBarriers();
+	mList->CopyResource(mDevice.GetTexture(dest).Resource, mDevice.GetTexture(source).Resource);
+}
+
+void D3D12RenderDevice::List::Upscale(RenderTexture dest, RenderTexture source, uint32_t sourceWidth, uint32_t sourceHeight)
+{
+	EndSprites();
+	const TextureViews& destViews = mDevice.GetTexture(dest);
+	const TextureViews& sourceViews = mDevice.GetTexture(source);
+	assert(sourceViews.Resource->GetDesc().SampleDesc.Count == 1);
+	D3D12_RESOURCE_DESC destDesc = destViews.Resource->GetDesc();
+	SetRenderTargets(dest, RenderTexture());
+	SetViewport(uint32_t(destDesc.Width), destDesc.Height);
+	mStates.Use(source.Id);
+	FlushBarriers();
+
+	BeginSprites();
+	RECT destRect = { 0, 0, LONG(destDesc.Width), LONG(destDesc.Height) };
+	RECT sourceRect = { 0, 0, LONG(sourceWidth), LONG(sourceHeight) };
+	mSprites->Draw(sourceViews.ShaderResource, GetTextureSize(sourceViews.Resource), destRect, &sourceRect);
+	EndSprites();
+}
+
+ID3D12GraphicsCommandList* D3D12RenderDevice::List::Get()const
+{
+	return mList.Get();
+}
+
+void D3D12RenderDevice::List::BeginSprites()
+{
+	if (mSprites)
+		return;
+
+	// A batch's pipeline state is built for one set of target formats and sample count.
+	mSprites = mDepthBound ? mDevice.mSpriteBatch : mDevice.mOverlaySpriteBatch;
+	assert(mSprites);
+	mSprites->SetViewport(mViewport);
+	mSprites->Begin(mList.Get());
+}
+
+void D3D12RenderDevice::List::EndSprites()
+{
+	if (mSprites)
+	{
+		mSprites->End();
+		mSprites = nullptr;
+	}
+}
+
+// Sprites are drawn at End, so an open batch is ended before barriers go in.
+void D3D12RenderDevice::List::FlushBarriers()
+{
+	if (!mStates.HasPending())
+		return;
+
+	EndSprites();
+	mDevice.IssueBarriers(mList.Get(), mStates.Flush(), mBarriers);
+}
+
+//
+// D3D12RenderDevice
+//
+
+D3D12RenderDevice::D3D12RenderDevice(ID3D12Device* device, ID3D12CommandQueue* queue) :
+	mDevice(device),
+	mQueue(queue),
+	mFenceValue(0),
+	mLineBatch(nullptr),
+	mSpriteBatch(nullptr),
+	mOverlaySpriteBatch(nullptr),
+	mHeaps{},
+	mHeapCount(0)
+{
+	DX::ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(mFence.ReleaseAndGetAddressOf())));
+
+	mFenceEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+	if (!mFenceEvent.IsValid())
+	{
+		throw std::exception("CreateEvent");
+	}
+}
+
+RenderTexture D3D12RenderDevice::AddTexture(const TextureViews& views)
+{
+	mTextures.push_back(views);
+	RenderTexture texture;
+	texture.Id = uint32_t(mTextures.size());
+	mStates.SetState(texture.Id, views.State);
+	return texture;
+}
+
+void D3D12RenderDevice::UpdateTexture(RenderTexture texture, const TextureViews& views)
+{
+	assert(texture.Id > 0 && texture.Id <= mTextures.size());
+	mTextures[texture.Id - 1] = views;
+	mStates.SetState(texture.Id, views.State);
+}
+
+RenderPipeline D3D12RenderDevice::AddPipeline(BasicEffect* effect, D3D12_GPU_DESCRIPTOR_HANDLE sampler)
+{
+	Pipeline pipeline = {};
+	pipeline.Effect = effect;
+	pipeline.Sampler = sampler;
+	pipeline.HasViewProjection = false;
+	mPipelines.push_back(pipeline);
+
+	RenderPipeline handle;
+	handle.Id = uint32_t(mPipelines.size());
+	return handle;
+}
+
+void D3D12RenderDevice::UpdatePipeline(RenderPipeline pipeline, BasicEffect* effect, D3D12_GPU_DESCRIPTOR_HANDLE sampler)
+{
+	assert(pipeline.Id > 0 && pipeline.Id <= mPipelines.size());
+	Pipeline& updated = mPipelines[pipeline.Id - 1];
+	updated.Effect = effect;
+	updated.Sampler = sampler;
+	updated.HasViewProjection = false;
+}
+
+RenderMesh D3D12RenderDevice::AddMesh(GeometricPrimitive* mesh)
+{
+	mMeshes.push_back(mesh);
+	RenderMesh handle;
+	handle.Id = uint32_t(mMeshes.size());
+	return handle;
+}
+
+RenderFont D3D12RenderDevice::AddFont(SpriteFont* font)
+{
+	mFonts.push_back(font);
+	RenderFont handle;
+	handle.Id = uint32_t(mFonts.size());
+	return handle;
+}
+
+void D3D12RenderDevice::SetLineBatch(PrimitiveBatch<VertexPositionColor>* batch)
+{
+	mLineBatch = batch;
+}
+
+void D3D12RenderDevice::SetSpriteBatch(SpriteBatch* batch)
+{
+	mSpriteBatch = batch;
+}
+
+void D3D12RenderDevice::SetOverlaySpriteBatch(SpriteBatch* batch)
+{
+	mOverlaySpriteBatch = batch;
+}
+
+void D3D12RenderDevice::SetDescriptorHeaps(ID3D12DescriptorHeap* resources, ID3D12DescriptorHeap* samplers)
+{
+	mHeapCount = 0;
+	if (resources)
+		mHeaps[mHeapCount++] = resources;
+	if (samplers)
+		mHeaps[mHeapCount++] = samplers;
+}
+
+std::unique_ptr<ICommandAllocator> D3D12RenderDevice::CreateAllocator()
+{
+	return std::make_unique<Allocator>(mDevice.Get());
+}
+
+std::unique_ptr<ICommandList> D3D12RenderDevice::CreateList(ICommandAllocator& allocator)
+{
+	return std::make_unique<List>(*this, static_cast<Allocator&>(allocator));
+}
+
+void D3D12RenderDevice::Execute(ICommandList* const* lists, size_t count)
+{
+	mExecuteLists.clear();
+	for (size_t i = 0; i < count; ++i)
+	{
+		List& list = static_cast<List&>(*lists[i]);
+
+		mFixups.clear();
+		mStates.Resolve(list.mStates, mFixups);
+		if (!mFixups.empty())
+			mExecuteLists.push_back(RecordFixups());
+
+		const ResourceStateTracker::Stats& stats = list.mStates.GetStats();
+		mStats.Barriers += stats.Barriers;
+		mStats.Batches += stats.Batches;
+		mStats.SplitBarriers += stats.SplitBarriers;
+		mStats.RedundantTransitions += stats.Redundant;
+
+		mExecuteLists.push_back(list.Get());
+	}
+
+	mQueue->ExecuteCommandLists(UINT(mExecuteLists.size()), mExecuteLists.data());
+}
+
+uint64_t D3D12RenderDevice::Signal()
+{
+	DX::ThrowIfFailed(mQueue->Signal(mFence.Get(), ++mFenceValue));
+	return mFenceValue;
+}
+
+uint64_t D3D12RenderDevice::GetCompletedFence()const
+{
+	return mFence->GetCompletedValue();
+}
+
+void D3D12RenderDevice::WaitForFence(uint64_t value)
+{
+	if (mFence->GetCompletedValue() < value)
+	{
+		DX::ThrowIfFailed(mFence->SetEventOnCompletion(value, mFenceEvent.Get()));
+		WaitForSingleObjectEx(mFenceEvent.Get(), INFINITE, FALSE);
+	}
+}
+
+ID3D12GraphicsCommandList* D3D12RenderDevice::GetNative(ICommandList& list)
+{
+	List& renderList = static_cast<List&>(list);
+	renderList.EndSprites();
+	renderList.FlushBarriers();
+	return renderList.Get();
+}
+
+D3D12RenderDevice::Stats D3D12RenderDevice::GetStats()const
+{
+	return mStats;
+}
+
+void D3D12RenderDevice::ResetStats()
+{
+	mStats = Stats();
+}
+
+const D3D12RenderDevice::TextureViews& D3D12RenderDevice::GetTexture(RenderTexture texture)const
+{
+	assert(texture.Id > 0 && texture.Id <= mTextures.size());
+	return mTextures[texture.Id - 1];
+}
+
+void D3D12RenderDevice::IssueBarriers(ID3D12GraphicsCommandList* list, const std::vector<StateBarrier>& barriers,
+	std::vector<D3D12_RESOURCE_BARRIER>& scratch)const
+{
+	if (barriers.empty())
+		return;
+
+	scratch.clear();
+	for (const StateBarrier& barrier : barriers)
+	{
+		D3D12_RESOURCE_BARRIER_FLAGS flags = barrier.Split == StateBarrier::Begin ? D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY
+			: barrier.Split == StateBarrier::End ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY : D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		RenderTexture texture;
+		texture.Id = barrier.Texture;
+		scratch.push_back(CD3DX12_RESOURCE_BARRIER::Transition(GetTexture(texture).Resource,
+			ToD3D12(barrier.Before), ToD3D12(barrier.After), D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, flags));
+	}
+	list->ResourceBarrier(UINT(scratch.size()), scratch.data());
+}
+
+// Records mFixups. The list is free again once the fence of the next Signal passed.
+ID3D12CommandList* D3D12RenderDevice::RecordFixups()
+{
+	uint64_t completed = GetCompletedFence();
+	auto fixupList = std::find_if(mFixupLists.begin(), mFixupLists.end(), [completed](const FixupList& candidate)
+	{
+		return candidate.Fence <= completed;
+	});
+
+	if (fixupList == mFixupLists.end())
+	{
+		FixupList created;
+		created.CommandAllocator = std::make_unique<Allocator>(mDevice.Get());
+		DX::ThrowIfFailed(mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, created.CommandAllocator->Get(),
+			nullptr, IID_PPV_ARGS(created.CommandList.ReleaseAndGetAddressOf())));
+		mFixupLists.push_back(std::move(created));
+		fixupList = mFixupLists.end() - 1;
+	}
+	else
+	{
+		fixupList->CommandAllocator->Reset();
+		DX::ThrowIfFailed(fixupList->CommandList->Reset(fixupList->CommandAllocator->Get(), nullptr));
+	}
+
+	IssueBarriers(fixupList->CommandList.Get(), mFixups, mFixupBarriers);
+	DX::ThrowIfFailed(fixupList->CommandList->Close());
+	fixupList->Fence = mFenceValue + 1;
+
+	mStats.Barriers += mFixups.size();
+	mStats.Batches++;
+	mStats.FixupBarriers += mFixups.size();
+	mStats.FixupLists++;
+	return fixupList->CommandList.Get();
+}
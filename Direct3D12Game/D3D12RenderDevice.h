@@ -0,0 +1,197 @@
+//
+// D3D12RenderDevice.h - Direct3D 12 backend of the render interface
+//
+
+#pragma once
+
+#include "pch.h"
+
+#include "RenderDevice.h"
+#include "ResourceStateTracker.h"
+
+#include <vector>
+
+// Direct command lists and allocators on one queue, fenced with a fence of their own.
+//
+// The backend does not own the objects it draws with: Game creates the resources and
+// the DirectXTK effects, batches and fonts as before and adds them here to get handles.
+// A pipeline is a BasicEffect, meshes are GeometricPrimitives, lines go through one
+// PrimitiveBatch and sprites, text and upscales through a SpriteBatch for the scene
+// targets and one for color targets bound alone. Only one list per frame may draw lines,
+// and only one list at a time may draw sprites. Add and update objects between frames,
+// never while lists are recording.
+//
+// Each list tracks texture states with a ResourceStateTracker and issues the queued
+// transitions with one ResourceBarrier call before its next clear, draw, resolve or
+// copy. Execute resolves the lists' entry states against the queue's; where they differ
+// it runs a small fix-up list of barriers in front of the list.
+class D3D12RenderDevice : public IRenderDevice
+{
+public:
+	class Allocator : public ICommandAllocator
+	{
+	public:
+		explicit Allocator(ID3D12Device* device);
+
+		void Reset() override;
+
+		ID3D12CommandAllocator* Get()const;
+
+	private:
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mAllocator;
+	};
+
+	class List : public IRenderCommandList
+	{
+	public:
+		List(D3D12RenderDevice& device, Allocator& allocator);
+
+		void Reset(ICommandAllocator& allocator) override;
+		void Close() override;
+
+		void Transition(RenderTexture texture, ResourceState after) override;
+		void BeginTransition(RenderTexture texture, ResourceState after) override;
+		void SetRenderTargets(RenderTexture color, RenderTexture depth) override;
+		void SetViewport(uint32_t width, uint32_t height) override;
+		void ClearColor(RenderTexture target, const float color[4]) override;
+		void ClearDepth(RenderTexture target, float depth) override;
+		void SetPipeline(RenderPipeline pipeline) override;
+		void SetTexture(RenderTexture texture) override;
+		void SetViewProjection(const float view[16], const float projection[16]) override;
+		void SetWorld(const float world[16]) override;
+		void DrawMesh(RenderMesh mesh) override;
+		void DrawLines(const RenderVertex* vertices, size_t vertexCount) override;
+		void DrawSprite(RenderTexture texture, float left, float top, float right, float bottom) override;
+		void DrawString(RenderFont font, const char* text, float x, float y) override;
+		void Resolve(RenderTexture dest, RenderTexture source) override;
+		void Copy(RenderTexture dest, RenderTexture source) override;
+		void Upscale(RenderTexture dest, RenderTexture source, uint32_t sourceWidth, uint32_t sourceHeight) override;
+
+		ID3D12GraphicsCommandList* Get()const;
+
+	private:
+		friend class D3D12RenderDevice;
+
+		void BeginSprites();
+		void EndSprites();
+		// Before commands that do GPU work.
+		void FlushBarriers();
+
+		D3D12RenderDevice& mDevice;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mList;
+		uint32_t mPipeline;
+		DirectX::SpriteBatch* mSprites;		// between Begin and End
+		bool mDepthBound;
+		D3D12_VIEWPORT mViewport;
+		ResourceStateTracker mStates;
+		std::vector<D3D12_RESOURCE_BARRIER> mBarriers;
+	};
+
+	// A resource and the views the commands need; unused views have a null ptr.
+	struct TextureViews
+	{
+		ID3D12Resource* Resource = nullptr;
+		D3D12_CPU_DESCRIPTOR_HANDLE RenderTarget = {};
+		D3D12_CPU_DESCRIPTOR_HANDLE DepthStencil = {};
+		D3D12_GPU_DESCRIPTOR_HANDLE ShaderResource = {};
+		DXGI_FORMAT ResolveFormat = DXGI_FORMAT_UNKNOWN;		// for Resolve into this texture
+		ResourceState State = ResourceState::Common;			// of the resource when added or updated
+	};
+
+	D3D12RenderDevice(ID3D12Device* device, ID3D12CommandQueue* queue);
+
+	RenderTexture AddTexture(const TextureViews& views);
+	// Point the handle at a recreated resource, e.g. after a resize.
+	void UpdateTexture(RenderTexture texture, const TextureViews& views);
+	RenderPipeline AddPipeline(DirectX::BasicEffect* effect, D3D12_GPU_DESCRIPTOR_HANDLE sampler);
+	// Point the handle at a recreated effect, e.g. for another sample count.
+	void UpdatePipeline(RenderPipeline pipeline, DirectX::BasicEffect* effect, D3D12_GPU_DESCRIPTOR_HANDLE sampler);
+	RenderMesh AddMesh(DirectX::GeometricPrimitive* mesh);
+	RenderFont AddFont(DirectX::SpriteFont* font);
+
+	void SetLineBatch(DirectX::PrimitiveBatch<DirectX::VertexPositionColor>* batch);
+	// Sprites go through the first batch while a depth target is bound, i.e. into the
+	// scene targets, and through the overlay batch into a single-sample color target bound
+	// alone, e.g. the HUD and upscales into the back buffer.
+	void SetSpriteBatch(DirectX::SpriteBatch* batch);
+	void SetOverlaySpriteBatch(DirectX::SpriteBatch* batch);
+	// Bound at the start of every list.
+	void SetDescriptorHeaps(ID3D12DescriptorHeap* resources, ID3D12DescriptorHeap* samplers);
+
+	std::unique_ptr<ICommandAllocator> CreateAllocator() override;
+	std::unique_ptr<ICommandList> CreateList(ICommandAllocator& allocator) override;
+
+	void Execute(ICommandList* const* lists, size_t count) override;
+	uint64_t Signal() override;
+	uint64_t GetCompletedFence()const override;
+	void WaitForFence(uint64_t value) override;
+
+	// The graphics command list behind a list handed out by a pool on this device, for
+	// work the render interface does not cover. An open sprite batch is ended and queued
+	// transitions are issued first.
+	static ID3D12GraphicsCommandList* GetNative(ICommandList& list);
+
+	// Barriers of the executed lists since the last ResetStats.
+	struct Stats
+	{
+		uint64_t Barriers = 0;				// including fix-ups and both halves of split barriers
+		uint64_t Batches = 0;				// ResourceBarrier calls
+		uint64_t SplitBarriers = 0;
+		uint64_t RedundantTransitions = 0;	// dropped by the trackers
+		uint64_t FixupBarriers = 0;
+		uint64_t FixupLists = 0;
+	};
+	Stats GetStats()const;
+	void ResetStats();
+
+private:
+	struct Pipeline
+	{
+		DirectX::BasicEffect* Effect;
+		D3D12_GPU_DESCRIPTOR_HANDLE Sampler;
+		// Last transforms handed to the effect, so unchanged ones are not pushed again.
+		float View[16];
+		float Projection[16];
+		bool HasViewProjection;
+	};
+
+	// Fix-up barriers recorded into a list of their own, reused once the fence passed.
+	struct FixupList
+	{
+		std::unique_ptr<Allocator> CommandAllocator;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CommandList;
+		uint64_t Fence;
+	};
+
+	const TextureViews& GetTexture(RenderTexture texture)const;
+	void IssueBarriers(ID3D12GraphicsCommandList* list, const std::vector<StateBarrier>& barriers,
+		std::vector<D3D12_RESOURCE_BARRIER>& scratch)const;
+	ID3D12CommandList* RecordFixups();
+
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mQueue;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	Microsoft::WRL::Wrappers::Event mFenceEvent;
+	uint64_t mFenceValue;
+
+	// Indexed by handle id - 1.
+	std::vector<TextureViews> mTextures;
+	std::vector<Pipeline> mPipelines;
+	std::vector<DirectX::GeometricPrimitive*> mMeshes;
+	std::vector<DirectX::SpriteFont*> mFonts;
+
+	DirectX::PrimitiveBatch<DirectX::VertexPositionColor>* mLineBatch;
+	DirectX::SpriteBatch* mSpriteBatch;
+	DirectX::SpriteBatch* mOverlaySpriteBatch;
+	ID3D12DescriptorHeap* mHeaps[2];
+	UINT mHeapCount;
+
+	std::vector<ID3D12CommandList*> mExecuteLists;
+
+	// Texture states on the queue, by handle id.
+	ResourceStates mStates;
+	std::vector<StateBarrier> mFixups;
+	std::vector<D3D12_RESOURCE_BARRIER> mFixupBarriers;
+	std::vector<FixupList> mFixupLists;
+	Stats mStats;
+};
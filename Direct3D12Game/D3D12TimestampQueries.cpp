@@ -0,0 +1,61 @@
+//
+// D3D12TimestampQueries.cpp
+//
+
+#include "pch.h"
+#include "D3D12TimestampQueries.h"
+
+#include "D3D12RenderDevice.h"
+
+D3D12TimestampQueries::D3D12TimestampQueries(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t count) :
+	mTicks(nullptr),
+	mCount(count)
+{
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = count;
+	DX::ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(mHeap.ReleaseAndGetAddressOf())));
+	mHeap->SetName(L"Timestamp queries");
+
+	CD3DX12_HEAP_PROPERTIES readbackHeap(D3D12_HEAP_TYPE_READBACK);
+	CD3DX12_RESOURCE_DESC readbackDesc = CD3DX12_RESOURCE_DESC::Buffer(UINT64(count) * sizeof(uint64_t));
+	DX::ThrowIfFailed(device->CreateCommittedResource(&readbackHeap, D3D12_HEAP_FLAG_NONE, &readbackDesc,
+		D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(mReadback.ReleaseAndGetAddressOf())));
+	mReadback->SetName(L"Timestamp readback");
+
+	void* data = nullptr;
+	DX::ThrowIfFailed(mReadback->Map(0, nullptr, &data));
+	mTicks = static_cast<const uint64_t*>(data);
+
+	DX::ThrowIfFailed(queue->GetTimestampFrequency(&mFrequency));
+}
+
+D3D12TimestampQueries::~D3D12TimestampQueries()
+{
+	D3D12_RANGE written = {};
+	mReadback->Unmap(0, &written);
+}
+
+uint64_t D3D12TimestampQueries::GetFrequency()const
+{
+	return mFrequency;
+}
+
+void D3D12TimestampQueries::WriteTimestamp(ICommandList& list, uint32_t query)
+{
+	assert(query < mCount);
+	D3D12RenderDevice::GetNative(list)->EndQuery(mHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query);
+}
+
+void D3D12TimestampQueries::Resolve(ICommandList& list, uint32_t first, uint32_t count)
+{
+	assert(first + count <= mCount);
+	D3D12RenderDevice::GetNative(list)->ResolveQueryData(mHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first, count,
+		mReadback.Get(), UINT64(first) * sizeof(uint64_t));
+}
+
+void D3D12TimestampQueries::Read(uint32_t first, uint32_t count, uint64_t* ticks)
+{
+	assert(first + count <= mCount);
+	memcpy(ticks, mTicks + first, count * sizeof(uint64_t));
+}
@@ -0,0 +1,34 @@
+//
+// D3D12TimestampQueries.h - Timestamp query heap with readback for the GPU profiler
+//
+
+#pragma once
+
+#include "pch.h"
+
+#include "GpuProfiler.h"
+
+// A timestamp query heap and a readback buffer of the same size, for lists of a
+// D3D12RenderDevice on a direct queue. The buffer stays mapped; ranges are only read
+// after the fence of their resolve passed.
+class D3D12TimestampQueries : public ITimestampSource
+{
+public:
+	D3D12TimestampQueries(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t count);
+	~D3D12TimestampQueries();
+
+	D3D12TimestampQueries(const D3D12TimestampQueries&) = delete;
+	D3D12TimestampQueries& operator=(const D3D12TimestampQueries&) = delete;
+
+	uint64_t GetFrequency()const override;
+	void WriteTimestamp(ICommandList& list, uint32_t query) override;
+	void Resolve(ICommandList& list, uint32_t first, uint32_t count) override;
+	void Read(uint32_t first, uint32_t count, uint64_t* ticks) override;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mHeap;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mReadback;
+	const uint64_t* mTicks;
+	uint32_t mCount;
+	uint64_t mFrequency;
+};
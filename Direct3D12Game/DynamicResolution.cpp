@@ -0,0 +1,89 @@
+//
+// DynamicResolution.cpp
+//
+
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution()
+	: DynamicResolution(Settings())
+{
+}
+
+DynamicResolution::DynamicResolution(const Settings& settings)
+{
+	SetSettings(settings);
+}
+
+void DynamicResolution::SetSettings(const Settings& settings)
+{
+	mSettings = settings;
+	mSettings.MinScale = std::min(std::max(mSettings.MinScale, 0.01f), 1.0f);
+	mSettings.MaxScale = std::min(std::max(mSettings.MaxScale, mSettings.MinScale), 1.0f);
+	mSettings.Granularity = std::max(mSettings.Granularity, 1u);
+	Reset();
+}
+
+const DynamicResolution::Settings& DynamicResolution::GetSettings()const
+{
+	return mSettings;
+}
+
+void DynamicResolution::Reset()
+{
+	mPixels = double(mSettings.MaxScale) * mSettings.MaxScale;
+	mSmoothedMs = 0.0;
+	mError = 0.0;
+	mPreviousError = 0.0;
+	mFrames = 0;
+}
+
+float DynamicResolution::Update(double frameMs)
+{
+	if (!(frameMs > 0.0) || !(mSettings.TargetMs > 0.0))
+		return GetScale();
+
+	mSmoothedMs = mFrames == 0 ? frameMs : mSmoothedMs + (frameMs - mSmoothedMs) * mSettings.Smoothing;
+	mFrames++;
+
+	double error = (mSettings.TargetMs - mSmoothedMs) / mSettings.TargetMs;
+	if (std::abs(error) < mSettings.DeadBand)
+		error = 0.0;
+
+	// The first frames have no history for the proportional and derivative terms.
+	double change = mSettings.Ki * error;
+	if (mFrames > 1)
+		change += mSettings.Kp * (error - mError);
+	if (mFrames > 2)
+		change += mSettings.Kd * (error - 2.0 * mError + mPreviousError);
+	mPreviousError = mError;
+	mError = error;
+
+	// At most halve or double the pixels per frame, however far off the time is.
+	change = std::min(std::max(change, -0.5), 1.0);
+	double minPixels = double(mSettings.MinScale) * mSettings.MinScale;
+	double maxPixels = double(mSettings.MaxScale) * mSettings.MaxScale;
+	mPixels = std::min(std::max(mPixels * (1.0 + change), minPixels), maxPixels);
+	return GetScale();
+}
+
+float DynamicResolution::GetScale()const
+{
+	return float(std::sqrt(mPixels));
+}
+
+double DynamicResolution::GetSmoothedMs()const
+{
+	return mSmoothedMs;
+}
+
+uint32_t DynamicResolution::GetScaledSize(uint32_t size)const
+{
+	if (mPixels >= 1.0)
+		return size;
+	uint32_t granularity = mSettings.Granularity;
+	uint32_t scaled = uint32_t(size * GetScale()) / granularity * granularity;
+	return std::min(std::max(scaled, granularity), size);
+}
@@ -0,0 +1,66 @@
+//
+// DynamicResolution.h - Render scale controller driven by measured frame times
+//
+
+#pragma once
+
+#include <stdint.h>
+
+// Picks the fraction of the output size the scene is rendered at, so that the measured
+// frame time stays at a target. Frame time grows roughly with the number of pixels, so
+// the controller works on the pixel fraction (the square of the scale) and changes it in
+// proportion to itself; how fast it settles then does not depend on what a pixel costs.
+//
+// The change per frame comes from a PID controller in velocity form on the headroom,
+// (target - time) / target, of the smoothed frame time: the integral term walks the
+// scale to the target, the proportional term reacts to steps and the derivative term
+// damps overshoot. The velocity form keeps no integrator that could wind up while the
+// scale sits at a limit. Headroom within DeadBand leaves the scale alone, so it does not
+// hunt around the target.
+//
+// Per frame:
+//     controller.Update(frameMs);
+//     uint32_t width = controller.GetScaledSize(outputWidth);
+class DynamicResolution
+{
+public:
+	struct Settings
+	{
+		double TargetMs = 16.0;
+		float MinScale = 0.5f;			// of the output width and height
+		float MaxScale = 1.0f;
+		double Kp = 0.3;				// gains per frame, on the headroom
+		double Ki = 0.15;
+		double Kd = 0.05;
+		double DeadBand = 0.05;			// of TargetMs
+		double Smoothing = 0.25;			// weight of the newest frame time
+		uint32_t Granularity = 8;		// scaled sizes are multiples of it
+	};
+
+	DynamicResolution();
+	explicit DynamicResolution(const Settings& settings);
+
+	// Also resets the controller.
+	void SetSettings(const Settings& settings);
+	const Settings& GetSettings()const;
+
+	// Back to MaxScale, forgetting the measured times.
+	void Reset();
+
+	// One measured frame; returns the scale for the next one.
+	float Update(double frameMs);
+
+	float GetScale()const;
+	double GetSmoothedMs()const;
+	// size * scale, rounded down to the granularity, within [granularity, size]; size
+	// itself at a scale of 1.
+	uint32_t GetScaledSize(uint32_t size)const;
+
+private:
+	Settings mSettings;
+	double mPixels;			// fraction of the output pixels, the scale squared
+	double mSmoothedMs;
+	double mError;			// headroom of the last two frames
+	double mPreviousError;
+	uint32_t mFrames;
+};
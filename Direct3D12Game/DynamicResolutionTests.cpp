@@ -0,0 +1,203 @@
+//
+// DynamicResolutionTests.cpp
+//
+
+#include "DynamicResolution.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// A GPU whose frame time is a fixed part plus a part in proportion to the pixels
+	// drawn, with optional noise.
+	struct SyntheticGpu
+	{
+		double FixedMs = 2.0;
+		double FullResolutionMs = 24.0;	// of the pixel part, at a scale of 1
+		double Noise = 0.0;				// relative, uniform
+		std::mt19937 Random{ 7 };
+
+		double FrameMs(float scale)
+		{
+			double ms = FixedMs + FullResolutionMs * double(scale) * scale;
+			if (Noise > 0.0)
+				ms *= 1.0 + Noise * (std::uniform_real_distribution<double>(-1.0, 1.0)(Random));
+			return ms;
+		}
+	};
+
+	struct Trace
+	{
+		std::vector<float> Scales;
+		std::vector<double> Times;
+	};
+
+	Trace Run(DynamicResolution& controller, SyntheticGpu& gpu, int frames)
+	{
+		Trace trace;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			double ms = gpu.FrameMs(controller.GetScale());
+			trace.Times.push_back(ms);
+			trace.Scales.push_back(controller.Update(ms));
+		}
+		return trace;
+	}
+
+	// First frame from which every frame time stays within tolerance of the target.
+	int SettledAt(const Trace& trace, double targetMs, double tolerance)
+	{
+		int settled = int(trace.Times.size());
+		for (int i = int(trace.Times.size()) - 1; i >= 0; --i)
+		{
+			if (std::abs(trace.Times[i] - targetMs) > targetMs * tolerance)
+				break;
+			settled = i;
+		}
+		return settled;
+	}
+
+	int DirectionChanges(const Trace& trace, size_t first)
+	{
+		int changes = 0;
+		int direction = 0;
+		for (size_t i = first + 1; i < trace.Scales.size(); ++i)
+		{
+			int next = trace.Scales[i] > trace.Scales[i - 1] ? 1 : trace.Scales[i] < trace.Scales[i - 1] ? -1 : 0;
+			if (next != 0 && direction != 0 && next != direction)
+				changes++;
+			if (next != 0)
+				direction = next;
+		}
+		return changes;
+	}
+}
+
+SELF_TEST(DynamicResolution, SettlesOnTheTarget)
+{
+	// 26 ms at full resolution against a 16 ms target: the pixel fraction that fits is
+	// 14 / 24, a scale of about 0.76.
+	DynamicResolution controller;
+	SyntheticGpu gpu;
+	Trace trace = Run(controller, gpu, 300);
+
+	int settled = SettledAt(trace, 16.0, 0.08);
+	double undershoot = *std::min_element(trace.Scales.begin(), trace.Scales.end());
+	context.Log("settled within 8%% after %d frames at scale %.3f, %.2f ms; lowest scale %.3f, %d reversals after settling",
+		settled, trace.Scales.back(), trace.Times.back(), undershoot, DirectionChanges(trace, settled));
+	SELF_CHECK(settled < 60);
+	SELF_CHECK(std::abs(trace.Times.back() - 16.0) <= 16.0 * controller.GetSettings().DeadBand * 1.5);
+	SELF_CHECK(undershoot > 0.6f);
+	SELF_CHECK(DirectionChanges(trace, settled) <= 2);
+}
+
+SELF_TEST(DynamicResolution, FollowsLoadSteps)
+{
+	// The scene gets twice as expensive, then back to where it was.
+	DynamicResolution controller;
+	SyntheticGpu gpu;
+	gpu.FullResolutionMs = 12.0;
+	Trace before = Run(controller, gpu, 100);
+	SELF_CHECK(before.Scales.back() == 1.0f);
+
+	gpu.FullResolutionMs = 24.0;
+	Trace heavy = Run(controller, gpu, 200);
+	int settledHeavy = SettledAt(heavy, 16.0, 0.08);
+
+	gpu.FullResolutionMs = 12.0;
+	Trace light = Run(controller, gpu, 200);
+	auto full = std::find(light.Scales.begin(), light.Scales.end(), 1.0f);
+	int backToFull = int(full - light.Scales.begin());
+
+	context.Log("step up: settled after %d frames at scale %.3f; step down: full resolution after %d frames",
+		settledHeavy, heavy.Scales.back(), backToFull);
+	SELF_CHECK(settledHeavy < 60);
+	SELF_CHECK(backToFull < 60);
+	SELF_CHECK(light.Scales.back() == 1.0f);
+}
+
+SELF_TEST(DynamicResolution, LimitsWithoutWindup)
+{
+	// Far too heavy: the scale rests on MinScale, and recovers right away once the load
+	// goes, without first unwinding an integrator.
+	DynamicResolution controller;
+	SyntheticGpu gpu;
+	gpu.FullResolutionMs = 200.0;
+	Trace heavy = Run(controller, gpu, 500);
+	SELF_CHECK(heavy.Scales.back() == controller.GetSettings().MinScale);
+	SELF_CHECK(heavy.Scales[20] == controller.GetSettings().MinScale);
+
+	gpu.FullResolutionMs = 18.0;
+	Trace light = Run(controller, gpu, 200);
+	auto rising = std::find_if(light.Scales.begin(), light.Scales.end(), [&](float scale)
+	{
+		return scale > controller.GetSettings().MinScale;
+	});
+	int recovered = SettledAt(light, 16.0, 0.08);
+	context.Log("rising after %d frames, settled after %d at scale %.3f", int(rising - light.Scales.begin()),
+		recovered, light.Scales.back());
+	SELF_CHECK(rising - light.Scales.begin() < 10);
+	SELF_CHECK(recovered < 60);
+
+	// Far too light: it stays at full resolution, at the output size itself.
+	controller.Reset();
+	gpu.FullResolutionMs = 4.0;
+	Run(controller, gpu, 100);
+	SELF_CHECK(controller.GetScale() == 1.0f);
+	SELF_CHECK(controller.GetScaledSize(1283) == 1283);
+}
+
+SELF_TEST(DynamicResolution, IgnoresNoise)
+{
+	// Frame times jittering by 10% around the target move the scale little.
+	DynamicResolution controller;
+	SyntheticGpu gpu;
+	gpu.Noise = 0.1;
+	Trace trace = Run(controller, gpu, 1000);
+
+	double sum = 0.0, squares = 0.0;
+	const size_t first = 200;
+	for (size_t i = first; i < trace.Scales.size(); ++i)
+	{
+		sum += trace.Scales[i];
+		squares += double(trace.Scales[i]) * trace.Scales[i];
+	}
+	double count = double(trace.Scales.size() - first);
+	double mean = sum / count;
+	double deviation = std::sqrt(std::max(squares / count - mean * mean, 0.0));
+	context.Log("scale %.3f +- %.4f with 10%% noise", mean, deviation);
+	SELF_CHECK(std::abs(mean - std::sqrt(14.0 / 24.0)) < 0.05);
+	SELF_CHECK(deviation < 0.03);
+}
+
+SELF_TEST(DynamicResolution, SettingsAndSizes)
+{
+	DynamicResolution::Settings settings;
+	settings.MinScale = -1.0f;
+	settings.MaxScale = 2.0f;
+	settings.Granularity = 0;
+	DynamicResolution controller(settings);
+	SELF_CHECK(controller.GetSettings().MinScale == 0.01f);
+	SELF_CHECK(controller.GetSettings().MaxScale == 1.0f);
+	SELF_CHECK(controller.GetSettings().Granularity == 1);
+
+	// Invalid frame times are ignored.
+	SELF_CHECK(controller.Update(0.0) == 1.0f);
+	SELF_CHECK(controller.Update(-5.0) == 1.0f);
+	SELF_CHECK(controller.Update(std::nan("")) == 1.0f);
+	SELF_CHECK(controller.GetSmoothedMs() == 0.0);
+
+	// Scaled sizes are multiples of the granularity, at least one step and at most the size.
+	settings = DynamicResolution::Settings();
+	settings.MaxScale = 0.5f;
+	controller.SetSettings(settings);
+	SELF_CHECK(controller.GetScale() == 0.5f);
+	SELF_CHECK(controller.GetScaledSize(1280) == 640);
+	SELF_CHECK(controller.GetScaledSize(1270) == 632);
+	SELF_CHECK(controller.GetScaledSize(10) == 8);
+	SELF_CHECK(controller.GetScaledSize(4) == 4);
+}
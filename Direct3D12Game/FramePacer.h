@@ -0,0 +1,207 @@
+//
+// FramePacer.h - Frame rate limiter that sleeps then spins to a target rate
+//
+
+#pragma once
+
+#include <thread>
+
+#include "StepTimer.h"
+
+namespace DX
+{
+    // Waiting primitives used by BasicFramePacer. SleepFor gives the CPU away for about the
+    // given time in clock units (the OS may oversleep), Relax is one iteration of the final
+    // spin. The generic versions use the standard library; specific clocks can overload them.
+    template<typename TClock>
+    void SleepFor(TClock& clock, uint64_t units)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(units * 1000000000 / clock.GetFrequency()));
+    }
+
+    template<typename TClock>
+    void Relax(TClock&)
+    {
+        std::this_thread::yield();
+    }
+
+#if defined(_WIN32)
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+    // A high resolution waitable timer (Windows 10 1803+) wakes up within a fraction of a
+    // millisecond instead of at the next scheduler tick; older systems use a regular one.
+    inline void SleepFor(QpcClock& clock, uint64_t units)
+    {
+        struct Timer
+        {
+            Timer()
+            {
+                handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+                if (!handle)
+                {
+                    handle = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+                }
+            }
+            ~Timer()
+            {
+                if (handle)
+                {
+                    CloseHandle(handle);
+                }
+            }
+            HANDLE handle;
+        };
+        static thread_local Timer timer;
+
+        // Negative due times are relative, in 100 ns units.
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -static_cast<LONGLONG>(units * 10000000 / clock.GetFrequency());
+        if (timer.handle && SetWaitableTimer(timer.handle, &dueTime, 0, nullptr, nullptr, FALSE))
+        {
+            WaitForSingleObject(timer.handle, INFINITE);
+        }
+        else
+        {
+            Sleep(static_cast<DWORD>(units * 1000 / clock.GetFrequency()));
+        }
+    }
+#endif
+
+    // Time only passes on a manual clock when the pacer waits, so the limiter can be
+    // driven deterministically. Each spin iteration counts as one microsecond.
+    inline void SleepFor(ManualClock& clock, uint64_t units)
+    {
+        clock.Advance(units);
+    }
+
+    inline void Relax(ManualClock& clock)
+    {
+        clock.Advance(std::max(uint64_t(1), clock.GetFrequency() / 1000000));
+    }
+
+    // Limits the frame rate without burning a core: Wait() sleeps until shortly before the
+    // next frame is due and spins for the rest, which is cheap and still accurate even with
+    // a coarse OS sleep. Deadlines advance by exactly one period, so the average rate
+    // matches the target; after falling more than a frame behind the schedule restarts
+    // instead of rushing frames to catch up.
+    template<typename TClock>
+    class BasicFramePacer
+    {
+    public:
+        explicit BasicFramePacer(const TClock& clock = TClock()) :
+            m_clock(clock),
+            m_period(0),
+            m_spinThreshold(0),
+            m_nextFrame(0),
+            m_scheduled(false),
+            m_lastSleep(0),
+            m_lastSpin(0),
+            m_missedFrames(0)
+        {
+            SetSpinThresholdSeconds(0.002);
+        }
+
+        TClock& GetClock()                                  { return m_clock; }
+        const TClock& GetClock() const                      { return m_clock; }
+
+        // Frames per second to pace to; 0 disables the limiter.
+        void SetTargetRate(double framesPerSecond)
+        {
+            uint64_t period = framesPerSecond > 0.0 ?
+                static_cast<uint64_t>(m_clock.GetFrequency() / framesPerSecond) : 0;
+            if (period != m_period)
+            {
+                m_period = period;
+                m_scheduled = false;
+            }
+        }
+
+        double GetTargetRate() const
+        {
+            return m_period ? static_cast<double>(m_clock.GetFrequency()) / m_period : 0.0;
+        }
+
+        // Time before a deadline below which Wait spins instead of sleeping. It should cover
+        // the usual oversleep of the OS timer.
+        void SetSpinThresholdSeconds(double seconds)
+        {
+            m_spinThreshold = static_cast<uint64_t>(seconds * m_clock.GetFrequency());
+        }
+
+        // Forget the schedule, e.g. after a pause; the next Wait returns immediately.
+        void Reset()                                        { m_scheduled = false; }
+
+        // Block until the next frame is due.
+        void Wait()
+        {
+            m_lastSleep = 0;
+            m_lastSpin = 0;
+            if (m_period == 0)
+            {
+                return;
+            }
+
+            uint64_t now = m_clock.GetTime();
+            if (!m_scheduled || now >= m_nextFrame + m_period)
+            {
+                if (m_scheduled)
+                {
+                    m_missedFrames++;
+                }
+                m_nextFrame = now + m_period;
+                m_scheduled = true;
+                return;
+            }
+
+            if (now < m_nextFrame)
+            {
+                uint64_t remaining = m_nextFrame - now;
+                if (remaining > m_spinThreshold)
+                {
+                    SleepFor(m_clock, remaining - m_spinThreshold);
+                    uint64_t woken = m_clock.GetTime();
+                    m_lastSleep = woken - now;
+                    now = woken;
+                }
+
+                uint64_t spinStart = now;
+                while (now < m_nextFrame)
+                {
+                    Relax(m_clock);
+                    now = m_clock.GetTime();
+                }
+                m_lastSpin = now - spinStart;
+            }
+
+            m_nextFrame += m_period;
+        }
+
+        // Time the last Wait spent sleeping and spinning, and the number of frames that
+        // started more than a full period late.
+        double GetLastSleepSeconds() const                  { return static_cast<double>(m_lastSleep) / m_clock.GetFrequency(); }
+        double GetLastSpinSeconds() const                   { return static_cast<double>(m_lastSpin) / m_clock.GetFrequency(); }
+        uint64_t GetMissedFrames() const                    { return m_missedFrames; }
+
+    private:
+        TClock m_clock;
+
+        // Pacing state in clock units.
+        uint64_t m_period;
+        uint64_t m_spinThreshold;
+        uint64_t m_nextFrame;
+        bool m_scheduled;
+
+        // Statistics.
+        uint64_t m_lastSleep;
+        uint64_t m_lastSpin;
+        uint64_t m_missedFrames;
+    };
+
+#if defined(_WIN32)
+    using FramePacer = BasicFramePacer<QpcClock>;
+#else
+    using FramePacer = BasicFramePacer<SteadyClock>;
+#endif
+}
@@ -0,0 +1,161 @@
+//
+// FramePacerTests.cpp
+//
+
+#include "FramePacer.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	using ManualPacer = DX::BasicFramePacer<DX::ManualClock>;
+	const uint64_t c_ticksPerMs = 10000;
+
+	// A manual clock whose sleeps overshoot like a coarse OS timer.
+	class OversleepingClock : public DX::ManualClock
+	{
+	public:
+		uint64_t Oversleep = 15000;
+	};
+
+	void SleepFor(OversleepingClock& clock, uint64_t units)
+	{
+		clock.Advance(units + clock.Oversleep);
+	}
+
+	void Relax(OversleepingClock& clock)
+	{
+		clock.Advance(10);
+	}
+}
+
+SELF_TEST(FramePacer, HitsTargetRate)
+{
+	// Ten seconds at 60 Hz with 3 ms of work per frame.
+	ManualPacer pacer;
+	pacer.SetTargetRate(60.0);
+	const uint64_t period = pacer.GetClock().GetFrequency() / 60;
+
+	pacer.Wait();
+	uint64_t start = pacer.GetClock().GetTime();
+	bool onTime = true;
+	bool splitWait = true;
+	for (int frame = 1; frame <= 600; ++frame)
+	{
+		pacer.GetClock().Advance(3 * c_ticksPerMs);
+		pacer.Wait();
+		onTime = onTime && pacer.GetClock().GetTime() - start == frame * period;
+
+		// Sleep until the spin threshold, then spin the last 2 ms.
+		splitWait = splitWait &&
+			fabs(pacer.GetLastSleepSeconds() - (double(period) / 1e7 - 0.003 - 0.002)) < 1e-6 &&
+			fabs(pacer.GetLastSpinSeconds() - 0.002) < 1e-6;
+	}
+
+	SELF_CHECK(onTime);
+	SELF_CHECK(splitWait);
+	SELF_CHECK(pacer.GetMissedFrames() == 0);
+	SELF_CHECK(pacer.GetTargetRate() > 59.999 && pacer.GetTargetRate() < 60.001);
+}
+
+SELF_TEST(FramePacer, LateFramesRestartSchedule)
+{
+	ManualPacer pacer;
+	pacer.SetTargetRate(100.0);
+	const uint64_t period = 10 * c_ticksPerMs;
+	pacer.Wait();
+
+	// Slightly late: the next deadline still follows the schedule, so the rate evens out.
+	pacer.GetClock().Advance(period + 2 * c_ticksPerMs);
+	uint64_t before = pacer.GetClock().GetTime();
+	pacer.Wait();
+	SELF_CHECK(pacer.GetClock().GetTime() == before);
+	pacer.GetClock().Advance(c_ticksPerMs);
+	pacer.Wait();
+	SELF_CHECK(pacer.GetClock().GetTime() == 2 * period);
+	SELF_CHECK(pacer.GetMissedFrames() == 0);
+
+	// A stall of several frames restarts the schedule instead of rushing frames after it.
+	pacer.GetClock().Advance(55 * c_ticksPerMs);
+	pacer.Wait();
+	uint64_t restart = pacer.GetClock().GetTime();
+	SELF_CHECK(pacer.GetMissedFrames() == 1);
+	for (int frame = 1; frame <= 5; ++frame)
+	{
+		pacer.Wait();
+		SELF_CHECK(pacer.GetClock().GetTime() == restart + frame * period);
+	}
+}
+
+SELF_TEST(FramePacer, DisabledAndRateChanges)
+{
+	ManualPacer pacer;
+	pacer.Wait();
+	pacer.Wait();
+	SELF_CHECK(pacer.GetClock().GetTime() == 0);
+	SELF_CHECK(pacer.GetTargetRate() == 0.0);
+
+	// A new rate starts a new schedule from the next Wait.
+	pacer.SetTargetRate(50.0);
+	pacer.Wait();
+	SELF_CHECK(pacer.GetClock().GetTime() == 0);
+	pacer.Wait();
+	SELF_CHECK(pacer.GetClock().GetTime() == 20 * c_ticksPerMs);
+	pacer.SetTargetRate(10.0);
+	pacer.Wait();
+	SELF_CHECK(pacer.GetClock().GetTime() == 20 * c_ticksPerMs);
+	pacer.Wait();
+	SELF_CHECK(pacer.GetClock().GetTime() == 120 * c_ticksPerMs);
+}
+
+SELF_TEST(FramePacer, SpinCoversOversleep)
+{
+	// A spin threshold above the oversleep hits every deadline exactly; one below it
+	// wakes up late, but the deadlines keep the average rate.
+	for (double threshold : { 0.002, 0.0005 })
+	{
+		DX::BasicFramePacer<OversleepingClock> pacer;
+		pacer.SetTargetRate(60.0);
+		pacer.SetSpinThresholdSeconds(threshold);
+		const uint64_t period = pacer.GetClock().GetFrequency() / 60;
+
+		pacer.Wait();
+		uint64_t start = pacer.GetClock().GetTime();
+		uint64_t latest = 0;
+		for (int frame = 1; frame <= 120; ++frame)
+		{
+			pacer.Wait();
+			latest = std::max(latest, pacer.GetClock().GetTime() - start - frame * period);
+		}
+
+		context.Log("threshold %.1f ms: up to %.2f ms late", threshold * 1000.0, double(latest) / c_ticksPerMs);
+		if (threshold > 0.0015)
+			SELF_CHECK(latest < 10);
+		else
+			SELF_CHECK(latest >= c_ticksPerMs && latest < 2 * c_ticksPerMs);
+		SELF_CHECK(pacer.GetMissedFrames() == 0);
+	}
+}
+
+SELF_TEST(FramePacer, SteadyClockRate)
+{
+	// 30 frames at 200 Hz on the real clock, mostly asleep.
+	DX::BasicFramePacer<DX::SteadyClock> pacer;
+	pacer.SetTargetRate(200.0);
+	pacer.Wait();
+	auto start = std::chrono::steady_clock::now();
+	double slept = 0.0;
+	for (int frame = 0; frame < 30; ++frame)
+	{
+		pacer.Wait();
+		slept += pacer.GetLastSleepSeconds();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	context.Log("30 frames in %.1f ms, %.1f ms of it asleep", seconds * 1000.0, slept * 1000.0);
+	SELF_CHECK(seconds >= 0.149 && seconds < 0.5);
+	SELF_CHECK(slept > 0.05);
+}
@@ -0,0 +1,188 @@
+//
+// FramePipeline.h - Producer thread running one frame ahead of the consumer
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <stdint.h>
+#include <thread>
+
+#include "TripleBuffer.h"
+
+namespace DX
+{
+    // Runs a producer (the simulation) on its own thread, pipelined with a consumer (the
+    // renderer): while the consumer works on packet N, the producer builds packet N + 1.
+    // The producer starts the next packet only once the consumer took the last one, so it
+    // never runs more than one frame ahead and follows the consumer's pace.
+    //
+    // Packets travel through a DX::TripleBuffer, whose publish/acquire is the whole
+    // handoff: neither side takes a lock, and a side that has to wait yields and then
+    // sleeps briefly. The producer writes into a recycled slot and must set every field
+    // of T. Exceptions thrown by the producer stop it and are rethrown to the consumer
+    // from Acquire.
+    template<typename T>
+    class FramePipeline
+    {
+    public:
+        FramePipeline() :
+            m_running(false),
+            m_failed(false),
+            m_acquired(0),
+            m_lastLatency(0.0),
+            m_lastProduce(0.0)
+        {
+        }
+
+        FramePipeline(const FramePipeline&) = delete;
+        FramePipeline& operator=(const FramePipeline&) = delete;
+
+        ~FramePipeline()
+        {
+            Stop();
+        }
+
+        // Start the producer thread; produce(T&) is called on it once per packet.
+        void Start(std::function<void(T&)> produce)
+        {
+            Stop();
+
+            // Drop a packet the last run published but nobody took.
+            m_buffers.Acquire();
+
+            m_produce = std::move(produce);
+            m_error = nullptr;
+            m_failed.store(false, std::memory_order_relaxed);
+            m_acquired.store(0, std::memory_order_relaxed);
+            m_running.store(true, std::memory_order_relaxed);
+            m_thread = std::thread([this]() { Run(); });
+        }
+
+        // Stop the producer after the packet it is working on and wait for the thread.
+        void Stop()
+        {
+            m_running.store(false, std::memory_order_relaxed);
+            if (m_thread.joinable())
+            {
+                m_thread.join();
+            }
+        }
+
+        // Consumer: wait up to timeout for a packet newer than the current one and let the
+        // producer start on the next. Returns false on timeout.
+        bool Acquire(std::chrono::milliseconds timeout)
+        {
+            auto deadline = Clock::now() + timeout;
+            uint32_t attempt = 0;
+            while (!m_buffers.Acquire())
+            {
+                if (m_failed.load(std::memory_order_acquire))
+                {
+                    m_failed.store(false, std::memory_order_relaxed);
+                    std::exception_ptr error = m_error;
+                    m_error = nullptr;
+                    std::rethrow_exception(error);
+                }
+                if (Clock::now() >= deadline)
+                {
+                    return false;
+                }
+                Backoff(attempt);
+            }
+
+            const Packet& packet = m_buffers.ReadBuffer();
+            m_acquired.store(packet.Frame, std::memory_order_release);
+            m_lastLatency = std::chrono::duration<double>(Clock::now() - packet.Published).count();
+            m_lastProduce = packet.ProduceSeconds;
+            return true;
+        }
+
+        // Consumer: the last acquired packet and its sequence number (starting at 1).
+        const T& Current() const                            { return m_buffers.ReadBuffer().State; }
+        uint64_t GetCurrentFrame() const                    { return m_buffers.ReadBuffer().Frame; }
+
+        // Consumer: time from publishing the current packet to acquiring it, and the time
+        // the producer spent building it.
+        double GetLastLatencySeconds() const                { return m_lastLatency; }
+        double GetLastProduceSeconds() const                { return m_lastProduce; }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Packet
+        {
+            T State;
+            uint64_t Frame = 0;
+            double ProduceSeconds = 0.0;
+            Clock::time_point Published;
+        };
+
+        // The other side is usually less than a frame away: yield at first, then sleep so
+        // a long wait does not burn a core.
+        static void Backoff(uint32_t& attempt)
+        {
+            if (attempt++ < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+
+        void Run()
+        {
+            uint64_t frame = 0;
+            while (m_running.load(std::memory_order_relaxed))
+            {
+                Packet& packet = m_buffers.WriteBuffer();
+                auto start = Clock::now();
+                try
+                {
+                    m_produce(packet.State);
+                }
+                catch (...)
+                {
+                    m_error = std::current_exception();
+                    m_failed.store(true, std::memory_order_release);
+                    return;
+                }
+                packet.Frame = ++frame;
+                packet.Published = Clock::now();
+                packet.ProduceSeconds = std::chrono::duration<double>(packet.Published - start).count();
+                m_buffers.Publish();
+
+                // Build the next packet only after the consumer took this one.
+                uint32_t attempt = 0;
+                while (m_acquired.load(std::memory_order_acquire) != frame)
+                {
+                    if (!m_running.load(std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                    Backoff(attempt);
+                }
+            }
+        }
+
+        TripleBuffer<Packet> m_buffers;
+        std::function<void(T&)> m_produce;
+        std::thread m_thread;
+
+        // Handshake between the threads. m_error is written by the producer before it
+        // sets m_failed, and read by the consumer after it saw it set.
+        std::atomic<bool> m_running;
+        std::atomic<bool> m_failed;
+        std::atomic<uint64_t> m_acquired;
+        std::exception_ptr m_error;
+
+        // Consumer side statistics.
+        double m_lastLatency;
+        double m_lastProduce;
+    };
+}
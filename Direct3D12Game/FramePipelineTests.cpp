@@ -0,0 +1,180 @@
+//
+// FramePipelineTests.cpp
+//
+
+#include "FramePipeline.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Stand-in for Game::RenderState: the simulation writes its step count into every
+	// field, so a packet mixing two steps shows up.
+	struct StubState
+	{
+		uint64_t Step = 0;
+		double Angle = 0.0;
+		double Position[16] = {};
+	};
+
+	void Simulate(StubState& state, uint64_t step)
+	{
+		state.Step = step;
+		state.Angle = double(step);
+		for (double& value : state.Position)
+			value = double(step);
+	}
+
+	bool IsConsistent(const StubState& state)
+	{
+		if (state.Angle != double(state.Step))
+			return false;
+		for (double value : state.Position)
+		{
+			if (value != double(state.Step))
+				return false;
+		}
+		return true;
+	}
+
+	// Busy work standing in for a simulation step or for recording a frame.
+	void Work(double seconds)
+	{
+		auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+		while (Clock::now() < end)
+		{
+		}
+	}
+}
+
+SELF_TEST(FramePipeline, PacketsArriveInOrderOneAhead)
+{
+	DX::FramePipeline<StubState> pipeline;
+	std::atomic<uint64_t> produced(0);
+	pipeline.Start([&](StubState& state)
+	{
+		Simulate(state, ++produced);
+	});
+
+	// Every packet reaches the consumer, in order and complete, and the producer is never
+	// more than the one packet it is building ahead.
+	bool ordered = true;
+	bool consistent = true;
+	bool oneAhead = true;
+	bool timedOut = false;
+	for (uint64_t frame = 1; frame <= 2000; ++frame)
+	{
+		if (!pipeline.Acquire(std::chrono::milliseconds(1000)))
+		{
+			timedOut = true;
+			break;
+		}
+		ordered = ordered && pipeline.GetCurrentFrame() == frame && pipeline.Current().Step == frame;
+		consistent = consistent && IsConsistent(pipeline.Current());
+		oneAhead = oneAhead && produced.load() <= frame + 1;
+	}
+	pipeline.Stop();
+
+	SELF_CHECK(!timedOut);
+	SELF_CHECK(ordered);
+	SELF_CHECK(consistent);
+	SELF_CHECK(oneAhead);
+	SELF_CHECK(produced.load() <= 2001);
+	SELF_CHECK(pipeline.GetLastLatencySeconds() >= 0.0);
+}
+
+SELF_TEST(FramePipeline, TimeoutAndProducerErrors)
+{
+	DX::FramePipeline<StubState> pipeline;
+	uint64_t step = 0;
+	pipeline.Start([&](StubState& state)
+	{
+		if (++step == 3)
+		{
+			// A slow step, then a failing one.
+			Work(0.05);
+			throw std::runtime_error("simulation failed");
+		}
+		Simulate(state, step);
+	});
+
+	SELF_CHECK(pipeline.Acquire(std::chrono::milliseconds(1000)));
+	SELF_CHECK(pipeline.Acquire(std::chrono::milliseconds(1000)));
+	SELF_CHECK(!pipeline.Acquire(std::chrono::milliseconds(1)));
+	SELF_CHECK(pipeline.Current().Step == 2);
+
+	bool threw = false;
+	try
+	{
+		pipeline.Acquire(std::chrono::milliseconds(1000));
+	}
+	catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	SELF_CHECK(threw);
+	SELF_CHECK(!pipeline.Acquire(std::chrono::milliseconds(1)));
+
+	// A restart begins a new sequence.
+	step = 10;
+	pipeline.Start([&](StubState& state) { Simulate(state, ++step); });
+	SELF_CHECK(pipeline.Acquire(std::chrono::milliseconds(1000)));
+	SELF_CHECK(pipeline.GetCurrentFrame() == 1 && pipeline.Current().Step == 11);
+}
+
+SELF_BENCHMARK(FramePipeline, SimulationAndRenderThreads)
+{
+	// A simulation step of 2 ms and a frame of 3 ms, run one after the other on one thread
+	// and pipelined on two. With a core for each, the pipelined frame rate is bound by the
+	// slower side only.
+	const double simulateSeconds = 0.002;
+	const double renderSeconds = 0.003;
+	const int frames = 300;
+
+	StubState serialState;
+	auto start = Clock::now();
+	for (int frame = 1; frame <= frames; ++frame)
+	{
+		Work(simulateSeconds);
+		Simulate(serialState, frame);
+		Work(renderSeconds);
+	}
+	double serial = std::chrono::duration<double>(Clock::now() - start).count();
+
+	DX::FramePipeline<StubState> pipeline;
+	uint64_t step = 0;
+	pipeline.Start([&](StubState& state)
+	{
+		Work(simulateSeconds);
+		Simulate(state, ++step);
+	});
+
+	double latency = 0.0;
+	double worstLatency = 0.0;
+	bool consistent = true;
+	start = Clock::now();
+	for (int frame = 1; frame <= frames; ++frame)
+	{
+		if (!SELF_CHECK(pipeline.Acquire(std::chrono::milliseconds(1000))))
+			return;
+		consistent = consistent && IsConsistent(pipeline.Current());
+		latency += pipeline.GetLastLatencySeconds();
+		worstLatency = std::max(worstLatency, pipeline.GetLastLatencySeconds());
+		Work(renderSeconds);
+	}
+	double pipelined = std::chrono::duration<double>(Clock::now() - start).count();
+	pipeline.Stop();
+
+	context.Log("%u hardware threads", std::thread::hardware_concurrency());
+	context.Log("serial:    %.0f frames/s (%.2f ms per frame)", frames / serial, serial * 1000.0 / frames);
+	context.Log("pipelined: %.0f frames/s (%.2f ms per frame), %.2fx", frames / pipelined, pipelined * 1000.0 / frames, serial / pipelined);
+	context.Log("publish to acquire latency: mean %.3f ms, worst %.3f ms", latency * 1000.0 / frames, worstLatency * 1000.0);
+	SELF_CHECK(consistent);
+}
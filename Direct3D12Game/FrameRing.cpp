@@ -0,0 +1,142 @@
+//
+// FrameRing.cpp
+//
+
+#include "FrameRing.h"
+
+#include "CpuProfiler.h"
+
+#include <cassert>
+
+FrameRing::FrameRing(IGpuFence& fence, uint32_t framesInFlight) :
+	mFence(fence),
+	mSlots(framesInFlight),
+	mFrameIndex(framesInFlight - 1),
+	mRecording(false)
+{
+	assert(framesInFlight > 0);
+}
+
+uint32_t FrameRing::BeginFrame()
+{
+	assert(!mRecording);
+
+	mFrameIndex = (mFrameIndex + 1) % uint32_t(mSlots.size());
+	Slot& slot = mSlots[mFrameIndex];
+
+	mStats.LastWaitSeconds = 0.0;
+	if (slot.Pending && slot.Fence > mFence.GetCompletedFence())
+	{
+		CPU_PROFILE_SCOPE("Wait for GPU fence");
+		auto start = Clock::now();
+		mFence.WaitForFence(slot.Fence);
+		mStats.LastWaitSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		mStats.FenceWaits++;
+	}
+
+	CollectCompleted(Clock::now());
+	mRecording = true;
+	return mFrameIndex;
+}
+
+void FrameRing::EndFrame()
+{
+	assert(mRecording);
+
+	Slot& slot = mSlots[mFrameIndex];
+	slot.Fence = mFence.Signal();
+	slot.Submitted = Clock::now();
+	slot.Pending = true;
+
+	uint64_t completed = mFence.GetCompletedFence();
+	uint32_t queued = 0;
+	for (auto& other : mSlots)
+	{
+		if (other.Pending && other.Fence > completed)
+			queued++;
+	}
+
+	mStats.FramesQueued = queued;
+	mStats.Frames++;
+	mRecording = false;
+}
+
+void FrameRing::WaitForIdle()
+{
+	mFence.WaitForFence(mFence.Signal());
+	CollectCompleted(Clock::now());
+}
+
+void FrameRing::CollectCompleted(Clock::time_point now)
+{
+	uint64_t completed = mFence.GetCompletedFence();
+	for (auto& slot : mSlots)
+	{
+		if (slot.Pending && slot.Fence <= completed)
+		{
+			slot.Pending = false;
+			mStats.LastGpuLatencySeconds = std::chrono::duration<double>(now - slot.Submitted).count();
+		}
+	}
+}
+
+uint32_t FrameRing::GetFrameIndex()const
+{
+	return mFrameIndex;
+}
+
+uint32_t FrameRing::GetFramesInFlight()const
+{
+	return uint32_t(mSlots.size());
+}
+
+const FrameRing::Stats& FrameRing::GetStats()const
+{
+	return mStats;
+}
+
+//
+// ManualGpuFence
+//
+
+uint64_t ManualGpuFence::Signal()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return ++mSignaled;
+}
+
+uint64_t ManualGpuFence::GetCompletedFence()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCompleted;
+}
+
+void ManualGpuFence::WaitForFence(uint64_t value)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (value > mCompleted)
+			mBlockingWaits++;
+	}
+	Complete(value);
+}
+
+void ManualGpuFence::Complete(uint64_t value)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	assert(value <= mSignaled);
+	if (value > mCompleted)
+		mCompleted = value;
+}
+
+uint64_t ManualGpuFence::GetSignaledFence()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mSignaled;
+}
+
+uint64_t ManualGpuFence::GetBlockingWaits()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBlockingWaits;
+}
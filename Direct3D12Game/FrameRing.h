@@ -0,0 +1,106 @@
+//
+// FrameRing.h - Fence bookkeeping for per-frame resources with several frames in flight
+//
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+// A monotonically increasing GPU fence on one queue.
+class IGpuFence
+{
+public:
+	virtual ~IGpuFence() = default;
+
+	// Fence value that completes once everything submitted so far has finished.
+	virtual uint64_t Signal() = 0;
+	virtual uint64_t GetCompletedFence()const = 0;
+	virtual void WaitForFence(uint64_t value) = 0;
+};
+
+// Ring of frame slots. Resources the CPU writes every frame (command allocators, upload
+// memory) are kept once per slot; a slot is only handed out again after the GPU passed
+// the fence of the frame that last used it, so the CPU can run up to FramesInFlight - 1
+// frames ahead of the GPU.
+//
+// Per frame:
+//     uint32_t slot = ring.BeginFrame();    // may wait for the GPU
+//     ... record and submit using the slot's resources ...
+//     ring.EndFrame();
+class FrameRing
+{
+public:
+	FrameRing(IGpuFence& fence, uint32_t framesInFlight);
+
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+
+	// Move to the next slot, waiting until the GPU is done with its last frame.
+	uint32_t BeginFrame();
+	// Fence the frame recorded since BeginFrame.
+	void EndFrame();
+
+	// Wait for everything submitted to the queue so far, inside the ring or not.
+	void WaitForIdle();
+
+	uint32_t GetFrameIndex()const;
+	uint32_t GetFramesInFlight()const;
+
+	struct Stats
+	{
+		uint64_t Frames = 0;				// EndFrame calls
+		uint64_t FenceWaits = 0;			// BeginFrame calls that had to wait for the GPU
+		double LastWaitSeconds = 0.0;		// time the last BeginFrame waited
+		uint32_t FramesQueued = 0;			// frames the GPU had not finished at the last EndFrame
+		// Time from EndFrame until the GPU was seen to finish the frame, for the last
+		// frame that finished. Completion is only checked in BeginFrame, so this is an
+		// upper bound with a granularity of one frame.
+		double LastGpuLatencySeconds = 0.0;
+	};
+	const Stats& GetStats()const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Slot
+	{
+		uint64_t Fence = 0;
+		Clock::time_point Submitted;
+		bool Pending = false;
+	};
+
+	void CollectCompleted(Clock::time_point now);
+
+	IGpuFence& mFence;
+	std::vector<Slot> mSlots;
+	uint32_t mFrameIndex;
+	bool mRecording;
+	Stats mStats;
+};
+
+// CPU stand-in for IGpuFence. Signal hands out increasing values; the simulated GPU only
+// finishes them when Complete or WaitForFence is called, so tests decide exactly when
+// the GPU catches up. Thread safe, like a real fence.
+class ManualGpuFence : public IGpuFence
+{
+public:
+	uint64_t Signal() override;
+	uint64_t GetCompletedFence()const override;
+	void WaitForFence(uint64_t value) override;
+
+	// Let the simulated GPU finish everything up to the fence value.
+	void Complete(uint64_t value);
+
+	uint64_t GetSignaledFence()const;
+	// WaitForFence calls that found the value not yet completed.
+	uint64_t GetBlockingWaits()const;
+
+private:
+	mutable std::mutex mMutex;
+	uint64_t mSignaled = 0;
+	uint64_t mCompleted = 0;
+	uint64_t mBlockingWaits = 0;
+};
@@ -0,0 +1,146 @@
+//
+// FrameRingTests.cpp
+//
+
+#include "FrameRing.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <vector>
+
+SELF_TEST(FrameRing, WaitsOnlyForTheSlotsLastFrame)
+{
+	ManualGpuFence fence;
+	FrameRing ring(fence, 3);
+	SELF_CHECK(ring.GetFramesInFlight() == 3);
+
+	// The CPU gets up to three frames ahead before it has to wait.
+	for (uint32_t frame = 0; frame < 3; ++frame)
+	{
+		SELF_CHECK(ring.BeginFrame() == frame);
+		ring.EndFrame();
+		SELF_CHECK(ring.GetStats().FramesQueued == frame + 1);
+	}
+	SELF_CHECK(ring.GetStats().FenceWaits == 0);
+	SELF_CHECK(fence.GetSignaledFence() == 3);
+
+	// Slot 0 still holds fence 1: waiting for it completes exactly that frame.
+	SELF_CHECK(ring.BeginFrame() == 0);
+	SELF_CHECK(ring.GetStats().FenceWaits == 1);
+	SELF_CHECK(fence.GetBlockingWaits() == 1);
+	SELF_CHECK(fence.GetCompletedFence() == 1);
+	ring.EndFrame();
+	SELF_CHECK(ring.GetStats().FramesQueued == 3);
+
+	// Once the GPU caught up by itself, the next slots are free.
+	fence.Complete(3);
+	SELF_CHECK(ring.BeginFrame() == 1);
+	ring.EndFrame();
+	SELF_CHECK(ring.BeginFrame() == 2);
+	ring.EndFrame();
+	SELF_CHECK(ring.GetStats().FenceWaits == 1);
+	SELF_CHECK(ring.GetStats().Frames == 6);
+
+	// Idle means every signaled fence completed, including ones outside the ring.
+	fence.Signal();
+	ring.WaitForIdle();
+	SELF_CHECK(fence.GetCompletedFence() == fence.GetSignaledFence());
+	SELF_CHECK(ring.GetFrameIndex() == 2);
+	SELF_CHECK(ring.BeginFrame() == 0);
+	SELF_CHECK(ring.GetStats().FenceWaits == 1);
+	ring.EndFrame();
+}
+
+namespace
+{
+	// A GPU on a simulated microsecond timeline: frames run one after another in submission
+	// order, each taking GpuMicroseconds. Waiting for a fence moves the time forward to
+	// when it finishes.
+	class SimulatedGpu : public ManualGpuFence
+	{
+	public:
+		uint64_t Now = 0;
+		uint64_t GpuMicroseconds = 0;
+		std::vector<uint64_t> Finish;	// by fence value - 1
+
+		uint64_t Signal() override
+		{
+			uint64_t value = ManualGpuFence::Signal();
+			uint64_t start = std::max(Now, Finish.empty() ? 0 : Finish.back());
+			Finish.push_back(start + GpuMicroseconds);
+			return value;
+		}
+
+		void WaitForFence(uint64_t value) override
+		{
+			ManualGpuFence::WaitForFence(value);
+			AdvanceTo(std::max(Now, Finish[value - 1]));
+		}
+
+		void AdvanceTo(uint64_t time)
+		{
+			Now = time;
+			uint64_t completed = GetCompletedFence();
+			while (completed < Finish.size() && Finish[completed] <= Now)
+				completed++;
+			Complete(completed);
+		}
+	};
+
+	struct Overlap
+	{
+		uint64_t FrameMicroseconds;		// between consecutive GPU finishes
+		uint64_t LatencyMicroseconds;	// from the CPU starting a frame to the GPU finishing it
+	};
+
+	Overlap Simulate(uint32_t framesInFlight, uint64_t cpuMicroseconds, uint64_t gpuMicroseconds)
+	{
+		SimulatedGpu gpu;
+		gpu.GpuMicroseconds = gpuMicroseconds;
+		FrameRing ring(gpu, framesInFlight);
+
+		const int frames = 50;
+		std::vector<uint64_t> starts;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			ring.BeginFrame();
+			starts.push_back(gpu.Now);
+			gpu.AdvanceTo(gpu.Now + cpuMicroseconds);
+			ring.EndFrame();
+		}
+
+		Overlap overlap;
+		overlap.FrameMicroseconds = gpu.Finish[frames - 1] - gpu.Finish[frames - 2];
+		overlap.LatencyMicroseconds = gpu.Finish[frames - 1] - starts[frames - 1];
+		return overlap;
+	}
+}
+
+SELF_TEST(FrameRing, FramesInFlightOverlap)
+{
+	// One frame in flight serializes CPU and GPU. Two overlap them fully; more only add
+	// latency when the GPU is the bottleneck, and nothing when the CPU is.
+	const uint64_t cpu = 10000;
+	const uint64_t gpu = 14000;
+	for (uint32_t framesInFlight = 1; framesInFlight <= 4; ++framesInFlight)
+	{
+		Overlap gpuBound = Simulate(framesInFlight, cpu, gpu);
+		Overlap cpuBound = Simulate(framesInFlight, gpu, cpu);
+		context.Log("%u in flight: GPU bound %.1f ms/frame, %.1f ms latency; CPU bound %.1f ms/frame, %.1f ms latency",
+			framesInFlight, gpuBound.FrameMicroseconds / 1000.0, gpuBound.LatencyMicroseconds / 1000.0,
+			cpuBound.FrameMicroseconds / 1000.0, cpuBound.LatencyMicroseconds / 1000.0);
+
+		if (framesInFlight == 1)
+		{
+			SELF_CHECK(gpuBound.FrameMicroseconds == cpu + gpu);
+			SELF_CHECK(cpuBound.FrameMicroseconds == cpu + gpu);
+		}
+		else
+		{
+			SELF_CHECK(gpuBound.FrameMicroseconds == gpu);
+			SELF_CHECK(gpuBound.LatencyMicroseconds == framesInFlight * gpu);
+			SELF_CHECK(cpuBound.FrameMicroseconds == gpu);
+		}
+		SELF_CHECK(cpuBound.LatencyMicroseconds == cpu + gpu);
+	}
+}
@@ -0,0 +1,276 @@
+//
+// FrameTimeStats.h - Frame time ring buffer and percentile histogram
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+namespace DX
+{
+    // Summary of the frame times recorded since the last Reset. Times are in milliseconds.
+    struct FrameTimeSummary
+    {
+        uint64_t Frames = 0;
+        uint64_t OverBudget = 0;        // frames longer than the budget
+        double BudgetMs = 0.0;
+        double MeanMs = 0.0;
+        double P50Ms = 0.0;
+        double P95Ms = 0.0;
+        double P99Ms = 0.0;
+        double MaxMs = 0.0;
+        double JitterMs = 0.0;          // mean absolute change between consecutive recent frames
+    };
+
+    // Records frame durations (in StepTimer ticks) from one thread and lets any thread
+    // query them without locks.
+    //
+    // The last RingSize durations are kept in a ring for pacing analysis and CSV dumps.
+    // All durations since Reset also go into an HDR style log-linear histogram: values
+    // are bucketed by microseconds with 32 sub-buckets per power of two, so percentiles
+    // are within ~3% from 1 us up to hours with a fixed amount of memory.
+    class FrameTimeStats
+    {
+    public:
+        static const uint32_t RingSize = 1024;
+        static const uint64_t TicksPerSecond = 10000000;
+
+        FrameTimeStats() :
+            m_budgetTicks(TicksPerSecond / 60)
+        {
+            Reset();
+        }
+
+        FrameTimeStats(const FrameTimeStats&) = delete;
+        FrameTimeStats& operator=(const FrameTimeStats&) = delete;
+
+        // Frames longer than the budget are counted as over budget.
+        void SetBudgetTicks(uint64_t ticks)                 { m_budgetTicks.store(ticks, std::memory_order_relaxed); }
+        uint64_t GetBudgetTicks() const                     { return m_budgetTicks.load(std::memory_order_relaxed); }
+
+        // Writer side, called once per frame.
+        void Record(uint64_t ticks)
+        {
+            uint64_t index = m_writeIndex.load(std::memory_order_relaxed);
+            m_ring[index % RingSize].store(ticks, std::memory_order_relaxed);
+            m_writeIndex.store(index + 1, std::memory_order_release);
+
+            m_buckets[BucketIndex(ticks / (TicksPerSecond / 1000000))].fetch_add(1, std::memory_order_relaxed);
+            m_totalTicks.fetch_add(ticks, std::memory_order_relaxed);
+            if (ticks > m_budgetTicks.load(std::memory_order_relaxed))
+            {
+                m_overBudget.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            uint64_t max = m_maxTicks.load(std::memory_order_relaxed);
+            if (ticks > max)
+            {
+                m_maxTicks.store(ticks, std::memory_order_relaxed);
+            }
+
+            m_frames.fetch_add(1, std::memory_order_release);
+        }
+
+        void Reset()
+        {
+            for (auto& bucket : m_buckets)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            m_frames.store(0, std::memory_order_relaxed);
+            m_totalTicks.store(0, std::memory_order_relaxed);
+            m_maxTicks.store(0, std::memory_order_relaxed);
+            m_overBudget.store(0, std::memory_order_relaxed);
+            m_resetIndex.store(m_writeIndex.load(std::memory_order_relaxed), std::memory_order_release);
+        }
+
+        // Copy the recent frame times (oldest first, at most RingSize) that were recorded
+        // since the last Reset. Entries overwritten while copying are dropped.
+        void GetRecent(std::vector<uint64_t>& ticks) const
+        {
+            uint64_t end = m_writeIndex.load(std::memory_order_acquire);
+            uint64_t begin = std::max(m_resetIndex.load(std::memory_order_acquire), end > RingSize ? end - RingSize : 0);
+
+            ticks.clear();
+            ticks.reserve(static_cast<size_t>(end - begin));
+            for (uint64_t i = begin; i < end; ++i)
+            {
+                ticks.push_back(m_ring[i % RingSize].load(std::memory_order_relaxed));
+            }
+
+            uint64_t written = m_writeIndex.load(std::memory_order_acquire);
+            uint64_t valid = written > RingSize ? written - RingSize : 0;
+            if (valid > begin)
+            {
+                ticks.erase(ticks.begin(), ticks.begin() + static_cast<size_t>(std::min(valid - begin, end - begin)));
+            }
+        }
+
+        FrameTimeSummary GetSummary() const
+        {
+            FrameTimeSummary summary;
+            summary.Frames = m_frames.load(std::memory_order_acquire);
+            summary.OverBudget = m_overBudget.load(std::memory_order_relaxed);
+            summary.BudgetMs = TicksToMs(GetBudgetTicks());
+            summary.MaxMs = TicksToMs(m_maxTicks.load(std::memory_order_relaxed));
+            if (summary.Frames == 0)
+            {
+                return summary;
+            }
+
+            summary.MeanMs = TicksToMs(m_totalTicks.load(std::memory_order_relaxed)) / summary.Frames;
+
+            uint32_t counts[BucketCount];
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < BucketCount; ++i)
+            {
+                counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+                total += counts[i];
+            }
+            summary.P50Ms = std::min(Percentile(counts, total, 0.50), summary.MaxMs);
+            summary.P95Ms = std::min(Percentile(counts, total, 0.95), summary.MaxMs);
+            summary.P99Ms = std::min(Percentile(counts, total, 0.99), summary.MaxMs);
+
+            std::vector<uint64_t> recent;
+            GetRecent(recent);
+            if (recent.size() > 1)
+            {
+                double jitter = 0.0;
+                for (size_t i = 1; i < recent.size(); ++i)
+                {
+                    jitter += recent[i] > recent[i - 1] ? double(recent[i] - recent[i - 1]) : double(recent[i - 1] - recent[i]);
+                }
+                summary.JitterMs = jitter / (recent.size() - 1) * 1000.0 / TicksPerSecond;
+            }
+
+            return summary;
+        }
+
+        // Recent frames, one line each: frame, ms.
+        void WriteCSV(std::ostream& out) const
+        {
+            std::vector<uint64_t> recent;
+            GetRecent(recent);
+
+            out << "frame,ms\n";
+            for (size_t i = 0; i < recent.size(); ++i)
+            {
+                out << i << ',' << TicksToMs(recent[i]) << '\n';
+            }
+        }
+
+        // Summary and the non-empty histogram buckets as [lower_us, upper_us, count].
+        void WriteJSON(std::ostream& out) const
+        {
+            FrameTimeSummary s = GetSummary();
+            out << "{\n"
+                << "  \"frames\": " << s.Frames << ",\n"
+                << "  \"over_budget\": " << s.OverBudget << ",\n"
+                << "  \"budget_ms\": " << s.BudgetMs << ",\n"
+                << "  \"mean_ms\": " << s.MeanMs << ",\n"
+                << "  \"p50_ms\": " << s.P50Ms << ",\n"
+                << "  \"p95_ms\": " << s.P95Ms << ",\n"
+                << "  \"p99_ms\": " << s.P99Ms << ",\n"
+                << "  \"max_ms\": " << s.MaxMs << ",\n"
+                << "  \"jitter_ms\": " << s.JitterMs << ",\n"
+                << "  \"histogram\": [";
+
+            bool first = true;
+            for (uint32_t i = 0; i < BucketCount; ++i)
+            {
+                uint32_t count = m_buckets[i].load(std::memory_order_relaxed);
+                if (count == 0)
+                {
+                    continue;
+                }
+                out << (first ? "\n" : ",\n") << "    [" << BucketLower(i) << ", " << BucketUpper(i) << ", " << count << "]";
+                first = false;
+            }
+            out << "\n  ]\n}\n";
+        }
+
+    private:
+        // Log-linear buckets over microseconds: values below 2 * SubBuckets get one bucket
+        // each, above that every power of two is split into SubBuckets buckets.
+        static const uint32_t SubBucketBits = 5;
+        static const uint32_t SubBuckets = 1u << SubBucketBits;
+        static const uint32_t MaxBit = 40;
+        static const uint32_t BucketCount = 2 * SubBuckets + (MaxBit - SubBucketBits) * SubBuckets;
+
+        static uint32_t HighestBit(uint64_t v)
+        {
+            uint32_t bit = 0;
+            for (uint32_t step = 32; step > 0; step >>= 1)
+            {
+                if (v >> (bit + step))
+                {
+                    bit += step;
+                }
+            }
+            return bit;
+        }
+
+        static uint32_t BucketIndex(uint64_t us)
+        {
+            if (us < 2 * SubBuckets)
+            {
+                return static_cast<uint32_t>(us);
+            }
+
+            uint32_t bit = std::min(HighestBit(us), uint32_t(MaxBit));
+            uint32_t shift = bit - SubBucketBits;
+            uint32_t sub = static_cast<uint32_t>(std::min(us >> shift, uint64_t(2 * SubBuckets - 1))) - SubBuckets;
+            return 2 * SubBuckets + (shift - 1) * SubBuckets + sub;
+        }
+
+        static uint64_t BucketLower(uint32_t index)
+        {
+            if (index < 2 * SubBuckets)
+            {
+                return index;
+            }
+
+            uint32_t shift = (index - 2 * SubBuckets) / SubBuckets + 1;
+            uint64_t sub = (index - 2 * SubBuckets) % SubBuckets + SubBuckets;
+            return sub << shift;
+        }
+
+        static uint64_t BucketUpper(uint32_t index)
+        {
+            return index + 1 < BucketCount ? BucketLower(index + 1) : BucketLower(index) * 2;
+        }
+
+        // Upper edge of the bucket holding the given fraction of the frames, in ms.
+        static double Percentile(const uint32_t* counts, uint64_t total, double fraction)
+        {
+            uint64_t target = std::max(uint64_t(1), static_cast<uint64_t>(fraction * total + 0.5));
+            uint64_t cumulative = 0;
+            for (uint32_t i = 0; i < BucketCount; ++i)
+            {
+                cumulative += counts[i];
+                if (cumulative >= target)
+                {
+                    return BucketUpper(i) / 1000.0;
+                }
+            }
+            return BucketUpper(BucketCount - 1) / 1000.0;
+        }
+
+        static double TicksToMs(uint64_t ticks)             { return static_cast<double>(ticks) * 1000.0 / TicksPerSecond; }
+
+        std::atomic<uint64_t> m_ring[RingSize];
+        std::atomic<uint64_t> m_writeIndex{ 0 };
+        std::atomic<uint64_t> m_resetIndex{ 0 };
+
+        std::atomic<uint32_t> m_buckets[BucketCount];
+        std::atomic<uint64_t> m_frames;
+        std::atomic<uint64_t> m_totalTicks;
+        std::atomic<uint64_t> m_maxTicks;
+        std::atomic<uint64_t> m_overBudget;
+        std::atomic<uint64_t> m_budgetTicks;
+    };
+}
@@ -0,0 +1,155 @@
+//
+// FrameTimeStatsTests.cpp
+//
+
+#include "FrameTimeStats.h"
+#include "SelfTest.h"
+#include "StepTimer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const uint64_t c_ticksPerMs = DX::FrameTimeStats::TicksPerSecond / 1000;
+
+	bool WithinBucket(double actualMs, double expectedMs)
+	{
+		// Buckets are 1/32 of a power of two wide and report their upper edge.
+		return actualMs >= expectedMs && actualMs <= expectedMs * (1.0 + 1.0 / 16.0) + 0.001;
+	}
+}
+
+SELF_TEST(FrameTimeStats, SummaryOfKnownFrames)
+{
+	DX::FrameTimeStats stats;
+	for (int i = 0; i < 980; ++i)
+		stats.Record(166000);
+	for (int i = 0; i < 15; ++i)
+		stats.Record(33 * c_ticksPerMs);
+	for (int i = 0; i < 5; ++i)
+		stats.Record(100 * c_ticksPerMs);
+
+	DX::FrameTimeSummary summary = stats.GetSummary();
+	SELF_CHECK(summary.Frames == 1000);
+	SELF_CHECK(summary.OverBudget == 20);
+	SELF_CHECK(fabs(summary.MeanMs - (980 * 16.6 + 15 * 33.0 + 5 * 100.0) / 1000.0) < 1e-9);
+	SELF_CHECK(WithinBucket(summary.P50Ms, 16.6));
+	SELF_CHECK(WithinBucket(summary.P95Ms, 16.6));
+	SELF_CHECK(WithinBucket(summary.P99Ms, 33.0));
+	SELF_CHECK(summary.MaxMs == 100.0);
+
+	stats.Reset();
+	std::vector<uint64_t> recent;
+	stats.GetRecent(recent);
+	summary = stats.GetSummary();
+	SELF_CHECK(recent.empty());
+	SELF_CHECK(summary.Frames == 0 && summary.OverBudget == 0 && summary.MaxMs == 0.0 && summary.P99Ms == 0.0);
+}
+
+SELF_TEST(FrameTimeStats, PercentilesMatchSortedTimes)
+{
+	// Log-uniform frame times from 10 us to 10 s.
+	std::mt19937 random(5);
+	std::uniform_real_distribution<double> exponent(2.0, 8.0);
+	std::vector<uint64_t> ticks;
+	DX::FrameTimeStats stats;
+	for (int i = 0; i < 100000; ++i)
+	{
+		ticks.push_back(uint64_t(pow(10.0, exponent(random))));
+		stats.Record(ticks.back());
+	}
+	std::sort(ticks.begin(), ticks.end());
+
+	DX::FrameTimeSummary summary = stats.GetSummary();
+	const double fractions[] = { 0.50, 0.95, 0.99 };
+	const double reported[] = { summary.P50Ms, summary.P95Ms, summary.P99Ms };
+	for (int i = 0; i < 3; ++i)
+	{
+		double exact = double(ticks[size_t(fractions[i] * ticks.size()) - 1]) / c_ticksPerMs;
+		context.Log("p%.0f %.4f ms, exact %.4f ms", fractions[i] * 100.0, reported[i], exact);
+		SELF_CHECK(fabs(reported[i] - exact) <= exact / 16.0);
+	}
+	SELF_CHECK(summary.MaxMs == double(ticks.back()) / c_ticksPerMs);
+}
+
+SELF_TEST(FrameTimeStats, RingKeepsRecentFramesAndJitter)
+{
+	DX::FrameTimeStats stats;
+	const uint64_t count = DX::FrameTimeStats::RingSize + 500;
+	for (uint64_t i = 0; i < count; ++i)
+		stats.Record((i & 1 ? 20 : 10) * c_ticksPerMs + i);
+
+	std::vector<uint64_t> recent;
+	stats.GetRecent(recent);
+	SELF_CHECK(recent.size() == DX::FrameTimeStats::RingSize);
+	bool ordered = true;
+	for (size_t i = 0; i < recent.size(); ++i)
+	{
+		uint64_t frame = count - recent.size() + i;
+		ordered = ordered && recent[i] == (frame & 1 ? 20 : 10) * c_ticksPerMs + frame;
+	}
+	SELF_CHECK(ordered);
+	SELF_CHECK(fabs(stats.GetSummary().JitterMs - 10.0) < 1e-3);
+
+	std::ostringstream csvStream;
+	stats.WriteCSV(csvStream);
+	std::string csv = csvStream.str();
+	SELF_CHECK(csv.compare(0, 9, "frame,ms\n") == 0);
+	SELF_CHECK(size_t(std::count(csv.begin(), csv.end(), '\n')) == DX::FrameTimeStats::RingSize + 1);
+
+	std::ostringstream jsonStream;
+	stats.WriteJSON(jsonStream);
+	std::string json = jsonStream.str();
+	SELF_CHECK(json.find("\"frames\": 1524,") != std::string::npos);
+	SELF_CHECK(json.find("\"histogram\": [") != std::string::npos);
+}
+
+SELF_TEST(FrameTimeStats, ReadWhileRecording)
+{
+	DX::FrameTimeStats stats;
+	const uint64_t frames = 200000;
+	std::atomic<bool> done(false);
+	std::thread writer([&]()
+	{
+		for (uint64_t i = 0; i < frames; ++i)
+			stats.Record(c_ticksPerMs + i % 1000);
+		done = true;
+	});
+
+	// Readers see complete, plausible summaries at any time.
+	bool sane = true;
+	uint64_t reads = 0;
+	while (!done)
+	{
+		DX::FrameTimeSummary summary = stats.GetSummary();
+		sane = sane && summary.Frames <= frames && summary.MaxMs <= 1.1 && (summary.Frames == 0 || summary.P50Ms >= 1.0);
+		reads++;
+	}
+	writer.join();
+
+	context.Log("%llu summaries taken while recording", (unsigned long long)reads);
+	SELF_CHECK(sane);
+	SELF_CHECK(stats.GetSummary().Frames == frames);
+}
+
+SELF_TEST(FrameTimeStats, StepTimerRecordsUnclampedFrames)
+{
+	// The timer clamps a stall for the simulation but the statistics see all of it.
+	DX::BasicStepTimer<DX::ManualClock> timer;
+	timer.GetClock().AdvanceSeconds(0.016);
+	timer.Tick([]() {});
+	timer.GetClock().AdvanceSeconds(0.25);
+	timer.Tick([]() {});
+
+	DX::FrameTimeSummary summary = timer.GetFrameTimeStats().GetSummary();
+	SELF_CHECK(summary.Frames == 2);
+	SELF_CHECK(summary.OverBudget == 1);
+	SELF_CHECK(summary.MaxMs == 250.0);
+	SELF_CHECK(timer.GetElapsedSeconds() == 0.1);
+}
@@ -5,6 +5,8 @@
 #include "pch.h"
 #include "Game.h"
 
+#include <fstream>
+
 extern void ExitGame();
 
 using namespace DirectX;
@@ -12,18 +14,92 @@ using namespace DirectX::SimpleMath;
 
 using Microsoft::WRL::ComPtr;
 
+namespace
+{
+	// Direction the sun light travels in, shared by the globe lighting and the shadow cascades.
+	const XMVECTORF32 c_lightDirection = { -1.0f, -0.50f, 1.0f, 0.0f };
+
+	// Camera flythrough files and the interval between recorded keys.
+	const char* const c_cameraPathFile = "camera.path";
+	const char* const c_cameraPathReportFile = "camera_path_report.csv";
+	const uint64_t c_cameraPathKeyInterval = DX::StepTimer::TicksPerSecond / 10;
+
+	// Simulation steps per second, and the most steps one frame may run to catch up.
+	const double c_simulationRate = 30.0;
+	const uint32_t c_maxSimulationStepsPerFrame = 4;
+
+	// Frame rate limits for the active window (0 = vsync only) and while in the background.
+	const double c_frameRateLimit = 0.0;
+	const double c_backgroundFrameRate = 10.0;
+
+	// Frame time dumps written with F8.
+	const char* const c_frameTimesCsvFile = "frame_times.csv";
+	const char* const c_frameTimesJsonFile = "frame_times.json";
+
+	// F11 captures the CPU scopes of this many frames into a Chrome trace.
+	const uint32_t c_cpuTraceFrames = 120;
+	const char* const c_cpuTraceFile = "cpu_trace.json";
+
+	// Render at 1 sample per pixel with a jittered projection and temporal accumulation
+	// instead of MSAA. Chosen at startup because the pipelines depend on the sample count.
+	const bool c_temporalAA = false;
+	const float c_temporalFeedback = 0.9f;
+
+	// GPU time per frame the dynamic resolution holds, under a 60 Hz vsync interval with
+	// room for the work outside the profiled passes.
+	const bool c_dynamicResolution = false;
+	const double c_dynamicResolutionTargetMs = 14.0;
+
+	// Timestamp pairs per frame for the GPU profiler, and the frames it averages over.
+	const uint32_t c_gpuProfilerScopes = 16;
+	const uint32_t c_gpuProfilerFrames = 60;
+
+	// Matrices as the render interface takes them.
+	void StoreMatrix(const XMFLOAT4X4& matrix, float out[16])
+	{
+		memcpy(out, &matrix._11, 16 * sizeof(float));
+	}
+}
+
 Game::Game() :
     m_window(nullptr),
     m_outputWidth(800),
     m_outputHeight(600),
     m_featureLevel(D3D_FEATURE_LEVEL_11_0),
+    m_framesInFlight(c_minFramesInFlight),
+    m_maxFrameLatency(1),
     m_backBufferIndex(0),
-    m_fenceValues{}
+    m_gpuPassVersion(0),
+    m_viewSize(0),
+    m_resetElapsedTime(false),
+    m_exitRequested(false),
+    m_cycleSampleCount(false),
+    m_toggleDynamicResolution(false),
+    m_lensSize(0),
+    m_suspended(false),
+    m_cpuSampleProcessTime(0),
+    m_cpuSampleFrames(0),
+    m_cpuMsPerFrame(0.0),
+    m_inputToSubmitMs(0.0),
+    m_firstFrameMs(0.0),
+    m_assetsReadyMs(0.0),
+    m_temporalAA(c_temporalAA),
+    m_sampleCount(c_temporalAA ? 1 : 4),
+    m_historyIndex(0),
+    m_historyValid(false),
+    m_dynamicResolutionEnabled(c_dynamicResolution && !c_temporalAA),
+    m_recordingPath(false),
+    m_playingPath(false),
+    m_pathStartTicks(0),
+    m_pathSegment(0)
 {
 }
 
 Game::~Game()
 {
+    m_simulation.Stop();
+	m_assetStreamer.reset();
+
     // Ensure that the GPU is no longer referencing resources that are about to be destroyed.
     WaitForGpu();
 }
@@ -31,7 +107,9 @@ Game::~Game()
 // Initialize the Direct3D resources required to run.
 void Game::Initialize(HWND window, int width, int height)
 {
+    m_startTime = std::chrono::steady_clock::now();
     m_window = window;
+    CpuProfiler::SetThreadName("Window");
     m_outputWidth = std::max(width, 1);
     m_outputHeight = std::max(height, 1);
 
@@ -43,47 +121,246 @@ void Game::Initialize(HWND window, int width, int height)
     CreateResources();
 	m_camera.SetPosition(0.0f, 1.0f, -5.0f);
 	m_camera.LookAt(m_camera.GetPosition3f(), XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
-    // TODO: Change the timer settings if you want something other than the default variable timestep mode.
-    // e.g. for 60 FPS fixed timestep update logic, call:
-    
-	//m_timer.SetFixedTimeStep(true);
-    m_timer.SetTargetElapsedSeconds(1.0 / 60);
-    
+	// Render everything relative to the camera so the scene can use planetary distances.
+	m_camera.SetLargeWorldCoordinates(true);
+	m_occlusionCuller.SetJobSystem(&m_jobSystem);
+    // The simulation runs at a fixed rate independent of the display rate; Render
+    // interpolates between steps.
+	m_timer.SetFixedTimeStep(true);
+    m_timer.SetTargetElapsedSeconds(1.0 / c_simulationRate);
+	// Under load, slow the simulation down rather than spiral into ever longer frames.
+	m_timer.SetMaxUpdatesPerTick(c_maxSimulationStepsPerFrame);
+	m_timer.SetCatchUpPolicy(DX::CatchUpPolicy::Drop);
+	m_lastFrameTime = std::chrono::steady_clock::now();
+	m_framePacer.SetTargetRate(c_frameRateLimit);
+	SampleCpuTime(m_lastFrameTime);
+
+	DynamicResolution::Settings dynamicResolution;
+	dynamicResolution.TargetMs = c_dynamicResolutionTargetMs;
+	m_dynamicResolution.SetSettings(dynamicResolution);
+
+	// From here on the simulation state belongs to the simulation thread.
+	m_viewSize = (uint64_t(m_outputWidth) << 32) | uint32_t(m_outputHeight);
+	m_simulation.Start([this](RenderState& state)
+	{
+		Simulate(state);
+	});
+}
+
+void Game::SetFrameQueue(UINT framesInFlight, UINT maxFrameLatency)
+{
+	m_framesInFlight = std::min(std::max(framesInFlight, c_minFramesInFlight), c_maxFramesInFlight);
+	m_maxFrameLatency = std::min(std::max(maxFrameLatency, 1u), m_framesInFlight);
+}
+
+void Game::SetSampleCount(UINT sampleCount)
+{
+	if (!m_temporalAA)
+		m_sampleCount = std::min(std::max(sampleCount, 1u), 8u);
+}
+
+void Game::SetDynamicResolution(bool enabled)
+{
+	m_dynamicResolutionEnabled = enabled && !m_temporalAA;
 }
 
 // Executes the basic game loop.
 void Game::Tick()
 {
+	// CPU traces requested with F11 start and end at frame boundaries.
+	if (CpuProfiler::MarkFrame())
+	{
+		bool written = CpuProfiler::WriteChromeTrace(c_cpuTraceFile);
+		char report[128];
+		snprintf(report, sizeof(report), "CPU trace of %u frames %s %s, %llu events, %llu dropped\n",
+			c_cpuTraceFrames, written ? "written to" : "could not be written to", c_cpuTraceFile,
+			static_cast<unsigned long long>(CpuProfiler::GetEventCount()),
+			static_cast<unsigned long long>(CpuProfiler::GetDroppedEvents()));
+		OutputDebugStringA(report);
+	}
+	CPU_PROFILE_FUNCTION();
+
+	// Sleep instead of spinning through the message loop: honour the frame rate limit, then
+	// block until the swap chain can queue another frame. Waiting here rather than in Present
+	// also means input is sampled as late as possible.
+	{
+		CPU_PROFILE_SCOPE("Wait for frame pacing and swap chain");
+		m_framePacer.Wait();
+		if (m_frameLatencyWaitable.IsValid())
+			WaitForSingleObjectEx(m_frameLatencyWaitable.Get(), 1000, TRUE);
+	}
+
+	if (m_exitRequested)
+	{
+		ExitGame();
+		return;
+	}
+
+	// Take the frame the simulation thread prepared; it starts on the next one while this
+	// one is rendered, so a GPU stall in Present no longer holds up the simulation.
+	{
+		CPU_PROFILE_SCOPE("Wait for simulation");
+		if (!m_simulation.Acquire(std::chrono::milliseconds(100)))
+			return;
+	}
+
+	if (m_cycleSampleCount.exchange(false))
+		CycleSampleCount();
+	if (m_toggleDynamicResolution.exchange(false))
+		ToggleDynamicResolution();
+
+    Render(m_simulation.Current());
+	SampleCpuTime(std::chrono::steady_clock::now());
+}
+
+// Runs on the simulation thread, once per rendered frame.
+void Game::Simulate(RenderState& state)
+{
+	CpuProfiler::SetThreadName("Simulation");
+	CPU_PROFILE_FUNCTION();
+
+	// Wall clock frame time, attributed to the current segment during path playback.
+	auto now = std::chrono::steady_clock::now();
+	if (m_resetElapsedTime.exchange(false))
+	{
+		m_timer.ResetElapsedTime();
+		m_lastFrameTime = now;
+	}
+	double frameSeconds = std::chrono::duration<double>(now - m_lastFrameTime).count();
+	m_lastFrameTime = now;
+
+	if (m_playingPath)
+		m_cameraPathStats.AddFrame(m_pathSegment, frameSeconds);
+
+	// Resizes arrive from the window thread.
+	uint64_t viewSize = m_viewSize;
+	if (viewSize != m_lensSize)
+	{
+		int width = int(viewSize >> 32);
+		int height = int(viewSize & 0xffffffff);
+		m_camera.SetLens(0.25f*DirectX::XM_PI, float(width) / float(height), 1.0f, 1000.0f);
+		m_lensSize = viewSize;
+	}
+
     m_timer.Tick([&]()
     {
         Update(m_timer);
     });
 
-    Render();
+	// Input and the camera run once per rendered frame rather than per simulation step,
+	// so they stay responsive at any display rate.
+	state.InputTime = std::chrono::steady_clock::now();
+	UpdateFrame(float(std::min(frameSeconds, 0.1)));
+
+	state.Camera = m_camera.GetSnapshot();
+	state.PreviousScene = m_previousScene;
+	state.CurrentScene = m_currentScene;
+	state.Alpha = float(m_timer.GetInterpolationAlpha());
+	state.Updates = m_timer.GetFrameCount();
+	state.FramesPerSecond = m_timer.GetTicksPerSecond();
+	state.UpdatesPerSecond = m_timer.GetFramesPerSecond();
+	state.TimeDilation = m_timer.GetTimeDilation();
+	state.DroppedSeconds = m_timer.GetDroppedSeconds();
+	state.RecordingPath = m_recordingPath;
+	state.PlayingPath = m_playingPath;
+	state.PathSegment = m_pathSegment;
+}
+
+// Averages the process CPU time over the frames of the last second or so.
+void Game::SampleCpuTime(std::chrono::steady_clock::time_point now)
+{
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return;
+
+	auto toTicks = [](const FILETIME& time)
+	{
+		return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+	};
+	uint64_t processTime = toTicks(kernel) + toTicks(user);
+
+	if (m_cpuSampleFrames == 0 && m_cpuSampleProcessTime == 0)
+	{
+		m_cpuSampleTime = now;
+		m_cpuSampleProcessTime = processTime;
+		return;
+	}
+
+	m_cpuSampleFrames++;
+	if (now - m_cpuSampleTime >= std::chrono::seconds(1))
+	{
+		m_cpuMsPerFrame = double(processTime - m_cpuSampleProcessTime) / 10000.0 / m_cpuSampleFrames;
+		m_cpuSampleTime = now;
+		m_cpuSampleProcessTime = processTime;
+		m_cpuSampleFrames = 0;
+	}
 }
 
-// Updates the world.
+// Steps the simulation. Runs at the fixed c_simulationRate; Render interpolates
+// between the previous and the current step.
 void Game::Update(DX::StepTimer const& timer)
 {
-	OnKeyboardInput(timer);
+    CPU_PROFILE_FUNCTION();
     float elapsedTime = float(timer.GetElapsedSeconds());
+	float totalTime = float(timer.GetTotalSeconds());
 
     // TODO: Add your game logic here.
-	Vector3 shapePos = Vector3(0.0f, 0.0f, cosf(elapsedTime));
+	m_previousScene = m_currentScene;
 
-	m_world = m_world;
+	// The globe orbits the world origin while spinning.
+	m_currentScene.GlobePosition = Vector3(cosf(totalTime) * 0.5f, 0.f, sinf(totalTime) * 0.5f);
+	m_currentScene.GlobeAngle = totalTime / 2.0f;
+	m_currentScene.GridOrigin = Vector3::One * sinf(elapsedTime);
+
+	// Nothing to interpolate from before the first step.
+	if (timer.GetFrameCount() == 1)
+		m_previousScene = m_currentScene;
 
 	// update earth rotation
 	m_earthRotation = m_earthRotation.CreateRotationY(elapsedTime);
+}
 
+// Handles input and moves the camera, once per rendered frame.
+void Game::UpdateFrame(float elapsedSeconds)
+{
+	CPU_PROFILE_FUNCTION();
 	auto kb = m_keyboard->GetState();
+	m_keyboardTracker.Update(kb);
+
+	// Path playback drives the camera instead of the keyboard and mouse.
+	UpdateCameraPath(m_timer);
+	if (!m_playingPath)
+		OnKeyboardInput(elapsedSeconds);
+
+	// The message loop belongs to the window thread, which quits on its next frame.
 	if (kb.Escape)
-		PostQuitMessage(0);
+		m_exitRequested = true;
+
+	// F7 switches to the next MSAA sample count; the window thread rebuilds the targets.
+	if (m_keyboardTracker.pressed.F7)
+		m_cycleSampleCount = true;
+
+	// F9 switches dynamic resolution on or off, also on the window thread.
+	if (m_keyboardTracker.pressed.F9)
+		m_toggleDynamicResolution = true;
+
+	// F11 captures a CPU trace of the next frames; Tick writes it.
+	if (m_keyboardTracker.pressed.F11)
+		CpuProfiler::RequestCapture(c_cpuTraceFrames);
+
+	// F8 dumps the recent frame times and the frame time histogram.
+	if (m_keyboardTracker.pressed.F8)
+	{
+		std::ofstream csv(c_frameTimesCsvFile);
+		m_timer.GetFrameTimeStats().WriteCSV(csv);
+		std::ofstream json(c_frameTimesJsonFile);
+		m_timer.GetFrameTimeStats().WriteJSON(json);
+	}
 
 	auto mouse = m_mouse->GetState();
 
 
-	if (mouse.positionMode == Mouse::MODE_RELATIVE)
+	if (mouse.positionMode == Mouse::MODE_RELATIVE && !m_playingPath)
 	{
 		static const float ROTATION_GAIN = 0.004f;
 
@@ -98,13 +375,74 @@ void Game::Update(DX::StepTimer const& timer)
 
 	m_mouse->SetMode(mouse.leftButton ? Mouse::MODE_RELATIVE : Mouse::MODE_ABSOLUTE);
 
+	// Final camera state for this frame; Simulate hands a snapshot of it to Render.
+	m_camera.UpdateViewMatrix();
+	if (m_temporalAA)
+		m_camera.AdvanceTemporalFrame(static_cast<UINT>(m_lensSize >> 32), static_cast<UINT>(m_lensSize & 0xffffffff));
 
 }
 
-void Game::OnKeyboardInput(DX::StepTimer const & timer)
+// F5 starts/stops recording a camera path, F6 replays the recorded path and writes
+// per segment frame time statistics when it ends. Paths run on the simulation clock
+// (fixed steps plus the interpolated part of the next step), so playback visits the
+// same poses however fast frames are rendered.
+void Game::UpdateCameraPath(DX::StepTimer const& timer)
 {
+	uint64_t ticks = timer.GetTotalTicks() + timer.GetLeftOverTicks();
+
+	if (m_keyboardTracker.pressed.F5 && !m_playingPath)
+	{
+		if (m_recordingPath)
+		{
+			m_recordingPath = false;
+			m_cameraPath.Save(c_cameraPathFile);
+		}
+		else
+		{
+			m_cameraPath.Clear();
+			m_recordingPath = true;
+		}
+	}
+
+	if (m_keyboardTracker.pressed.F6 && !m_recordingPath && !m_playingPath &&
+		m_cameraPath.Load(c_cameraPathFile) && m_cameraPath.GetSegmentCount() > 0)
+	{
+		m_playingPath = true;
+		m_pathStartTicks = ticks;
+		m_pathSegment = 0;
+		m_cameraPathStats.Reset(m_cameraPath.GetSegmentCount());
+	}
+
+	if (m_recordingPath)
+	{
+		size_t keyCount = m_cameraPath.GetKeyCount();
+		if (keyCount == 0 ||
+			ticks - m_cameraPath.GetKey(keyCount - 1).Ticks >= c_cameraPathKeyInterval)
+		{
+			m_cameraPath.AddKey(ticks, m_camera);
+		}
+	}
+	else if (m_playingPath)
+	{
+		uint64_t elapsed = ticks - m_pathStartTicks;
+		m_pathSegment = m_cameraPath.Apply(elapsed, m_camera);
+
+		if (elapsed >= m_cameraPath.GetDuration())
+		{
+			m_playingPath = false;
+
+			std::string report = m_cameraPathStats.Report();
+			OutputDebugStringA(report.c_str());
+			std::ofstream(c_cameraPathReportFile) << report;
+		}
+	}
+}
+
+void Game::OnKeyboardInput(float elapsedSeconds)
+{
+	CPU_PROFILE_FUNCTION();
 	
-	const float dt = 0.01f; //timer.GetElapsedTicks(); // TODO: Totally calculated
+	const float dt = elapsedSeconds;
 
 	if (GetAsyncKeyState('W') & 0x8000)
 		m_camera.Walk(10.0f*dt);
@@ -123,150 +461,310 @@ void Game::OnKeyboardInput(DX::StepTimer const & timer)
 
 
 // Draws the scene.
-void Game::Render() //RenderHere
+void Game::Render(const RenderState& state) //RenderHere
 {
+    CPU_PROFILE_FUNCTION();
+
     // Don't try to render anything before the first Update.
-    if (m_timer.GetFrameCount() == 0)
+    if (state.Updates == 0)
     {
         return;
     }
 
-    // Prepare the command list to render a new frame.
-    Clear();
-
-    // TODO: Add your rendering code here.
-	m_spriteBatch->Begin(m_commandList.Get());
-
-	// renderText
-	// drawBackgroud
-	
-	m_spriteBatch->Draw(m_resourceDescriptors->GetGpuHandle(Descriptors::Background),
-		GetTextureSize(m_background.Get()),
-		m_fullscreenRect);
-
-	Vector2 fpsPosition(5.0f, 5.0f);
-	Vector2 textPosition(5.0f, 25.0f);
-	Vector3 camPos = m_camera.GetPosition();
-	drawText(std::to_string(m_timer.GetFramesPerSecond()).c_str(), fpsPosition);
-	// prepare the camera position string
-	std::string camString = "camera(x,y,z): " + std::to_string((float)camPos.x) + ":" + std::to_string((float)camPos.y) + ":" + std::to_string((float)camPos.z);
-	drawText(camString.c_str(), textPosition);
-	
-	m_spriteBatch->End();
-
-
+    // Render runs on the window thread and only reads the simulation through the state packet.
+    const CameraSnapshot& camera = state.Camera;
 
-	// rendergrid
-	m_gridEffect->SetWorld(m_world);
-	m_gridEffect->SetView(m_camera.GetView());
-	m_gridEffect->SetProjection(m_camera.GetProj());
-	
-
-	m_gridEffect->Apply(m_commandList.Get());
+	// Swap in the assets whose uploads finished since the last frame.
+	if (m_assetStreamer->Update() > 0 && m_assetStreamer->GetPending() == 0)
+	{
+		m_assetsReadyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_startTime).count();
+	}
 
-	m_batch->Begin(m_commandList.Get());
+	// The GPU times of the frames that finished set the scale of this one.
+	if (m_gpuProfiler->BeginFrame() > 0 && m_dynamicResolutionEnabled)
+	{
+		m_dynamicResolution.Update(m_gpuProfiler->GetStats().LastFrameMs);
+	}
 
-	Vector3 origin = Vector3::One * sinf(m_timer.GetElapsedSeconds());
+	// Everything the passes record from; they only read it.
+	SceneFrame& frame = m_sceneFrame;
+	frame.OutputWidth = static_cast<uint32_t>(m_outputWidth);
+	frame.OutputHeight = static_cast<uint32_t>(m_outputHeight);
+	frame.Upscale = m_dynamicResolutionEnabled;
+	frame.Width = frame.Upscale ? m_dynamicResolution.GetScaledSize(frame.OutputWidth) : frame.OutputWidth;
+	frame.Height = frame.Upscale ? m_dynamicResolution.GetScaledSize(frame.OutputHeight) : frame.OutputHeight;
+	frame.BackBuffer = m_backBufferTextures[m_backBufferIndex];
+	frame.SceneColor = m_offscreenRenderTarget ? m_sceneColorTexture : frame.BackBuffer;
+	frame.UpscaleSource = m_upscaleSource ? m_upscaleSourceTexture : RenderTexture();
 
-	size_t divisions = 10;
+    // Prepare the command list to render a new frame.
+    Clear();
 
+	StoreMatrix(camera.View, frame.View);
+	// With temporal AA the projection carries this frame's jitter.
+	StoreMatrix(m_temporalAA ? camera.JitteredProj : camera.Proj, frame.Projection);
+	frame.Background = m_background ? m_backgroundTexture : m_placeholderTexture;
+	frame.GlobeTexture = m_texture ? m_earthTexture : m_placeholderTexture;
+	frame.Font = m_fontHandle;
+	UpdateHud(state);
+
+	// Interpolate the simulation state between the last two fixed steps.
+	const SceneState& previous = state.PreviousScene;
+	const SceneState& current = state.CurrentScene;
+	Vector3 shapePos = Vector3::Lerp(previous.GlobePosition, current.GlobePosition, state.Alpha);
+	float shapeAngle = previous.GlobeAngle + (current.GlobeAngle - previous.GlobeAngle) * state.Alpha;
+	Vector3 origin = Vector3::Lerp(previous.GridOrigin, current.GridOrigin, state.Alpha);
+
+	// The globe orbits the world origin; it is also the occluder for everything behind it.
+	WorldPosition shapeWorldPos(shapePos.x, shapePos.y, shapePos.z);
+	Matrix shapeWorld = camera.GetCameraRelativeWorld(Matrix::CreateRotationY(shapeAngle) * m_world, shapeWorldPos);
+
+	m_occlusionCuller.BeginFrame(XMLoadFloat4x4(&camera.View), XMLoadFloat4x4(&camera.Proj));
+	m_occlusionCuller.AddOccluder(m_globeOccluderPositions.data(), m_globeOccluderPositions.size(),
+		m_globeOccluderIndices.data(), m_globeOccluderIndices.size(), shapeWorld);
+	m_occlusionCuller.RasterizeOccluders();
+
+	// The grids are authored around the world origin, which is rebased to camera relative space.
+	Vector3 worldOffset = camera.ToCameraRelative(WorldPosition());
+	StoreMatrix(camera.GetCameraRelativeWorld(m_world, WorldPosition()), frame.GridWorld);
+	frame.GridOrigin[0] = origin.x;
+	frame.GridOrigin[1] = origin.y;
+	frame.GridOrigin[2] = origin.z;
+
+	// Frustum cull the grids as AABBs (center, half extents) in SoA form.
+	Vector3 gridCenter = origin + worldOffset;
+	float gridCX[3] = { gridCenter.x, gridCenter.x, gridCenter.x - 1.f };
+	float gridCY[3] = { gridCenter.y, gridCenter.y - 1.f, gridCenter.y };
+	float gridCZ[3] = { gridCenter.z + 1.f, gridCenter.z, gridCenter.z };
+	float gridEX[3] = { 1.f, 1.f, 0.f };
+	float gridEY[3] = { 1.f, 0.f, 1.f };
+	float gridEZ[3] = { 0.f, 1.f, 1.f };
+	uint32_t gridVisible = 0;
+	camera.CullAABBs(gridCX, gridCY, gridCZ, gridEX, gridEY, gridEZ, 3, &gridVisible);
+
+	// Then drop grids hidden behind the globe, using their bounding spheres.
+	float gridRadius[3] = { 1.415f, 1.415f, 1.415f };
+	uint32_t gridUnoccluded = 0;
+	m_occlusionCuller.TestSpheres(gridCX, gridCY, gridCZ, gridRadius, 3, &gridUnoccluded);
+	frame.GridVisible = gridVisible & gridUnoccluded;
+
+	StoreMatrix(shapeWorld, frame.GlobeWorld);
+
+	// Skip the globe entirely when its bounding sphere is outside the view frustum.
+	Vector3 shapeCenter = camera.ToCameraRelative(shapeWorldPos);
+	float shapeRadius = 0.5f;
+	uint32_t shapeVisible = 0;
+	camera.CullSpheres(&shapeCenter.x, &shapeCenter.y, &shapeCenter.z, &shapeRadius, 1, &shapeVisible);
+
+	// Record the passes on the job system, each into its own command list. Every pass has
+	// its own pipelines, so they do not share state; Submit restores the pass order.
+	JobSystem::Counter passes;
+	m_jobSystem.Run(passes, [this]()
+	{
+		CPU_PROFILE_SCOPE("Record background");
+		IRenderCommandList& list = BeginPass(RenderPass::Sprites);
+		GpuProfiler::Scope scope(*m_gpuProfiler, list, "background");
+		m_sceneRenderer->RecordSprites(list, m_sceneFrame);
+	});
+	if (frame.GridVisible)
+	{
+		m_jobSystem.Run(passes, [this]()
+		{
+			CPU_PROFILE_SCOPE("Record grids");
+			IRenderCommandList& list = BeginPass(RenderPass::Grids);
+			GpuProfiler::Scope scope(*m_gpuProfiler, list, "grids");
+			m_sceneRenderer->RecordGrids(list, m_sceneFrame);
+		});
+	}
+	if (shapeVisible)
+	{
+		m_jobSystem.Run(passes, [this]()
+		{
+			CPU_PROFILE_SCOPE("Record globe");
+			IRenderCommandList& list = BeginPass(RenderPass::Globe);
+			GpuProfiler::Scope scope(*m_gpuProfiler, list, "globe");
+			m_sceneRenderer->RecordGlobe(list, m_sceneFrame);
+		});
+	}
+	m_jobSystem.Wait(passes);
 
-	drawGrid(Vector3::UnitX, Vector3::UnitY, origin + Vector3(0.f, 0.f, 1.f), XMFLOAT4(1.f, 0.f, 0.f, 0.01f), divisions);
-	drawGrid(Vector3::UnitX, Vector3::UnitZ, origin + Vector3(0.f, -1.f, 0.f), XMFLOAT4(0.f, 1.f, 0.f, 0.01f), divisions);
-	drawGrid(Vector3::UnitY, Vector3::UnitZ, origin + Vector3(-1.f, 0.f, 0.f), XMFLOAT4(0.f, 0.f, 1.f, 0.01f), divisions);
-	
-	m_batch->End();
+    // Show the new frame.
+    Present(state);
+	m_graphicsMemory->Commit(m_commandQueue.Get());
+}
 
-	// render sphere
-	ID3D12DescriptorHeap* heaps[] = { m_resourceDescriptors->Heap(), m_states->Heap() };
-	m_commandList->SetDescriptorHeaps(_countof(heaps), heaps);
+// HUD text, drawn over the back buffer by the resolve.
+void Game::UpdateHud(const RenderState& state)
+{
+	std::vector<SceneText>& hud = m_sceneFrame.Hud;
+	hud.clear();
 
-	float time = (float)m_timer.GetTotalSeconds();
-	Vector3 shapePos = Vector3(cosf(time) * 0.5f, 0.f, sinf(time) * 0.5f);
-	//m_shapeEffect->SetMatrices(m_world * m_earthRotation * Matrix::CreateTranslation(shapePos) , m_camera.GetView(), m_camera.GetProj());
-	m_shapeEffect->SetMatrices(Matrix::CreateRotationY(time / 2.0f) * Matrix::CreateTranslation(shapePos) * m_world, m_camera.GetView(), m_camera.GetProj());
+	// No text is drawn until the font streamed in.
+	if (!m_font)
+		return;
 
-	/*
-	for (auto&& itr : m_renderItems) {
-		m_shapeEffect->SetMatrices(m_world * m_rotation * Matrix::CreateTranslation(shapePos), m_view, m_proj);
-		m_shapeEffect->Apply(m_commandList.Get());
-		itr->Geo->Draw(m_commandList.Get());
+	auto addText = [&hud](std::string text, float x, float y)
+	{
+		SceneText line;
+		line.Text = std::move(text);
+		line.X = x;
+		line.Y = y;
+		hud.push_back(std::move(line));
 	};
-	*/
-	//m_shapeEffect->SetMatrices(m_world, m_camera.GetView(), m_camera.GetProj());
 
-	m_shapeEffect->Apply(m_commandList.Get());
+	const CameraSnapshot& camera = state.Camera;
+	WorldPosition camPos(camera.Origin.x + camera.Position.x,
+		camera.Origin.y + camera.Position.y,
+		camera.Origin.z + camera.Position.z);
+	// FPS hides stutter, so show the frame time distribution next to it.
+	DX::FrameTimeSummary frameTimes = m_timer.GetFrameTimeStats().GetSummary();
+	char fpsString[160];
+	snprintf(fpsString, sizeof(fpsString),
+		"%u fps (%u sim)  p50 %.1f  p95 %.1f  p99 %.1f  max %.1f  jitter %.2f ms  over budget %llu",
+		state.FramesPerSecond, state.UpdatesPerSecond, frameTimes.P50Ms, frameTimes.P95Ms, frameTimes.P99Ms,
+		frameTimes.MaxMs, frameTimes.JitterMs, static_cast<unsigned long long>(frameTimes.OverBudget));
+	addText(fpsString, 5.0f, 5.0f);
+	char cpuString[64];
+	snprintf(cpuString, sizeof(cpuString), "cpu %.2f ms/frame  simulation %.2f ms  latency %.2f ms", m_cpuMsPerFrame,
+		m_simulation.GetLastProduceSeconds() * 1000.0, m_simulation.GetLastLatencySeconds() * 1000.0);
+	addText(cpuString, 5.0f, 85.0f);
+	// How far the CPU runs ahead of the GPU: time blocked on the frame ring is time the two
+	// did not overlap. Input to present adds the GPU time on top of input to submit.
+	const FrameRing::Stats& ringStats = m_commandListPool->GetFrameRing().GetStats();
+	char queueString[160];
+	snprintf(queueString, sizeof(queueString),
+		"%u frames in flight, latency %u  queued %u  gpu wait %.2f ms  input to submit %.1f ms  to present %.1f ms",
+		m_framesInFlight, m_maxFrameLatency, ringStats.FramesQueued, ringStats.LastWaitSeconds * 1000.0,
+		m_inputToSubmitMs, m_inputToSubmitMs + ringStats.LastGpuLatencySeconds * 1000.0);
+	addText(queueString, 5.0f, 105.0f);
+	char startupString[96];
+	snprintf(startupString, sizeof(startupString), "startup: first frame %.0f ms, assets streamed in %.0f ms",
+		m_firstFrameMs, m_assetsReadyMs);
+	addText(startupString, 5.0f, 125.0f);
+	char barrierString[96];
+	snprintf(barrierString, sizeof(barrierString), "barriers %llu in %llu batches, %llu split, %llu fix-ups",
+		static_cast<unsigned long long>(m_renderStats.Barriers), static_cast<unsigned long long>(m_renderStats.Batches),
+		static_cast<unsigned long long>(m_renderStats.SplitBarriers),
+		static_cast<unsigned long long>(m_renderStats.FixupBarriers));
+	addText(barrierString, 5.0f, 145.0f);
+	addText(m_sampleCountText, 5.0f, 165.0f);
+	char resolutionString[128];
+	if (m_dynamicResolutionEnabled)
+	{
+		snprintf(resolutionString, sizeof(resolutionString),
+			"dynamic resolution %.0f%% %ux%u (F9)  gpu %.1f ms, target %.1f ms",
+			m_dynamicResolution.GetScale() * 100.0f, m_sceneFrame.Width, m_sceneFrame.Height,
+			m_dynamicResolution.GetSmoothedMs(), c_dynamicResolutionTargetMs);
+	}
+	else
+	{
+		snprintf(resolutionString, sizeof(resolutionString), "dynamic resolution off (F9)");
+	}
+	addText(resolutionString, 5.0f, 185.0f);
+	if (!m_gpuPassText.empty())
+		addText(m_gpuPassText, 5.0f, 205.0f);
+	if (state.TimeDilation < 0.99)
+	{
+		char dilationString[96];
+		snprintf(dilationString, sizeof(dilationString), "simulation %.0f%% speed, %.1f s dropped",
+			state.TimeDilation * 100.0, state.DroppedSeconds);
+		addText(dilationString, 5.0f, 65.0f);
+	}
+	// prepare the camera position string
+	addText("camera(x,y,z): " + std::to_string(camPos.x) + ":" + std::to_string(camPos.y) + ":" + std::to_string(camPos.z),
+		5.0f, 25.0f);
+	if (state.RecordingPath)
+		addText("recording camera path (F5 to stop)", 5.0f, 45.0f);
+	else if (state.PlayingPath)
+		addText("playing camera path, segment " + std::to_string(state.PathSegment), 5.0f, 45.0f);
+}
 
-	m_shape->Draw(m_commandList.Get());
-	//m_shape2->Draw(m_commandList.Get());
+// HUD line and log entry with the GPU time per pass, whenever the profiler published
+// new averages.
+void Game::UpdateGpuPassText()
+{
+	if (m_gpuProfiler->GetAveragesVersion() == m_gpuPassVersion)
+		return;
+	m_gpuPassVersion = m_gpuProfiler->GetAveragesVersion();
+
+	char passString[64];
+	snprintf(passString, sizeof(passString), "gpu %.2f ms/frame:", m_gpuProfiler->GetAverageFrameMs());
+	m_gpuPassText = passString;
+	for (const auto& pass : m_gpuProfiler->GetAverages())
+	{
+		snprintf(passString, sizeof(passString), "  %s %.2f", pass.Name.c_str(), pass.Milliseconds);
+		m_gpuPassText += passString;
+	}
+	OutputDebugStringA((m_gpuPassText + "\n").c_str());
+}
 
-    // Show the new frame.
-    Present();
-	m_graphicsMemory->Commit(m_commandQueue.Get());
+// Opens the render list for one pass of the frame on the calling thread; the backend
+// binds the descriptor heaps, the scene renderer the targets.
+IRenderCommandList& Game::BeginPass(RenderPass pass)
+{
+	return IRenderDevice::GetRenderList(m_commandListPool->BeginPass(UINT(pass), UINT(m_jobSystem.GetThreadIndex())));
 }
 
 // Helper method to prepare the command list for rendering and clear the back buffers.
 void Game::Clear()
 {
-    // Reset command list and allocator.
-    DX::ThrowIfFailed(m_commandAllocators[m_backBufferIndex]->Reset());
-    DX::ThrowIfFailed(m_commandList->Reset(m_commandAllocators[m_backBufferIndex].Get(), nullptr));
+    CPU_PROFILE_FUNCTION();
 
-    // Transition the render target into the correct state to allow for drawing into it.
-    D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-		m_offscreenRenderTarget.Get(),
-		D3D12_RESOURCE_STATE_RESOLVE_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    // Start a frame in the command list pool; this list holds the clears and runs first.
+    m_commandListPool->BeginFrame();
 
-
-    m_commandList->ResourceBarrier(1, &barrier);
-
-    // Clear the views.
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor(m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), c_swapBufferCount, m_rtvDescriptorSize);
-
-    CD3DX12_CPU_DESCRIPTOR_HANDLE dsvDescriptor(m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-    m_commandList->OMSetRenderTargets(1, &rtvDescriptor, FALSE, &dsvDescriptor);
-    m_commandList->ClearRenderTargetView(rtvDescriptor, Colors::CornflowerBlue, 0, nullptr);
-    m_commandList->ClearDepthStencilView(dsvDescriptor, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
-
-    // Set the viewport and scissor rect.
-    D3D12_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(m_outputWidth), static_cast<float>(m_outputHeight), D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
-    D3D12_RECT scissorRect = { 0, 0, m_outputWidth, m_outputHeight };
-    m_commandList->RSSetViewports(1, &viewport);
-    m_commandList->RSSetScissorRects(1, &scissorRect);
+    IRenderCommandList& list = BeginPass(RenderPass::Clear);
+    GpuProfiler::Scope scope(*m_gpuProfiler, list, "clear");
+    m_sceneRenderer->RecordClear(list, m_sceneFrame);
 }
 
 // Submits the command list to the GPU and presents the back buffer contents to the screen.
-void Game::Present()
+void Game::Present(const RenderState& state)
 {
-	
-	D3D12_RESOURCE_BARRIER barriers[2] =
-	{
-		CD3DX12_RESOURCE_BARRIER::Transition(m_offscreenRenderTarget.Get(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET,
-		D3D12_RESOURCE_STATE_RESOLVE_SOURCE),
-		CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_backBufferIndex].Get(),
-		D3D12_RESOURCE_STATE_PRESENT,
-		D3D12_RESOURCE_STATE_RESOLVE_DEST)
-	};
-	m_commandList->ResourceBarrier(2, barriers);
-
-	m_commandList->ResolveSubresource(m_renderTargets[m_backBufferIndex].Get(), 0,
-		m_offscreenRenderTarget.Get(), 0, DXGI_FORMAT_B8G8R8A8_UNORM);
+	CPU_PROFILE_FUNCTION();
+	const CameraSnapshot& camera = state.Camera;
 
+	// The resolve goes into the last command list of the frame.
+	IRenderCommandList& list = BeginPass(RenderPass::Resolve);
 
-    // Transition the render target to the state that allows it to be presented to the display.
-    D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_backBufferIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-    m_commandList->ResourceBarrier(1, &barrier);
-	
-
-    // Send the command list off to the GPU for processing.
-    DX::ThrowIfFailed(m_commandList->Close());
-    m_commandQueue->ExecuteCommandLists(1, CommandListCast(m_commandList.GetAddressOf()));
+	{
+		GpuProfiler::Scope scope(*m_gpuProfiler, list, "resolve");
+		if (m_temporalAA)
+		{
+			ResolveTemporal(list, camera);
+		}
+		else
+		{
+			m_sceneRenderer->RecordResolve(list, m_sceneFrame);
+		}
+	}
+	// The other lists execute before this one, so all of the frame's timestamps are written.
+	m_gpuProfiler->ResolveFrame(list);
+
+    // Send the frame's command lists off to the GPU, in pass order with one ExecuteCommandLists.
+    m_commandListPool->Submit();
+	m_inputToSubmitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - state.InputTime).count();
+    m_gpuProfiler->EndFrame();
+	m_renderStats = m_renderDevice->GetStats();
+	m_renderDevice->ResetStats();
+	UpdateGpuPassText();
+
+	if (m_firstFrameMs == 0.0)
+	{
+		m_firstFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_startTime).count();
+		char report[64];
+		snprintf(report, sizeof(report), "Time to first frame: %.1f ms\n", m_firstFrameMs);
+		OutputDebugStringA(report);
+	}
 
     // The first argument instructs DXGI to block until VSync, putting the application
     // to sleep until the next VSync. This ensures we don't waste any cycles rendering
     // frames that will never be displayed to the screen.
-    HRESULT hr = m_swapChain->Present(1, 0);
+    HRESULT hr;
+    {
+        CPU_PROFILE_SCOPE("IDXGISwapChain::Present");
+        hr = m_swapChain->Present(1, 0);
+    }
 
     // If the device was reset we must completely reinitialize the renderer.
     if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
@@ -281,27 +779,88 @@ void Game::Present()
     }
 }
 
+// Accumulates the jittered scene into the history target with the temporal resolve
+// pass and copies the result to the back buffer. The targets ping-pong every frame.
+void Game::ResolveTemporal(IRenderCommandList& list, const CameraSnapshot& camera)
+{
+	RenderTexture history = m_historyTextures[m_historyIndex];
+	RenderTexture backBuffer = m_backBufferTextures[m_backBufferIndex];
+
+	// The states the frame's passes and the last frame left behind.
+	list.Transition(m_sceneColorTexture, ResourceState::RenderTarget);
+	list.Transition(m_sceneDepthTexture, ResourceState::DepthWrite);
+	list.Transition(history, ResourceState::ShaderResource);
+	list.Transition(backBuffer, ResourceState::Present);
+
+	list.Transition(m_sceneColorTexture, ResourceState::ShaderResource);
+	list.Transition(m_sceneDepthTexture, ResourceState::ShaderResource);
+	list.Transition(history, ResourceState::RenderTarget);
+	// The back buffer is not needed until the copy, so its transition overlaps the resolve.
+	list.BeginTransition(backBuffer, ResourceState::CopyDest);
+
+	// The resolve shader is not part of the render interface; GetNative issues the
+	// barriers queued so far.
+	ID3D12GraphicsCommandList* commandList = D3D12RenderDevice::GetNative(list);
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE historyDescriptor(m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
+		c_swapBufferCount + 1 + m_historyIndex, m_rtvDescriptorSize);
+	commandList->OMSetRenderTargets(1, &historyDescriptor, FALSE, nullptr);
+
+	ID3D12DescriptorHeap* heaps[] = { m_resourceDescriptors->Heap() };
+	commandList->SetDescriptorHeaps(_countof(heaps), heaps);
+
+	// Without valid history (first frame, after a resize) the current frame is used as is.
+	TemporalAA::ResolveDesc desc;
+	desc.Width = static_cast<UINT>(m_outputWidth);
+	desc.Height = static_cast<UINT>(m_outputHeight);
+	desc.Feedback = m_historyValid ? c_temporalFeedback : 0.0f;
+	desc.Jitter = camera.Jitter;
+	desc.InvViewProj = camera.InvViewProj;
+	desc.PrevViewProj = camera.PrevViewProj;
+	m_temporalResolve->Process(commandList, desc,
+		m_resourceDescriptors->GetGpuHandle(Descriptors::SceneColor),
+		m_resourceDescriptors->GetGpuHandle(Descriptors::History0 + (1 - m_historyIndex)));
+
+	list.Transition(history, ResourceState::CopySource);
+	list.Copy(backBuffer, history);
+	m_sceneRenderer->RecordHud(list, m_sceneFrame);
+
+	// Back to the states the next frame starts from.
+	list.Transition(history, ResourceState::ShaderResource);
+	list.Transition(backBuffer, ResourceState::Present);
+	list.Transition(m_sceneColorTexture, ResourceState::RenderTarget);
+	list.Transition(m_sceneDepthTexture, ResourceState::DepthWrite);
+
+	m_historyIndex = 1 - m_historyIndex;
+	m_historyValid = true;
+}
+
 // Message handlers
 void Game::OnActivated()
 {
-    // TODO: Game is becoming active window.
+	// Back in the foreground: drop the background rate for the active window's limit.
+	m_framePacer.SetTargetRate(c_frameRateLimit);
 }
 
 void Game::OnDeactivated()
 {
-    // TODO: Game is becoming background window.
+	// Keep animating in the background, but at a rate that barely costs any power.
+	m_framePacer.SetTargetRate(c_backgroundFrameRate);
 }
 
 void Game::OnSuspending()
 {
-    // TODO: Game is being power-suspended (or minimized).
+	// The message loop blocks while suspended instead of rendering frames nobody sees.
+	m_suspended = true;
 }
 
 void Game::OnResuming()
 {
-    m_timer.ResetElapsedTime();
-
-    // TODO: Game is being power-resumed (or returning from minimize).
+	// Render again, without counting the time spent suspended as one long frame, and
+	// let the pacer start a new schedule instead of catching up on the missed frames.
+	m_suspended = false;
+	m_resetElapsedTime = true;
+	m_framePacer.Reset();
 }
 
 void Game::OnWindowSizeChanged(int width, int height)
@@ -310,9 +869,9 @@ void Game::OnWindowSizeChanged(int width, int height)
     m_outputHeight = std::max(height, 1);
 
     CreateResources();
-	
-    // TODO: Game window is being resized.
-	m_camera.SetLens(0.25f*DirectX::XM_PI, m_outputWidth / m_outputHeight, 1.0f, 1000.0f);
+
+	// The simulation thread updates the camera lens before its next frame.
+	m_viewSize = (uint64_t(m_outputWidth) << 32) | uint32_t(m_outputHeight);
 }
 
 // Properties
@@ -392,7 +951,7 @@ void Game::CreateDevice()
 
     // Create descriptor heaps for render target views and depth stencil views.
     D3D12_DESCRIPTOR_HEAP_DESC rtvDescriptorHeapDesc = {};
-    rtvDescriptorHeapDesc.NumDescriptors = c_swapBufferCount + 1; // <---- Add one here!
+    rtvDescriptorHeapDesc.NumDescriptors = c_swapBufferCount + 3; // <---- offscreen target and two history targets
     rtvDescriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 
     D3D12_DESCRIPTOR_HEAP_DESC dsvDescriptorHeapDesc = {};
@@ -404,35 +963,170 @@ void Game::CreateDevice()
 
     m_rtvDescriptorSize = m_d3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
-    // Create a command allocator for each back buffer that will be rendered to.
-    for (UINT n = 0; n < c_swapBufferCount; n++)
-    {
-        DX::ThrowIfFailed(m_d3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(m_commandAllocators[n].ReleaseAndGetAddressOf())));
-    }
+    // Every job system thread records into its own command lists, with an allocator per
+    // thread and frame in flight that is recycled once the GPU finished that frame. The
+    // pool's frame ring also fences GPU progress for WaitForGpu; the number of frames in
+    // flight is independent of the number of back buffers.
+    m_renderDevice = std::make_unique<D3D12RenderDevice>(m_d3dDevice.Get(), m_commandQueue.Get());
+    m_commandListPool = std::make_unique<CommandListPool>(*m_renderDevice, m_framesInFlight, m_jobSystem.GetThreadCount());
+
+	// Timestamps around every pass, in a query range per frame in flight that is read back
+	// once the frame's fence passed.
+	m_timestampQueries = std::make_unique<D3D12TimestampQueries>(m_d3dDevice.Get(), m_commandQueue.Get(),
+		GpuProfiler::GetQueryCount(m_framesInFlight, c_gpuProfilerScopes));
+	m_gpuProfiler = std::make_unique<GpuProfiler>(*m_timestampQueries, *m_renderDevice, m_framesInFlight,
+		c_gpuProfilerScopes, c_gpuProfilerFrames);
+	m_gpuPassVersion = 0;
+	m_gpuPassText.clear();
 
-    // Create a command list for recording graphics commands.
-    DX::ThrowIfFailed(m_d3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocators[0].Get(), nullptr, IID_PPV_ARGS(m_commandList.ReleaseAndGetAddressOf())));
-    DX::ThrowIfFailed(m_commandList->Close());
+    // TODO: Initialize device dependent objects here (independent of window size). // CreateDeviceHere
 
-    // Create a fence for tracking GPU execution progress.
-    DX::ThrowIfFailed(m_d3dDevice->CreateFence(m_fenceValues[m_backBufferIndex], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fence.ReleaseAndGetAddressOf())));
-    m_fenceValues[m_backBufferIndex]++;
 
-    m_fenceEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
-    if (!m_fenceEvent.IsValid())
-    {
-        throw std::exception("CreateEvent");
-    }
 
-    // TODO: Initialize device dependent objects here (independent of window size). // CreateDeviceHere
+	m_graphicsMemory = std::make_unique<GraphicsMemory>(m_d3dDevice.Get());
 
+	// MSAA levels with quality levels for both scene target formats. The requested count
+	// falls back to the highest supported one below it.
+	m_sampleCounts.assign(1, 1u);
+	for (UINT sampleCount = 2; sampleCount <= 8; sampleCount *= 2)
+	{
+		bool supported = true;
+		for (DXGI_FORMAT format : { DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_FORMAT_D32_FLOAT })
+		{
+			D3D12_FEATURE_DATA_MULTISAMPLE_QUALITY_LEVELS levels = {};
+			levels.Format = format;
+			levels.SampleCount = sampleCount;
+			if (FAILED(m_d3dDevice->CheckFeatureSupport(D3D12_FEATURE_MULTISAMPLE_QUALITY_LEVELS, &levels, sizeof(levels))) ||
+				levels.NumQualityLevels == 0)
+			{
+				supported = false;
+			}
+		}
+		if (supported)
+			m_sampleCounts.push_back(sampleCount);
+	}
+	m_sampleCount = *(std::upper_bound(m_sampleCounts.begin(), m_sampleCounts.end(), m_sampleCount) - 1);
 
+	m_resourceDescriptors = std::make_unique<DescriptorHeap>(m_d3dDevice.Get(),
+		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+		D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+		Descriptors::Count);
 
-	m_graphicsMemory = std::make_unique<GraphicsMemory>(m_d3dDevice.Get());
+	m_states = std::make_unique<CommonStates>(m_d3dDevice.Get());
+
+	// A grey texel stands in for every texture until the real one is streamed in. The direct
+	// queue waits for its copy on the GPU, the CPU does not.
+	m_copyQueue = std::make_unique<D3D12CopyQueue>(m_d3dDevice.Get());
+	{
+		CD3DX12_HEAP_PROPERTIES defaultHeap(D3D12_HEAP_TYPE_DEFAULT);
+		CD3DX12_RESOURCE_DESC placeholderDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1);
+		DX::ThrowIfFailed(m_d3dDevice->CreateCommittedResource(&defaultHeap, D3D12_HEAP_FLAG_NONE, &placeholderDesc,
+			D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(m_placeholder.ReleaseAndGetAddressOf())));
+		m_placeholder->SetName(L"Placeholder texture");
+
+		const uint32_t texel = 0xff808080;
+		D3D12_SUBRESOURCE_DATA placeholderData = { &texel, sizeof(texel), sizeof(texel) };
+		uint64_t placeholderFence = m_copyQueue->UploadTexture(m_placeholder.Get(), &placeholderData, 1);
+		DX::ThrowIfFailed(m_commandQueue->Wait(m_copyQueue->GetFence(), placeholderFence));
+
+		CreateShaderResourceView(m_d3dDevice.Get(), m_placeholder.Get(),
+			m_resourceDescriptors->GetCpuHandle(Descriptors::Placeholder));
+
+		D3D12RenderDevice::TextureViews placeholderViews;
+		placeholderViews.Resource = m_placeholder.Get();
+		placeholderViews.ShaderResource = m_resourceDescriptors->GetGpuHandle(Descriptors::Placeholder);
+		m_placeholderTexture = m_renderDevice->AddTexture(placeholderViews);
+	}
+
+	// Decoding happens on the streaming thread, so the first frame does not wait for it.
+	m_assetStreamer = std::make_unique<AssetStreamer>(*m_copyQueue);
+
+	// Frames use the placeholder until the resource is set, so the handles can exist before.
+	m_backgroundTexture = m_renderDevice->AddTexture(D3D12RenderDevice::TextureViews());
+	m_earthTexture = m_renderDevice->AddTexture(D3D12RenderDevice::TextureViews());
+	StreamTexture(L"galaxy.jpg", &m_background, Descriptors::Background, m_backgroundTexture);
+	StreamTexture(L"earth.bmp", &m_texture, Descriptors::Earth, m_earthTexture);
+
+	// SpriteFont only loads through a ResourceUploadBatch, which records for the direct queue,
+	// so the font skips the copy queue. It is still loaded on the streaming thread and
+	// finished by the time its load returns.
+	{
+		ID3D12Device* device = m_d3dDevice.Get();
+		ID3D12CommandQueue* commandQueue = m_commandQueue.Get();
+		D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = m_resourceDescriptors->GetCpuHandle(Descriptors::Courier);
+		D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = m_resourceDescriptors->GetGpuHandle(Descriptors::Courier);
+		auto font = std::make_shared<std::unique_ptr<SpriteFont>>();
+		m_assetStreamer->Load([device, commandQueue, cpuHandle, gpuHandle, font]() -> uint64_t
+		{
+			ResourceUploadBatch fontUpload(device);
+			fontUpload.Begin();
+			*font = std::make_unique<SpriteFont>(device, fontUpload, L"courier.spritefont", cpuHandle, gpuHandle);
+			fontUpload.End(commandQueue).wait();
+			return 0;
+		},
+		[this, font]()
+		{
+			m_font = std::move(*font);
+			m_fontHandle = m_renderDevice->AddFont(m_font.get());
+		});
+	}
+
+	m_batch = std::make_unique<PrimitiveBatch<VertexPositionColor>>(m_d3dDevice.Get());
+	CreatePipelines();
+
+	if (m_temporalAA)
+		m_temporalResolve = std::make_unique<TemporalAA::ResolvePass>(m_d3dDevice.Get(), DXGI_FORMAT_B8G8R8A8_UNORM);
+
+	// shape init
+	//ShapeObject shape1;
+	//ShapeObject shape2;
+	//m_shapes.push_back(shape1);
+	//m_shapes.push_back(shape2);
+
+	m_shape = GeometricPrimitive::CreateSphere();
+
+	// Low tessellation copy of the globe for the CPU occlusion culler. The polygon is
+	// inscribed in the sphere, so it never occludes more than the real globe.
+	{
+		std::vector<GeometricPrimitive::VertexType> vertices;
+		GeometricPrimitive::CreateSphere(vertices, m_globeOccluderIndices, 1.0f, 8);
+
+		m_globeOccluderPositions.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+			m_globeOccluderPositions[i] = vertices[i].position;
+	}
+	//m_shape2 = GeometricPrimitive::CreateTorus();
+	
 
+	m_world = Matrix::Identity;
+
+	// The DirectXTK objects are the D3D12 backend's pipelines, mesh and batches. The targets
+	// get their resources in CreateResources.
+	m_sceneResources.Grid = m_renderDevice->AddPipeline(m_gridEffect.get(), D3D12_GPU_DESCRIPTOR_HANDLE());
+	m_sceneResources.Globe = m_renderDevice->AddPipeline(m_shapeEffect.get(), m_states->AnisotropicWrap());
+	m_sceneResources.GlobeMesh = m_renderDevice->AddMesh(m_shape.get());
+	m_renderDevice->SetLineBatch(m_batch.get());
+	m_renderDevice->SetDescriptorHeaps(m_resourceDescriptors->Heap(), m_states->Heap());
+	m_sceneRenderer = std::make_unique<SceneRenderer>(m_sceneResources);
+
+	for (UINT n = 0; n < c_swapBufferCount; n++)
+		m_backBufferTextures[n] = m_renderDevice->AddTexture(D3D12RenderDevice::TextureViews());
+	m_sceneColorTexture = m_renderDevice->AddTexture(D3D12RenderDevice::TextureViews());
+	m_sceneDepthTexture = m_renderDevice->AddTexture(D3D12RenderDevice::TextureViews());
+	for (UINT n = 0; n < 2; n++)
+		m_historyTextures[n] = m_renderDevice->AddTexture(D3D12RenderDevice::TextureViews());
+	m_upscaleSourceTexture = m_renderDevice->AddTexture(D3D12RenderDevice::TextureViews());
+	m_sceneFrame.SceneDepth = m_sceneDepthTexture;
+}
+
+// The effects and the sprite batch are built for one sample count. When it changes they
+// are recreated and the render device's handles pointed at the new ones; the caller waits
+// for the GPU first.
+void Game::CreatePipelines()
+{
 	// set render target state
 	RenderTargetState rtState(DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_FORMAT_D32_FLOAT);
-	rtState.sampleDesc.Count = 4; // <---- 4x MSAA
+	rtState.sampleDesc.Count = m_sampleCount; // <---- MSAA level, or 1 with temporal AA
 
 	CD3DX12_RASTERIZER_DESC rastDesc(D3D12_FILL_MODE_SOLID, D3D12_CULL_MODE_NONE, FALSE,
 		D3D12_DEFAULT_DEPTH_BIAS, D3D12_DEFAULT_DEPTH_BIAS_CLAMP,
@@ -458,43 +1152,14 @@ void Game::CreateDevice()
 		rtState
 	);
 
-
-
-	m_resourceDescriptors = std::make_unique<DescriptorHeap>(m_d3dDevice.Get(),
-		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-		D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
-		Descriptors::Count);
-
-	m_states = std::make_unique<CommonStates>(m_d3dDevice.Get());
+	// The previous sprite batch's upload may still be in flight.
+	if (m_uploadFinished.valid())
+		m_uploadFinished.wait();
 
 	ResourceUploadBatch resourceUpload(m_d3dDevice.Get());
 
 	resourceUpload.Begin(); // ResourceUploadHere
 
-	
-	DX::ThrowIfFailed(
-		CreateWICTextureFromFile(m_d3dDevice.Get(), resourceUpload, L"galaxy.jpg",
-			m_background.ReleaseAndGetAddressOf()));
-
-	DX::ThrowIfFailed(
-		CreateWICTextureFromFile(m_d3dDevice.Get(), resourceUpload, L"earth.bmp",
-			m_texture.ReleaseAndGetAddressOf(), false));
-
-	CreateShaderResourceView(m_d3dDevice.Get(), m_background.Get(),
-		m_resourceDescriptors->GetCpuHandle(Descriptors::Background));
-
-	CreateShaderResourceView(m_d3dDevice.Get(), m_texture.Get(),
-		m_resourceDescriptors->GetCpuHandle(Descriptors::Earth));
-
-	// Load .spritefont file and make it ready.
-	m_font = std::make_unique<SpriteFont>(m_d3dDevice.Get(), resourceUpload,
-		L"courier.spritefont",
-		m_resourceDescriptors->GetCpuHandle(Descriptors::Courier),
-		m_resourceDescriptors->GetGpuHandle(Descriptors::Courier));
-
-	m_batch = std::make_unique<PrimitiveBatch<VertexPositionColor>>(m_d3dDevice.Get());
-	
-
 	SpriteBatchPipelineStateDescription sprite_pd(rtState);
 
 	// basic effect initialization
@@ -502,28 +1167,86 @@ void Game::CreateDevice()
 	m_shapeEffect = std::make_unique<BasicEffect>(m_d3dDevice.Get(), EffectFlags::PerPixelLighting | EffectFlags::Texture, shape_pd);
 	m_shapeEffect->SetLightEnabled(0, true);
 	m_shapeEffect->SetLightDiffuseColor(0, Colors::White);
-	m_shapeEffect->SetLightDirection(0, Vector3(-1.0f, -0.50f, 1.0f));
-	m_shapeEffect->SetTexture(m_resourceDescriptors->GetGpuHandle(Descriptors::Earth),
-		m_states->AnisotropicWrap());
+	m_shapeEffect->SetLightDirection(0, c_lightDirection);
 
-	// spritebatch init for text
+	// spritebatch init for the background
 	m_spriteBatch = std::make_unique<SpriteBatch>(m_d3dDevice.Get(), resourceUpload, sprite_pd);
+	m_renderDevice->SetSpriteBatch(m_spriteBatch.get());
 
-	// shape init
-	//ShapeObject shape1;
-	//ShapeObject shape2;
-	//m_shapes.push_back(shape1);
-	//m_shapes.push_back(shape2);
+	// The HUD and the upscale draw into the back buffer without depth, whatever the sample
+	// count.
+	if (!m_overlaySpriteBatch)
+	{
+		RenderTargetState overlayState(DXGI_FORMAT_B8G8R8A8_UNORM, DXGI_FORMAT_UNKNOWN);
+		SpriteBatchPipelineStateDescription overlay_pd(overlayState);
+		m_overlaySpriteBatch = std::make_unique<SpriteBatch>(m_d3dDevice.Get(), resourceUpload, overlay_pd);
+		m_renderDevice->SetOverlaySpriteBatch(m_overlaySpriteBatch.get());
+	}
 
-	m_shape = GeometricPrimitive::CreateSphere();
-	//m_shape2 = GeometricPrimitive::CreateTorus();
-	
+	// Only the sprite batches' index buffers are in this batch. Frames are executed on the
+	// same queue after it, so there is no need to wait; the future just keeps the staging
+	// memory alive until the upload is done.
+	m_uploadFinished = resourceUpload.End(m_commandQueue.Get()); // ResourceUploadEndHere
 
-	m_world = Matrix::Identity;
+	// On a rebuild; at device creation the pipelines are added afterwards.
+	if (m_sceneRenderer)
+	{
+		m_renderDevice->UpdatePipeline(m_sceneResources.Grid, m_gridEffect.get(), D3D12_GPU_DESCRIPTOR_HANDLE());
+		m_renderDevice->UpdatePipeline(m_sceneResources.Globe, m_shapeEffect.get(), m_states->AnisotropicWrap());
+	}
+}
 
-	auto uploadResourcesFinished = resourceUpload.End(m_commandQueue.Get()); // ResourceUploadEndHere
+// F7: the next supported sample count, wrapping around to 1.
+void Game::CycleSampleCount()
+{
+	if (m_temporalAA || m_sampleCounts.size() < 2)
+		return;
 
-	uploadResourcesFinished.wait();
+	auto next = std::upper_bound(m_sampleCounts.begin(), m_sampleCounts.end(), m_sampleCount);
+	m_sampleCount = next == m_sampleCounts.end() ? m_sampleCounts.front() : *next;
+
+	WaitForGpu();
+	CreatePipelines();
+	CreateResources();
+}
+
+// F9: dynamic resolution on or off, which adds or drops the offscreen targets at 1x and
+// the upscale source with MSAA.
+void Game::ToggleDynamicResolution()
+{
+	if (m_temporalAA)
+		return;
+
+	m_dynamicResolutionEnabled = !m_dynamicResolutionEnabled;
+	m_dynamicResolution.Reset();
+	CreateResources();
+}
+
+UINT64 Game::GetTargetMemory(UINT sampleCount, UINT width, UINT height) const
+{
+	D3D12_RESOURCE_DESC descs[4] =
+	{
+		CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_TYPELESS, width, height, 1, 1, sampleCount, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL),
+		CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_B8G8R8A8_UNORM, width, height, 1, 1, sampleCount, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+		CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_B8G8R8A8_UNORM, width, height, 1, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET),
+		CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_B8G8R8A8_UNORM, width, height, 1, 1, 1, 0,
+			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+	};
+
+	// Depth; the scene color unless the scene goes straight into the back buffer; the
+	// history targets with temporal AA, or the upscale source for MSAA with dynamic
+	// resolution. The back buffers belong to the swap chain.
+	UINT count = 1;
+	if (sampleCount > 1 || m_temporalAA || m_dynamicResolutionEnabled)
+		count++;
+	if (m_temporalAA)
+		count += 2;
+	else if (sampleCount > 1 && m_dynamicResolutionEnabled)
+		count++;
+	return m_d3dDevice->GetResourceAllocationInfo(0, count, descs).SizeInBytes;
 }
 
 // Allocate all memory resources that change on a window SizeChanged event.
@@ -532,11 +1255,10 @@ void Game::CreateResources()
     // Wait until all previous GPU work is complete.
     WaitForGpu();
 
-    // Release resources that are tied to the swap chain and update fence values.
+    // Release resources that are tied to the swap chain.
     for (UINT n = 0; n < c_swapBufferCount; n++)
     {
         m_renderTargets[n].Reset();
-        m_fenceValues[n] = m_fenceValues[m_backBufferIndex];
     }
 
     DXGI_FORMAT backBufferFormat = DXGI_FORMAT_B8G8R8A8_UNORM;
@@ -547,7 +1269,8 @@ void Game::CreateResources()
     // If the swap chain already exists, resize it, otherwise create one.
     if (m_swapChain)
     {
-        HRESULT hr = m_swapChain->ResizeBuffers(c_swapBufferCount, backBufferWidth, backBufferHeight, backBufferFormat, 0);
+        HRESULT hr = m_swapChain->ResizeBuffers(c_swapBufferCount, backBufferWidth, backBufferHeight, backBufferFormat,
+            DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT);
 
         if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET)
         {
@@ -577,6 +1300,7 @@ void Game::CreateResources()
         swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
         swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
         swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_IGNORE;
+        swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
 
         DXGI_SWAP_CHAIN_FULLSCREEN_DESC fsSwapChainDesc = {};
         fsSwapChainDesc.Windowed = TRUE;
@@ -594,6 +1318,11 @@ void Game::CreateResources()
 
         DX::ThrowIfFailed(swapChain.As(&m_swapChain));
 
+        // Tick waits on this object so the CPU never queues more than m_maxFrameLatency
+        // frames for presentation.
+        DX::ThrowIfFailed(m_swapChain->SetMaximumFrameLatency(m_maxFrameLatency));
+        m_frameLatencyWaitable.Attach(m_swapChain->GetFrameLatencyWaitableObject());
+
         // This template does not support exclusive fullscreen mode and prevents DXGI from responding to the ALT+ENTER shortcut
         DX::ThrowIfFailed(m_dxgiFactory->MakeWindowAssociation(m_window, DXGI_MWA_NO_ALT_ENTER));
     }
@@ -610,6 +1339,13 @@ void Game::CreateResources()
 
         CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor(m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), n, m_rtvDescriptorSize);
         m_d3dDevice->CreateRenderTargetView(m_renderTargets[n].Get(), nullptr, rtvDescriptor);
+
+        D3D12RenderDevice::TextureViews backBufferViews;
+        backBufferViews.Resource = m_renderTargets[n].Get();
+        backBufferViews.RenderTarget = rtvDescriptor;
+        backBufferViews.ResolveFormat = backBufferFormat;
+        backBufferViews.State = ResourceState::Present;
+        m_renderDevice->UpdateTexture(m_backBufferTextures[n], backBufferViews);
     }
 
     // Reset the index to the current back buffer.
@@ -619,13 +1355,14 @@ void Game::CreateResources()
     // on this surface.
     CD3DX12_HEAP_PROPERTIES depthHeapProperties(D3D12_HEAP_TYPE_DEFAULT);
 
+    // Typeless, so the temporal resolve can read it as R32_FLOAT.
     D3D12_RESOURCE_DESC depthStencilDesc = CD3DX12_RESOURCE_DESC::Tex2D(
-        depthBufferFormat,
+        DXGI_FORMAT_R32_TYPELESS,
         backBufferWidth,
         backBufferHeight,
         1, // This depth stencil view has only one texture.
         1, // Use a single mipmap level.
-		4  // <---- Use 4x MSAA
+		m_sampleCount  // <---- MSAA level
         );
     depthStencilDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
 
@@ -647,16 +1384,22 @@ void Game::CreateResources()
 
     D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
     dsvDesc.Format = depthBufferFormat;
-    dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DMS; // <---- use MSAA version
+    dsvDesc.ViewDimension = m_sampleCount > 1 ? D3D12_DSV_DIMENSION_TEXTURE2DMS : D3D12_DSV_DIMENSION_TEXTURE2D; // <---- use MSAA version
 
     m_d3dDevice->CreateDepthStencilView(m_depthStencil.Get(), &dsvDesc, m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 
+	if (m_temporalAA)
+	{
+		D3D12_SHADER_RESOURCE_VIEW_DESC depthSrvDesc = {};
+		depthSrvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		depthSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		depthSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		depthSrvDesc.Texture2D.MipLevels = 1;
+		m_d3dDevice->CreateShaderResourceView(m_depthStencil.Get(), &depthSrvDesc,
+			m_resourceDescriptors->GetCpuHandle(Descriptors::SceneDepth));
+	}
+
     // TODO: Initialize windows-size dependent objects here. //CreateResourcesHere
-	// Set DirectX viewport
-	D3D12_VIEWPORT viewport = { 0.0f, 0.0f,
-		static_cast<float>(backBufferWidth), static_cast<float>(backBufferHeight),
-		D3D12_MIN_DEPTH, D3D12_MAX_DEPTH };
-	
 	// msaa resource desription
 	D3D12_RESOURCE_DESC msaaRTDesc = CD3DX12_RESOURCE_DESC::Tex2D(
 		backBufferFormat,
@@ -664,7 +1407,7 @@ void Game::CreateResources()
 		backBufferHeight,
 		1, // This render target view has only one texture.
 		1, // Use a single mipmap level
-		4  // <--- Use 4x MSAA 
+		m_sampleCount  // <--- MSAA level
 	);
 	msaaRTDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
 
@@ -672,76 +1415,154 @@ void Game::CreateResources()
 	msaaOptimizedClearValue.Format = backBufferFormat;
 	memcpy(msaaOptimizedClearValue.Color, Colors::CornflowerBlue, sizeof(float) * 4);
 
-	DX::ThrowIfFailed(m_d3dDevice->CreateCommittedResource(
-		&depthHeapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&msaaRTDesc,
-		D3D12_RESOURCE_STATE_RESOLVE_SOURCE,
-		&msaaOptimizedClearValue,
-		IID_PPV_ARGS(m_offscreenRenderTarget.ReleaseAndGetAddressOf())
-	));
-
+	// At 1x without temporal AA or dynamic resolution there is nothing to resolve or
+	// upscale; Render points the scene color at the back buffer instead.
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvDescriptor(
 		m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
 		c_swapBufferCount, m_rtvDescriptorSize);
-	m_d3dDevice->CreateRenderTargetView(m_offscreenRenderTarget.Get(), nullptr, rtvDescriptor);
+	if (m_sampleCount > 1 || m_temporalAA || m_dynamicResolutionEnabled)
+	{
+		DX::ThrowIfFailed(m_d3dDevice->CreateCommittedResource(
+			&depthHeapProperties,
+			D3D12_HEAP_FLAG_NONE,
+			&msaaRTDesc,
+			D3D12_RESOURCE_STATE_RENDER_TARGET,
+			&msaaOptimizedClearValue,
+			IID_PPV_ARGS(m_offscreenRenderTarget.ReleaseAndGetAddressOf())
+		));
+
+		m_d3dDevice->CreateRenderTargetView(m_offscreenRenderTarget.Get(), nullptr, rtvDescriptor);
+	}
+	else
+	{
+		m_offscreenRenderTarget.Reset();
+	}
 
-	// set fullscreen rectangle
-	m_fullscreenRect.left = 0;
-	m_fullscreenRect.top = 0;
-	m_fullscreenRect.right = backBufferWidth;
-	m_fullscreenRect.bottom = backBufferHeight;
+	// A single-sample scene color is read by the temporal resolve or the upscale.
+	bool readSceneColor = m_offscreenRenderTarget && m_sampleCount == 1;
+	if (readSceneColor)
+	{
+		CreateShaderResourceView(m_d3dDevice.Get(), m_offscreenRenderTarget.Get(),
+			m_resourceDescriptors->GetCpuHandle(Descriptors::SceneColor));
+	}
+
+	// With MSAA the upscale reads a single-sample resolve of the scene.
+	D3D12RenderDevice::TextureViews upscaleSourceViews;
+	if (m_dynamicResolutionEnabled && m_sampleCount > 1)
+	{
+		D3D12_RESOURCE_DESC upscaleSourceDesc = CD3DX12_RESOURCE_DESC::Tex2D(backBufferFormat,
+			backBufferWidth, backBufferHeight, 1, 1);
+		DX::ThrowIfFailed(m_d3dDevice->CreateCommittedResource(
+			&depthHeapProperties,
+			D3D12_HEAP_FLAG_NONE,
+			&upscaleSourceDesc,
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+			nullptr,
+			IID_PPV_ARGS(m_upscaleSource.ReleaseAndGetAddressOf())
+		));
+		m_upscaleSource->SetName(L"Upscale source");
+		CreateShaderResourceView(m_d3dDevice.Get(), m_upscaleSource.Get(),
+			m_resourceDescriptors->GetCpuHandle(Descriptors::UpscaleSource));
+
+		upscaleSourceViews.Resource = m_upscaleSource.Get();
+		upscaleSourceViews.ShaderResource = m_resourceDescriptors->GetGpuHandle(Descriptors::UpscaleSource);
+		upscaleSourceViews.ResolveFormat = backBufferFormat;
+		upscaleSourceViews.State = ResourceState::ShaderResource;
+	}
+	else
+	{
+		m_upscaleSource.Reset();
+	}
+	m_renderDevice->UpdateTexture(m_upscaleSourceTexture, upscaleSourceViews);
 
-	m_spriteBatch->SetViewport(viewport);
+	// Temporal AA: the scene is read by the resolve pass, which accumulates into two
+	// history targets used alternately as destination and previous frame.
+	if (m_temporalAA)
+	{
 
-	m_camera.UpdateViewMatrix();
+		for (UINT n = 0; n < 2; n++)
+		{
+			DX::ThrowIfFailed(m_d3dDevice->CreateCommittedResource(
+				&depthHeapProperties,
+				D3D12_HEAP_FLAG_NONE,
+				&msaaRTDesc,
+				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+				&msaaOptimizedClearValue,
+				IID_PPV_ARGS(m_historyTargets[n].ReleaseAndGetAddressOf())
+			));
+
+			CD3DX12_CPU_DESCRIPTOR_HANDLE historyDescriptor(
+				m_rtvDescriptorHeap->GetCPUDescriptorHandleForHeapStart(),
+				c_swapBufferCount + 1 + n, m_rtvDescriptorSize);
+			m_d3dDevice->CreateRenderTargetView(m_historyTargets[n].Get(), nullptr, historyDescriptor);
+			CreateShaderResourceView(m_d3dDevice.Get(), m_historyTargets[n].Get(),
+				m_resourceDescriptors->GetCpuHandle(Descriptors::History0 + n));
+
+			D3D12RenderDevice::TextureViews historyViews;
+			historyViews.Resource = m_historyTargets[n].Get();
+			historyViews.RenderTarget = historyDescriptor;
+			historyViews.State = ResourceState::ShaderResource;
+			m_renderDevice->UpdateTexture(m_historyTextures[n], historyViews);
+		}
+		m_historyIndex = 0;
+		m_historyValid = false;
+	}
 
-	m_earthRotation = Matrix::CreateRotationX(0.f);
-	// set effect matrices
-	m_gridEffect->SetView(m_camera.GetView());
-	m_gridEffect->SetProjection(m_camera.GetProj());
+	D3D12RenderDevice::TextureViews sceneColorViews;
+	sceneColorViews.Resource = m_offscreenRenderTarget.Get();
+	sceneColorViews.RenderTarget = rtvDescriptor;
+	sceneColorViews.State = ResourceState::RenderTarget;
+	if (readSceneColor)
+		sceneColorViews.ShaderResource = m_resourceDescriptors->GetGpuHandle(Descriptors::SceneColor);
+	m_renderDevice->UpdateTexture(m_sceneColorTexture, sceneColorViews);
+
+	D3D12RenderDevice::TextureViews sceneDepthViews;
+	sceneDepthViews.Resource = m_depthStencil.Get();
+	sceneDepthViews.DepthStencil = m_dsvDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+	sceneDepthViews.State = ResourceState::DepthWrite;
+	m_renderDevice->UpdateTexture(m_sceneDepthTexture, sceneDepthViews);
+
+	// What each supported MSAA level costs at this size, for picking one per machine.
+	char sampleCountString[160];
+	int length = snprintf(sampleCountString, sizeof(sampleCountString), "msaa %ux (F7)  scene targets %.1f MB  [",
+		m_sampleCount, GetTargetMemory(m_sampleCount, backBufferWidth, backBufferHeight) / (1024.0 * 1024.0));
+	for (UINT sampleCount : m_sampleCounts)
+	{
+		length += snprintf(sampleCountString + length, sizeof(sampleCountString) - length, " %ux %.1f",
+			sampleCount, GetTargetMemory(sampleCount, backBufferWidth, backBufferHeight) / (1024.0 * 1024.0));
+	}
+	snprintf(sampleCountString + length, sizeof(sampleCountString) - length, " MB ]");
+	m_sampleCountText = sampleCountString;
+	OutputDebugStringA((m_sampleCountText + "\n").c_str());
 
 	
 }
 
 void Game::WaitForGpu() noexcept
 {
-    if (m_commandQueue && m_fence && m_fenceEvent.IsValid())
+    CPU_PROFILE_FUNCTION();
+
+    if (m_commandListPool)
     {
-        // Schedule a Signal command in the GPU queue.
-        UINT64 fenceValue = m_fenceValues[m_backBufferIndex];
-        if (SUCCEEDED(m_commandQueue->Signal(m_fence.Get(), fenceValue)))
+        try
+        {
+            m_commandListPool->WaitForIdle();
+        }
+        catch (...)
         {
-            // Wait until the Signal has been processed.
-            if (SUCCEEDED(m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent.Get())))
-            {
-                WaitForSingleObjectEx(m_fenceEvent.Get(), INFINITE, FALSE);
-
-                // Increment the fence value for the current frame.
-                m_fenceValues[m_backBufferIndex]++;
-            }
+            // The device is gone; there is nothing left to wait for.
         }
     }
 }
 
 void Game::MoveToNextFrame()
 {
-    // Schedule a Signal command in the queue.
-    const UINT64 currentFenceValue = m_fenceValues[m_backBufferIndex];
-    DX::ThrowIfFailed(m_commandQueue->Signal(m_fence.Get(), currentFenceValue));
+    CPU_PROFILE_FUNCTION();
 
-    // Update the back buffer index.
+    // Update the back buffer index. Waiting for the GPU happens in the command list pool
+    // when the next frame starts, once it would run more than m_framesInFlight frames ahead;
+    // DXGI itself keeps the CPU from overwriting a back buffer that is still queued.
     m_backBufferIndex = m_swapChain->GetCurrentBackBufferIndex();
-
-    // If the next frame is not ready to be rendered yet, wait until it is ready.
-    if (m_fence->GetCompletedValue() < m_fenceValues[m_backBufferIndex])
-    {
-        DX::ThrowIfFailed(m_fence->SetEventOnCompletion(m_fenceValues[m_backBufferIndex], m_fenceEvent.Get()));
-        WaitForSingleObjectEx(m_fenceEvent.Get(), INFINITE, FALSE);
-    }
-
-    // Set the fence value for the next frame.
-    m_fenceValues[m_backBufferIndex] = currentFenceValue + 1;
 }
 
 // This method acquires the first available hardware adapter that supports Direct3D 12.
@@ -790,12 +1611,22 @@ void Game::GetAdapter(IDXGIAdapter1** ppAdapter)
 void Game::OnDeviceLost()
 {
     // TODO: Perform Direct3D resource cleanup. // ondevicelosthere
+	m_assetStreamer.reset();
+	m_copyQueue.reset();
+	m_placeholder.Reset();
+	if (m_uploadFinished.valid())
+		m_uploadFinished.wait();
 	m_graphicsMemory.reset();
 	m_font.reset();
 	m_shapeEffect.reset();
 	m_offscreenRenderTarget.Reset();
+	m_temporalResolve.reset();
+	m_historyTargets[0].Reset();
+	m_historyTargets[1].Reset();
+	m_upscaleSource.Reset();
 	m_resourceDescriptors.reset();
 	m_spriteBatch.reset();
+	m_overlaySpriteBatch.reset();
 	m_gridEffect.reset();
 	m_batch.reset();
 	m_background.Reset();
@@ -811,13 +1642,17 @@ void Game::OnDeviceLost()
 
     for (UINT n = 0; n < c_swapBufferCount; n++)
     {
-        m_commandAllocators[n].Reset();
         m_renderTargets[n].Reset();
     }
 
     m_depthStencil.Reset();
-    m_fence.Reset();
-    m_commandList.Reset();
+    m_sceneRenderer.reset();
+    m_gpuProfiler.reset();
+    m_timestampQueries.reset();
+    m_commandListPool.reset();
+    m_renderDevice.reset();
+    m_fontHandle = RenderFont();
+    m_frameLatencyWaitable.Close();
     m_swapChain.Reset();
     m_rtvDescriptorHeap.Reset();
     m_dsvDescriptorHeap.Reset();
@@ -829,55 +1664,35 @@ void Game::OnDeviceLost()
     CreateResources();
 }
 
-void Game::drawText(const char * asciiString, const Vector2 &pos)
-{
-	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-	std::wstring output = converter.from_bytes(asciiString);
-
-	ID3D12DescriptorHeap* heaps[] = { m_resourceDescriptors->Heap() };
-	m_commandList->SetDescriptorHeaps(_countof(heaps), heaps);
-
-	//Vector2 origin = m_font->MeasureString(output.c_str()) / 2.f; // sets text origin to center
-	Vector2 origin = { 0.0f, 0.0f }; // set text origin to upper left corner
-	Vector2 fontPos = pos;
-
-	m_font->DrawString(m_spriteBatch.get(), output.c_str(),
-		fontPos, Colors::White, 0.f, origin);
-
-}
-
-void Game::drawGrid(Vector3 xaxis,
-					Vector3 yaxis,
-					Vector3 origin,
-					XMFLOAT4 color,
-					size_t divisions)
+// Decodes and uploads a texture on the asset streamer. Once the copy finished, the texture
+// is stored in *texture with a view in the descriptor slot, and handle points at it.
+void Game::StreamTexture(const wchar_t* fileName, ComPtr<ID3D12Resource>* texture,
+	size_t descriptor, RenderTexture handle)
 {
+	ID3D12Device* device = m_d3dDevice.Get();
+	D3D12CopyQueue* copyQueue = m_copyQueue.get();
+	auto loaded = std::make_shared<ComPtr<ID3D12Resource>>();
 
-	for (size_t i = 0; i <= divisions; ++i)
+	m_assetStreamer->Load([device, copyQueue, fileName, loaded]()
 	{
-		float fPercent = float(i) / float(divisions);
-		fPercent = (fPercent * 2.0f) - 1.0f;
-
-		Vector3 scale = xaxis * fPercent + origin;
-
-		VertexPositionColor v1(scale - yaxis, color);
-		VertexPositionColor v2(scale + yaxis, color);
-		m_batch->DrawLine(v1, v2);
-	}
-
-	for (size_t i = 0; i <= divisions; i++)
+		// Created in the COPY_DEST state, ready for the copy queue.
+		std::unique_ptr<uint8_t[]> decoded;
+		D3D12_SUBRESOURCE_DATA subresource;
+		DX::ThrowIfFailed(LoadWICTextureFromFile(device, fileName, loaded->GetAddressOf(), decoded, subresource));
+		return copyQueue->UploadTexture(loaded->Get(), &subresource, 1);
+	},
+	[this, texture, descriptor, handle, loaded]()
 	{
-		float fPercent = float(i) / float(divisions);
-		fPercent = (fPercent * 2.0f) - 1.0f;
-
-		Vector3 scale = yaxis * fPercent + origin;
-
-		VertexPositionColor v1(scale - xaxis, color);
-		VertexPositionColor v2(scale + xaxis, color);
-		m_batch->DrawLine(v1, v2);
-	}
-
-	
+		// The slot has not been used by any frame yet, so it can be written while frames
+		// are in flight.
+		*texture = *loaded;
+		CreateShaderResourceView(m_d3dDevice.Get(), texture->Get(), m_resourceDescriptors->GetCpuHandle(descriptor));
+
+		D3D12RenderDevice::TextureViews views;
+		views.Resource = texture->Get();
+		views.ShaderResource = m_resourceDescriptors->GetGpuHandle(descriptor);
+		m_renderDevice->UpdateTexture(handle, views);
+	});
 }
 
 void Game::BuildRenderItems()
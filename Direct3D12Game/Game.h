@@ -4,7 +4,21 @@
 
 #pragma once
 
+#include "AssetStreamer.h"
+#include "CameraPath.h"
+#include "CpuProfiler.h"
+#include "D3D12CopyQueue.h"
+#include "D3D12RenderDevice.h"
+#include "D3D12TimestampQueries.h"
+#include "DynamicResolution.h"
+#include "FramePacer.h"
+#include "FramePipeline.h"
+#include "GpuProfiler.h"
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+#include "SceneRenderer.h"
 #include "StepTimer.h"
+#include "TemporalResolvePass.h"
 
 // A basic game implementation that creates a D3D12 device and
 // provides a game loop.
@@ -17,6 +31,16 @@ public:
     // Initialization and management
     void Initialize(HWND window, int width, int height);
 
+	// Frames the CPU may record ahead of the GPU (clamped to 2 to 4) and frames DXGI may
+	// queue for presentation (1 to framesInFlight). Call before Initialize.
+	void SetFrameQueue(UINT framesInFlight, UINT maxFrameLatency);
+	// MSAA samples per pixel (1, 2, 4 or 8); the highest count the device supports up to
+	// it is used. Ignored with temporal AA. Call before Initialize; F7 cycles at run time.
+	void SetSampleCount(UINT sampleCount);
+	// Render the scene at the scale that holds the frame time target and upscale it.
+	// Ignored with temporal AA. Call before Initialize; F9 toggles at run time.
+	void SetDynamicResolution(bool enabled);
+
     // Basic game loop
     void Tick();
 
@@ -29,23 +53,79 @@ public:
 
     // Properties
     void GetDefaultSize( int& width, int& height ) const;
+	bool IsSuspended() const { return m_suspended; }
 
 private:
 
+	// Simulation state of the last two fixed steps, interpolated by Render.
+	struct SceneState
+	{
+		DirectX::SimpleMath::Vector3 GlobePosition;
+		float GlobeAngle = 0.0f;
+		DirectX::SimpleMath::Vector3 GridOrigin;
+	};
+
+	// Everything Render needs from the simulation thread for one frame.
+	struct RenderState
+	{
+		CameraSnapshot Camera;
+		SceneState PreviousScene;
+		SceneState CurrentScene;
+		float Alpha = 0.0f;							// interpolation factor between the scenes
+		uint64_t Updates = 0;						// simulation steps run so far
+		uint32_t FramesPerSecond = 0;
+		uint32_t UpdatesPerSecond = 0;
+		double TimeDilation = 1.0;
+		double DroppedSeconds = 0.0;
+		bool RecordingPath = false;
+		bool PlayingPath = false;
+		size_t PathSegment = 0;
+		std::chrono::steady_clock::time_point InputTime;	// when the input of this frame was read
+	};
+
+	// simulation thread: one frame of input, fixed steps and camera, packed for Render
+	void Simulate(RenderState& state);
     void Update(DX::StepTimer const& timer);
+	// per frame input and camera update
+	void UpdateFrame(float elapsedSeconds);
 	// input and movement
-	void OnKeyboardInput(DX::StepTimer const& timer);
+	void OnKeyboardInput(float elapsedSeconds);
+	// camera path recording and playback
+	void UpdateCameraPath(DX::StepTimer const& timer);
 
 	std::unique_ptr<DirectX::Keyboard>	m_keyboard;
 	std::unique_ptr<DirectX::Mouse>		m_mouse;
+	DirectX::Keyboard::KeyboardStateTracker	m_keyboardTracker;
+
+	// Command lists of a frame, in submission order
+	enum class RenderPass : UINT
+	{
+		Clear,
+		Sprites,
+		Grids,
+		Globe,
+		Resolve
+	};
 
-    void Render();
+    void Render(const RenderState& state);
+	// HUD text of the frame, into m_sceneFrame
+	void UpdateHud(const RenderState& state);
+	void UpdateGpuPassText();
+	IRenderCommandList& BeginPass(RenderPass pass);
 
     void Clear();
-    void Present();
+    void Present(const RenderState& state);
+	void ResolveTemporal(IRenderCommandList& list, const CameraSnapshot& camera);
+	void SampleCpuTime(std::chrono::steady_clock::time_point now);
 
     void CreateDevice();
     void CreateResources();
+	// Effects and sprite batch for m_sampleCount.
+	void CreatePipelines();
+	void CycleSampleCount();
+	void ToggleDynamicResolution();
+	// GPU memory of the scene targets at a sample count.
+	UINT64 GetTargetMemory(UINT sampleCount, UINT width, UINT height) const;
 
     void WaitForGpu() noexcept;
     void MoveToNextFrame();
@@ -61,7 +141,11 @@ private:
 
     // Direct3D Objects
     D3D_FEATURE_LEVEL                                   m_featureLevel;
-    static const UINT                                   c_swapBufferCount = 2;
+    static const UINT                                   c_swapBufferCount = 3;
+    static const UINT                                   c_minFramesInFlight = 2;
+    static const UINT                                   c_maxFramesInFlight = 4;
+    UINT                                                m_framesInFlight;
+    UINT                                                m_maxFrameLatency;
     UINT                                                m_backBufferIndex;
     UINT                                                m_rtvDescriptorSize;
     Microsoft::WRL::ComPtr<ID3D12Device>                m_d3dDevice;
@@ -69,20 +153,41 @@ private:
     Microsoft::WRL::ComPtr<ID3D12CommandQueue>          m_commandQueue;
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>        m_rtvDescriptorHeap;
     Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>        m_dsvDescriptorHeap;
-    Microsoft::WRL::ComPtr<ID3D12CommandAllocator>      m_commandAllocators[c_swapBufferCount];
-    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>   m_commandList;
-    Microsoft::WRL::ComPtr<ID3D12Fence>                 m_fence;
-    UINT64                                              m_fenceValues[c_swapBufferCount];
-    Microsoft::WRL::Wrappers::Event                     m_fenceEvent;
+    std::unique_ptr<D3D12RenderDevice>                  m_renderDevice;
+    std::unique_ptr<CommandListPool>                    m_commandListPool;
+	std::unique_ptr<D3D12TimestampQueries>				m_timestampQueries;
+	std::unique_ptr<GpuProfiler>						m_gpuProfiler;
+	uint64_t											m_gpuPassVersion;	// averages shown in m_gpuPassText
+	std::string											m_gpuPassText;
 
     // Rendering resources
     Microsoft::WRL::ComPtr<IDXGISwapChain3>             m_swapChain;
     Microsoft::WRL::ComPtr<ID3D12Resource>              m_renderTargets[c_swapBufferCount];
     Microsoft::WRL::ComPtr<ID3D12Resource>              m_depthStencil;
+    Microsoft::WRL::Wrappers::Event                     m_frameLatencyWaitable;
 
     // Game state
     DX::StepTimer                                       m_timer;
 
+	// The simulation runs on its own thread one frame ahead of Render. The window thread
+	// only talks to it through these.
+	DX::FramePipeline<RenderState>						m_simulation;
+	std::atomic<uint64_t>								m_viewSize;			// width << 32 | height
+	std::atomic<bool>									m_resetElapsedTime;
+	std::atomic<bool>									m_exitRequested;
+	std::atomic<bool>									m_cycleSampleCount;	// F7, applied by Tick
+	std::atomic<bool>									m_toggleDynamicResolution;	// F9, applied by Tick
+	uint64_t											m_lensSize;			// m_viewSize the camera lens was set for
+	DX::FramePacer										m_framePacer;
+	bool												m_suspended;
+
+	// Process CPU time per rendered frame, averaged over about a second.
+	std::chrono::steady_clock::time_point				m_cpuSampleTime;
+	uint64_t											m_cpuSampleProcessTime;	// 100 ns units
+	uint32_t											m_cpuSampleFrames;
+	double												m_cpuMsPerFrame;
+	double												m_inputToSubmitMs;	// last frame, input read to ExecuteCommandLists
+
 	// User variables *********************************//
 	//***********************************************///
 	// Graphics memory unique pointer
@@ -90,16 +195,51 @@ private:
 	std::unique_ptr<DirectX::DescriptorHeap>			m_resourceDescriptors;
 	std::unique_ptr<DirectX::SpriteFont>				m_font;
 
+	// Textures and the font stream in on the copy queue; until they are swapped in the
+	// draws use a 1x1 placeholder and the HUD has no text.
+	std::unique_ptr<D3D12CopyQueue>						m_copyQueue;
+	std::unique_ptr<AssetStreamer>						m_assetStreamer;
+	Microsoft::WRL::ComPtr<ID3D12Resource>				m_placeholder;
+	std::future<void>									m_uploadFinished;	// small direct queue uploads, never waited on
+	std::chrono::steady_clock::time_point				m_startTime;
+	double												m_firstFrameMs;
+	double												m_assetsReadyMs;
+
 	Microsoft::WRL::ComPtr<ID3D12Resource>				m_background;
 	Microsoft::WRL::ComPtr<ID3D12Resource>				m_offscreenRenderTarget;
+
+	// Anti-aliasing: either MSAA resolved into the back buffer, or 1 sample per pixel
+	// with a jittered projection accumulated into ping-ponged history targets. At 1 sample
+	// without temporal AA the scene is drawn straight into the back buffer.
+	bool												m_temporalAA;
+	UINT												m_sampleCount;
+	std::vector<UINT>									m_sampleCounts;		// supported by the device, ascending
+	std::string											m_sampleCountText;	// HUD line with the target memory
+	std::unique_ptr<TemporalAA::ResolvePass>			m_temporalResolve;
+	Microsoft::WRL::ComPtr<ID3D12Resource>				m_historyTargets[2];
+	UINT												m_historyIndex;		// history written this frame
+	bool												m_historyValid;
 	Microsoft::WRL::ComPtr<ID3D12Resource>				m_texture;
 	std::unique_ptr<DirectX::CommonStates>				m_states;
 
-	// Font attributes
+	// Dynamic resolution: the scene targets keep the window size and the scene is drawn
+	// into their top left at the controller's scale, then upscaled into the back buffer.
+	// With MSAA it is resolved into m_upscaleSource first. The GPU time of the profiled
+	// passes is what the controller holds at the target.
+	DynamicResolution									m_dynamicResolution;
+	bool												m_dynamicResolutionEnabled;
+	Microsoft::WRL::ComPtr<ID3D12Resource>				m_upscaleSource;
+
+	// Font attributes; the overlay batch draws the HUD and the upscale into the back buffer
 	std::unique_ptr<DirectX::SpriteBatch>				m_spriteBatch;
+	std::unique_ptr<DirectX::SpriteBatch>				m_overlaySpriteBatch;
 	DirectX::SimpleMath::Vector2						m_origin;
 
 
+	// Simulation state, owned by the simulation thread
+	SceneState											m_previousScene;
+	SceneState											m_currentScene;
+
 	// Matrices
 	DirectX::SimpleMath::Matrix							m_earthRotation;
 	DirectX::SimpleMath::Matrix							m_world;
@@ -108,7 +248,24 @@ private:
 	// Camera
 	Camera												m_camera;
 
+	// Camera flythrough recording and benchmark playback
+	CameraPath											m_cameraPath;
+	CameraPathStats										m_cameraPathStats;
+	bool												m_recordingPath;
+	bool												m_playingPath;
+	uint64_t											m_pathStartTicks;
+	size_t												m_pathSegment;
+	std::chrono::steady_clock::time_point				m_lastFrameTime;
+
 	std::unique_ptr<DirectX::GeometricPrimitive>		m_shape;
+
+	// Worker threads for per-frame work on the window thread (Render)
+	JobSystem											m_jobSystem;
+
+	// CPU occlusion culling against the globe
+	OcclusionCuller										m_occlusionCuller;
+	std::vector<DirectX::XMFLOAT3>						m_globeOccluderPositions;
+	std::vector<uint16_t>								m_globeOccluderIndices;
 	//std::unique_ptr<DirectX::GeometricPrimitive>		m_shape2;
 
 
@@ -117,24 +274,41 @@ private:
 	std::unique_ptr<DirectX::BasicEffect> m_shapeEffect;
 	std::unique_ptr<DirectX::PrimitiveBatch<DirectX::VertexPositionColor>> m_batch;
 
+	// The passes record through the render interface. The objects above are added to
+	// m_renderDevice in CreateDevice; the handles stay valid across resizes.
+	std::unique_ptr<SceneRenderer>						m_sceneRenderer;
+	SceneFrame											m_sceneFrame;		// filled in by Render before the passes start
+	SceneResources										m_sceneResources;
+	RenderTexture										m_backBufferTextures[c_swapBufferCount];
+	RenderTexture										m_sceneColorTexture;
+	RenderTexture										m_sceneDepthTexture;
+	RenderTexture										m_historyTextures[2];
+	RenderTexture										m_upscaleSourceTexture;
+	RenderTexture										m_placeholderTexture;
+	RenderTexture										m_backgroundTexture;
+	RenderTexture										m_earthTexture;
+	RenderFont											m_fontHandle;
+	D3D12RenderDevice::Stats							m_renderStats;		// barriers of the last frame
+
 	// Rect descriptors
-	RECT m_fullscreenRect;
 	enum Descriptors
 	{
+		Placeholder,
 		Courier,
 		Earth,
 		Background,
+		SceneColor,		// SceneColor and SceneDepth must stay consecutive
+		SceneDepth,
+		History0,
+		History1,
+		UpscaleSource,
 		Count
 	};
 
 	// ************************************************//
 	// User Methods ********************************//
-	void drawText(const char* asciiString, const DirectX::SimpleMath::Vector2 &pos);
-	void drawGrid(	DirectX::SimpleMath::Vector3 xaxis,
-					DirectX::SimpleMath::Vector3 yaxis,
-					DirectX::SimpleMath::Vector3 origin,
-					DirectX::XMFLOAT4 color,
-					size_t divisions);
+	void StreamTexture(const wchar_t* fileName, Microsoft::WRL::ComPtr<ID3D12Resource>* texture,
+		size_t descriptor, RenderTexture handle);
 
 	void BuildRenderItems();
 
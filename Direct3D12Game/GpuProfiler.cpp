@@ -0,0 +1,284 @@
+//
+// GpuProfiler.cpp
+//
+
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cassert>
+
+//
+// GpuProfiler::Scope
+//
+
+GpuProfiler::Scope::Scope(GpuProfiler& profiler, ICommandList& list, const char* name) :
+	mProfiler(profiler),
+	mList(list),
+	mScope(profiler.BeginScope(list, name))
+{
+}
+
+GpuProfiler::Scope::~Scope()
+{
+	mProfiler.EndScope(mList, mScope);
+}
+
+//
+// GpuProfiler
+//
+
+GpuProfiler::GpuProfiler(ITimestampSource& source, IGpuFence& fence, uint32_t framesInFlight, uint32_t maxScopes,
+	uint32_t averageFrames) :
+	mSource(source),
+	mFence(fence),
+	mMaxScopes(maxScopes),
+	mAverageFrames(std::max(averageFrames, 1u)),
+	mSlots(framesInFlight),
+	mFrameIndex(framesInFlight - 1),
+	mRecording(false),
+	mNextScope(0),
+	mTicks(size_t(maxScopes) * 2),
+	mWindowFrameMs(0.0),
+	mWindowFrames(0),
+	mAverageFrameMs(0.0),
+	mAveragesVersion(0)
+{
+	assert(framesInFlight > 0 && maxScopes > 0);
+
+	for (auto& slot : mSlots)
+	{
+		slot.Names.resize(maxScopes);
+		slot.Ended.resize(maxScopes);
+	}
+}
+
+uint32_t GpuProfiler::GetQueryCount(uint32_t framesInFlight, uint32_t maxScopes)
+{
+	return framesInFlight * maxScopes * 2;
+}
+
+uint32_t GpuProfiler::BeginFrame()
+{
+	assert(!mRecording);
+
+	// Oldest first, so the averages see the frames in order. Only the oldest slot, the
+	// one about to be reused, is waited for; the rest finish after it.
+	uint32_t count = uint32_t(mSlots.size());
+	uint32_t collected = 0;
+	for (uint32_t i = 1; i <= count; i++)
+	{
+		uint32_t index = (mFrameIndex + i) % count;
+		Slot& slot = mSlots[index];
+		if (!slot.Pending)
+			continue;
+
+		if (slot.Fence > mFence.GetCompletedFence())
+		{
+			if (i > 1)
+				break;
+			mFence.WaitForFence(slot.Fence);
+			mStats.FenceWaits++;
+		}
+
+		Collect(slot, index);
+		collected++;
+	}
+
+	mFrameIndex = (mFrameIndex + 1) % count;
+	Slot& slot = mSlots[mFrameIndex];
+	slot.Scopes = 0;
+	std::fill(slot.Names.begin(), slot.Names.end(), nullptr);
+	std::fill(slot.Ended.begin(), slot.Ended.end(), uint8_t(0));
+	mNextScope = 0;
+	mRecording = true;
+	return collected;
+}
+
+uint32_t GpuProfiler::BeginScope(ICommandList& list, const char* name)
+{
+	assert(mRecording);
+
+	// Past the last pair the counter keeps running, so ResolveFrame can count the drops.
+	uint32_t scope = mNextScope.fetch_add(1);
+	if (scope >= mMaxScopes)
+		return InvalidScope;
+
+	mSlots[mFrameIndex].Names[scope] = name;
+	mSource.WriteTimestamp(list, GetFirstQuery(mFrameIndex) + scope * 2);
+	return scope;
+}
+
+void GpuProfiler::EndScope(ICommandList& list, uint32_t scope)
+{
+	if (scope == InvalidScope)
+		return;
+
+	assert(mRecording && scope < mMaxScopes);
+	mSource.WriteTimestamp(list, GetFirstQuery(mFrameIndex) + scope * 2 + 1);
+	mSlots[mFrameIndex].Ended[scope] = 1;
+}
+
+void GpuProfiler::ResolveFrame(ICommandList& list)
+{
+	assert(mRecording);
+
+	uint32_t begun = mNextScope;
+	Slot& slot = mSlots[mFrameIndex];
+	slot.Scopes = std::min(begun, mMaxScopes);
+	mStats.DroppedScopes += begun - slot.Scopes;
+	if (slot.Scopes > 0)
+		mSource.Resolve(list, GetFirstQuery(mFrameIndex), slot.Scopes * 2);
+}
+
+void GpuProfiler::EndFrame()
+{
+	assert(mRecording);
+
+	Slot& slot = mSlots[mFrameIndex];
+	slot.Fence = mFence.Signal();
+	slot.Pending = true;
+	mRecording = false;
+}
+
+void GpuProfiler::WaitForIdle()
+{
+	assert(!mRecording);
+
+	mFence.WaitForFence(mFence.Signal());
+	uint32_t count = uint32_t(mSlots.size());
+	for (uint32_t i = 1; i <= count; i++)
+	{
+		uint32_t index = (mFrameIndex + i) % count;
+		if (mSlots[index].Pending)
+			Collect(mSlots[index], index);
+	}
+}
+
+void GpuProfiler::Collect(Slot& slot, uint32_t index)
+{
+	slot.Pending = false;
+	if (slot.Scopes == 0)
+		return;
+
+	mSource.Read(GetFirstQuery(index), slot.Scopes * 2, mTicks.data());
+	double msPerTick = 1000.0 / double(mSource.GetFrequency());
+
+	uint64_t first = UINT64_MAX;
+	uint64_t last = 0;
+	for (uint32_t scope = 0; scope < slot.Scopes; scope++)
+	{
+		if (!slot.Ended[scope])
+		{
+			mStats.UnendedScopes++;
+			continue;
+		}
+
+		uint64_t begin = mTicks[scope * 2];
+		uint64_t end = std::max(mTicks[scope * 2 + 1], begin);
+		first = std::min(first, begin);
+		last = std::max(last, end);
+
+		const char* name = slot.Names[scope];
+		auto pass = std::find_if(mWindow.begin(), mWindow.end(),
+			[name](const PassTime& time) { return time.Name == name; });
+		if (pass == mWindow.end())
+		{
+			mWindow.push_back(PassTime());
+			pass = mWindow.end() - 1;
+			pass->Name = name;
+		}
+		pass->Milliseconds += (end - begin) * msPerTick;
+	}
+
+	if (first > last)
+		return;
+
+	mStats.LastFrameMs = (last - first) * msPerTick;
+	mStats.Frames++;
+	mWindowFrameMs += mStats.LastFrameMs;
+	if (++mWindowFrames >= mAverageFrames)
+		Publish();
+}
+
+void GpuProfiler::Publish()
+{
+	mAverages.swap(mWindow);
+	for (auto& pass : mAverages)
+		pass.Milliseconds /= mWindowFrames;
+	mAverageFrameMs = mWindowFrameMs / mWindowFrames;
+	mAveragesVersion++;
+
+	mWindow.clear();
+	mWindowFrameMs = 0.0;
+	mWindowFrames = 0;
+}
+
+uint32_t GpuProfiler::GetFirstQuery(uint32_t slot)const
+{
+	return slot * mMaxScopes * 2;
+}
+
+const std::vector<GpuProfiler::PassTime>& GpuProfiler::GetAverages()const
+{
+	return mAverages;
+}
+
+double GpuProfiler::GetAverageFrameMs()const
+{
+	return mAverageFrameMs;
+}
+
+uint64_t GpuProfiler::GetAveragesVersion()const
+{
+	return mAveragesVersion;
+}
+
+const GpuProfiler::Stats& GpuProfiler::GetStats()const
+{
+	return mStats;
+}
+
+//
+// ManualTimestampSource
+//
+
+ManualTimestampSource::ManualTimestampSource(uint32_t count, uint64_t frequency) :
+	mFrequency(frequency),
+	mTime(0),
+	mQueries(count),
+	mReadback(count)
+{
+}
+
+uint64_t ManualTimestampSource::GetFrequency()const
+{
+	return mFrequency;
+}
+
+void ManualTimestampSource::WriteTimestamp(ICommandList&, uint32_t query)
+{
+	assert(query < mQueries.size());
+	mQueries[query] = mTime;
+}
+
+void ManualTimestampSource::Resolve(ICommandList&, uint32_t first, uint32_t count)
+{
+	assert(first + count <= mQueries.size());
+	std::copy_n(mQueries.begin() + first, count, mReadback.begin() + first);
+}
+
+void ManualTimestampSource::Read(uint32_t first, uint32_t count, uint64_t* ticks)
+{
+	assert(first + count <= mReadback.size());
+	std::copy_n(mReadback.begin() + first, count, ticks);
+}
+
+void ManualTimestampSource::Advance(uint64_t ticks)
+{
+	mTime += ticks;
+}
+
+uint64_t ManualTimestampSource::GetTime()const
+{
+	return mTime;
+}
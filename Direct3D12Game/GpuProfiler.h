@@ -0,0 +1,172 @@
+//
+// GpuProfiler.h - GPU timestamps around named render passes, averaged over frames
+//
+
+#pragma once
+
+#include "CommandListPool.h"
+#include "FrameRing.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Timestamp queries on one queue: a heap of Count queries that lists write into and
+// readback memory they are resolved to.
+class ITimestampSource
+{
+public:
+	virtual ~ITimestampSource() = default;
+
+	// Ticks per second of the timestamps.
+	virtual uint64_t GetFrequency()const = 0;
+	// Record writing the GPU's time to the query once the list's earlier work finished.
+	virtual void WriteTimestamp(ICommandList& list, uint32_t query) = 0;
+	// Record copying the queries [first, first + count) to the readback memory.
+	virtual void Resolve(ICommandList& list, uint32_t first, uint32_t count) = 0;
+	// The resolved ticks of the queries; the GPU must be done with the resolve.
+	virtual void Read(uint32_t first, uint32_t count, uint64_t* ticks) = 0;
+};
+
+// Measures the GPU time of named scopes, one pair of timestamps each, and averages them
+// per frame. Every frame in flight has its own range of MaxScopes query pairs, handed
+// out again only after the fence of the frame that last used it passed, like the slots
+// of a FrameRing. Results are therefore read FramesInFlight - 1 frames late.
+//
+// Scopes may be recorded on any thread and in any list of the frame, and may nest. The
+// frame's time is the span from its earliest begin to its latest end timestamp, which
+// includes gaps between the scopes.
+//
+// Per frame:
+//     profiler.BeginFrame();               // reads the frames the GPU finished
+//     { GpuProfiler::Scope scope(profiler, list, "pass"); ... }    // on any thread
+//     profiler.ResolveFrame(lastList);     // in the list that executes last
+//     ... submit ...
+//     profiler.EndFrame();
+class GpuProfiler
+{
+public:
+	static const uint32_t InvalidScope = UINT32_MAX;
+
+	// Begin and end timestamps in the lifetime of an object.
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler& profiler, ICommandList& list, const char* name);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		GpuProfiler& mProfiler;
+		ICommandList& mList;
+		uint32_t mScope;
+	};
+
+	// The source needs GetQueryCount(framesInFlight, maxScopes) queries. Averages are
+	// published every averageFrames collected frames.
+	GpuProfiler(ITimestampSource& source, IGpuFence& fence, uint32_t framesInFlight, uint32_t maxScopes,
+		uint32_t averageFrames);
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+	static uint32_t GetQueryCount(uint32_t framesInFlight, uint32_t maxScopes);
+
+	// Collect the frames the GPU finished, then move to the next slot, waiting for the
+	// GPU if it still uses it. Returns the number of frames collected.
+	uint32_t BeginFrame();
+	// Thread safe. The name must outlive the frame, a string literal in practice. Returns
+	// InvalidScope, which EndScope ignores, when the frame has no query pair left.
+	uint32_t BeginScope(ICommandList& list, const char* name);
+	void EndScope(ICommandList& list, uint32_t scope);
+	// After every scope of the frame ended.
+	void ResolveFrame(ICommandList& list);
+	// After the frame's lists were submitted.
+	void EndFrame();
+
+	// Wait for every frame in flight and collect it.
+	void WaitForIdle();
+
+	struct PassTime
+	{
+		std::string Name;
+		double Milliseconds = 0.0;	// per frame, of all scopes with the name
+	};
+
+	// Of the last published window, in the order the passes first appeared in it.
+	const std::vector<PassTime>& GetAverages()const;
+	double GetAverageFrameMs()const;
+	// Incremented whenever new averages are published.
+	uint64_t GetAveragesVersion()const;
+
+	struct Stats
+	{
+		uint64_t Frames = 0;				// collected frames
+		uint64_t FenceWaits = 0;			// BeginFrame calls that had to wait for the GPU
+		uint64_t DroppedScopes = 0;			// scopes beyond MaxScopes in a frame
+		uint64_t UnendedScopes = 0;			// scopes that were begun but never ended
+		double LastFrameMs = 0.0;			// GPU time of the last collected frame
+	};
+	const Stats& GetStats()const;
+
+private:
+	struct Slot
+	{
+		uint64_t Fence = 0;
+		bool Pending = false;
+		uint32_t Scopes = 0;				// query pairs used, set by ResolveFrame
+		std::vector<const char*> Names;
+		std::vector<uint8_t> Ended;
+	};
+
+	void Collect(Slot& slot, uint32_t index);
+	void Publish();
+	uint32_t GetFirstQuery(uint32_t slot)const;
+
+	ITimestampSource& mSource;
+	IGpuFence& mFence;
+	uint32_t mMaxScopes;
+	uint32_t mAverageFrames;
+	std::vector<Slot> mSlots;
+	uint32_t mFrameIndex;
+	bool mRecording;
+	std::atomic<uint32_t> mNextScope;
+	std::vector<uint64_t> mTicks;
+
+	// Totals of the window being accumulated.
+	std::vector<PassTime> mWindow;
+	double mWindowFrameMs;
+	uint32_t mWindowFrames;
+
+	std::vector<PassTime> mAverages;
+	double mAverageFrameMs;
+	uint64_t mAveragesVersion;
+	Stats mStats;
+};
+
+// CPU stand-in for ITimestampSource. Timestamps take the value of a clock the test
+// advances; resolving copies them right away, so the readback shows a query as it was
+// when the resolve was recorded. Writing distinct queries is thread safe.
+class ManualTimestampSource : public ITimestampSource
+{
+public:
+	ManualTimestampSource(uint32_t count, uint64_t frequency);
+
+	uint64_t GetFrequency()const override;
+	void WriteTimestamp(ICommandList& list, uint32_t query) override;
+	void Resolve(ICommandList& list, uint32_t first, uint32_t count) override;
+	void Read(uint32_t first, uint32_t count, uint64_t* ticks) override;
+
+	// Move the simulated GPU clock forward.
+	void Advance(uint64_t ticks);
+	uint64_t GetTime()const;
+
+private:
+	uint64_t mFrequency;
+	std::atomic<uint64_t> mTime;
+	std::vector<uint64_t> mQueries;
+	std::vector<uint64_t> mReadback;
+};
@@ -0,0 +1,210 @@
+//
+// GpuProfilerTests.cpp
+//
+
+#include "GpuProfiler.h"
+#include "JobSystem.h"
+#include "SelfTest.h"
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	// The timestamp source ignores the list it records into.
+	class NullList : public ICommandList
+	{
+	public:
+		void Reset(ICommandAllocator&) override {}
+		void Close() override {}
+	};
+
+	// One tick per microsecond.
+	const uint64_t c_frequency = 1000000;
+
+	const GpuProfiler::PassTime* Find(const GpuProfiler& profiler, const char* name)
+	{
+		for (const GpuProfiler::PassTime& pass : profiler.GetAverages())
+		{
+			if (pass.Name == name)
+				return &pass;
+		}
+		return nullptr;
+	}
+
+	bool Near(double a, double b)
+	{
+		return std::abs(a - b) < 1e-9;
+	}
+}
+
+SELF_TEST(GpuProfiler, AveragesPerPassAndFrame)
+{
+	const uint32_t framesInFlight = 2;
+	ManualTimestampSource source(GpuProfiler::GetQueryCount(framesInFlight, 8), c_frequency);
+	ManualGpuFence fence;
+	GpuProfiler profiler(source, fence, framesInFlight, 8, 4);
+	NullList list;
+
+	// Per frame: shadows for 2 ms plus 0.1 ms per frame, a 0.5 ms gap nobody measured,
+	// and the scene in two scopes of 3 and 1 ms with the HUD nested in the second. The
+	// GPU keeps up.
+	for (int frame = 0; frame < 9; ++frame)
+	{
+		profiler.BeginFrame();
+		{
+			GpuProfiler::Scope shadows(profiler, list, "shadows");
+			source.Advance(2000 + frame * 100);
+		}
+		source.Advance(500);
+		{
+			GpuProfiler::Scope scene(profiler, list, "scene");
+			source.Advance(3000);
+		}
+		{
+			GpuProfiler::Scope scene(profiler, list, "scene");
+			GpuProfiler::Scope hud(profiler, list, "hud");
+			source.Advance(1000);
+		}
+		profiler.ResolveFrame(list);
+		profiler.EndFrame();
+		fence.Complete(fence.GetSignaledFence());
+	}
+
+	// Frames are collected when the next one begins: 8 so far, two windows of 4.
+	GpuProfiler::Stats stats = profiler.GetStats();
+	SELF_CHECK(stats.Frames == 8);
+	SELF_CHECK(stats.FenceWaits == 0);
+	SELF_CHECK(profiler.GetAveragesVersion() == 2);
+	SELF_CHECK(Near(stats.LastFrameMs, 2.7 + 0.5 + 3.0 + 1.0));
+
+	// Window of frames 4 to 7, in the order the passes appeared.
+	const std::vector<GpuProfiler::PassTime>& averages = profiler.GetAverages();
+	SELF_CHECK(averages.size() == 3 && averages[0].Name == "shadows" && averages[1].Name == "scene" && averages[2].Name == "hud");
+	SELF_CHECK(Find(profiler, "shadows") && Near(Find(profiler, "shadows")->Milliseconds, 2.55));
+	SELF_CHECK(Find(profiler, "scene") && Near(Find(profiler, "scene")->Milliseconds, 4.0));
+	SELF_CHECK(Find(profiler, "hud") && Near(Find(profiler, "hud")->Milliseconds, 1.0));
+	SELF_CHECK(Near(profiler.GetAverageFrameMs(), 2.55 + 0.5 + 4.0));
+	for (const GpuProfiler::PassTime& pass : averages)
+		context.Log("%-8s %.3f ms", pass.Name.c_str(), pass.Milliseconds);
+
+	profiler.WaitForIdle();
+	SELF_CHECK(profiler.GetStats().Frames == 9);
+}
+
+SELF_TEST(GpuProfiler, ReadsFramesInFlightLate)
+{
+	// A GPU that only finishes what the profiler waits for: every frame once the ring is
+	// full costs a wait for the oldest slot, and the frame collected is always that one,
+	// with its own timestamps although its queries were written frames ago.
+	for (uint32_t framesInFlight : { 1u, 2u, 3u })
+	{
+		ManualTimestampSource source(GpuProfiler::GetQueryCount(framesInFlight, 4), c_frequency);
+		ManualGpuFence fence;
+		GpuProfiler profiler(source, fence, framesInFlight, 4, 1);
+		NullList list;
+
+		const uint32_t frames = 10;
+		bool inOrder = true;
+		for (uint32_t frame = 0; frame < frames; ++frame)
+		{
+			uint32_t collected = profiler.BeginFrame();
+			if (frame >= framesInFlight)
+			{
+				// Frame n lasts n + 1 ms.
+				uint32_t oldest = frame - framesInFlight;
+				inOrder = inOrder && collected == 1 && Near(profiler.GetStats().LastFrameMs, oldest + 1.0);
+			}
+			else
+			{
+				inOrder = inOrder && collected == 0;
+			}
+
+			uint32_t scope = profiler.BeginScope(list, "frame");
+			source.Advance((frame + 1) * 1000);
+			profiler.EndScope(list, scope);
+			profiler.ResolveFrame(list);
+			profiler.EndFrame();
+		}
+		SELF_CHECK(inOrder);
+		SELF_CHECK(profiler.GetStats().FenceWaits == frames - framesInFlight);
+
+		profiler.WaitForIdle();
+		SELF_CHECK(profiler.GetStats().Frames == frames);
+		SELF_CHECK(Near(profiler.GetStats().LastFrameMs, frames));
+		SELF_CHECK(Near(profiler.GetAverageFrameMs(), frames));
+	}
+}
+
+SELF_TEST(GpuProfiler, DroppedAndUnendedScopes)
+{
+	ManualTimestampSource source(GpuProfiler::GetQueryCount(1, 2), c_frequency);
+	ManualGpuFence fence;
+	GpuProfiler profiler(source, fence, 1, 2, 1);
+	NullList list;
+
+	// Two pairs per frame: a third scope is dropped, an unended one is left out.
+	profiler.BeginFrame();
+	uint32_t measured = profiler.BeginScope(list, "measured");
+	uint32_t unended = profiler.BeginScope(list, "unended");
+	uint32_t dropped = profiler.BeginScope(list, "dropped");
+	SELF_CHECK(measured == 0 && unended == 1);
+	SELF_CHECK(dropped == GpuProfiler::InvalidScope);
+	source.Advance(1500);
+	profiler.EndScope(list, dropped);
+	profiler.EndScope(list, measured);
+	profiler.ResolveFrame(list);
+	profiler.EndFrame();
+	profiler.WaitForIdle();
+
+	GpuProfiler::Stats stats = profiler.GetStats();
+	SELF_CHECK(stats.DroppedScopes == 1);
+	SELF_CHECK(stats.UnendedScopes == 1);
+	SELF_CHECK(stats.Frames == 1 && Near(stats.LastFrameMs, 1.5));
+	SELF_CHECK(profiler.GetAverages().size() == 1 && profiler.GetAverages()[0].Name == "measured");
+
+	// A frame without any scope is not counted.
+	profiler.BeginFrame();
+	profiler.ResolveFrame(list);
+	profiler.EndFrame();
+	profiler.WaitForIdle();
+	SELF_CHECK(profiler.GetStats().Frames == 1);
+}
+
+SELF_TEST(GpuProfiler, ScopesFromManyThreads)
+{
+	const uint32_t maxScopes = 64;
+	ManualTimestampSource source(GpuProfiler::GetQueryCount(2, maxScopes), c_frequency);
+	ManualGpuFence fence;
+	GpuProfiler profiler(source, fence, 2, maxScopes, 10);
+	JobSystem jobs(3);
+
+	// Passes recorded in parallel each get their own query pair. The clock stands still
+	// while they record, so they take no time and the frame is the span around them.
+	static const char* const c_names[] = { "a", "b", "c", "d" };
+	for (int frame = 0; frame < 20; ++frame)
+	{
+		profiler.BeginFrame();
+		NullList start;
+		uint32_t span = profiler.BeginScope(start, "span");
+		source.Advance(1000);
+		jobs.ParallelFor(0, 40, 1, [&](size_t pass)
+		{
+			NullList list;
+			GpuProfiler::Scope scope(profiler, list, c_names[pass % 4]);
+		});
+		source.Advance(1000);
+		profiler.EndScope(start, span);
+		profiler.ResolveFrame(start);
+		profiler.EndFrame();
+		fence.Complete(fence.GetSignaledFence());
+	}
+	profiler.WaitForIdle();
+
+	GpuProfiler::Stats stats = profiler.GetStats();
+	SELF_CHECK(stats.Frames == 20 && stats.DroppedScopes == 0 && stats.UnendedScopes == 0);
+	SELF_CHECK(profiler.GetAverages().size() == 5);
+	SELF_CHECK(Find(profiler, "span") && Near(Find(profiler, "span")->Milliseconds, 2.0));
+	SELF_CHECK(Find(profiler, "a") && Near(Find(profiler, "a")->Milliseconds, 0.0));
+	SELF_CHECK(Near(profiler.GetAverageFrameMs(), 2.0));
+}
@@ -0,0 +1,277 @@
+//
+// JobSystem.cpp
+//
+
+#include "JobSystem.h"
+
+#include "CpuProfiler.h"
+
+#include <cstdio>
+
+namespace
+{
+	// The system the calling thread belongs to and its index in it.
+	thread_local const JobSystem* tJobSystem = nullptr;
+	thread_local int tThreadIndex = -1;
+
+	// Idle iterations before a worker goes to sleep.
+	const int c_spinCount = 256;
+}
+
+bool JobSystem::WorkStealingDeque::Push(Job* job)
+{
+	int64_t bottom = mBottom.load(std::memory_order_relaxed);
+	int64_t top = mTop.load(std::memory_order_acquire);
+	if (bottom - top > Mask)
+		return false;
+
+	mJobs[bottom & Mask].store(job, std::memory_order_relaxed);
+	mBottom.store(bottom + 1, std::memory_order_release);
+	return true;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Pop()
+{
+	int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+	mBottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = mTop.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// Empty.
+		mBottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = mJobs[bottom & Mask].load(std::memory_order_relaxed);
+	if (top == bottom)
+	{
+		// Last job; race the thieves for it.
+		if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		mBottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Steal()
+{
+	int64_t top = mTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = mBottom.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return nullptr;
+
+	Job* job = mJobs[top & Mask].load(std::memory_order_relaxed);
+	if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+unsigned JobSystem::DefaultWorkerCount()
+{
+	unsigned hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+JobSystem::JobSystem(unsigned workerCount)
+{
+	for (unsigned i = 0; i <= workerCount; ++i)
+	{
+		mThreads.push_back(std::make_unique<ThreadState>());
+		mThreads.back()->Random = 0x9e3779b9u * (i + 1);
+	}
+
+	// The creating thread is thread 0.
+	tJobSystem = this;
+	tThreadIndex = 0;
+
+	for (unsigned i = 1; i <= workerCount; ++i)
+	{
+		mWorkers.emplace_back([this, i]()
+		{
+			WorkerMain(int(i));
+		});
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mRunning = false;
+	}
+	mWake.notify_all();
+
+	for (auto& worker : mWorkers)
+		worker.join();
+
+	if (tJobSystem == this)
+	{
+		tJobSystem = nullptr;
+		tThreadIndex = -1;
+	}
+}
+
+unsigned JobSystem::GetThreadCount()const
+{
+	return unsigned(mThreads.size());
+}
+
+int JobSystem::GetThreadIndex()const
+{
+	return tJobSystem == this ? tThreadIndex : -1;
+}
+
+JobSystem::Job* JobSystem::AllocateJob(ThreadState& thread)
+{
+	// Slots are handed out round robin; a slot whose job has not finished yet means
+	// this thread has MaxJobsPerThread jobs in flight.
+	Job& job = thread.Jobs[thread.NextJob];
+	if (job.Function.load(std::memory_order_acquire) != nullptr)
+		return nullptr;
+
+	thread.NextJob = (thread.NextJob + 1) & (MaxJobsPerThread - 1);
+	return &job;
+}
+
+void JobSystem::Submit(ThreadState& thread, Job* job)
+{
+	if (!thread.Deque.Push(job))
+	{
+		thread.Inline.fetch_add(1, std::memory_order_relaxed);
+		Execute(*job);
+		return;
+	}
+
+	mQueued.fetch_add(1, std::memory_order_seq_cst);
+	if (mSleeping.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mWake.notify_one();
+	}
+}
+
+JobSystem::Job* JobSystem::FindJob(int threadIndex)
+{
+	ThreadState& thread = *mThreads[threadIndex];
+	Job* job = thread.Deque.Pop();
+	if (job)
+	{
+		mQueued.fetch_sub(1, std::memory_order_relaxed);
+		return job;
+	}
+
+	// Steal from the others, starting at a random thread so thieves spread out.
+	size_t count = mThreads.size();
+	thread.Random ^= thread.Random << 13;
+	thread.Random ^= thread.Random >> 17;
+	thread.Random ^= thread.Random << 5;
+	size_t start = thread.Random % count;
+	for (size_t i = 0; i < count; ++i)
+	{
+		size_t victim = (start + i) % count;
+		if (victim == size_t(threadIndex))
+			continue;
+
+		job = mThreads[victim]->Deque.Steal();
+		if (job)
+		{
+			mQueued.fetch_sub(1, std::memory_order_relaxed);
+			thread.Stolen.fetch_add(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::Execute(Job& job)
+{
+	job.Function.load(std::memory_order_acquire)(job);
+
+	Counter* owner = job.Owner;
+	job.Function.store(nullptr, std::memory_order_release);
+	owner->Pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::Wait(Counter& counter)
+{
+	int index = GetThreadIndex();
+	while (counter.Pending.load(std::memory_order_acquire) > 0)
+	{
+		Job* job = index >= 0 ? FindJob(index) : nullptr;
+		if (job)
+		{
+			mThreads[index]->Executed.fetch_add(1, std::memory_order_relaxed);
+			Execute(*job);
+		}
+		else
+		{
+			// The remaining jobs are running on other threads.
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::WorkerMain(int threadIndex)
+{
+	tJobSystem = this;
+	tThreadIndex = threadIndex;
+	ThreadState& thread = *mThreads[threadIndex];
+
+	char name[32];
+	snprintf(name, sizeof(name), "job worker %d", threadIndex);
+	CpuProfiler::SetThreadName(name);
+
+	int idle = 0;
+	while (mRunning.load(std::memory_order_relaxed))
+	{
+		Job* job = FindJob(threadIndex);
+		if (job)
+		{
+			thread.Executed.fetch_add(1, std::memory_order_relaxed);
+			Execute(*job);
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < c_spinCount)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Nothing to steal for a while, sleep until Submit queues a job.
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mSleeping.fetch_add(1, std::memory_order_seq_cst);
+		mWake.wait(lock, [this]()
+		{
+			return mQueued.load(std::memory_order_seq_cst) > 0 || !mRunning;
+		});
+		mSleeping.fetch_sub(1, std::memory_order_relaxed);
+		idle = 0;
+	}
+}
+
+JobSystem::Stats JobSystem::GetStats()const
+{
+	Stats stats;
+	for (auto& thread : mThreads)
+	{
+		stats.Executed += thread->Executed.load(std::memory_order_relaxed);
+		stats.Stolen += thread->Stolen.load(std::memory_order_relaxed);
+		stats.Inline += thread->Inline.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void JobSystem::ResetStats()
+{
+	for (auto& thread : mThreads)
+	{
+		thread->Executed.store(0, std::memory_order_relaxed);
+		thread->Stolen.store(0, std::memory_order_relaxed);
+		thread->Inline.store(0, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,215 @@
+//
+// JobSystem.h - Work-stealing job scheduler for per-frame tasks
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Runs small jobs on a pool of worker threads. Every thread that belongs to the
+// system (the thread that created it and the workers) owns a Chase-Lev deque: it
+// pushes and pops its own jobs at the bottom, idle threads steal from the top of
+// the others. Jobs spawned while running a job therefore stay on the same core
+// while there is enough work, and spread out as soon as someone runs dry.
+//
+// Completion is tracked with counters: Run increments a counter, the job decrements
+// it when it finishes, and Wait runs other jobs until the counter reaches zero.
+// A job may itself Run and Wait, which is how dependencies and nested parallel
+// loops are expressed.
+//
+// Usage:
+//     JobSystem::Counter counter;
+//     jobs.Run(counter, [&]() { ... });
+//     jobs.Run(counter, [&]() { ... });
+//     jobs.Wait(counter);
+//
+//     jobs.ParallelFor(0, count, [&](size_t i) { ... });
+//
+// Jobs are stored in fixed size slots, so the callable must be trivially copyable
+// and destructible and fit in JobDataSize bytes, e.g. a lambda capturing a few
+// references or pointers. Threads that do not belong to the system, and threads
+// with too many unfinished jobs, run the job inline instead of queuing it.
+class JobSystem
+{
+public:
+	static const size_t JobDataSize = 48;
+	static const size_t MaxJobsPerThread = 4096;	// power of two
+
+	struct Counter
+	{
+		std::atomic<uint32_t> Pending{ 0 };
+	};
+
+	// One worker per additional hardware thread; the creating thread is the other one.
+	static unsigned DefaultWorkerCount();
+
+	explicit JobSystem(unsigned workerCount = DefaultWorkerCount());
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Threads that run jobs, including the creating thread.
+	unsigned GetThreadCount()const;
+	// Index of the calling thread in [0, GetThreadCount()), or -1 for threads that do
+	// not belong to the system. Per-thread resources can be indexed with it.
+	int GetThreadIndex()const;
+
+	template<typename F>
+	void Run(Counter& counter, const F& function);
+
+	// Run queued jobs until the counter reaches zero.
+	void Wait(Counter& counter);
+
+	// Call body(i) for every i in [begin, end). Ranges of up to grain indices run as
+	// one job; grain 0 picks about four jobs per thread.
+	template<typename F>
+	void ParallelFor(size_t begin, size_t end, size_t grain, const F& body);
+	template<typename F>
+	void ParallelFor(size_t begin, size_t end, const F& body);
+
+	struct Stats
+	{
+		uint64_t Executed = 0;	// jobs run from a deque
+		uint64_t Stolen = 0;	// of which taken from another thread's deque
+		uint64_t Inline = 0;	// jobs run directly by Run
+	};
+	Stats GetStats()const;
+	void ResetStats();
+
+private:
+	// 64 bytes, one cache line when the slot array happens to be aligned.
+	struct Job
+	{
+		// Null while the slot is free.
+		std::atomic<void(*)(Job&)> Function{ nullptr };
+		Counter* Owner = nullptr;
+		alignas(16) unsigned char Data[JobDataSize];
+	};
+
+	// Chase-Lev deque of job pointers with a fixed capacity (Le et al. 2013 memory ordering).
+	class WorkStealingDeque
+	{
+	public:
+		bool Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		static const int64_t Mask = MaxJobsPerThread - 1;
+		// Padding keeps the thieves' top and the owner's bottom on separate cache lines.
+		std::atomic<int64_t> mTop{ 0 };
+		char mPadding[64];
+		std::atomic<int64_t> mBottom{ 0 };
+		std::atomic<Job*> mJobs[MaxJobsPerThread];
+	};
+
+	struct ThreadState
+	{
+		WorkStealingDeque Deque;
+		std::vector<Job> Jobs{ MaxJobsPerThread };
+		size_t NextJob = 0;
+		uint32_t Random = 0;
+		std::atomic<uint64_t> Executed{ 0 };
+		std::atomic<uint64_t> Stolen{ 0 };
+		std::atomic<uint64_t> Inline{ 0 };
+	};
+
+	template<typename F>
+	static void Invoke(Job& job)
+	{
+		(*reinterpret_cast<F*>(job.Data))();
+	}
+
+	template<typename F>
+	void RunRange(Counter& counter, size_t begin, size_t end, size_t grain, const F* body);
+
+	Job* AllocateJob(ThreadState& thread);
+	void Submit(ThreadState& thread, Job* job);
+	Job* FindJob(int threadIndex);
+	void Execute(Job& job);
+	void WorkerMain(int threadIndex);
+
+	std::vector<std::unique_ptr<ThreadState>> mThreads;
+	std::vector<std::thread> mWorkers;
+
+	// Idle workers sleep until jobs are queued.
+	std::atomic<int> mQueued{ 0 };
+	std::atomic<int> mSleeping{ 0 };
+	std::atomic<bool> mRunning{ true };
+	std::mutex mSleepMutex;
+	std::condition_variable mWake;
+};
+
+template<typename F>
+void JobSystem::Run(Counter& counter, const F& function)
+{
+	static_assert(sizeof(F) <= JobDataSize, "job captures too much state");
+	static_assert(alignof(F) <= 16, "job callable is over-aligned");
+	static_assert(std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value,
+		"job callables must be trivially copyable and destructible");
+
+	int index = GetThreadIndex();
+	Job* job = index >= 0 ? AllocateJob(*mThreads[index]) : nullptr;
+	if (!job)
+	{
+		if (index >= 0)
+			mThreads[index]->Inline.fetch_add(1, std::memory_order_relaxed);
+		function();
+		return;
+	}
+
+	new (job->Data) F(function);
+	job->Owner = &counter;
+	counter.Pending.fetch_add(1, std::memory_order_relaxed);
+	job->Function.store(&Invoke<F>, std::memory_order_relaxed);
+	Submit(*mThreads[index], job);
+}
+
+template<typename F>
+void JobSystem::RunRange(Counter& counter, size_t begin, size_t end, size_t grain, const F* body)
+{
+	// Split off the upper half as a job until the range is small enough; thieves take
+	// the biggest halves first since they steal from the top of the deque.
+	while (end - begin > grain)
+	{
+		size_t middle = begin + (end - begin) / 2;
+		Run(counter, [this, &counter, middle, end, grain, body]()
+		{
+			RunRange(counter, middle, end, grain, body);
+		});
+		end = middle;
+	}
+
+	for (size_t i = begin; i < end; ++i)
+		(*body)(i);
+}
+
+template<typename F>
+void JobSystem::ParallelFor(size_t begin, size_t end, size_t grain, const F& body)
+{
+	if (end <= begin)
+		return;
+
+	if (grain == 0)
+		grain = std::max(size_t(1), (end - begin) / (GetThreadCount() * 4));
+
+	Counter counter;
+	RunRange(counter, begin, end, grain, &body);
+	Wait(counter);
+}
+
+template<typename F>
+void JobSystem::ParallelFor(size_t begin, size_t end, const F& body)
+{
+	ParallelFor(begin, end, 0, body);
+}
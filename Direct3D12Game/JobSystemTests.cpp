@@ -0,0 +1,207 @@
+//
+// JobSystemTests.cpp
+//
+
+#include "JobSystem.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+
+namespace
+{
+	// Splits [begin, end) into jobs until the pieces are small, like a nested parallel
+	// loop, and adds up the indices.
+	struct SumJob
+	{
+		JobSystem* Jobs;
+		std::atomic<uint64_t>* Sum;
+
+		void operator()(uint64_t begin, uint64_t end) const
+		{
+			if (end - begin <= 16)
+			{
+				uint64_t sum = 0;
+				for (uint64_t i = begin; i < end; ++i)
+					sum += i;
+				Sum->fetch_add(sum, std::memory_order_relaxed);
+				return;
+			}
+
+			uint64_t middle = begin + (end - begin) / 2;
+			const SumJob* self = this;
+			JobSystem::Counter counter;
+			Jobs->Run(counter, [self, begin, middle]() { (*self)(begin, middle); });
+			Jobs->Run(counter, [self, middle, end]() { (*self)(middle, end); });
+			Jobs->Wait(counter);
+		}
+	};
+
+	// Arithmetic that keeps a core busy without touching memory.
+	float Kernel(size_t i)
+	{
+		float x = float(i & 1023) * 0.001f;
+		for (int k = 0; k < 64; ++k)
+			x = sqrtf(x * x + 1.0f) * 0.5f;
+		return x;
+	}
+}
+
+SELF_TEST(JobSystem, ParallelForVisitsEveryIndexOnce)
+{
+	const size_t count = 100000;
+	for (unsigned workers : { 0u, 1u, 3u })
+	{
+		JobSystem jobs(workers);
+		SELF_CHECK(jobs.GetThreadCount() == workers + 1);
+		SELF_CHECK(jobs.GetThreadIndex() == 0);
+
+		std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[count]);
+		for (size_t i = 0; i < count; ++i)
+			visits[i] = 0;
+		std::atomic<uint32_t> threadsSeen(0);
+
+		for (size_t grain : { size_t(0), size_t(1), size_t(1000) })
+		{
+			jobs.ParallelFor(0, count, grain, [&](size_t i)
+			{
+				visits[i].fetch_add(1, std::memory_order_relaxed);
+				threadsSeen.fetch_or(1u << jobs.GetThreadIndex(), std::memory_order_relaxed);
+			});
+		}
+
+		bool exact = true;
+		for (size_t i = 0; i < count; ++i)
+			exact = exact && visits[i].load() == 3;
+		SELF_CHECK(exact);
+		SELF_CHECK(threadsSeen.load() < (1u << (workers + 1)));
+
+		JobSystem::Stats stats = jobs.GetStats();
+		context.Log("%u workers: %llu jobs, %llu stolen, %llu inline", workers,
+			(unsigned long long)stats.Executed, (unsigned long long)stats.Stolen, (unsigned long long)stats.Inline);
+		if (workers == 0)
+			SELF_CHECK(stats.Stolen == 0);
+		jobs.ResetStats();
+		SELF_CHECK(jobs.GetStats().Executed == 0);
+	}
+}
+
+SELF_TEST(JobSystem, NestedRunAndWait)
+{
+	JobSystem jobs(3);
+	const uint64_t count = 200000;
+	std::atomic<uint64_t> sum(0);
+	SumJob root = { &jobs, &sum };
+
+	// Jobs that run and wait for jobs, from the creating thread and the workers.
+	root(0, count);
+	SELF_CHECK(sum.load() == count * (count - 1) / 2);
+
+	sum = 0;
+	JobSystem::Counter counter;
+	const SumJob* job = &root;
+	for (uint64_t part = 0; part < 8; ++part)
+		jobs.Run(counter, [job, part, count]() { (*job)(part * count / 8, (part + 1) * count / 8); });
+	jobs.Wait(counter);
+	SELF_CHECK(counter.Pending.load() == 0);
+	SELF_CHECK(sum.load() == count * (count - 1) / 2);
+}
+
+SELF_TEST(JobSystem, InlineOutsideTheSystemAndWhenFull)
+{
+	JobSystem jobs(1);
+
+	// A thread that does not belong to the system runs its jobs right away.
+	bool ranInline = false;
+	int foreignIndex = 0;
+	std::thread foreign([&]()
+	{
+		foreignIndex = jobs.GetThreadIndex();
+		JobSystem::Counter counter;
+		bool* ran = &ranInline;
+		jobs.Run(counter, [ran]() { *ran = true; });
+		jobs.Wait(counter);
+	});
+	foreign.join();
+	SELF_CHECK(foreignIndex == -1);
+	SELF_CHECK(ranInline);
+
+	// More unfinished jobs than a thread has slots: the rest run inline, none are lost.
+	// Queued jobs block until the first one that runs on the creating thread, which can
+	// only be an inline one before Wait.
+	std::atomic<bool> release(false);
+	std::atomic<uint32_t> done(0);
+	JobSystem::Counter counter;
+	const uint32_t count = uint32_t(JobSystem::MaxJobsPerThread) * 2;
+	JobSystem* system = &jobs;
+	std::atomic<bool>* gate = &release;
+	std::atomic<uint32_t>* finished = &done;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		jobs.Run(counter, [system, gate, finished]()
+		{
+			if (system->GetThreadIndex() == 0)
+				gate->store(true);
+			while (!gate->load())
+				std::this_thread::yield();
+			finished->fetch_add(1);
+		});
+	}
+	jobs.Wait(counter);
+
+	JobSystem::Stats stats = jobs.GetStats();
+	SELF_CHECK(done.load() == count);
+	SELF_CHECK(stats.Inline > 0);
+	SELF_CHECK(stats.Executed + stats.Inline == count);
+}
+
+SELF_BENCHMARK(JobSystem, Scaling)
+{
+	// Per job overhead: empty jobs queued and waited for from the creating thread.
+	{
+		JobSystem jobs;
+		const int rounds = 200;
+		const int perRound = 1000;
+		auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < rounds; ++round)
+		{
+			JobSystem::Counter counter;
+			for (int i = 0; i < perRound; ++i)
+				jobs.Run(counter, []() {});
+			jobs.Wait(counter);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		context.Log("empty jobs: %.0f ns each on %u threads", seconds * 1e9 / (rounds * perRound), jobs.GetThreadCount());
+	}
+
+	// A compute bound ParallelFor on one thread up to all of them.
+	const size_t count = 1 << 20;
+	std::unique_ptr<float[]> results(new float[count]);
+	double single = 0.0;
+	for (unsigned workers = 0; workers <= JobSystem::DefaultWorkerCount(); workers = workers ? workers * 2 : 1)
+	{
+		JobSystem jobs(workers);
+		double best = 1e9;
+		for (int run = 0; run < 5; ++run)
+		{
+			auto start = std::chrono::steady_clock::now();
+			jobs.ParallelFor(0, count, [&](size_t i) { results[i] = Kernel(i); });
+			best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		if (workers == 0)
+			single = best;
+
+		JobSystem::Stats stats = jobs.GetStats();
+		context.Log("%2u threads: %7.2f ms, %.2fx, %llu of %llu jobs stolen", jobs.GetThreadCount(), best * 1000.0,
+			single / best, (unsigned long long)stats.Stolen, (unsigned long long)stats.Executed);
+	}
+
+	bool same = true;
+	for (size_t i = 0; i < count; ++i)
+		same = same && results[i] == Kernel(i);
+	SELF_CHECK(same);
+}
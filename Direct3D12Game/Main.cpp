@@ -3,13 +3,41 @@
 //
 
 #include "pch.h"
+#include "CpuProfiler.h"
 #include "Game.h"
+#include "SelfTest.h"
+#include "SoftwareRenderBenchmark.h"
+
+#include <fstream>
 
 using namespace DirectX;
 
 namespace
 {
     std::unique_ptr<Game> g_game;
+
+    // The text after a switch like -selftest:, up to the next space. Only ASCII is kept.
+    std::string GetSwitchValue(const wchar_t* value)
+    {
+        std::string text;
+        for (; *value && *value != L' '; ++value)
+        {
+            if (*value < 0x80)
+                text += static_cast<char>(*value);
+        }
+        return text;
+    }
+
+    // Runs the self tests or benchmarks whose name starts with the switch value and writes
+    // the report. Returns the number of failures.
+    int RunSelfTests(const wchar_t* arg, size_t switchLength, bool benchmarks, const char* fileName)
+    {
+        std::string prefix = arg[switchLength] == L':' ? GetSwitchValue(arg + switchLength + 1) : std::string();
+        SelfTest::Result result = SelfTest::Run(benchmarks, prefix.c_str());
+        OutputDebugStringA(result.Report.c_str());
+        std::ofstream(fileName) << result.Report;
+        return static_cast<int>(result.Failed);
+    }
 };
 
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
@@ -25,7 +53,6 @@ extern "C"
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
 {
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
     if (!XMVerifyCPUSupport())
         return 1;
@@ -34,8 +61,55 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
     if (FAILED(initialize))
         return 1;
 
+    // -selftest[:prefix] runs the checks of the engine modules instead of the game and
+    // writes selftest_report.txt; -benchmark[:prefix] does the same with the benchmarks.
+    // Both return the number of failures.
+    if (const wchar_t* arg = wcsstr(lpCmdLine, L"-selftest"))
+        return RunSelfTests(arg, 9, false, "selftest_report.txt");
+    if (const wchar_t* arg = wcsstr(lpCmdLine, L"-benchmark"))
+        return RunSelfTests(arg, 10, true, "benchmark_report.txt");
+
+    // -softrender draws the scene with the CPU rasterizer at each thread count instead of
+    // running the game, and writes the timings and the last frame to the working directory.
+    if (wcsstr(lpCmdLine, L"-softrender"))
+    {
+        std::string report = SoftwareRenderBenchmark::Run(SoftwareRenderBenchmark::Settings());
+        OutputDebugStringA(report.c_str());
+        std::ofstream("software_render_report.txt") << report;
+        return 0;
+    }
+
+    // -profilebench times the CPU profiler's scopes against their 50 ns budget instead of
+    // running the game. Returns 1 if they are over it.
+    if (wcsstr(lpCmdLine, L"-profilebench"))
+    {
+        CpuProfiler::BenchmarkResult result = CpuProfiler::RunBenchmark(10000000, 50.0);
+        OutputDebugStringA(result.Report.c_str());
+        std::ofstream("cpu_profiler_benchmark.txt") << result.Report;
+        return result.WithinBudget ? 0 : 1;
+    }
+
     g_game = std::make_unique<Game>();
 
+    // -frames:N sets the frames in flight (2 to 4), -latency:N the frames DXGI may queue.
+    {
+        UINT framesInFlight = 2;
+        UINT maxFrameLatency = 1;
+        if (const wchar_t* arg = wcsstr(lpCmdLine, L"-frames:"))
+            framesInFlight = static_cast<UINT>(_wtoi(arg + 8));
+        if (const wchar_t* arg = wcsstr(lpCmdLine, L"-latency:"))
+            maxFrameLatency = static_cast<UINT>(_wtoi(arg + 9));
+        g_game->SetFrameQueue(framesInFlight, maxFrameLatency);
+    }
+
+    // -msaa:N starts with N samples per pixel (1, 2, 4 or 8); F7 cycles through them.
+    if (const wchar_t* arg = wcsstr(lpCmdLine, L"-msaa:"))
+        g_game->SetSampleCount(static_cast<UINT>(_wtoi(arg + 6)));
+
+    // -dynres scales the scene to hold the frame time target; F9 toggles it.
+    if (wcsstr(lpCmdLine, L"-dynres"))
+        g_game->SetDynamicResolution(true);
+
     // Register class and create window
     {
         // Register class
@@ -95,6 +169,11 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
             TranslateMessage(&msg);
             DispatchMessage(&msg);
         }
+        else if (g_game->IsSuspended())
+        {
+            // Nothing to render while minimized or suspended, sleep until the next message.
+            WaitMessage();
+        }
         else
         {
             g_game->Tick();
@@ -0,0 +1,470 @@
+//
+// OcclusionCuller.cpp
+//
+
+#include "OcclusionCuller.h"
+
+#include "Camera.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height) :
+	mJobs(nullptr),
+	mWidth(width),
+	mHeight(height),
+	mTilesX(width / TileSize),
+	mTilesY(height / TileSize),
+	mView(Identity4x4()),
+	mProj(Identity4x4()),
+	mViewProj(Identity4x4()),
+	mNearZ(0.0f)
+{
+	assert(width % TileSize == 0 && height % TileSize == 0);
+
+	mBins.resize(mTilesX * mTilesY);
+
+	// Allocate the Hi-Z pyramid down to a single texel.
+	uint32_t w = width;
+	uint32_t h = height;
+	for (;;)
+	{
+		Level level;
+		level.Width = w;
+		level.Height = h;
+		level.Depth.resize(size_t(w) * h, 1.0f);
+		mLevels.push_back(std::move(level));
+
+		if (w == 1 && h == 1)
+			break;
+
+		w = std::max(1u, (w + 1) / 2);
+		h = std::max(1u, (h + 1) / 2);
+	}
+}
+
+void OcclusionCuller::SetJobSystem(JobSystem* jobs)
+{
+	mJobs = jobs;
+}
+
+void OcclusionCuller::BeginFrame(FXMMATRIX view, CXMMATRIX proj)
+{
+	XMStoreFloat4x4(&mView, view);
+	XMStoreFloat4x4(&mProj, proj);
+	XMStoreFloat4x4(&mViewProj, XMMatrixMultiply(view, proj));
+
+	// View space depth of the near plane of a perspective projection.
+	mNearZ = -mProj(3, 2) / mProj(2, 2);
+
+	mTriangles.clear();
+	for (auto& bin : mBins)
+		bin.clear();
+
+	mStats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const XMFLOAT3* positions, size_t vertexCount,
+	const uint16_t* indices, size_t indexCount, FXMMATRIX world)
+{
+	XMMATRIX worldViewProj = XMMatrixMultiply(world, XMLoadFloat4x4(&mViewProj));
+
+	mClipPositions.resize(vertexCount);
+	XMVector3TransformStream(mClipPositions.data(), sizeof(XMFLOAT4),
+		positions, sizeof(XMFLOAT3), vertexCount, worldViewProj);
+
+	const size_t triangleCount = indexCount / 3;
+	const float halfWidth = 0.5f * mWidth;
+	const float halfHeight = 0.5f * mHeight;
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 vHalfWidth = _mm_set1_ps(halfWidth);
+	const __m128 vHalfHeight = _mm_set1_ps(halfHeight);
+	const __m128 width = _mm_set1_ps(float(mWidth));
+	const __m128 height = _mm_set1_ps(float(mHeight));
+	const __m128 lastX = _mm_set1_ps(float(mWidth - 1));
+	const __m128 lastY = _mm_set1_ps(float(mHeight - 1));
+
+	// Project and bound four triangles at a time, one per lane. The bounds are clamped
+	// to the screen before converting them to tiles, so huge coordinates from vertices
+	// close to w = 0 can't overflow the integer conversion.
+	size_t t = 0;
+	for (; t + 4 <= triangleCount; t += 4)
+	{
+		const uint16_t* tri = indices + t * 3;
+		__m128 x[3], y[3], z[3];
+		__m128 rejected = zero;
+
+		for (int v = 0; v < 3; ++v)
+		{
+			__m128 px = _mm_loadu_ps(&mClipPositions[tri[v]].x);
+			__m128 py = _mm_loadu_ps(&mClipPositions[tri[3 + v]].x);
+			__m128 pz = _mm_loadu_ps(&mClipPositions[tri[6 + v]].x);
+			__m128 pw = _mm_loadu_ps(&mClipPositions[tri[9 + v]].x);
+			_MM_TRANSPOSE4_PS(px, py, pz, pw);
+
+			// Drop triangles touching the near plane instead of clipping them.
+			rejected = _mm_or_ps(rejected, _mm_or_ps(_mm_cmple_ps(pw, zero), _mm_cmplt_ps(pz, zero)));
+
+			__m128 invW = _mm_div_ps(one, pw);
+			x[v] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(px, invW), one), vHalfWidth);
+			y[v] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(py, invW)), vHalfHeight);
+			z[v] = _mm_mul_ps(pz, invW);
+		}
+
+		__m128 minX = _mm_min_ps(x[0], _mm_min_ps(x[1], x[2]));
+		__m128 maxX = _mm_max_ps(x[0], _mm_max_ps(x[1], x[2]));
+		__m128 minY = _mm_min_ps(y[0], _mm_min_ps(y[1], y[2]));
+		__m128 maxY = _mm_max_ps(y[0], _mm_max_ps(y[1], y[2]));
+
+		rejected = _mm_or_ps(rejected, _mm_or_ps(_mm_cmplt_ps(maxX, zero), _mm_cmplt_ps(maxY, zero)));
+		rejected = _mm_or_ps(rejected, _mm_or_ps(_mm_cmpge_ps(minX, width), _mm_cmpge_ps(minY, height)));
+
+		int accepted = ~_mm_movemask_ps(rejected) & 0xF;
+		if (accepted == 0)
+			continue;
+
+		alignas(16) int32_t tileX0[4], tileX1[4], tileY0[4], tileY1[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(tileX0), _mm_srai_epi32(_mm_cvttps_epi32(_mm_max_ps(minX, zero)), TileShift));
+		_mm_store_si128(reinterpret_cast<__m128i*>(tileX1), _mm_srai_epi32(_mm_cvttps_epi32(_mm_min_ps(maxX, lastX)), TileShift));
+		_mm_store_si128(reinterpret_cast<__m128i*>(tileY0), _mm_srai_epi32(_mm_cvttps_epi32(_mm_max_ps(minY, zero)), TileShift));
+		_mm_store_si128(reinterpret_cast<__m128i*>(tileY1), _mm_srai_epi32(_mm_cvttps_epi32(_mm_min_ps(maxY, lastY)), TileShift));
+
+		alignas(16) float xs[3][4], ys[3][4], zs[3][4];
+		for (int v = 0; v < 3; ++v)
+		{
+			_mm_store_ps(xs[v], x[v]);
+			_mm_store_ps(ys[v], y[v]);
+			_mm_store_ps(zs[v], z[v]);
+		}
+
+		for (; accepted; accepted &= accepted - 1)
+		{
+			int lane = 0;
+			while (!(accepted & (1 << lane)))
+				++lane;
+
+			ScreenTriangle screen;
+			for (int v = 0; v < 3; ++v)
+			{
+				screen.x[v] = xs[v][lane];
+				screen.y[v] = ys[v][lane];
+				screen.z[v] = zs[v][lane];
+			}
+			BinTriangle(screen, tileX0[lane], tileX1[lane], tileY0[lane], tileY1[lane]);
+		}
+	}
+
+	// The last few triangles, one at a time.
+	for (; t < triangleCount; ++t)
+	{
+		ScreenTriangle screen;
+		bool clipped = false;
+
+		for (int v = 0; v < 3; ++v)
+		{
+			const XMFLOAT4& p = mClipPositions[indices[t * 3 + v]];
+
+			if (p.w <= 0.0f || p.z < 0.0f)
+			{
+				clipped = true;
+				break;
+			}
+
+			float invW = 1.0f / p.w;
+			screen.x[v] = (p.x * invW + 1.0f) * halfWidth;
+			screen.y[v] = (1.0f - p.y * invW) * halfHeight;
+			screen.z[v] = p.z * invW;
+		}
+
+		if (clipped)
+			continue;
+
+		float minX = std::min(screen.x[0], std::min(screen.x[1], screen.x[2]));
+		float maxX = std::max(screen.x[0], std::max(screen.x[1], screen.x[2]));
+		float minY = std::min(screen.y[0], std::min(screen.y[1], screen.y[2]));
+		float maxY = std::max(screen.y[0], std::max(screen.y[1], screen.y[2]));
+
+		if (maxX < 0.0f || maxY < 0.0f || minX >= float(mWidth) || minY >= float(mHeight))
+			continue;
+
+		BinTriangle(screen,
+			int(std::max(minX, 0.0f)) >> TileShift, int(std::min(maxX, float(mWidth - 1))) >> TileShift,
+			int(std::max(minY, 0.0f)) >> TileShift, int(std::min(maxY, float(mHeight - 1))) >> TileShift);
+	}
+}
+
+void OcclusionCuller::BinTriangle(const ScreenTriangle& tri, int tileX0, int tileX1, int tileY0, int tileY1)
+{
+	uint32_t triIndex = static_cast<uint32_t>(mTriangles.size());
+	mTriangles.push_back(tri);
+
+	// Bin the triangle into every tile its bounding box touches.
+	for (int ty = tileY0; ty <= tileY1; ++ty)
+	{
+		for (int tx = tileX0; tx <= tileX1; ++tx)
+		{
+			mBins[ty * mTilesX + tx].push_back(triIndex);
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeOccluders()
+{
+	std::fill(mLevels[0].Depth.begin(), mLevels[0].Depth.end(), 1.0f);
+
+	auto rasterizeTile = [this](size_t tile)
+	{
+		RasterizeTile(uint32_t(tile));
+	};
+	if (mJobs)
+		mJobs->ParallelFor(0, mTilesX * mTilesY, 1, rasterizeTile);
+	else
+		for (uint32_t tile = 0; tile < mTilesX * mTilesY; ++tile)
+			rasterizeTile(tile);
+
+	BuildHiZ();
+
+	mStats.OccluderTriangles = mTriangles.size();
+}
+
+void OcclusionCuller::RasterizeTile(uint32_t tileIndex)
+{
+	const int tileX0 = int(tileIndex % mTilesX) * int(TileSize);
+	const int tileY0 = int(tileIndex / mTilesX) * int(TileSize);
+	const int tileX1 = tileX0 + int(TileSize) - 1;
+	const int tileY1 = tileY0 + int(TileSize) - 1;
+
+	float* depth = mLevels[0].Depth.data();
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+	for (uint32_t triIndex : mBins[tileIndex])
+	{
+		const ScreenTriangle& t = mTriangles[triIndex];
+
+		float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+		if (area == 0.0f)
+			continue;
+
+		// Edge functions E(p) = A * x + B * y + C, oriented so the interior is positive
+		// for either winding.
+		float sign = area > 0.0f ? 1.0f : -1.0f;
+		float A[3], B[3], C[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			int a = e;
+			int b = (e + 1) % 3;
+			A[e] = sign * (t.y[a] - t.y[b]);
+			B[e] = sign * (t.x[b] - t.x[a]);
+			C[e] = -(A[e] * t.x[a] + B[e] * t.y[a]);
+		}
+
+		// Depth plane z = zx * x + zy * y + zc.
+		float dx1 = t.x[1] - t.x[0], dy1 = t.y[1] - t.y[0], dz1 = t.z[1] - t.z[0];
+		float dx2 = t.x[2] - t.x[0], dy2 = t.y[2] - t.y[0], dz2 = t.z[2] - t.z[0];
+		float zx = (dz1 * dy2 - dz2 * dy1) / area;
+		float zy = (dx1 * dz2 - dx2 * dz1) / area;
+		float zc = t.z[0] - zx * t.x[0] - zy * t.y[0];
+
+		// Triangle bounds clipped to the tile; x is aligned down to the 4-wide SIMD lanes.
+		int minX = std::max(tileX0, int(std::min(t.x[0], std::min(t.x[1], t.x[2])))) & ~3;
+		int maxX = std::min(tileX1, int(std::max(t.x[0], std::max(t.x[1], t.x[2]))));
+		int minY = std::max(tileY0, int(std::min(t.y[0], std::min(t.y[1], t.y[2]))));
+		int maxY = std::min(tileY1, int(std::max(t.y[0], std::max(t.y[1], t.y[2]))));
+
+		__m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]);
+		__m128 vzx = _mm_set1_ps(zx);
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			float py = float(y) + 0.5f;
+			__m128 row0 = _mm_set1_ps(B[0] * py + C[0]);
+			__m128 row1 = _mm_set1_ps(B[1] * py + C[1]);
+			__m128 row2 = _mm_set1_ps(B[2] * py + C[2]);
+			__m128 rowZ = _mm_set1_ps(zy * py + zc);
+
+			float* depthRow = depth + size_t(y) * mWidth;
+
+			for (int x = minX; x <= maxX; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 z = _mm_add_ps(_mm_mul_ps(vzx, px), rowZ);
+				__m128 d = _mm_loadu_ps(depthRow + x);
+				__m128 nearest = _mm_min_ps(d, z);
+				_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, d)));
+			}
+		}
+	}
+}
+
+void OcclusionCuller::BuildHiZ()
+{
+	// Each texel keeps the farthest depth of the four texels below it, so a
+	// bound that is behind a texel is behind everything that texel covers.
+	for (size_t l = 1; l < mLevels.size(); ++l)
+	{
+		const Level& src = mLevels[l - 1];
+		Level& dst = mLevels[l];
+
+		for (uint32_t y = 0; y < dst.Height; ++y)
+		{
+			uint32_t sy0 = std::min(2 * y, src.Height - 1);
+			uint32_t sy1 = std::min(2 * y + 1, src.Height - 1);
+
+			for (uint32_t x = 0; x < dst.Width; ++x)
+			{
+				uint32_t sx0 = std::min(2 * x, src.Width - 1);
+				uint32_t sx1 = std::min(2 * x + 1, src.Width - 1);
+
+				float d = std::max(
+					std::max(src.Depth[sy0 * src.Width + sx0], src.Depth[sy0 * src.Width + sx1]),
+					std::max(src.Depth[sy1 * src.Width + sx0], src.Depth[sy1 * src.Width + sx1]));
+
+				dst.Depth[y * dst.Width + x] = d;
+			}
+		}
+	}
+}
+
+size_t OcclusionCuller::TestSpheres(const float* centerX, const float* centerY, const float* centerZ,
+	const float* radius, size_t count, uint32_t* visibleMask)
+{
+	const size_t wordCount = (count + 31) / 32;
+
+	// One mask word per task, so workers never write to the same word.
+	auto testWord = [&](size_t word)
+	{
+		uint32_t bits = 0;
+		size_t first = word * 32;
+		size_t last = std::min(first + 32, count);
+
+		for (size_t i = first; i < last; ++i)
+		{
+			if (IsSphereVisible(centerX[i], centerY[i], centerZ[i], radius[i]))
+				bits |= 1u << (i - first);
+		}
+
+		visibleMask[word] = bits;
+	};
+	if (mJobs)
+		mJobs->ParallelFor(0, wordCount, 1, testWord);
+	else
+		for (size_t word = 0; word < wordCount; ++word)
+			testWord(word);
+
+	size_t visible = 0;
+	for (size_t w = 0; w < wordCount; ++w)
+	{
+		for (uint32_t bits = visibleMask[w]; bits; bits &= bits - 1)
+			++visible;
+	}
+
+	mStats.Tested = count;
+	mStats.Occluded = count - visible;
+
+	return visible;
+}
+
+bool OcclusionCuller::IsSphereVisible(float x, float y, float z, float r)const
+{
+	const XMFLOAT4X4& V = mView;
+	const XMFLOAT4X4& P = mProj;
+
+	// Sphere center in view space.
+	float vx = x * V(0, 0) + y * V(1, 0) + z * V(2, 0) + V(3, 0);
+	float vy = x * V(0, 1) + y * V(1, 1) + z * V(2, 1) + V(3, 1);
+	float vz = x * V(0, 2) + y * V(1, 2) + z * V(2, 2) + V(3, 2);
+
+	// Anything reaching the near plane can't be tested against the buffer.
+	float nearestZ = vz - r;
+	if (nearestZ <= mNearZ)
+		return true;
+	float farthestZ = vz + r;
+
+	// Project the view space AABB of the sphere; for each side the extreme is reached
+	// at the nearest depth if the coordinate is positive and the farthest otherwise.
+	float maxNX = (vx + r) * P(0, 0) / ((vx + r) >= 0.0f ? nearestZ : farthestZ) + P(2, 0);
+	float minNX = (vx - r) * P(0, 0) / ((vx - r) <= 0.0f ? nearestZ : farthestZ) + P(2, 0);
+	float maxNY = (vy + r) * P(1, 1) / ((vy + r) >= 0.0f ? nearestZ : farthestZ) + P(2, 1);
+	float minNY = (vy - r) * P(1, 1) / ((vy - r) <= 0.0f ? nearestZ : farthestZ) + P(2, 1);
+
+	float minX = (minNX + 1.0f) * 0.5f * mWidth;
+	float maxX = (maxNX + 1.0f) * 0.5f * mWidth;
+	float minY = (1.0f - maxNY) * 0.5f * mHeight;
+	float maxY = (1.0f - minNY) * 0.5f * mHeight;
+
+	// Off screen; leave that decision to frustum culling.
+	if (maxX < 0.0f || maxY < 0.0f || minX >= float(mWidth) || minY >= float(mHeight))
+		return true;
+
+	int x0 = std::max(0, int(minX));
+	int x1 = std::min(int(mWidth) - 1, int(maxX));
+	int y0 = std::max(0, int(minY));
+	int y1 = std::min(int(mHeight) - 1, int(maxY));
+
+	// Pick the level where the bounds cover at most 2x2 texels (3x3 when unaligned).
+	int extent = std::max(x1 - x0, y1 - y0) + 1;
+	size_t level = 0;
+	while ((1 << level) * 2 < extent && level + 1 < mLevels.size())
+		++level;
+
+	const Level& hiz = mLevels[level];
+	x0 >>= level;
+	x1 >>= level;
+	y0 >>= level;
+	y1 >>= level;
+
+	float maxDepth = 0.0f;
+	for (int ty = y0; ty <= y1; ++ty)
+	{
+		for (int tx = x0; tx <= x1; ++tx)
+		{
+			maxDepth = std::max(maxDepth, hiz.Depth[size_t(ty) * hiz.Width + tx]);
+		}
+	}
+
+	// Post-projection depth of the nearest point of the sphere.
+	float sphereDepth = P(2, 2) + P(3, 2) / nearestZ;
+
+	return sphereDepth <= maxDepth;
+}
+
+OcclusionCuller::Stats OcclusionCuller::GetStats()const
+{
+	return mStats;
+}
+
+uint32_t OcclusionCuller::GetWidth()const
+{
+	return mWidth;
+}
+
+uint32_t OcclusionCuller::GetHeight()const
+{
+	return mHeight;
+}
+
+const float* OcclusionCuller::GetDepth(uint32_t level, uint32_t* width, uint32_t* height)const
+{
+	assert(level < mLevels.size());
+	if (width)
+		*width = mLevels[level].Width;
+	if (height)
+		*height = mLevels[level].Height;
+	return mLevels[level].Depth.data();
+}
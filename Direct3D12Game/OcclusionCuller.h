@@ -0,0 +1,108 @@
+//
+// OcclusionCuller.h - CPU software hierarchical-Z occlusion culling
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+class JobSystem;
+
+// Rasterizes a small set of occluder meshes into a low resolution depth buffer,
+// builds a hierarchical-Z (max depth) pyramid from it and tests bounding spheres
+// against the pyramid.
+//
+// Usage per frame:
+//     BeginFrame(view, proj);
+//     AddOccluder(...) for each large occluder;
+//     RasterizeOccluders();
+//     TestSpheres(...);
+//
+// Occluder triangles are projected and binned into screen tiles four at a time,
+// and each tile is rasterized as its own job with SSE edge functions. Triangles
+// crossing the near plane are dropped, which only makes culling less aggressive,
+// never wrong.
+class OcclusionCuller
+{
+public:
+	static const int TileShift = 5;
+	static const uint32_t TileSize = 1u << TileShift;
+
+	// Width and height must be multiples of TileSize.
+	OcclusionCuller(uint32_t width = 256, uint32_t height = 128);
+
+	// Jobs for the tile rasterization and sphere tests; without one everything runs
+	// on the calling thread.
+	void SetJobSystem(JobSystem* jobs);
+
+	void BeginFrame(DirectX::FXMMATRIX view, DirectX::CXMMATRIX proj);
+
+	// Add an occluder mesh in object space with a triangle list index buffer.
+	void AddOccluder(const DirectX::XMFLOAT3* positions, size_t vertexCount,
+		const uint16_t* indices, size_t indexCount, DirectX::FXMMATRIX world);
+
+	// Rasterize all occluders added since BeginFrame and build the Hi-Z pyramid.
+	void RasterizeOccluders();
+
+	// Test SoA bounding spheres (same space as the view matrix). The mask layout matches
+	// Camera::CullSpheres; a bit is cleared when the sphere is fully hidden behind the
+	// occluders. Returns the number of visible spheres.
+	size_t TestSpheres(const float* centerX, const float* centerY, const float* centerZ,
+		const float* radius, size_t count, uint32_t* visibleMask);
+
+	struct Stats
+	{
+		size_t OccluderTriangles = 0;	// triangles rasterized in the last RasterizeOccluders
+		size_t Tested = 0;				// spheres tested in the last TestSpheres
+		size_t Occluded = 0;			// spheres found hidden in the last TestSpheres
+	};
+	Stats GetStats()const;
+
+	uint32_t GetWidth()const;
+	uint32_t GetHeight()const;
+
+	// Depth of one Hi-Z level (level 0 is the full resolution buffer).
+	const float* GetDepth(uint32_t level, uint32_t* width, uint32_t* height)const;
+
+private:
+	struct ScreenTriangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+	};
+
+	void BinTriangle(const ScreenTriangle& tri, int tileX0, int tileX1, int tileY0, int tileY1);
+	void RasterizeTile(uint32_t tileIndex);
+	void BuildHiZ();
+	bool IsSphereVisible(float x, float y, float z, float r)const;
+
+	JobSystem* mJobs;
+
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mTilesX;
+	uint32_t mTilesY;
+
+	DirectX::XMFLOAT4X4 mView;
+	DirectX::XMFLOAT4X4 mProj;
+	DirectX::XMFLOAT4X4 mViewProj;
+	float mNearZ;
+
+	std::vector<DirectX::XMFLOAT4> mClipPositions;
+	std::vector<ScreenTriangle> mTriangles;
+	std::vector<std::vector<uint32_t>> mBins;
+
+	// Hi-Z pyramid; mLevels[0] is the rasterized depth buffer.
+	struct Level
+	{
+		uint32_t Width;
+		uint32_t Height;
+		std::vector<float> Depth;
+	};
+	std::vector<Level> mLevels;
+
+	Stats mStats;
+};
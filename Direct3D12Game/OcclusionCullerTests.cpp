@@ -0,0 +1,192 @@
+//
+// OcclusionCullerTests.cpp
+//
+
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+#include "SelfTest.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	struct Mesh
+	{
+		std::vector<XMFLOAT3> Positions;
+		std::vector<uint16_t> Indices;
+	};
+
+	// Latitude/longitude sphere of the given radius around the origin.
+	Mesh MakeSphere(float radius, int rings, int segments)
+	{
+		Mesh mesh;
+		for (int r = 0; r <= rings; ++r)
+		{
+			float theta = XM_PI * r / rings;
+			for (int s = 0; s <= segments; ++s)
+			{
+				float phi = XM_2PI * s / segments;
+				mesh.Positions.push_back(XMFLOAT3(
+					radius * sinf(theta) * cosf(phi), radius * cosf(theta), radius * sinf(theta) * sinf(phi)));
+			}
+		}
+		for (int r = 0; r < rings; ++r)
+		{
+			for (int s = 0; s < segments; ++s)
+			{
+				uint16_t a = uint16_t(r * (segments + 1) + s);
+				uint16_t b = uint16_t(a + segments + 1);
+				uint16_t quad[] = { a, b, uint16_t(a + 1), uint16_t(a + 1), b, uint16_t(b + 1) };
+				mesh.Indices.insert(mesh.Indices.end(), quad, quad + 6);
+			}
+		}
+		return mesh;
+	}
+
+	XMMATRIX MakeView(float distance)
+	{
+		return XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, -distance, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	}
+
+	XMMATRIX MakeProj()
+	{
+		return XMMatrixPerspectiveFovLH(0.25f * XM_PI, 2.0f, 0.1f, 100.0f);
+	}
+
+	size_t CountCovered(const OcclusionCuller& culler)
+	{
+		uint32_t width, height;
+		const float* depth = culler.GetDepth(0, &width, &height);
+		size_t covered = 0;
+		for (size_t i = 0; i < size_t(width) * height; ++i)
+			covered += depth[i] < 1.0f ? 1 : 0;
+		return covered;
+	}
+}
+
+SELF_TEST(OcclusionCuller, FourWideBinningMatchesScalar)
+{
+	// A sphere cut by the near plane and a soup of triangles reaching behind the camera
+	// and far off screen. Added in one call the triangles go through the four-wide path,
+	// added one by one through the scalar one; the depth buffers must be identical.
+	Mesh mesh = MakeSphere(1.0f, 13, 17);
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> position(-40.0f, 40.0f);
+	for (int i = 0; i < 3001; ++i)
+	{
+		mesh.Indices.push_back(uint16_t(mesh.Positions.size()));
+		mesh.Positions.push_back(XMFLOAT3(position(random), position(random), position(random)));
+	}
+
+	const XMMATRIX world = XMMatrixRotationY(0.3f);
+	OcclusionCuller batched;
+	OcclusionCuller single;
+	batched.BeginFrame(MakeView(1.05f), MakeProj());
+	single.BeginFrame(MakeView(1.05f), MakeProj());
+
+	batched.AddOccluder(mesh.Positions.data(), mesh.Positions.size(), mesh.Indices.data(), mesh.Indices.size(), world);
+	for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+		single.AddOccluder(mesh.Positions.data(), mesh.Positions.size(), &mesh.Indices[i], 3, world);
+
+	batched.RasterizeOccluders();
+	single.RasterizeOccluders();
+
+	size_t triangles = batched.GetStats().OccluderTriangles;
+	context.Log("%zu of %zu triangles binned, %zu texels covered", triangles, mesh.Indices.size() / 3, CountCovered(batched));
+	SELF_CHECK(triangles == single.GetStats().OccluderTriangles);
+	SELF_CHECK(triangles > 0 && triangles < mesh.Indices.size() / 3);
+	SELF_CHECK(CountCovered(batched) > 0);
+
+	const float* a = batched.GetDepth(0, nullptr, nullptr);
+	const float* b = single.GetDepth(0, nullptr, nullptr);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < size_t(batched.GetWidth()) * batched.GetHeight(); ++i)
+		mismatches += a[i] == b[i] ? 0 : 1;
+	SELF_CHECK(mismatches == 0);
+}
+
+SELF_TEST(OcclusionCuller, GlobeHidesWhatIsBehindIt)
+{
+	Mesh globe = MakeSphere(1.0f, 16, 24);
+	OcclusionCuller culler;
+	culler.BeginFrame(MakeView(4.0f), MakeProj());
+	culler.AddOccluder(globe.Positions.data(), globe.Positions.size(), globe.Indices.data(), globe.Indices.size(), XMMatrixIdentity());
+	culler.RasterizeOccluders();
+
+	// Behind the center, in front of the globe, beside it, behind it but larger than
+	// it looks, and behind the camera.
+	const float x[] = { 0.0f, 0.0f, 3.0f, 0.0f, 0.0f };
+	const float y[] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	const float z[] = { 3.0f, -2.0f, 3.0f, 3.0f, -6.0f };
+	const float r[] = { 0.2f, 0.2f, 0.2f, 2.5f, 0.2f };
+	uint32_t mask = 0;
+	size_t visible = culler.TestSpheres(x, y, z, r, 5, &mask);
+
+	SELF_CHECK(mask == 0x1E);
+	SELF_CHECK(visible == 4);
+	SELF_CHECK(culler.GetStats().Tested == 5);
+	SELF_CHECK(culler.GetStats().Occluded == 1);
+}
+
+SELF_BENCHMARK(OcclusionCuller, Instances100k)
+{
+	const size_t count = 100000;
+	const int frames = 50;
+
+	// Small bodies scattered through a slab around and behind a globe.
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> across(-12.0f, 12.0f);
+	std::uniform_real_distribution<float> depth(-1.0f, 20.0f);
+	std::uniform_real_distribution<float> size(0.01f, 0.1f);
+	std::vector<float> x(count), y(count), z(count), r(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		x[i] = across(random);
+		y[i] = 0.5f * across(random);
+		z[i] = depth(random);
+		r[i] = size(random);
+	}
+	std::vector<uint32_t> mask((count + 31) / 32);
+
+	Mesh globe = MakeSphere(1.5f, 32, 48);
+	JobSystem jobs;
+
+	for (bool parallel : { false, true })
+	{
+		OcclusionCuller culler;
+		culler.SetJobSystem(parallel ? &jobs : nullptr);
+
+		double addNs = 0.0;
+		double rasterizeNs = 0.0;
+		double testNs = 0.0;
+		size_t visible = 0;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			culler.BeginFrame(MakeView(4.0f), MakeProj());
+
+			auto start = std::chrono::steady_clock::now();
+			culler.AddOccluder(globe.Positions.data(), globe.Positions.size(), globe.Indices.data(), globe.Indices.size(),
+				XMMatrixRotationY(0.01f * frame));
+			auto added = std::chrono::steady_clock::now();
+			culler.RasterizeOccluders();
+			auto rasterized = std::chrono::steady_clock::now();
+			visible = culler.TestSpheres(x.data(), y.data(), z.data(), r.data(), count, mask.data());
+			auto tested = std::chrono::steady_clock::now();
+
+			addNs += std::chrono::duration<double, std::nano>(added - start).count();
+			rasterizeNs += std::chrono::duration<double, std::nano>(rasterized - added).count();
+			testNs += std::chrono::duration<double, std::nano>(tested - rasterized).count();
+		}
+
+		OcclusionCuller::Stats stats = culler.GetStats();
+		context.Log("%-8s %zu of %zu occluded (%.1f%%), %zu occluder triangles: bin %.1f us, rasterize %.1f us, test %.1f us (%.2f ns/instance)",
+			parallel ? "jobs" : "inline", stats.Occluded, count, 100.0 * stats.Occluded / count, stats.OccluderTriangles,
+			addNs / frames / 1000.0, rasterizeNs / frames / 1000.0, testNs / frames / 1000.0, testNs / frames / count);
+		SELF_CHECK(stats.Occluded > 0 && visible + stats.Occluded == count);
+	}
+}
@@ -0,0 +1,612 @@
+//
+// RecordingRenderDevice.cpp
+//
+
+#include "RecordingRenderDevice.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	enum ObjectKind : char
+	{
+		TextureObject = 'T',
+		MeshObject = 'M',
+		PipelineObject = 'P',
+		FontObject = 'F'
+	};
+
+	// FNV-1a, to tell transforms apart without keeping them.
+	uint32_t Hash(const float* values, size_t count)
+	{
+		uint32_t hash = 2166136261u;
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+		for (size_t i = 0; i < count * sizeof(float); ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	const char* const c_commandNames[] =
+	{
+		"barrier", "begin barrier", "end barrier", "set render targets", "set viewport", "clear color", "clear depth",
+		"set pipeline", "set texture", "set view projection", "set world", "draw mesh",
+		"draw lines", "draw sprite", "draw string", "resolve", "copy", "upscale"
+	};
+
+	const char* const c_stateNames[] =
+	{
+		"Common", "RenderTarget", "DepthWrite", "ShaderResource", "ResolveSource",
+		"ResolveDest", "CopySource", "CopyDest", "Present"
+	};
+}
+
+//
+// List
+//
+
+RecordingRenderDevice::List::List(RecordingRenderDevice& device, int id) :
+	mDevice(device),
+	mId(id),
+	mAllocator(nullptr),
+	mOpen(false)
+{
+}
+
+void RecordingRenderDevice::List::Reset(ICommandAllocator& allocator)
+{
+	Allocator& recordingAllocator = static_cast<Allocator&>(allocator);
+	if (mOpen)
+		throw std::logic_error("command list reset while recording");
+	if (recordingAllocator.mRecording)
+		throw std::logic_error("command allocator already backs a recording list");
+
+	mAllocator = &recordingAllocator;
+	mAllocator->mRecording = this;
+	mOpen = true;
+	mCommands.clear();
+	mStates.Reset();
+	mDevice.AddLog("reset list " + std::to_string(mId) + " allocator " + std::to_string(mAllocator->mId));
+}
+
+void RecordingRenderDevice::List::Close()
+{
+	if (!mOpen)
+		throw std::logic_error("command list closed twice");
+
+	RecordBarriers(mStates.Close());
+	mOpen = false;
+	mAllocator->mRecording = nullptr;
+	mDevice.AddLog("close list " + std::to_string(mId));
+}
+
+void RecordingRenderDevice::List::Transition(RenderTexture texture, ResourceState after)
+{
+	RequireOpen();
+	RequireTexture(texture);
+	mStates.Transition(texture.Id, after);
+}
+
+void RecordingRenderDevice::List::BeginTransition(RenderTexture texture, ResourceState after)
+{
+	RequireOpen();
+	RequireTexture(texture);
+	mStates.BeginTransition(texture.Id, after);
+}
+
+void RecordingRenderDevice::List::SetRenderTargets(RenderTexture color, RenderTexture depth)
+{
+	RequireTexture(color);
+	mStates.Use(color.Id);
+	if (depth)
+	{
+		RequireTexture(depth);
+		mStates.Use(depth.Id);
+	}
+	Record(RecordedCommandType::SetRenderTargets, color.Id, depth.Id);
+}
+
+void RecordingRenderDevice::List::SetViewport(uint32_t width, uint32_t height)
+{
+	Record(RecordedCommandType::SetViewport, width, height);
+}
+
+void RecordingRenderDevice::List::ClearColor(RenderTexture target, const float color[4])
+{
+	RequireTexture(target);
+	mStates.Use(target.Id);
+	FlushBarriers();
+	Record(RecordedCommandType::ClearColor, target.Id, Hash(color, 4));
+}
+
+void RecordingRenderDevice::List::ClearDepth(RenderTexture target, float depth)
+{
+	RequireTexture(target);
+	mStates.Use(target.Id);
+	FlushBarriers();
+	Record(RecordedCommandType::ClearDepth, target.Id, Hash(&depth, 1));
+}
+
+void RecordingRenderDevice::List::SetPipeline(RenderPipeline pipeline)
+{
+	RequireObject(pipeline.Id, PipelineObject, "unknown pipeline handle");
+	Record(RecordedCommandType::SetPipeline, pipeline.Id);
+}
+
+void RecordingRenderDevice::List::SetTexture(RenderTexture texture)
+{
+	RequireTexture(texture);
+	mStates.Use(texture.Id);
+	Record(RecordedCommandType::SetTexture, texture.Id);
+}
+
+void RecordingRenderDevice::List::SetViewProjection(const float view[16], const float projection[16])
+{
+	Record(RecordedCommandType::SetViewProjection, Hash(view, 16) ^ (Hash(projection, 16) * 31u), 0,
+		2 * 16 * sizeof(float));
+}
+
+void RecordingRenderDevice::List::SetWorld(const float world[16])
+{
+	Record(RecordedCommandType::SetWorld, Hash(world, 16), 0, 16 * sizeof(float));
+}
+
+void RecordingRenderDevice::List::DrawMesh(RenderMesh mesh)
+{
+	RequireObject(mesh.Id, MeshObject, "unknown mesh handle");
+	FlushBarriers();
+	Record(RecordedCommandType::DrawMesh, mesh.Id);
+}
+
+void RecordingRenderDevice::List::DrawLines(const RenderVertex* vertices, size_t vertexCount)
+{
+	if (vertexCount % 2 != 0)
+		throw std::logic_error("lines need an even number of vertices");
+	(void)vertices;
+	FlushBarriers();
+	Record(RecordedCommandType::DrawLines, uint32_t(vertexCount), 0, vertexCount * sizeof(RenderVertex));
+}
+
+void RecordingRenderDevice::List::DrawSprite(RenderTexture texture, float left, float top, float right, float bottom)
+{
+	RequireTexture(texture);
+	mStates.Use(texture.Id);
+	FlushBarriers();
+	(void)left; (void)top; (void)right; (void)bottom;
+	// One quad of four position, color and texture coordinate vertices.
+	Record(RecordedCommandType::DrawSprite, texture.Id, 0, 4 * 9 * sizeof(float));
+}
+
+void RecordingRenderDevice::List::DrawString(RenderFont font, const char* text, float x, float y)
+{
+	(void)x; (void)y;
+	RequireObject(font.Id, FontObject, "unknown font handle");
+	size_t length = strlen(text);
+	FlushBarriers();
+	Record(RecordedCommandType::DrawString, font.Id, uint32_t(length), length * 4 * 9 * sizeof(float));
+}
+
+void RecordingRenderDevice::List::Resolve(RenderTexture dest, RenderTexture source)
+{
+	RequireTexture(dest);
+	RequireTexture(source);
+	mStates.Use(dest.Id);
+	mStates.Use(source.Id);
+	FlushBarriers();
+	Record(RecordedCommandType::Resolve, dest.Id, source.Id);
+}
+
+void RecordingRenderDevice::List::Copy(RenderTexture dest, RenderTexture source)
+{
+	RequireTexture(dest);
+	RequireTexture(source);
+	mStates.Use(dest.Id);
+	mStates.Use(source.Id);
+	FlushBarriers();
+	Record(RecordedCommandType::Copy, dest.Id, source.Id);
+}
+
+void RecordingRenderDevice::List::Upscale(RenderTexture dest, RenderTexture source, uint32_t sourceWidth, uint32_t sourceHeight)
+{
+	RequireTexture(dest);
+	RequireTexture(source);
+	if (sourceWidth == 0 || sourceHeight == 0 || sourceWidth > 0xffff || sourceHeight > 0xffff)
+		throw std::logic_error("upscale source size out of range");
+	mStates.Use(dest.Id);
+	mStates.Use(source.Id);
+	FlushBarriers();
+	// One quad, as for a sprite.
+	Record(RecordedCommandType::Upscale, dest.Id, source.Id, 4 * 9 * sizeof(float));
+	mCommands.back().C = sourceWidth << 16 | sourceHeight;
+}
+
+int RecordingRenderDevice::List::GetId()const
+{
+	return mId;
+}
+
+const std::vector<RecordedCommand>& RecordingRenderDevice::List::GetCommands()const
+{
+	return mCommands;
+}
+
+void RecordingRenderDevice::List::Record(RecordedCommandType type, uint32_t a, uint32_t b, size_t bytes)
+{
+	RequireOpen();
+
+	RecordedCommand command;
+	command.Type = type;
+	command.A = a;
+	command.B = b;
+	command.Bytes = uint32_t(bytes);
+	mCommands.push_back(command);
+}
+
+void RecordingRenderDevice::List::RecordBarriers(const std::vector<StateBarrier>& barriers)
+{
+	for (const StateBarrier& barrier : barriers)
+	{
+		RecordedCommandType type = barrier.Split == StateBarrier::Begin ? RecordedCommandType::BeginBarrier
+			: barrier.Split == StateBarrier::End ? RecordedCommandType::EndBarrier : RecordedCommandType::Barrier;
+		Record(type, barrier.Texture, uint32_t(barrier.After));
+	}
+}
+
+void RecordingRenderDevice::List::FlushBarriers()
+{
+	RequireOpen();
+	if (mStates.HasPending())
+		RecordBarriers(mStates.Flush());
+}
+
+void RecordingRenderDevice::List::RequireOpen()const
+{
+	if (!mOpen)
+		throw std::logic_error("recording into a closed command list");
+}
+
+void RecordingRenderDevice::List::RequireTexture(RenderTexture texture)const
+{
+	RequireObject(texture.Id, TextureObject, "unknown texture handle");
+}
+
+void RecordingRenderDevice::List::RequireObject(uint32_t id, char kind, const char* message)const
+{
+	// Objects are added before recording starts, so this needs no lock. Id 0, the null
+	// handle, has no kind.
+	if (id >= mDevice.mKinds.size() || mDevice.mKinds[id] != kind)
+		throw std::logic_error(message);
+}
+
+//
+// Allocator
+//
+
+RecordingRenderDevice::Allocator::Allocator(RecordingRenderDevice& device, int id) :
+	mDevice(device),
+	mId(id),
+	mLastUse(0),
+	mRecording(nullptr)
+{
+}
+
+void RecordingRenderDevice::Allocator::Reset()
+{
+	if (mRecording)
+		throw std::logic_error("command allocator reset while a list is recording");
+	if (mLastUse > mDevice.GetCompletedFence())
+		throw std::logic_error("command allocator reset while the GPU may still use it");
+
+	mDevice.AddLog("reset allocator " + std::to_string(mId));
+}
+
+int RecordingRenderDevice::Allocator::GetId()const
+{
+	return mId;
+}
+
+//
+// RecordingRenderDevice
+//
+
+RenderTexture RecordingRenderDevice::AddTexture(const std::string& name, ResourceState state)
+{
+	RenderTexture texture;
+	texture.Id = AddObject(name, TextureObject);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStates.SetState(texture.Id, state);
+	return texture;
+}
+
+RenderMesh RecordingRenderDevice::AddMesh(const std::string& name)
+{
+	RenderMesh mesh;
+	mesh.Id = AddObject(name, MeshObject);
+	return mesh;
+}
+
+RenderPipeline RecordingRenderDevice::AddPipeline(const std::string& name)
+{
+	RenderPipeline pipeline;
+	pipeline.Id = AddObject(name, PipelineObject);
+	return pipeline;
+}
+
+RenderFont RecordingRenderDevice::AddFont(const std::string& name)
+{
+	RenderFont font;
+	font.Id = AddObject(name, FontObject);
+	return font;
+}
+
+uint32_t RecordingRenderDevice::AddObject(const std::string& name, char kind)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mNames.push_back(name);
+	mKinds.push_back(kind);
+	return uint32_t(mNames.size() - 1);
+}
+
+std::unique_ptr<ICommandAllocator> RecordingRenderDevice::CreateAllocator()
+{
+	int id;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		id = mNextId++;
+	}
+	AddLog("create allocator " + std::to_string(id));
+	return std::make_unique<Allocator>(*this, id);
+}
+
+std::unique_ptr<ICommandList> RecordingRenderDevice::CreateList(ICommandAllocator&)
+{
+	int id;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		id = mNextId++;
+	}
+	AddLog("create list " + std::to_string(id));
+	return std::make_unique<List>(*this, id);
+}
+
+void RecordingRenderDevice::Execute(ICommandList* const* lists, size_t count)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	std::string entry = "execute";
+	for (size_t i = 0; i < count; ++i)
+	{
+		List& list = static_cast<List&>(*lists[i]);
+		if (list.mOpen)
+			throw std::logic_error("executing an open command list");
+
+		list.mAllocator->mLastUse = mNextFence;
+
+		// Fix-ups run as a batch of their own in front of the list.
+		mFixups.clear();
+		mStates.Resolve(list.mStates, mFixups);
+		for (const StateBarrier& fixup : mFixups)
+		{
+			RecordedCommand command;
+			command.Type = RecordedCommandType::Barrier;
+			command.A = fixup.Texture;
+			command.B = uint32_t(fixup.After);
+			if (mCapture)
+				mExecuted.push_back(command);
+		}
+		if (!mFixups.empty())
+		{
+			mStats.Commands += mFixups.size();
+			mStats.Barriers += mFixups.size();
+			mStats.FixupBarriers += mFixups.size();
+			mStats.BarrierBatches++;
+		}
+
+		Count(list);
+		if (mCapture)
+		{
+			mExecuted.insert(mExecuted.end(), list.mCommands.begin(), list.mCommands.end());
+			entry += " " + std::to_string(list.mId);
+		}
+	}
+	mStats.ExecuteCalls++;
+	if (mCapture)
+		mLog.push_back(entry);
+}
+
+void RecordingRenderDevice::Count(const List& list)
+{
+	// State starts out unset in every list, as on the GPU.
+	uint32_t targets[2] = {};
+	uint32_t viewport[2] = {};
+	uint32_t pipeline = 0;
+	uint32_t texture = 0;
+	uint32_t viewProjection = 0;
+	uint32_t world = 0;
+	bool hasViewProjection = false;
+	bool hasWorld = false;
+
+	auto change = [this](bool redundant)
+	{
+		mStats.StateChanges++;
+		if (redundant)
+			mStats.RedundantStateChanges++;
+	};
+
+	for (const auto& command : list.mCommands)
+	{
+		mStats.Commands++;
+		mStats.UploadBytes += command.Bytes;
+
+		switch (command.Type)
+		{
+		case RecordedCommandType::Barrier:
+		case RecordedCommandType::BeginBarrier:
+		case RecordedCommandType::EndBarrier:
+			mStats.Barriers++;
+			break;
+		case RecordedCommandType::SetRenderTargets:
+			change(targets[0] == command.A && targets[1] == command.B);
+			targets[0] = command.A;
+			targets[1] = command.B;
+			break;
+		case RecordedCommandType::SetViewport:
+			change(viewport[0] == command.A && viewport[1] == command.B);
+			viewport[0] = command.A;
+			viewport[1] = command.B;
+			break;
+		case RecordedCommandType::SetPipeline:
+			change(pipeline == command.A);
+			pipeline = command.A;
+			break;
+		case RecordedCommandType::SetTexture:
+			change(texture == command.A);
+			texture = command.A;
+			break;
+		case RecordedCommandType::SetViewProjection:
+			change(hasViewProjection && viewProjection == command.A);
+			viewProjection = command.A;
+			hasViewProjection = true;
+			break;
+		case RecordedCommandType::SetWorld:
+			change(hasWorld && world == command.A);
+			world = command.A;
+			hasWorld = true;
+			break;
+		case RecordedCommandType::DrawMesh:
+		case RecordedCommandType::DrawLines:
+		case RecordedCommandType::DrawSprite:
+		case RecordedCommandType::DrawString:
+			mStats.Draws++;
+			break;
+		case RecordedCommandType::Upscale:
+			// Binds the destination with a viewport of its size, which is not recorded.
+			targets[0] = command.A;
+			targets[1] = 0;
+			viewport[0] = 0;
+			viewport[1] = 0;
+			mStats.Draws++;
+			break;
+		default:
+			break;
+		}
+	}
+	const ResourceStateTracker::Stats& states = list.mStates.GetStats();
+	mStats.BarrierBatches += states.Batches;
+	mStats.SplitBarriers += states.SplitBarriers;
+	mStats.RedundantTransitions += states.Redundant;
+	mStats.ListsExecuted++;
+}
+
+uint64_t RecordingRenderDevice::Signal()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mCapture)
+		mLog.push_back("signal " + std::to_string(mNextFence));
+	return mNextFence++;
+}
+
+void RecordingRenderDevice::WaitForFence(uint64_t value)
+{
+	CompleteFence(value);
+}
+
+void RecordingRenderDevice::CompleteFence(uint64_t value)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (value > mCompletedFence)
+	{
+		mCompletedFence = value;
+		if (mCapture)
+			mLog.push_back("complete " + std::to_string(value));
+	}
+}
+
+uint64_t RecordingRenderDevice::GetCompletedFence()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mCompletedFence;
+}
+
+RecordingRenderDevice::Stats RecordingRenderDevice::GetStats()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void RecordingRenderDevice::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats = Stats();
+}
+
+const std::vector<std::string>& RecordingRenderDevice::GetLog()const
+{
+	return mLog;
+}
+
+const std::vector<RecordedCommand>& RecordingRenderDevice::GetExecutedCommands()const
+{
+	return mExecuted;
+}
+
+void RecordingRenderDevice::SetCapture(bool capture)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCapture = capture;
+}
+
+std::string RecordingRenderDevice::Describe(const RecordedCommand& command)const
+{
+	std::string text = c_commandNames[size_t(command.Type)];
+	switch (command.Type)
+	{
+	case RecordedCommandType::Barrier:
+	case RecordedCommandType::BeginBarrier:
+	case RecordedCommandType::EndBarrier:
+		text += " " + GetName(command.A) + " -> " + c_stateNames[command.B];
+		break;
+	case RecordedCommandType::SetRenderTargets:
+	case RecordedCommandType::Resolve:
+	case RecordedCommandType::Copy:
+		text += " " + GetName(command.A) + ", " + GetName(command.B);
+		break;
+	case RecordedCommandType::SetViewport:
+		text += " " + std::to_string(command.A) + "x" + std::to_string(command.B);
+		break;
+	case RecordedCommandType::Upscale:
+		text += " " + GetName(command.A) + ", " + GetName(command.B) + " " + std::to_string(command.C >> 16)
+			+ "x" + std::to_string(command.C & 0xffff);
+		break;
+	case RecordedCommandType::DrawLines:
+		text += " " + std::to_string(command.A / 2);
+		break;
+	case RecordedCommandType::DrawString:
+		text += " " + GetName(command.A) + ", " + std::to_string(command.B) + " characters";
+		break;
+	case RecordedCommandType::SetViewProjection:
+	case RecordedCommandType::SetWorld:
+		break;
+	default:
+		text += " " + GetName(command.A);
+		break;
+	}
+	return text;
+}
+
+void RecordingRenderDevice::AddLog(const std::string& entry)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mCapture)
+		mLog.push_back(entry);
+}
+
+const std::string& RecordingRenderDevice::GetName(uint32_t id)const
+{
+	static const std::string unknown = "?";
+	return id < mNames.size() ? mNames[id] : unknown;
+}
@@ -0,0 +1,201 @@
+//
+// RecordingRenderDevice.h - Render backend that captures the command stream in memory
+//
+
+#pragma once
+
+#include "RenderDevice.h"
+#include "ResourceStateTracker.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class RecordedCommandType : uint8_t
+{
+	Barrier,
+	BeginBarrier,
+	EndBarrier,
+	SetRenderTargets,
+	SetViewport,
+	ClearColor,
+	ClearDepth,
+	SetPipeline,
+	SetTexture,
+	SetViewProjection,
+	SetWorld,
+	DrawMesh,
+	DrawLines,
+	DrawSprite,
+	DrawString,
+	Resolve,
+	Copy,
+	Upscale
+};
+
+// One captured command. A and B are the handles or sizes the command takes, e.g. the
+// texture and the state after a barrier (barriers are captured as the tracker flushes
+// them, not as Transition is called), the destination and source of a copy, or the
+// width and height of a viewport; transforms store a hash of the matrices in A. C is
+// the source size of an upscale, width << 16 | height. Bytes is the data the command
+// uploads.
+struct RecordedCommand
+{
+	RecordedCommandType Type;
+	uint32_t A = 0;
+	uint32_t B = 0;
+	uint32_t C = 0;
+	uint32_t Bytes = 0;
+};
+
+// CPU stand-in for a render backend, for running the render path headless. Lists
+// capture their commands instead of recording GPU work, and executing them appends
+// them to the device's stream and counters. Like a GPU, it does not look at what is
+// drawn, but it throws std::logic_error on misuse a real device would not catch on its
+// own: resetting an allocator before the GPU finished with it, recording two lists on
+// one allocator at once, executing a list that is still open, and using handles it did
+// not create, the null handle or a handle of another kind. Texture states are tracked
+// like on D3D12RenderDevice, fix-up barriers included, so the captured barriers are the
+// ones a GPU would get. The GPU is simulated by a completed fence value that only moves
+// when WaitForFence or CompleteFence is called.
+class RecordingRenderDevice : public IRenderDevice
+{
+public:
+	class Allocator;
+
+	class List : public IRenderCommandList
+	{
+	public:
+		List(RecordingRenderDevice& device, int id);
+
+		void Reset(ICommandAllocator& allocator) override;
+		void Close() override;
+
+		void Transition(RenderTexture texture, ResourceState after) override;
+		void BeginTransition(RenderTexture texture, ResourceState after) override;
+		void SetRenderTargets(RenderTexture color, RenderTexture depth) override;
+		void SetViewport(uint32_t width, uint32_t height) override;
+		void ClearColor(RenderTexture target, const float color[4]) override;
+		void ClearDepth(RenderTexture target, float depth) override;
+		void SetPipeline(RenderPipeline pipeline) override;
+		void SetTexture(RenderTexture texture) override;
+		void SetViewProjection(const float view[16], const float projection[16]) override;
+		void SetWorld(const float world[16]) override;
+		void DrawMesh(RenderMesh mesh) override;
+		void DrawLines(const RenderVertex* vertices, size_t vertexCount) override;
+		void DrawSprite(RenderTexture texture, float left, float top, float right, float bottom) override;
+		void DrawString(RenderFont font, const char* text, float x, float y) override;
+		void Resolve(RenderTexture dest, RenderTexture source) override;
+		void Copy(RenderTexture dest, RenderTexture source) override;
+		void Upscale(RenderTexture dest, RenderTexture source, uint32_t sourceWidth, uint32_t sourceHeight) override;
+
+		int GetId()const;
+		const std::vector<RecordedCommand>& GetCommands()const;
+
+	private:
+		friend class RecordingRenderDevice;
+
+		void Record(RecordedCommandType type, uint32_t a = 0, uint32_t b = 0, size_t bytes = 0);
+		void RecordBarriers(const std::vector<StateBarrier>& barriers);
+		// Before commands that do GPU work.
+		void FlushBarriers();
+		void RequireOpen()const;
+		void RequireTexture(RenderTexture texture)const;
+		void RequireObject(uint32_t id, char kind, const char* message)const;
+
+		RecordingRenderDevice& mDevice;
+		int mId;
+		Allocator* mAllocator;
+		bool mOpen;
+		std::vector<RecordedCommand> mCommands;
+		ResourceStateTracker mStates;
+	};
+
+	class Allocator : public ICommandAllocator
+	{
+	public:
+		Allocator(RecordingRenderDevice& device, int id);
+
+		void Reset() override;
+
+		int GetId()const;
+
+	private:
+		friend class RecordingRenderDevice;
+		friend class List;
+
+		RecordingRenderDevice& mDevice;
+		int mId;
+		uint64_t mLastUse;		// fence value of the last Execute of a list using it
+		List* mRecording;
+	};
+
+	// Backend objects only have a name. Add them before recording with them; textures
+	// start out in the given state.
+	RenderTexture AddTexture(const std::string& name, ResourceState state = ResourceState::Common);
+	RenderMesh AddMesh(const std::string& name);
+	RenderPipeline AddPipeline(const std::string& name);
+	RenderFont AddFont(const std::string& name);
+
+	std::unique_ptr<ICommandAllocator> CreateAllocator() override;
+	std::unique_ptr<ICommandList> CreateList(ICommandAllocator& allocator) override;
+
+	void Execute(ICommandList* const* lists, size_t count) override;
+	uint64_t Signal() override;
+	uint64_t GetCompletedFence()const override;
+	void WaitForFence(uint64_t value) override;
+
+	// Let the simulated GPU finish everything up to the fence value.
+	void CompleteFence(uint64_t value);
+
+	// Counters of the executed commands since the last ResetStats. State changes that set
+	// what the list already had are counted as redundant as well.
+	struct Stats
+	{
+		uint64_t Commands = 0;
+		uint64_t Draws = 0;
+		uint64_t StateChanges = 0;
+		uint64_t RedundantStateChanges = 0;
+		uint64_t Barriers = 0;					// including fix-ups and both halves of split barriers
+		uint64_t BarrierBatches = 0;			// ResourceBarrier calls
+		uint64_t SplitBarriers = 0;
+		uint64_t FixupBarriers = 0;
+		uint64_t RedundantTransitions = 0;		// dropped by the trackers
+		uint64_t UploadBytes = 0;
+		uint64_t ListsExecuted = 0;
+		uint64_t ExecuteCalls = 0;
+	};
+	Stats GetStats()const;
+	void ResetStats();
+
+	// Every device call in order, e.g. "execute 3 1 2", and the executed commands in order.
+	// Capturing both can be turned off for long benchmarks; the stats are always kept.
+	const std::vector<std::string>& GetLog()const;
+	const std::vector<RecordedCommand>& GetExecutedCommands()const;
+	void SetCapture(bool capture);
+
+	// Readable form of a command, e.g. "barrier earth.bmp -> ShaderResource".
+	std::string Describe(const RecordedCommand& command)const;
+
+private:
+	void AddLog(const std::string& entry);
+	void Count(const List& list);
+	uint32_t AddObject(const std::string& name, char kind);
+	const std::string& GetName(uint32_t id)const;
+
+	mutable std::mutex mMutex;
+	std::vector<std::string> mLog;
+	std::vector<RecordedCommand> mExecuted;
+	bool mCapture = true;
+	Stats mStats;
+	int mNextId = 0;
+	uint64_t mNextFence = 1;	// value the next Signal returns
+	uint64_t mCompletedFence = 0;
+	ResourceStates mStates;
+	std::vector<StateBarrier> mFixups;
+
+	// Names and kinds of the added objects, indexed by handle id (all kinds share the
+	// ids, mKinds tells them apart).
+	std::vector<std::string> mNames{ "none" };
+	std::vector<char> mKinds{ 0 };
+};
@@ -0,0 +1,75 @@
+//
+// RecordingRenderDeviceTests.cpp
+//
+
+#include "RecordingRenderDevice.h"
+#include "SelfTest.h"
+
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+namespace
+{
+	bool Throws(const std::function<void()>& call)
+	{
+		try
+		{
+			call();
+		}
+		catch (const std::logic_error&)
+		{
+			return true;
+		}
+		return false;
+	}
+}
+
+SELF_TEST(RecordingRenderDevice, RejectsUnknownHandles)
+{
+	RecordingRenderDevice device;
+	RenderTexture texture = device.AddTexture("texture", ResourceState::ShaderResource);
+	RenderMesh mesh = device.AddMesh("mesh");
+	RenderPipeline pipeline = device.AddPipeline("pipeline");
+	RenderFont font = device.AddFont("font");
+
+	std::unique_ptr<ICommandAllocator> allocator = device.CreateAllocator();
+	std::unique_ptr<ICommandList> commandList = device.CreateList(*allocator);
+	commandList->Reset(*allocator);
+	IRenderCommandList& list = IRenderDevice::GetRenderList(*commandList);
+
+	// Handles of the right kind are recorded.
+	list.SetPipeline(pipeline);
+	list.SetTexture(texture);
+	list.DrawMesh(mesh);
+	list.DrawString(font, "text", 0.0f, 0.0f);
+	SELF_CHECK(static_cast<RecordingRenderDevice::List&>(list).GetCommands().size() == 4);
+
+	// The null handle, ids the device never handed out and handles of another kind are
+	// not, whichever kind is asked for.
+	RenderPipeline nullPipeline, unknownPipeline, meshAsPipeline;
+	unknownPipeline.Id = 100;
+	meshAsPipeline.Id = mesh.Id;
+	SELF_CHECK(Throws([&]() { list.SetPipeline(nullPipeline); }));
+	SELF_CHECK(Throws([&]() { list.SetPipeline(unknownPipeline); }));
+	SELF_CHECK(Throws([&]() { list.SetPipeline(meshAsPipeline); }));
+
+	RenderMesh nullMesh, pipelineAsMesh;
+	pipelineAsMesh.Id = pipeline.Id;
+	SELF_CHECK(Throws([&]() { list.DrawMesh(nullMesh); }));
+	SELF_CHECK(Throws([&]() { list.DrawMesh(pipelineAsMesh); }));
+
+	RenderFont nullFont, textureAsFont;
+	textureAsFont.Id = texture.Id;
+	SELF_CHECK(Throws([&]() { list.DrawString(nullFont, "text", 0.0f, 0.0f); }));
+	SELF_CHECK(Throws([&]() { list.DrawString(textureAsFont, "text", 0.0f, 0.0f); }));
+
+	RenderTexture nullTexture, fontAsTexture;
+	fontAsTexture.Id = font.Id;
+	SELF_CHECK(Throws([&]() { list.SetTexture(nullTexture); }));
+	SELF_CHECK(Throws([&]() { list.SetTexture(fontAsTexture); }));
+	SELF_CHECK(Throws([&]() { list.DrawSprite(fontAsTexture, 0.0f, 0.0f, 1.0f, 1.0f); }));
+
+	SELF_CHECK(static_cast<RecordingRenderDevice::List&>(list).GetCommands().size() == 4);
+	commandList->Close();
+}
@@ -0,0 +1,116 @@
+//
+// RenderDevice.h - Backend-agnostic render command interface
+//
+
+#pragma once
+
+#include "CommandListPool.h"
+
+#include <stdint.h>
+
+// Handles to backend objects; Id 0 means none. Creating them is backend specific
+// (D3D12RenderDevice wraps existing Direct3D and DirectXTK objects, RecordingRenderDevice
+// only remembers a description), recording with them is not.
+struct RenderTexture
+{
+	uint32_t Id = 0;
+	explicit operator bool()const { return Id != 0; }
+	bool operator==(const RenderTexture& other)const { return Id == other.Id; }
+	bool operator!=(const RenderTexture& other)const { return Id != other.Id; }
+};
+
+struct RenderMesh
+{
+	uint32_t Id = 0;
+	explicit operator bool()const { return Id != 0; }
+};
+
+// A shader and fixed function state, plus the transforms and texture it draws with.
+struct RenderPipeline
+{
+	uint32_t Id = 0;
+	explicit operator bool()const { return Id != 0; }
+	bool operator==(const RenderPipeline& other)const { return Id == other.Id; }
+	bool operator!=(const RenderPipeline& other)const { return Id != other.Id; }
+};
+
+struct RenderFont
+{
+	uint32_t Id = 0;
+	explicit operator bool()const { return Id != 0; }
+};
+
+enum class ResourceState : uint8_t
+{
+	Common,
+	RenderTarget,
+	DepthWrite,
+	ShaderResource,
+	ResolveSource,
+	ResolveDest,
+	CopySource,
+	CopyDest,
+	Present
+};
+
+// Position and RGBA color, laid out like DirectX::VertexPositionColor.
+struct RenderVertex
+{
+	float Position[3];
+	float Color[4];
+};
+
+// Commands of one list. Matrices are 4x4, row major with row vectors, as in DirectXMath.
+// Pipelines carry their own transforms and texture, so a pipeline must only be used by
+// one list of a frame.
+//
+// Texture states are tracked per list (see ResourceStateTracker): transitions only name
+// the new state and are batched up to the next command that does GPU work. The first
+// transition of a texture in a list states what the list expects it in; execution adds
+// fix-up barriers if earlier lists left it in another state.
+class IRenderCommandList : public ICommandList
+{
+public:
+	// States
+	virtual void Transition(RenderTexture texture, ResourceState after) = 0;
+	// Split transition, finished right before the texture's next use or at Close.
+	virtual void BeginTransition(RenderTexture texture, ResourceState after) = 0;
+
+	// Targets
+	virtual void SetRenderTargets(RenderTexture color, RenderTexture depth) = 0;
+	virtual void SetViewport(uint32_t width, uint32_t height) = 0;
+	virtual void ClearColor(RenderTexture target, const float color[4]) = 0;
+	virtual void ClearDepth(RenderTexture target, float depth) = 0;
+
+	// Pipeline state
+	virtual void SetPipeline(RenderPipeline pipeline) = 0;
+	virtual void SetTexture(RenderTexture texture) = 0;
+	virtual void SetViewProjection(const float view[16], const float projection[16]) = 0;
+	virtual void SetWorld(const float world[16]) = 0;
+
+	// Draws with the current pipeline; lines come in pairs of vertices.
+	virtual void DrawMesh(RenderMesh mesh) = 0;
+	virtual void DrawLines(const RenderVertex* vertices, size_t vertexCount) = 0;
+
+	// Screen space drawing in pixels, independent of the pipeline.
+	virtual void DrawSprite(RenderTexture texture, float left, float top, float right, float bottom) = 0;
+	virtual void DrawString(RenderFont font, const char* text, float x, float y) = 0;
+
+	virtual void Resolve(RenderTexture dest, RenderTexture source) = 0;
+	virtual void Copy(RenderTexture dest, RenderTexture source) = 0;
+	// Stretches the top left sourceWidth x sourceHeight pixels of a single-sample source
+	// over all of dest with bilinear filtering. Binds dest as the only render target with a
+	// viewport of its size; source must be a ShaderResource and dest a RenderTarget.
+	virtual void Upscale(RenderTexture dest, RenderTexture source, uint32_t sourceWidth, uint32_t sourceHeight) = 0;
+};
+
+// A command device whose lists are IRenderCommandLists.
+class IRenderDevice : public ICommandDevice
+{
+public:
+	// The render interface of a list handed out by a pool on a render device.
+	static IRenderCommandList& GetRenderList(ICommandList& list)
+	{
+		return static_cast<IRenderCommandList&>(list);
+	}
+};
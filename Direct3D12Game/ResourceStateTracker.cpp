@@ -0,0 +1,212 @@
+//
+// ResourceStateTracker.cpp
+//
+
+#include "ResourceStateTracker.h"
+
+#include <algorithm>
+#include <iterator>
+
+//
+// ResourceStateTracker
+//
+
+void ResourceStateTracker::Reset()
+{
+	for (uint32_t texture : mTouched)
+		mLocals[texture] = Local();
+	mTouched.clear();
+	mEntryStates.clear();
+	mPending.clear();
+	mFlushed.clear();
+	mStats = Stats();
+}
+
+void ResourceStateTracker::Transition(uint32_t texture, ResourceState after)
+{
+	mStats.Transitions++;
+	Local& local = GetLocal(texture);
+	if (!local.Known)
+	{
+		local.Known = true;
+		local.State = after;
+		mEntryStates.push_back({ texture, after });
+		return;
+	}
+
+	if (local.Split)
+		EndSplit(texture, local);
+	if (local.State == after)
+	{
+		mStats.Redundant++;
+		return;
+	}
+
+	Queue({ texture, local.State, after, StateBarrier::Full });
+	local.State = after;
+}
+
+void ResourceStateTracker::BeginTransition(uint32_t texture, ResourceState after)
+{
+	Local& local = GetLocal(texture);
+	if (!local.Known)
+	{
+		// Nothing to overlap with; the fix-up at execution does the whole transition.
+		Transition(texture, after);
+		return;
+	}
+
+	mStats.Transitions++;
+	if (local.Split)
+		EndSplit(texture, local);
+	if (local.State == after)
+	{
+		mStats.Redundant++;
+		return;
+	}
+
+	Queue({ texture, local.State, after, StateBarrier::Begin });
+	local.Split = true;
+	local.SplitBefore = local.State;
+	local.State = after;
+}
+
+void ResourceStateTracker::Use(uint32_t texture)
+{
+	if (texture < mLocals.size() && mLocals[texture].Split)
+		EndSplit(texture, mLocals[texture]);
+}
+
+bool ResourceStateTracker::HasPending()const
+{
+	return !mPending.empty();
+}
+
+const std::vector<StateBarrier>& ResourceStateTracker::Flush()
+{
+	mFlushed.swap(mPending);
+	mPending.clear();
+
+	if (!mFlushed.empty())
+	{
+		mStats.Batches++;
+		mStats.Barriers += uint32_t(mFlushed.size());
+		for (const StateBarrier& barrier : mFlushed)
+		{
+			if (barrier.Split != StateBarrier::Full)
+				mStats.SplitBarriers++;
+		}
+	}
+	return mFlushed;
+}
+
+const std::vector<StateBarrier>& ResourceStateTracker::Close()
+{
+	for (uint32_t texture : mTouched)
+	{
+		if (mLocals[texture].Split)
+			EndSplit(texture, mLocals[texture]);
+	}
+	return Flush();
+}
+
+const std::vector<ResourceStateTracker::Entry>& ResourceStateTracker::GetEntryStates()const
+{
+	return mEntryStates;
+}
+
+void ResourceStateTracker::GetExitStates(std::vector<Entry>& states)const
+{
+	states.clear();
+	for (uint32_t texture : mTouched)
+	{
+		if (mLocals[texture].Known)
+			states.push_back({ texture, mLocals[texture].State });
+	}
+}
+
+const ResourceStateTracker::Stats& ResourceStateTracker::GetStats()const
+{
+	return mStats;
+}
+
+ResourceStateTracker::Local& ResourceStateTracker::GetLocal(uint32_t texture)
+{
+	if (texture >= mLocals.size())
+		mLocals.resize(texture + 1);
+
+	Local& local = mLocals[texture];
+	if (!local.Known && std::find(mTouched.begin(), mTouched.end(), texture) == mTouched.end())
+		mTouched.push_back(texture);
+	return local;
+}
+
+void ResourceStateTracker::EndSplit(uint32_t texture, Local& local)
+{
+	Queue({ texture, local.SplitBefore, local.State, StateBarrier::End });
+	local.Split = false;
+}
+
+// Merges with the texture's last queued barrier where the result is the same.
+void ResourceStateTracker::Queue(const StateBarrier& barrier)
+{
+	auto last = std::find_if(mPending.rbegin(), mPending.rend(), [&barrier](const StateBarrier& queued)
+	{
+		return queued.Texture == barrier.Texture;
+	});
+
+	if (last != mPending.rend())
+	{
+		// Nothing ran since the split began, so there is nothing to overlap with.
+		if (barrier.Split == StateBarrier::End && last->Split == StateBarrier::Begin)
+		{
+			last->Split = StateBarrier::Full;
+			mStats.Merged++;
+			return;
+		}
+
+		if (barrier.Split == StateBarrier::Full && last->Split == StateBarrier::Full)
+		{
+			last->After = barrier.After;
+			mStats.Merged++;
+			if (last->Before == last->After)
+			{
+				mPending.erase(std::next(last).base());
+				mStats.Merged++;
+			}
+			return;
+		}
+	}
+
+	mPending.push_back(barrier);
+}
+
+//
+// ResourceStates
+//
+
+void ResourceStates::SetState(uint32_t texture, ResourceState state)
+{
+	if (texture >= mStates.size())
+		mStates.resize(texture + 1, ResourceState::Common);
+	mStates[texture] = state;
+}
+
+ResourceState ResourceStates::GetState(uint32_t texture)const
+{
+	return texture < mStates.size() ? mStates[texture] : ResourceState::Common;
+}
+
+void ResourceStates::Resolve(const ResourceStateTracker& list, std::vector<StateBarrier>& fixups)
+{
+	for (const ResourceStateTracker::Entry& entry : list.GetEntryStates())
+	{
+		ResourceState current = GetState(entry.Texture);
+		if (current != entry.State)
+			fixups.push_back({ entry.Texture, current, entry.State, StateBarrier::Full });
+	}
+
+	list.GetExitStates(mExitStates);
+	for (const ResourceStateTracker::Entry& exit : mExitStates)
+		SetState(exit.Texture, exit.State);
+}
@@ -0,0 +1,119 @@
+//
+// ResourceStateTracker.h - Texture state tracking, barrier batching and split barriers
+//
+
+#pragma once
+
+#include "RenderDevice.h"
+
+#include <vector>
+
+// One transition of a texture, by handle id. A split transition is issued as two
+// barriers: Begin once the texture is done with the old state and End right before it
+// is used in the new one, so the GPU can do the transition while other work runs.
+struct StateBarrier
+{
+	enum Kind : uint8_t
+	{
+		Full,
+		Begin,
+		End
+	};
+
+	uint32_t Texture;
+	ResourceState Before;
+	ResourceState After;
+	Kind Split;
+};
+
+// The texture states one command list sees while it records. Transitions are only
+// queued; the backend flushes the queue as one batch right before its next draw, clear,
+// resolve or copy, so the transitions of a pass end up in a single ResourceBarrier call.
+// Within a batch, transitions of the same texture are merged (A to B and B to C become
+// A to C, A to B and back disappear) and transitions to the state a texture is already
+// in are dropped.
+//
+// A list does not know what the lists before it leave behind. The first transition of
+// a texture therefore issues no barrier: it sets the entry state, the state the list
+// expects the texture in at its start, and ResourceStates fixes the texture up at
+// execution if it is not. Textures a list uses without a transition are expected to be
+// in the right state already. Split transitions still open at Close are ended there.
+//
+// Not thread safe; each list owns one.
+class ResourceStateTracker
+{
+public:
+	struct Entry
+	{
+		uint32_t Texture;
+		ResourceState State;
+	};
+
+	struct Stats
+	{
+		uint32_t Transitions = 0;		// Transition and BeginTransition calls
+		uint32_t Redundant = 0;			// transitions to the current state, dropped
+		uint32_t Merged = 0;			// barriers saved by merging within a batch
+		uint32_t Barriers = 0;			// barriers flushed, both halves of split ones included
+		uint32_t SplitBarriers = 0;		// of those, Begin and End halves
+		uint32_t Batches = 0;			// non-empty flushes
+	};
+
+	void Reset();
+
+	void Transition(uint32_t texture, ResourceState after);
+	// Split transition, ended by the next Use or transition of the texture, or by Close.
+	void BeginTransition(uint32_t texture, ResourceState after);
+	// The next command reads or writes the texture.
+	void Use(uint32_t texture);
+
+	bool HasPending()const;
+	// The queued barriers, in order, and an empty queue. Valid until the next call.
+	const std::vector<StateBarrier>& Flush();
+	// Ends the open split transitions and flushes.
+	const std::vector<StateBarrier>& Close();
+
+	// Entry states in order of first transition, and the states the list leaves behind.
+	const std::vector<Entry>& GetEntryStates()const;
+	void GetExitStates(std::vector<Entry>& states)const;
+
+	const Stats& GetStats()const;
+
+private:
+	struct Local
+	{
+		bool Known = false;			// transitioned in this list
+		bool Split = false;			// a split transition from SplitBefore to State is open
+		ResourceState State = ResourceState::Common;
+		ResourceState SplitBefore = ResourceState::Common;
+	};
+
+	Local& GetLocal(uint32_t texture);
+	void EndSplit(uint32_t texture, Local& local);
+	void Queue(const StateBarrier& barrier);
+
+	std::vector<Local> mLocals;			// by texture id
+	std::vector<uint32_t> mTouched;		// ids with a Local in use, to reset
+	std::vector<Entry> mEntryStates;
+	std::vector<StateBarrier> mPending;
+	std::vector<StateBarrier> mFlushed;
+	Stats mStats;
+};
+
+// The state every texture is in once the executed lists have run, as the queue sees it.
+// Execute resolves each list against it in submission order.
+class ResourceStates
+{
+public:
+	// A texture that was (re)created, in its initial state.
+	void SetState(uint32_t texture, ResourceState state);
+	ResourceState GetState(uint32_t texture)const;
+
+	// Appends the barriers that bring textures from their current state into the list's
+	// entry states, to be executed before the list, then takes over its exit states.
+	void Resolve(const ResourceStateTracker& list, std::vector<StateBarrier>& fixups);
+
+private:
+	std::vector<ResourceState> mStates;		// by texture id; Common when never set
+	std::vector<ResourceStateTracker::Entry> mExitStates;
+};
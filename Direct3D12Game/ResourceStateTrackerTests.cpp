@@ -0,0 +1,304 @@
+//
+// ResourceStateTrackerTests.cpp
+//
+
+#include "CommandListPool.h"
+#include "RecordingRenderDevice.h"
+#include "ResourceStateTracker.h"
+#include "SelfTest.h"
+
+#include <random>
+#include <vector>
+
+namespace
+{
+	bool Same(const std::vector<StateBarrier>& barriers, std::initializer_list<StateBarrier> expected)
+	{
+		if (barriers.size() != expected.size())
+			return false;
+		auto next = expected.begin();
+		for (const StateBarrier& barrier : barriers)
+		{
+			if (barrier.Texture != next->Texture || barrier.Before != next->Before ||
+				barrier.After != next->After || barrier.Split != next->Split)
+				return false;
+			++next;
+		}
+		return true;
+	}
+
+	// A queue that checks every barrier it executes against the state the texture is
+	// really in, the way the debug layer would.
+	class CheckedQueue
+	{
+	public:
+		static const uint32_t TextureCount = 4;
+
+		CheckedQueue()
+		{
+			for (uint32_t texture = 1; texture <= TextureCount; ++texture)
+				mStates.SetState(texture, ResourceState::Common);
+		}
+
+		void Apply(const StateBarrier& barrier)
+		{
+			State& actual = mActual[barrier.Texture];
+			switch (barrier.Split)
+			{
+			case StateBarrier::Full:
+				mValid = mValid && !actual.Splitting && actual.Current == barrier.Before;
+				actual.Current = barrier.After;
+				break;
+			case StateBarrier::Begin:
+				mValid = mValid && !actual.Splitting && actual.Current == barrier.Before;
+				actual.Splitting = true;
+				actual.Current = barrier.After;
+				break;
+			case StateBarrier::End:
+				mValid = mValid && actual.Splitting && actual.Current == barrier.After;
+				actual.Splitting = false;
+				break;
+			}
+		}
+
+		// Runs a recorded list: its fix-ups, then its batches and uses in order.
+		void Execute(const ResourceStateTracker& tracker, const std::vector<std::vector<StateBarrier>>& batches,
+			const std::vector<std::vector<StateBarrier>>& usesAfterBatch)
+		{
+			std::vector<StateBarrier> fixups;
+			mStates.Resolve(tracker, fixups);
+			for (const StateBarrier& fixup : fixups)
+				Apply(fixup);
+			mFixups += fixups.size();
+
+			for (size_t i = 0; i < batches.size(); ++i)
+			{
+				for (const StateBarrier& barrier : batches[i])
+					Apply(barrier);
+				// A use records the state the list meant the texture to be in.
+				for (const StateBarrier& use : usesAfterBatch[i])
+				{
+					const State& actual = mActual[use.Texture];
+					mValid = mValid && !actual.Splitting && actual.Current == use.After;
+				}
+			}
+			for (uint32_t texture = 1; texture <= TextureCount; ++texture)
+				mValid = mValid && !mActual[texture].Splitting && mStates.GetState(texture) == mActual[texture].Current;
+		}
+
+		bool IsValid()const { return mValid; }
+		size_t GetFixups()const { return mFixups; }
+
+	private:
+		struct State
+		{
+			ResourceState Current = ResourceState::Common;
+			bool Splitting = false;
+		};
+
+		ResourceStates mStates;
+		State mActual[TextureCount + 1];
+		size_t mFixups = 0;
+		bool mValid = true;
+	};
+}
+
+SELF_TEST(ResourceStateTracker, EntryStatesAndMerging)
+{
+	ResourceStateTracker tracker;
+
+	// First transitions only state what the list expects.
+	tracker.Transition(1, ResourceState::RenderTarget);
+	tracker.Transition(2, ResourceState::ShaderResource);
+	SELF_CHECK(!tracker.HasPending());
+	SELF_CHECK(tracker.GetEntryStates().size() == 2);
+	SELF_CHECK(tracker.GetEntryStates()[0].Texture == 1 && tracker.GetEntryStates()[0].State == ResourceState::RenderTarget);
+
+	// A to B and B to C become A to C; A to B and back disappear; a transition to the
+	// current state is dropped.
+	tracker.Transition(1, ResourceState::ResolveSource);
+	tracker.Transition(1, ResourceState::CopySource);
+	tracker.Transition(2, ResourceState::CopyDest);
+	tracker.Transition(2, ResourceState::ShaderResource);
+	tracker.Transition(1, ResourceState::CopySource);
+	SELF_CHECK(Same(tracker.Flush(), { { 1, ResourceState::RenderTarget, ResourceState::CopySource, StateBarrier::Full } }));
+	SELF_CHECK(tracker.Flush().empty());
+
+	// Batches do not merge across a flush.
+	tracker.Transition(1, ResourceState::RenderTarget);
+	SELF_CHECK(Same(tracker.Flush(), { { 1, ResourceState::CopySource, ResourceState::RenderTarget, StateBarrier::Full } }));
+
+	ResourceStateTracker::Stats stats = tracker.GetStats();
+	SELF_CHECK(stats.Transitions == 8);
+	SELF_CHECK(stats.Redundant == 1);
+	SELF_CHECK(stats.Merged == 3);
+	SELF_CHECK(stats.Barriers == 2 && stats.Batches == 2);
+
+	std::vector<ResourceStateTracker::Entry> exit;
+	tracker.GetExitStates(exit);
+	SELF_CHECK(exit.size() == 2);
+	SELF_CHECK(exit[0].Texture == 1 && exit[0].State == ResourceState::RenderTarget);
+	SELF_CHECK(exit[1].Texture == 2 && exit[1].State == ResourceState::ShaderResource);
+
+	tracker.Reset();
+	SELF_CHECK(tracker.GetEntryStates().empty());
+	SELF_CHECK(tracker.GetStats().Transitions == 0);
+	tracker.Transition(1, ResourceState::Present);
+	SELF_CHECK(!tracker.HasPending());
+}
+
+SELF_TEST(ResourceStateTracker, SplitBarriers)
+{
+	ResourceStateTracker tracker;
+	tracker.Transition(1, ResourceState::RenderTarget);
+	tracker.Transition(2, ResourceState::RenderTarget);
+
+	// A split begun in one batch ends right before the texture's next use; other
+	// textures' uses leave it open.
+	tracker.BeginTransition(1, ResourceState::ShaderResource);
+	SELF_CHECK(Same(tracker.Flush(), { { 1, ResourceState::RenderTarget, ResourceState::ShaderResource, StateBarrier::Begin } }));
+	tracker.Use(2);
+	SELF_CHECK(!tracker.HasPending());
+	tracker.Use(1);
+	SELF_CHECK(Same(tracker.Flush(), { { 1, ResourceState::RenderTarget, ResourceState::ShaderResource, StateBarrier::End } }));
+
+	// Begun and used with nothing in between: one full barrier.
+	tracker.BeginTransition(1, ResourceState::CopySource);
+	tracker.Use(1);
+	SELF_CHECK(Same(tracker.Flush(), { { 1, ResourceState::ShaderResource, ResourceState::CopySource, StateBarrier::Full } }));
+
+	// A transition of a texture whose split is open ends the split first.
+	tracker.BeginTransition(2, ResourceState::ResolveSource);
+	tracker.Flush();
+	tracker.Transition(2, ResourceState::CopyDest);
+	SELF_CHECK(Same(tracker.Flush(),
+	{
+		{ 2, ResourceState::RenderTarget, ResourceState::ResolveSource, StateBarrier::End },
+		{ 2, ResourceState::ResolveSource, ResourceState::CopyDest, StateBarrier::Full }
+	}));
+
+	// Splits still open at Close are ended there; a first split transition has nothing to
+	// overlap with and only sets the entry state.
+	tracker.BeginTransition(3, ResourceState::Present);
+	tracker.BeginTransition(2, ResourceState::Present);
+	tracker.Flush();
+	SELF_CHECK(Same(tracker.Close(), { { 2, ResourceState::CopyDest, ResourceState::Present, StateBarrier::End } }));
+	SELF_CHECK(tracker.GetEntryStates().size() == 3);
+
+	ResourceStateTracker::Stats stats = tracker.GetStats();
+	SELF_CHECK(stats.SplitBarriers == 6);
+	SELF_CHECK(stats.Barriers == 8);
+}
+
+SELF_TEST(ResourceStateTracker, ScriptedSequencesStayValid)
+{
+	// Random lists of transitions, split transitions and uses over a few textures, executed
+	// one after another: every barrier must start from the state the texture is really in,
+	// every use must find the state its list asked for, and the queue's view must match.
+	const ResourceState states[] =
+	{
+		ResourceState::Common, ResourceState::RenderTarget, ResourceState::ShaderResource,
+		ResourceState::ResolveSource, ResourceState::ResolveDest, ResourceState::CopySource,
+		ResourceState::CopyDest, ResourceState::Present
+	};
+	std::mt19937 random(2024);
+	CheckedQueue queue;
+	ResourceStateTracker tracker;
+	uint64_t barriers = 0;
+	uint64_t splits = 0;
+	uint64_t merged = 0;
+
+	for (int list = 0; list < 2000 && queue.IsValid(); ++list)
+	{
+		tracker.Reset();
+		ResourceState requested[CheckedQueue::TextureCount + 1] = {};
+		bool known[CheckedQueue::TextureCount + 1] = {};
+		std::vector<std::vector<StateBarrier>> batches;
+		std::vector<std::vector<StateBarrier>> uses;
+
+		int commands = 1 + int(random() % 12);
+		for (int command = 0; command < commands; ++command)
+		{
+			uint32_t texture = 1 + random() % CheckedQueue::TextureCount;
+			ResourceState state = states[random() % 8];
+			switch (random() % 4)
+			{
+			case 0:
+				tracker.Transition(texture, state);
+				requested[texture] = state;
+				known[texture] = true;
+				break;
+			case 1:
+				tracker.BeginTransition(texture, state);
+				requested[texture] = state;
+				known[texture] = true;
+				break;
+			default:
+				// Draws and copies flush before they run. A texture used without a
+				// transition in this list is in whatever state it was left in.
+				tracker.Use(texture);
+				batches.push_back(tracker.Flush());
+				uses.push_back({});
+				if (known[texture])
+					uses.back().push_back({ texture, requested[texture], requested[texture], StateBarrier::Full });
+				break;
+			}
+		}
+		batches.push_back(tracker.Close());
+		uses.push_back({});
+		queue.Execute(tracker, batches, uses);
+
+		barriers += tracker.GetStats().Barriers;
+		splits += tracker.GetStats().SplitBarriers;
+		merged += tracker.GetStats().Merged;
+	}
+
+	context.Log("%llu barriers, %llu split halves, %llu merged away, %zu fix-ups", (unsigned long long)barriers,
+		(unsigned long long)splits, (unsigned long long)merged, queue.GetFixups());
+	SELF_CHECK(queue.IsValid());
+	SELF_CHECK(splits > 0 && merged > 0 && queue.GetFixups() > 0);
+}
+
+SELF_TEST(ResourceStateTracker, FixupsOnTheRecordingDevice)
+{
+	RecordingRenderDevice device;
+	RenderTexture target = device.AddTexture("target", ResourceState::Present);
+	RenderTexture copy = device.AddTexture("copy", ResourceState::CopyDest);
+	CommandListPool pool(device, 2, 1);
+	const float black[4] = {};
+
+	// Pass 0 expects the presented target as a render target, pass 1 expects it as a copy
+	// source: both get a fix-up. The copy's split transition overlaps with the clear.
+	pool.BeginFrame();
+	IRenderCommandList& clear = IRenderDevice::GetRenderList(pool.BeginPass(0, 0));
+	clear.Transition(target, ResourceState::RenderTarget);
+	clear.ClearColor(target, black);
+	IRenderCommandList& present = IRenderDevice::GetRenderList(pool.BeginPass(1, 0));
+	present.Transition(target, ResourceState::CopySource);
+	present.Transition(copy, ResourceState::CopyDest);
+	present.Copy(copy, target);
+	present.BeginTransition(copy, ResourceState::ShaderResource);
+	present.Transition(target, ResourceState::RenderTarget);
+	present.ClearColor(target, black);
+	present.Transition(target, ResourceState::Present);
+	present.Transition(target, ResourceState::Present);
+	pool.Submit();
+
+	RecordingRenderDevice::Stats stats = device.GetStats();
+	SELF_CHECK(stats.FixupBarriers == 2);
+	SELF_CHECK(stats.SplitBarriers == 2);
+	SELF_CHECK(stats.RedundantTransitions == 1);
+	for (const RecordedCommand& command : device.GetExecutedCommands())
+		context.Log("%s", device.Describe(command).c_str());
+
+	// The next frame's first pass finds the target presented: again a fix-up, and the
+	// copy where the split left it.
+	device.ResetStats();
+	pool.BeginFrame();
+	IRenderCommandList& again = IRenderDevice::GetRenderList(pool.BeginPass(0, 0));
+	again.Transition(target, ResourceState::RenderTarget);
+	again.Transition(copy, ResourceState::ShaderResource);
+	again.ClearColor(target, black);
+	pool.Submit();
+	SELF_CHECK(device.GetStats().FixupBarriers == 1);
+}
@@ -0,0 +1,191 @@
+//
+// SceneRenderer.cpp
+//
+
+#include "SceneRenderer.h"
+
+namespace
+{
+	const float c_clearColor[4] = { 0.392156899f, 0.584313750f, 0.929411829f, 1.0f };	// cornflower blue
+	const size_t c_gridDivisions = 10;
+
+	const float c_unitX[3] = { 1.0f, 0.0f, 0.0f };
+	const float c_unitY[3] = { 0.0f, 1.0f, 0.0f };
+	const float c_unitZ[3] = { 0.0f, 0.0f, 1.0f };
+
+	RenderVertex MakeVertex(const float position[3], const float offset[3], float sign, const float color[4])
+	{
+		RenderVertex vertex;
+		for (int i = 0; i < 3; ++i)
+			vertex.Position[i] = position[i] + offset[i] * sign;
+		for (int i = 0; i < 4; ++i)
+			vertex.Color[i] = color[i];
+		return vertex;
+	}
+}
+
+SceneRenderer::SceneRenderer(const SceneResources& resources) :
+	mResources(resources)
+{
+	mGridVertices.reserve(3 * GetGridVertexCount(c_gridDivisions));
+}
+
+void SceneRenderer::RecordClear(IRenderCommandList& list, const SceneFrame& frame)
+{
+	// Drawing straight into the back buffer, which was last presented.
+	if (frame.SceneColor == frame.BackBuffer)
+		list.Transition(frame.SceneColor, ResourceState::Present);
+	list.Transition(frame.SceneColor, ResourceState::RenderTarget);
+	list.Transition(frame.SceneDepth, ResourceState::DepthWrite);
+
+	BeginPass(list, frame);
+	list.ClearColor(frame.SceneColor, c_clearColor);
+	list.ClearDepth(frame.SceneDepth, 1.0f);
+}
+
+void SceneRenderer::RecordSprites(IRenderCommandList& list, const SceneFrame& frame)
+{
+	BeginPass(list, frame);
+
+	list.DrawSprite(frame.Background, 0.0f, 0.0f, float(frame.Width), float(frame.Height));
+}
+
+void SceneRenderer::RecordGrids(IRenderCommandList& list, const SceneFrame& frame)
+{
+	BeginPass(list, frame);
+
+	const float* origin = frame.GridOrigin;
+	const float red[4] = { 1.0f, 0.0f, 0.0f, 0.01f };
+	const float green[4] = { 0.0f, 1.0f, 0.0f, 0.01f };
+	const float blue[4] = { 0.0f, 0.0f, 1.0f, 0.01f };
+
+	mGridVertices.clear();
+	if (frame.GridVisible & 1)
+	{
+		const float center[3] = { origin[0], origin[1], origin[2] + 1.0f };
+		AddGrid(c_unitX, c_unitY, center, red, c_gridDivisions);
+	}
+	if (frame.GridVisible & 2)
+	{
+		const float center[3] = { origin[0], origin[1] - 1.0f, origin[2] };
+		AddGrid(c_unitX, c_unitZ, center, green, c_gridDivisions);
+	}
+	if (frame.GridVisible & 4)
+	{
+		const float center[3] = { origin[0] - 1.0f, origin[1], origin[2] };
+		AddGrid(c_unitY, c_unitZ, center, blue, c_gridDivisions);
+	}
+
+	if (mGridVertices.empty())
+		return;
+
+	list.SetPipeline(mResources.Grid);
+	list.SetViewProjection(frame.View, frame.Projection);
+	list.SetWorld(frame.GridWorld);
+	list.DrawLines(mGridVertices.data(), mGridVertices.size());
+}
+
+void SceneRenderer::RecordGlobe(IRenderCommandList& list, const SceneFrame& frame)
+{
+	BeginPass(list, frame);
+
+	list.SetPipeline(mResources.Globe);
+	list.SetTexture(frame.GlobeTexture);
+	list.SetViewProjection(frame.View, frame.Projection);
+	list.SetWorld(frame.GlobeWorld);
+	list.DrawMesh(mResources.GlobeMesh);
+}
+
+void SceneRenderer::RecordResolve(IRenderCommandList& list, const SceneFrame& frame)
+{
+	if (frame.SceneColor == frame.BackBuffer)
+	{
+		RecordHud(list, frame);
+		list.Transition(frame.BackBuffer, ResourceState::Present);
+		return;
+	}
+
+	// The passes before leave the scene color a render target, the back buffer was last
+	// presented and the upscale source last read. Saying so first keeps the transitions
+	// below in this list.
+	list.Transition(frame.SceneColor, ResourceState::RenderTarget);
+	list.Transition(frame.BackBuffer, ResourceState::Present);
+	if (frame.Upscale && frame.UpscaleSource)
+		list.Transition(frame.UpscaleSource, ResourceState::ShaderResource);
+
+	if (frame.Upscale)
+	{
+		RenderTexture source = frame.SceneColor;
+		if (frame.UpscaleSource)
+		{
+			list.Transition(frame.SceneColor, ResourceState::ResolveSource);
+			list.Transition(frame.UpscaleSource, ResourceState::ResolveDest);
+			list.Resolve(frame.UpscaleSource, frame.SceneColor);
+			source = frame.UpscaleSource;
+		}
+		list.Transition(source, ResourceState::ShaderResource);
+		list.Transition(frame.BackBuffer, ResourceState::RenderTarget);
+		list.Upscale(frame.BackBuffer, source, frame.Width, frame.Height);
+	}
+	else
+	{
+		list.Transition(frame.SceneColor, ResourceState::ResolveSource);
+		list.Transition(frame.BackBuffer, ResourceState::ResolveDest);
+		list.Resolve(frame.BackBuffer, frame.SceneColor);
+	}
+	RecordHud(list, frame);
+
+	// Transition the render target to the state that allows it to be presented to the display,
+	// and the scene color back to what the next frame's clear expects.
+	list.Transition(frame.BackBuffer, ResourceState::Present);
+	list.Transition(frame.SceneColor, ResourceState::RenderTarget);
+}
+
+void SceneRenderer::RecordHud(IRenderCommandList& list, const SceneFrame& frame)
+{
+	list.Transition(frame.BackBuffer, ResourceState::RenderTarget);
+
+	// The font is still streaming in.
+	if (!frame.Font || frame.Hud.empty())
+		return;
+
+	list.SetRenderTargets(frame.BackBuffer, RenderTexture());
+	list.SetViewport(frame.OutputWidth, frame.OutputHeight);
+	for (const SceneText& text : frame.Hud)
+		list.DrawString(frame.Font, text.Text.c_str(), text.X, text.Y);
+}
+
+size_t SceneRenderer::GetGridVertexCount(size_t divisions)
+{
+	return 4 * (divisions + 1);
+}
+
+// Every pass draws into the scene targets over the whole view.
+void SceneRenderer::BeginPass(IRenderCommandList& list, const SceneFrame& frame)const
+{
+	list.SetRenderTargets(frame.SceneColor, frame.SceneDepth);
+	list.SetViewport(frame.Width, frame.Height);
+}
+
+// A square of lines spanning -1 to 1 along both axes around the origin.
+void SceneRenderer::AddGrid(const float xaxis[3], const float yaxis[3], const float origin[3],
+	const float color[4], size_t divisions)
+{
+	for (int direction = 0; direction < 2; ++direction)
+	{
+		const float* along = direction == 0 ? xaxis : yaxis;
+		const float* across = direction == 0 ? yaxis : xaxis;
+
+		for (size_t i = 0; i <= divisions; ++i)
+		{
+			float percent = float(i) / float(divisions) * 2.0f - 1.0f;
+
+			float position[3];
+			for (int j = 0; j < 3; ++j)
+				position[j] = along[j] * percent + origin[j];
+
+			mGridVertices.push_back(MakeVertex(position, across, -1.0f, color));
+			mGridVertices.push_back(MakeVertex(position, across, 1.0f, color));
+		}
+	}
+}
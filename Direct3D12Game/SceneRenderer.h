@@ -0,0 +1,99 @@
+//
+// SceneRenderer.h - Records the scene's passes on any render backend
+//
+
+#pragma once
+
+#include "RenderDevice.h"
+
+#include <string>
+#include <vector>
+
+// Backend objects the scene draws with, created by whoever owns the backend.
+struct SceneResources
+{
+	RenderPipeline Grid;		// vertex colored lines
+	RenderPipeline Globe;		// lit and textured
+	RenderMesh GlobeMesh;
+};
+
+struct SceneText
+{
+	std::string Text;
+	float X = 0.0f;
+	float Y = 0.0f;
+};
+
+// Everything one frame of the scene is recorded from. Game fills it in on the window
+// thread before the passes start; the passes only read it.
+struct SceneFrame
+{
+	// Size the scene is drawn at, in the top left of its targets, and size of the back
+	// buffer. They only differ with Upscale.
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t OutputWidth = 0;
+	uint32_t OutputHeight = 0;
+
+	// Multisampled scene targets, and the back buffer the scene is resolved into. Without
+	// multisampling SceneColor may be the back buffer itself, and nothing is resolved.
+	RenderTexture SceneColor;
+	RenderTexture SceneDepth;
+	RenderTexture BackBuffer;
+
+	// Dynamic resolution: the scene is stretched over the back buffer instead of resolved
+	// into it. A multisampled scene color is resolved into UpscaleSource first, a single-
+	// sample one is read as it is.
+	bool Upscale = false;
+	RenderTexture UpscaleSource;
+
+	float View[16];
+	float Projection[16];
+
+	// Three grids around GridOrigin in grid space; bit n of GridVisible enables grid n.
+	float GridWorld[16];
+	float GridOrigin[3];
+	uint32_t GridVisible = 0;
+
+	float GlobeWorld[16];
+	RenderTexture GlobeTexture;
+
+	// Full screen background, and HUD text drawn over the back buffer at output size; no
+	// text is drawn without a font.
+	RenderTexture Background;
+	RenderFont Font;
+	std::vector<SceneText> Hud;
+};
+
+// The scene as a sequence of passes, each recorded into its own list, in the order
+// Clear, Sprites, Grids, Globe, Resolve. Passes may be recorded on different threads at
+// the same time; every pass uses its own pipelines and scratch memory.
+class SceneRenderer
+{
+public:
+	explicit SceneRenderer(const SceneResources& resources);
+
+	// Scene targets into the render target and depth write states, and cleared.
+	void RecordClear(IRenderCommandList& list, const SceneFrame& frame);
+	// Background.
+	void RecordSprites(IRenderCommandList& list, const SceneFrame& frame);
+	void RecordGrids(IRenderCommandList& list, const SceneFrame& frame);
+	void RecordGlobe(IRenderCommandList& list, const SceneFrame& frame);
+	// MSAA resolve or upscale of the scene color into the back buffer, then the HUD, ready
+	// to present. Only the HUD when the scene was drawn into the back buffer.
+	void RecordResolve(IRenderCommandList& list, const SceneFrame& frame);
+	// HUD text over the back buffer, which is left a render target. For resolves that are
+	// not recorded by RecordResolve.
+	void RecordHud(IRenderCommandList& list, const SceneFrame& frame);
+
+	// Lines one grid adds, divisions + 1 in each direction.
+	static size_t GetGridVertexCount(size_t divisions);
+
+private:
+	void BeginPass(IRenderCommandList& list, const SceneFrame& frame)const;
+	void AddGrid(const float xaxis[3], const float yaxis[3], const float origin[3],
+		const float color[4], size_t divisions);
+
+	SceneResources mResources;
+	std::vector<RenderVertex> mGridVertices;	// only used by the grid pass
+};
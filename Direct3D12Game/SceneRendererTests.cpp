@@ -0,0 +1,231 @@
+//
+// SceneRendererTests.cpp
+//
+
+#include "CommandListPool.h"
+#include "JobSystem.h"
+#include "RecordingRenderDevice.h"
+#include "SceneRenderer.h"
+#include "SelfTest.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+	enum Pass : uint32_t
+	{
+		ClearPass,
+		SpritesPass,
+		GridsPass,
+		GlobePass,
+		ResolvePass,
+		PassCount
+	};
+
+	void Identity(float m[16])
+	{
+		for (int i = 0; i < 16; ++i)
+			m[i] = i % 5 == 0 ? 1.0f : 0.0f;
+	}
+
+	// The demo scene on a recording device: MSAA targets resolved into the back buffer,
+	// all grids, the globe and two lines of HUD text.
+	struct HeadlessScene
+	{
+		RecordingRenderDevice Device;
+		SceneResources Resources;
+		SceneFrame Frame;
+
+		HeadlessScene()
+		{
+			Resources.Grid = Device.AddPipeline("grid");
+			Resources.Globe = Device.AddPipeline("globe");
+			Resources.GlobeMesh = Device.AddMesh("sphere");
+
+			Frame.Width = Frame.OutputWidth = 1280;
+			Frame.Height = Frame.OutputHeight = 720;
+			Frame.SceneColor = Device.AddTexture("scene color", ResourceState::RenderTarget);
+			Frame.SceneDepth = Device.AddTexture("scene depth", ResourceState::DepthWrite);
+			Frame.BackBuffer = Device.AddTexture("back buffer", ResourceState::Present);
+			Frame.Background = Device.AddTexture("galaxy.jpg", ResourceState::ShaderResource);
+			Frame.GlobeTexture = Device.AddTexture("earth.bmp", ResourceState::ShaderResource);
+			Frame.Font = Device.AddFont("myfile.spritefont");
+			Identity(Frame.View);
+			Identity(Frame.Projection);
+			Identity(Frame.GridWorld);
+			Identity(Frame.GlobeWorld);
+			Frame.GridOrigin[0] = Frame.GridOrigin[1] = Frame.GridOrigin[2] = 0.0f;
+			Frame.GridVisible = 7;
+
+			SceneText fps;
+			fps.Text = "60 fps";
+			Frame.Hud.push_back(fps);
+			SceneText frameTime;
+			frameTime.Text = "16.67 ms";
+			frameTime.Y = 20.0f;
+			Frame.Hud.push_back(frameTime);
+		}
+
+		// One frame, the way Game::Render records it: passes in any order, on any thread.
+		void Render(SceneRenderer& renderer, CommandListPool& pool, float time, JobSystem* jobs = nullptr)
+		{
+			Frame.GlobeWorld[12] = std::cos(time) * 0.5f;
+			Frame.GlobeWorld[14] = std::sin(time) * 0.5f;
+
+			pool.BeginFrame();
+			auto record = [&](size_t pass)
+			{
+				uint32_t thread = jobs ? uint32_t(jobs->GetThreadIndex()) : 0;
+				IRenderCommandList& list = IRenderDevice::GetRenderList(pool.BeginPass(uint32_t(pass), thread));
+				switch (pass)
+				{
+				case ClearPass: renderer.RecordClear(list, Frame); break;
+				case SpritesPass: renderer.RecordSprites(list, Frame); break;
+				case GridsPass: renderer.RecordGrids(list, Frame); break;
+				case GlobePass: renderer.RecordGlobe(list, Frame); break;
+				default: renderer.RecordResolve(list, Frame); break;
+				}
+			};
+			if (jobs)
+			{
+				jobs->ParallelFor(0, PassCount, 1, record);
+			}
+			else
+			{
+				for (size_t pass = 0; pass < PassCount; ++pass)
+					record(pass);
+			}
+			pool.Submit();
+		}
+
+		// State the last executed barrier left the texture in.
+		ResourceState LastState(RenderTexture texture)const
+		{
+			ResourceState state = ResourceState::Common;
+			for (const RecordedCommand& command : Device.GetExecutedCommands())
+			{
+				if ((command.Type == RecordedCommandType::Barrier || command.Type == RecordedCommandType::EndBarrier) &&
+					command.A == texture.Id)
+					state = ResourceState(command.B);
+			}
+			return state;
+		}
+
+		size_t Count(RecordedCommandType type)const
+		{
+			size_t count = 0;
+			for (const RecordedCommand& command : Device.GetExecutedCommands())
+				count += command.Type == type ? 1 : 0;
+			return count;
+		}
+	};
+}
+
+SELF_TEST(SceneRenderer, HeadlessFrame)
+{
+	HeadlessScene scene;
+	SceneRenderer renderer(scene.Resources);
+	CommandListPool pool(scene.Device, 2, 1);
+
+	scene.Render(renderer, pool, 0.0f);
+	for (const RecordedCommand& command : scene.Device.GetExecutedCommands())
+		context.Log("%s", scene.Device.Describe(command).c_str());
+
+	// Background, grid lines, globe and one string per HUD line, in one submission.
+	RecordingRenderDevice::Stats stats = scene.Device.GetStats();
+	SELF_CHECK(stats.Draws == 5);
+	SELF_CHECK(stats.ExecuteCalls == 1 && stats.ListsExecuted == PassCount);
+	SELF_CHECK(stats.FixupBarriers == 0);
+	SELF_CHECK(stats.UploadBytes >= 3 * SceneRenderer::GetGridVertexCount(10) * sizeof(RenderVertex));
+	SELF_CHECK(scene.Count(RecordedCommandType::Resolve) == 1);
+	SELF_CHECK(scene.LastState(scene.Frame.BackBuffer) == ResourceState::Present);
+	SELF_CHECK(scene.LastState(scene.Frame.SceneColor) == ResourceState::RenderTarget);
+
+	// Every frame records the same work, and the states line up across frames.
+	for (int frame = 1; frame < 10; ++frame)
+		scene.Render(renderer, pool, frame / 60.0f);
+	RecordingRenderDevice::Stats tenFrames = scene.Device.GetStats();
+	SELF_CHECK(tenFrames.Draws == 10 * stats.Draws);
+	SELF_CHECK(tenFrames.Barriers == 10 * stats.Barriers);
+	SELF_CHECK(tenFrames.StateChanges == 10 * stats.StateChanges);
+	SELF_CHECK(tenFrames.FixupBarriers == 0);
+}
+
+SELF_TEST(SceneRenderer, FrameVariants)
+{
+	// Drawing straight into the back buffer: nothing to resolve.
+	{
+		HeadlessScene scene;
+		scene.Frame.SceneColor = scene.Frame.BackBuffer;
+		SceneRenderer renderer(scene.Resources);
+		CommandListPool pool(scene.Device, 2, 1);
+		scene.Render(renderer, pool, 0.0f);
+		scene.Render(renderer, pool, 0.0f);
+		SELF_CHECK(scene.Count(RecordedCommandType::Resolve) == 0);
+		SELF_CHECK(scene.Device.GetStats().FixupBarriers == 0);
+		SELF_CHECK(scene.LastState(scene.Frame.BackBuffer) == ResourceState::Present);
+	}
+
+	// Dynamic resolution: resolved into the upscale source, then stretched.
+	{
+		HeadlessScene scene;
+		scene.Frame.Upscale = true;
+		scene.Frame.Width = 960;
+		scene.Frame.Height = 540;
+		scene.Frame.UpscaleSource = scene.Device.AddTexture("upscale source", ResourceState::ShaderResource);
+		SceneRenderer renderer(scene.Resources);
+		CommandListPool pool(scene.Device, 2, 1);
+		scene.Render(renderer, pool, 0.0f);
+		scene.Render(renderer, pool, 0.0f);
+		SELF_CHECK(scene.Count(RecordedCommandType::Resolve) == 2);
+		SELF_CHECK(scene.Count(RecordedCommandType::Upscale) == 2);
+		SELF_CHECK(scene.Device.GetStats().FixupBarriers == 0);
+		SELF_CHECK(scene.LastState(scene.Frame.BackBuffer) == ResourceState::Present);
+	}
+
+	// The font is still streaming in, and the grids are hidden.
+	{
+		HeadlessScene scene;
+		scene.Frame.Font = RenderFont();
+		scene.Frame.GridVisible = 0;
+		SceneRenderer renderer(scene.Resources);
+		CommandListPool pool(scene.Device, 2, 1);
+		scene.Render(renderer, pool, 0.0f);
+		SELF_CHECK(scene.Count(RecordedCommandType::DrawString) == 0);
+		SELF_CHECK(scene.Count(RecordedCommandType::DrawLines) == 0);
+		SELF_CHECK(scene.Device.GetStats().Draws == 2);
+	}
+}
+
+SELF_BENCHMARK(SceneRenderer, RecordingCost)
+{
+	// CPU cost of recording and submitting a frame, without capturing the stream, with the
+	// passes recorded inline and on the job system.
+	const int frames = 20000;
+	for (int parallel = 0; parallel < 2; ++parallel)
+	{
+		JobSystem jobs;
+		HeadlessScene scene;
+		scene.Device.SetCapture(false);
+		SceneRenderer renderer(scene.Resources);
+		CommandListPool pool(scene.Device, 2, jobs.GetThreadCount());
+
+		auto start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; ++frame)
+			scene.Render(renderer, pool, frame / 60.0f, parallel ? &jobs : nullptr);
+		pool.WaitForIdle();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		RecordingRenderDevice::Stats stats = scene.Device.GetStats();
+		context.Log("%s: %.2f us per frame; per frame %llu commands, %llu draws, %llu state changes, %llu barriers in %llu batches, %llu upload bytes",
+			parallel ? "job system" : "inline", seconds * 1e6 / frames,
+			(unsigned long long)(stats.Commands / frames), (unsigned long long)(stats.Draws / frames),
+			(unsigned long long)(stats.StateChanges / frames), (unsigned long long)(stats.Barriers / frames),
+			(unsigned long long)(stats.BarrierBatches / frames), (unsigned long long)(stats.UploadBytes / frames));
+		SELF_CHECK(stats.Draws == uint64_t(frames) * 5);
+	}
+}
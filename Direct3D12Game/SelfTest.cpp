@@ -0,0 +1,139 @@
+//
+// SelfTest.cpp
+//
+
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+namespace
+{
+	struct Entry
+	{
+		const char* Name;
+		bool Benchmark;
+		SelfTest::Function Function;
+	};
+
+	// Filled by static constructors, so it must exist before the first of them runs.
+	std::vector<Entry>& GetEntries()
+	{
+		static std::vector<Entry> entries;
+		return entries;
+	}
+
+	void Append(std::string& report, const char* format, va_list args)
+	{
+		char line[512];
+		vsnprintf(line, sizeof(line), format, args);
+		report += line;
+	}
+
+	void Append(std::string& report, const char* format, ...)
+	{
+		va_list args;
+		va_start(args, format);
+		Append(report, format, args);
+		va_end(args);
+	}
+}
+
+namespace SelfTest
+{
+	Context::Context(std::string& report) :
+		mReport(report),
+		mFailures(0)
+	{
+	}
+
+	bool Context::Check(bool condition, const char* expression, const char* file, int line)
+	{
+		if (condition)
+			return true;
+
+		const char* name = file;
+		for (const char* c = file; *c; c++)
+		{
+			if (*c == '/' || *c == '\\')
+				name = c + 1;
+		}
+		Append(mReport, "    %s(%d): failed: %s\n", name, line, expression);
+		mFailures++;
+		return false;
+	}
+
+	void Context::Log(const char* format, ...)
+	{
+		mReport += "    ";
+		va_list args;
+		va_start(args, format);
+		Append(mReport, format, args);
+		va_end(args);
+		mReport += '\n';
+	}
+
+	uint32_t Context::GetFailures()const
+	{
+		return mFailures;
+	}
+
+	Registrar::Registrar(const char* name, bool benchmark, Function function)
+	{
+		GetEntries().push_back(Entry{ name, benchmark, function });
+	}
+
+	Result Run(bool benchmarks, const char* prefix)
+	{
+		std::vector<Entry> entries = GetEntries();
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+		{
+			return strcmp(a.Name, b.Name) < 0;
+		});
+
+		Result result;
+		if (!prefix)
+			prefix = "";
+		size_t prefixLength = strlen(prefix);
+		for (const Entry& entry : entries)
+		{
+			if (entry.Benchmark != benchmarks || strncmp(entry.Name, prefix, prefixLength) != 0)
+				continue;
+
+			std::string report;
+			Context context(report);
+			bool threw = false;
+			auto start = std::chrono::steady_clock::now();
+			try
+			{
+				entry.Function(context);
+			}
+			catch (const std::exception& e)
+			{
+				Append(report, "    exception: %s\n", e.what());
+				threw = true;
+			}
+			catch (...)
+			{
+				report += "    unknown exception\n";
+				threw = true;
+			}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			result.Run++;
+			bool failed = threw || context.GetFailures() > 0;
+			if (failed)
+				result.Failed++;
+			Append(result.Report, "%-6s %s (%.1f ms)\n", failed ? "FAIL" : "ok", entry.Name, ms);
+			result.Report += report;
+		}
+
+		Append(result.Report, "%u %s, %u failed\n", result.Run, benchmarks ? "benchmarks" : "tests", result.Failed);
+		return result;
+	}
+}
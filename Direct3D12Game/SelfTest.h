@@ -0,0 +1,71 @@
+//
+// SelfTest.h - Checks and benchmarks of the engine modules, run from the command line
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#define SELF_TEST_CONCAT_INNER(a, b) a##b
+#define SELF_TEST_CONCAT(a, b) SELF_TEST_CONCAT_INNER(a, b)
+
+#define SELF_TEST_CASE(group, name, benchmark) \
+	static void SelfTest_##group##_##name(SelfTest::Context& context); \
+	static const SelfTest::Registrar SELF_TEST_CONCAT(selfTestRegistrar, __LINE__)( \
+		#group "." #name, benchmark, &SelfTest_##group##_##name); \
+	static void SelfTest_##group##_##name(SelfTest::Context& context)
+
+// Defines a check, run by -selftest, or a benchmark, run by -benchmark. The body gets a
+// SelfTest::Context named context.
+#define SELF_TEST(group, name) SELF_TEST_CASE(group, name, false)
+#define SELF_BENCHMARK(group, name) SELF_TEST_CASE(group, name, true)
+
+// Records a failure with the expression and location when condition is false, and
+// returns the condition, so a test can stop where going on makes no sense.
+#define SELF_CHECK(condition) context.Check(bool(condition), #condition, __FILE__, __LINE__)
+
+// Tests live next to the modules they cover, in <Module>Tests.cpp, and only use portable
+// code, so they run without a window or a device. Tests and benchmarks are named
+// "Group.Name"; a run picks those whose name starts with a prefix.
+//
+// -selftest[:prefix] and -benchmark[:prefix] on the command line run them instead of the
+// game and write the report to the working directory. Elsewhere, the SelfTests target of
+// CMakeLists.txt runs them from SelfTestMain.cpp.
+namespace SelfTest
+{
+	class Context
+	{
+	public:
+		explicit Context(std::string& report);
+
+		bool Check(bool condition, const char* expression, const char* file, int line);
+		// Adds a line to the report, printf style.
+		void Log(const char* format, ...);
+
+		uint32_t GetFailures()const;
+
+	private:
+		std::string& mReport;
+		uint32_t mFailures;
+	};
+
+	using Function = void(*)(Context& context);
+
+	// Adds a test to the list Run picks from, from a static object in the test's file.
+	struct Registrar
+	{
+		Registrar(const char* name, bool benchmark, Function function);
+	};
+
+	struct Result
+	{
+		uint32_t Run = 0;
+		uint32_t Failed = 0;
+		std::string Report;
+	};
+
+	// Runs the tests (or the benchmarks) whose name starts with prefix, in name order.
+	// An exception fails the test that threw it.
+	Result Run(bool benchmarks, const char* prefix);
+}
@@ -0,0 +1,28 @@
+//
+// SelfTestMain.cpp
+//
+
+#include "SelfTest.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Entry point of the portable test runner built by CMakeLists.txt, for platforms without
+// the game: SelfTests [-benchmark] [prefix] runs the tests (or the benchmarks) whose name
+// starts with prefix, prints the report and returns the number of failures.
+int main(int argc, char* argv[])
+{
+	bool benchmarks = false;
+	const char* prefix = "";
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-benchmark") == 0)
+			benchmarks = true;
+		else
+			prefix = argv[i];
+	}
+
+	SelfTest::Result result = SelfTest::Run(benchmarks, prefix);
+	fputs(result.Report.c_str(), stdout);
+	return static_cast<int>(result.Failed);
+}
@@ -0,0 +1,183 @@
+//
+// ShadowCascades.cpp
+//
+
+#include "ShadowCascades.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+bool ShadowCascades::Fit::operator==(const Fit& rhs)const
+{
+	return X == rhs.X && Y == rhs.Y && Z == rhs.Z && Radius == rhs.Radius &&
+		LightDir.x == rhs.LightDir.x && LightDir.y == rhs.LightDir.y && LightDir.z == rhs.LightDir.z;
+}
+
+ShadowCascades::ShadowCascades()
+{
+}
+
+void ShadowCascades::SetCascadeCount(int count)
+{
+	mCascadeCount = std::max(1, std::min(count, int(MaxCascades)));
+	InvalidateStaticCasters();
+}
+
+void ShadowCascades::SetSplitLambda(float lambda)
+{
+	mSplitLambda = std::max(0.0f, std::min(lambda, 1.0f));
+	InvalidateStaticCasters();
+}
+
+void ShadowCascades::SetShadowMapSize(uint32_t size)
+{
+	mShadowMapSize = std::max(size, 1u);
+	InvalidateStaticCasters();
+}
+
+void ShadowCascades::SetMaxShadowDistance(float distance)
+{
+	mMaxShadowDistance = distance;
+	InvalidateStaticCasters();
+}
+
+void ShadowCascades::SetCasterDistance(float distance)
+{
+	mCasterDistance = distance;
+	InvalidateStaticCasters();
+}
+
+int ShadowCascades::GetCascadeCount()const
+{
+	return mCascadeCount;
+}
+
+const ShadowCascades::Cascade& ShadowCascades::GetCascade(int i)const
+{
+	assert(i >= 0 && i < mCascadeCount);
+	return mCascades[i];
+}
+
+void ShadowCascades::Update(const Camera& camera, FXMVECTOR lightDir)
+{
+	float zNear = camera.GetNearZ();
+	float zFar = camera.GetFarZ();
+	if (mMaxShadowDistance > 0.0f)
+		zFar = std::min(zFar, mMaxShadowDistance);
+	zFar = std::max(zFar, zNear);
+
+	// Squared slope of the frustum's corner rays.
+	float tanHalfY = 0.5f * camera.GetNearWindowHeight() / zNear;
+	float tanHalfX = 0.5f * camera.GetNearWindowWidth() / zNear;
+	float k2 = tanHalfX * tanHalfX + tanHalfY * tanHalfY;
+
+	// Light view is a pure rotation so snapping can be done on world space coordinates.
+	XMVECTOR L = XMVector3Normalize(lightDir);
+	XMVECTOR up = fabsf(XMVectorGetY(L)) > 0.99f ? g_XMIdentityR2 : g_XMIdentityR1;
+	XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), L, up);
+
+	XMFLOAT4X4 lv;
+	XMStoreFloat4x4(&lv, lightView);
+	XMFLOAT3 lightDir3;
+	XMStoreFloat3(&lightDir3, L);
+
+	// Camera relative origin in light space, in double precision.
+	WorldPosition origin = camera.GetWorldOrigin();
+	double originLS[3];
+	for (int a = 0; a < 3; ++a)
+		originLS[a] = origin.x * lv(0, a) + origin.y * lv(1, a) + origin.z * lv(2, a);
+
+	XMVECTOR P = camera.GetPosition();
+	XMVECTOR look = camera.GetLook();
+
+	float prevSplit = zNear;
+	for (int i = 0; i < mCascadeCount; ++i)
+	{
+		// Practical split scheme.
+		float t = float(i + 1) / float(mCascadeCount);
+		float logSplit = zNear * powf(zFar / zNear, t);
+		float uniformSplit = zNear + (zFar - zNear) * t;
+		float split = mSplitLambda * logSplit + (1.0f - mSplitLambda) * uniformSplit;
+
+		Cascade& c = mCascades[i];
+		c.SplitNear = prevSplit;
+		c.SplitFar = split;
+		prevSplit = split;
+
+		// Smallest sphere around the slice. Its center lies on the view axis where the
+		// distances to the near and far corners are equal, clamped to the far plane.
+		float zn = c.SplitNear;
+		float zf = c.SplitFar;
+		float centerZ = 0.5f * (zf + zn) * (1.0f + k2);
+		float radius;
+		if (centerZ >= zf)
+		{
+			centerZ = zf;
+			radius = zf * sqrtf(k2);
+		}
+		else
+		{
+			radius = sqrtf((centerZ - zn) * (centerZ - zn) + zn * zn * k2);
+		}
+
+		// Quantize the radius so float noise cannot change the projection scale.
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		XMStoreFloat3(&c.Center, XMVectorMultiplyAdd(XMVectorReplicate(centerZ), look, P));
+		c.Radius = radius;
+
+		// Snap the world space light space center to whole texels.
+		double texel = 2.0 * radius / mShadowMapSize;
+		double world[3] = { origin.x + c.Center.x, origin.y + c.Center.y, origin.z + c.Center.z };
+		double snapped[3];
+		for (int a = 0; a < 3; ++a)
+		{
+			double v = world[0] * lv(0, a) + world[1] * lv(1, a) + world[2] * lv(2, a);
+			snapped[a] = floor(v / texel) * texel;
+		}
+
+		Fit& fit = mCurrentFit[i];
+		fit.X = snapped[0];
+		fit.Y = snapped[1];
+		fit.Z = snapped[2];
+		fit.Radius = radius;
+		fit.LightDir = lightDir3;
+
+		// Build the projection around the snapped center, relative to the camera origin.
+		float cx = static_cast<float>(snapped[0] - originLS[0]);
+		float cy = static_cast<float>(snapped[1] - originLS[1]);
+		float cz = static_cast<float>(snapped[2] - originLS[2]);
+		float casterDistance = mCasterDistance > 0.0f ? mCasterDistance : radius;
+
+		XMMATRIX lightProj = XMMatrixOrthographicOffCenterLH(
+			cx - radius, cx + radius,
+			cy - radius, cy + radius,
+			cz - radius - casterDistance, cz + radius);
+
+		c.LightView = lv;
+		XMStoreFloat4x4(&c.LightProj, lightProj);
+		XMStoreFloat4x4(&c.LightViewProj, XMMatrixMultiply(lightView, lightProj));
+	}
+}
+
+void ShadowCascades::InvalidateStaticCasters()
+{
+	++mStaticCasterVersion;
+}
+
+bool ShadowCascades::NeedsRedraw(int i)const
+{
+	assert(i >= 0 && i < mCascadeCount);
+	return mRenderedCasterVersion[i] != mStaticCasterVersion ||
+		!(mCurrentFit[i] == mRenderedFit[i]);
+}
+
+void ShadowCascades::MarkRendered(int i)
+{
+	assert(i >= 0 && i < mCascadeCount);
+	mRenderedFit[i] = mCurrentFit[i];
+	mRenderedCasterVersion[i] = mStaticCasterVersion;
+}
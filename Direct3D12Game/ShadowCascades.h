@@ -0,0 +1,91 @@
+//
+// ShadowCascades.h - Cascaded shadow map splits and light matrices fitted to the Camera frustum
+//
+
+#pragma once
+
+#include "Camera.h"
+
+#include <DirectXMath.h>
+#include <stdint.h>
+
+// Splits the camera view range into cascades using the practical split scheme
+// (a blend of uniform and logarithmic splits) and fits an orthographic light
+// projection to the bounding sphere of each slice.
+//
+// The bounding sphere only depends on the slice depth range and the field of view,
+// so its size does not change as the camera rotates, and its center is snapped to
+// whole shadow map texels in world light space. Together that keeps each cascade's
+// shadow map contents stable until the camera has moved by at least one texel, which
+// is tracked per cascade so unchanged cascades do not need their casters redrawn.
+class ShadowCascades
+{
+public:
+	static const int MaxCascades = 4;
+
+	struct Cascade
+	{
+		// View space depth range covered by this cascade.
+		float SplitNear = 0.0f;
+		float SplitFar = 0.0f;
+
+		// Bounding sphere of the slice in the camera's (possibly camera relative) world space.
+		DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+		float Radius = 0.0f;
+
+		// Light matrices for rendering casters and sampling the map, in the same space as Center.
+		DirectX::XMFLOAT4X4 LightView = Identity4x4();
+		DirectX::XMFLOAT4X4 LightProj = Identity4x4();
+		DirectX::XMFLOAT4X4 LightViewProj = Identity4x4();
+	};
+
+	ShadowCascades();
+
+	// Configuration. Changing any of these invalidates every cascade.
+	void SetCascadeCount(int count);
+	void SetSplitLambda(float lambda);			// 0 = uniform, 1 = logarithmic
+	void SetShadowMapSize(uint32_t size);
+	void SetMaxShadowDistance(float distance);	// 0 = use the camera far plane
+	void SetCasterDistance(float distance);		// how far towards the light casters may be
+
+	int GetCascadeCount()const;
+	const Cascade& GetCascade(int i)const;
+
+	// Recompute splits and light matrices for a directional light shining along lightDir.
+	void Update(const Camera& camera, DirectX::FXMVECTOR lightDir);
+
+	// Call when static shadow casters changed; every cascade must be redrawn.
+	void InvalidateStaticCasters();
+
+	// A cascade needs its static casters redrawn when its world space light frustum
+	// moved or the static casters changed since MarkRendered was last called for it.
+	bool NeedsRedraw(int i)const;
+	void MarkRendered(int i);
+
+private:
+	int mCascadeCount = MaxCascades;
+	float mSplitLambda = 0.75f;
+	uint32_t mShadowMapSize = 2048;
+	float mMaxShadowDistance = 0.0f;
+	float mCasterDistance = 0.0f;
+
+	Cascade mCascades[MaxCascades];
+
+	// Snapped light space sphere center (double precision, world space) and radius
+	// of the last update, and of the last time each cascade was rendered.
+	struct Fit
+	{
+		double X = 0.0;
+		double Y = 0.0;
+		double Z = 0.0;
+		float Radius = -1.0f;
+		DirectX::XMFLOAT3 LightDir = { 0.0f, 0.0f, 0.0f };
+
+		bool operator==(const Fit& rhs)const;
+	};
+	Fit mCurrentFit[MaxCascades];
+	Fit mRenderedFit[MaxCascades];
+
+	uint64_t mStaticCasterVersion = 1;
+	uint64_t mRenderedCasterVersion[MaxCascades] = {};
+};
@@ -0,0 +1,165 @@
+//
+// ShadowCascadesTests.cpp
+//
+
+#include "SelfTest.h"
+#include "ShadowCascades.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	const XMVECTORF32 c_light = { -1.0f, -0.5f, 1.0f, 0.0f };
+
+	Camera MakeCamera()
+	{
+		Camera camera;
+		camera.SetLens(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+		camera.LookAt(XMFLOAT3(3.0f, 2.0f, -5.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+		camera.UpdateViewMatrix();
+		return camera;
+	}
+
+	// Where a world point lands on a cascade's shadow map, in texels.
+	XMFLOAT2 ToTexels(const ShadowCascades::Cascade& cascade, uint32_t mapSize, FXMVECTOR point)
+	{
+		XMVECTOR clip = XMVector3Transform(point, XMLoadFloat4x4(&cascade.LightViewProj));
+		return XMFLOAT2(
+			(XMVectorGetX(clip) * 0.5f + 0.5f) * mapSize,
+			(XMVectorGetY(clip) * 0.5f + 0.5f) * mapSize);
+	}
+
+	// Distance of a texel coordinate's fraction from another one's, wrapping at 1.
+	float FractionDistance(float a, float b)
+	{
+		float d = fabsf((a - floorf(a)) - (b - floorf(b)));
+		return std::min(d, 1.0f - d);
+	}
+}
+
+SELF_TEST(ShadowCascades, SplitsFollowPracticalScheme)
+{
+	Camera camera = MakeCamera();
+	const float zNear = camera.GetNearZ();
+	const float zFar = 100.0f;
+
+	for (float lambda : { 0.0f, 0.75f, 1.0f })
+	{
+		ShadowCascades cascades;
+		cascades.SetCascadeCount(4);
+		cascades.SetSplitLambda(lambda);
+		cascades.SetMaxShadowDistance(zFar);
+		cascades.Update(camera, c_light);
+
+		// C_i = lambda * n * (f / n)^(i / N) + (1 - lambda) * (n + (f - n) * i / N)
+		float previous = zNear;
+		for (int i = 0; i < cascades.GetCascadeCount(); ++i)
+		{
+			double t = double(i + 1) / cascades.GetCascadeCount();
+			double expected = lambda * zNear * pow(double(zFar) / zNear, t) + (1.0 - lambda) * (zNear + (zFar - zNear) * t);
+			const ShadowCascades::Cascade& cascade = cascades.GetCascade(i);
+			SELF_CHECK(cascade.SplitNear == previous);
+			SELF_CHECK(fabs(cascade.SplitFar - expected) <= 1e-4 * expected);
+			previous = cascade.SplitFar;
+		}
+		SELF_CHECK(fabsf(previous - zFar) <= 1e-4f * zFar);
+	}
+}
+
+SELF_TEST(ShadowCascades, SnappedUnderSubTexelMotion)
+{
+	const uint32_t mapSize = 2048;
+	Camera camera = MakeCamera();
+	ShadowCascades cascades;
+	cascades.SetShadowMapSize(mapSize);
+	cascades.SetMaxShadowDistance(100.0f);
+	cascades.Update(camera, c_light);
+
+	const int count = cascades.GetCascadeCount();
+	const XMVECTOR point = XMVectorSet(0.3f, 0.2f, 0.1f, 1.0f);
+	float radius[ShadowCascades::MaxCascades];
+	XMFLOAT2 first[ShadowCascades::MaxCascades];
+	for (int i = 0; i < count; ++i)
+	{
+		radius[i] = cascades.GetCascade(i).Radius;
+		first[i] = ToTexels(cascades.GetCascade(i), mapSize, point);
+	}
+
+	// Walk in steps of a tenth of the finest texel while turning a little. The maps may
+	// shift by whole texels, never by a fraction of one, and the fit keeps its size.
+	float step = 0.1f * 2.0f * radius[0] / mapSize;
+	float worst = 0.0f;
+	bool sameRadius = true;
+	for (int move = 0; move < 200; ++move)
+	{
+		camera.Walk(step);
+		camera.Strafe(0.37f * step);
+		camera.RotateY(0.001f);
+		camera.UpdateViewMatrix();
+		cascades.Update(camera, c_light);
+
+		for (int i = 0; i < count; ++i)
+		{
+			XMFLOAT2 texels = ToTexels(cascades.GetCascade(i), mapSize, point);
+			worst = std::max(worst, std::max(FractionDistance(texels.x, first[i].x), FractionDistance(texels.y, first[i].y)));
+			sameRadius = sameRadius && cascades.GetCascade(i).Radius == radius[i];
+		}
+	}
+
+	context.Log("worst sub-texel shift %.4f texels", worst);
+	SELF_CHECK(worst < 0.02f);
+	SELF_CHECK(sameRadius);
+}
+
+SELF_TEST(ShadowCascades, CacheHitsForStaticCamera)
+{
+	Camera camera = MakeCamera();
+	ShadowCascades cascades;
+	cascades.SetMaxShadowDistance(100.0f);
+	cascades.Update(camera, c_light);
+
+	const int count = cascades.GetCascadeCount();
+	for (int i = 0; i < count; ++i)
+	{
+		SELF_CHECK(cascades.NeedsRedraw(i));
+		cascades.MarkRendered(i);
+	}
+
+	// Frames with an unchanged camera hit the cache in every cascade.
+	int redraws = 0;
+	for (int frame = 0; frame < 100; ++frame)
+	{
+		camera.UpdateViewMatrix();
+		cascades.Update(camera, c_light);
+		for (int i = 0; i < count; ++i)
+		{
+			if (cascades.NeedsRedraw(i))
+			{
+				redraws++;
+				cascades.MarkRendered(i);
+			}
+		}
+	}
+	SELF_CHECK(redraws == 0);
+
+	// Changed static casters miss everywhere, once.
+	cascades.InvalidateStaticCasters();
+	for (int i = 0; i < count; ++i)
+	{
+		SELF_CHECK(cascades.NeedsRedraw(i));
+		cascades.MarkRendered(i);
+		SELF_CHECK(!cascades.NeedsRedraw(i));
+	}
+
+	// So does a turning light, and moving far enough.
+	cascades.Update(camera, XMVectorSet(-1.0f, -0.6f, 1.0f, 0.0f));
+	for (int i = 0; i < count; ++i)
+		SELF_CHECK(cascades.NeedsRedraw(i));
+
+	camera.Walk(50.0f);
+	camera.UpdateViewMatrix();
+	cascades.Update(camera, c_light);
+	SELF_CHECK(cascades.NeedsRedraw(0));
+}
@@ -0,0 +1,344 @@
+//
+// SoftwareRenderBenchmark.cpp
+//
+
+#include "SoftwareRenderBenchmark.h"
+
+#include "CommandListPool.h"
+#include "JobSystem.h"
+#include "SceneRenderer.h"
+#include "SoftwareRenderDevice.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+	const float c_pi = 3.14159265358979f;
+	const float c_lightDirection[3] = { -1.0f, -0.5f, 1.0f };
+	const float c_frameSeconds = 1.0f / 60.0f;
+
+	enum Pass : uint32_t
+	{
+		ClearPass,
+		SpritesPass,
+		GridsPass,
+		GlobePass,
+		ResolvePass
+	};
+
+	void Normalize(float v[3])
+	{
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		for (int i = 0; i < 3; ++i)
+			v[i] /= length;
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	float Dot(const float a[3], const float b[3])
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	// XMMatrixLookAtLH and XMMatrixPerspectiveFovLH, row major for row vectors.
+	void LookAt(const float eye[3], const float at[3], const float up[3], float out[16])
+	{
+		float z[3] = { at[0] - eye[0], at[1] - eye[1], at[2] - eye[2] };
+		Normalize(z);
+		float x[3];
+		Cross(up, z, x);
+		Normalize(x);
+		float y[3];
+		Cross(z, x, y);
+
+		const float view[16] =
+		{
+			x[0], y[0], z[0], 0.0f,
+			x[1], y[1], z[1], 0.0f,
+			x[2], y[2], z[2], 0.0f,
+			-Dot(x, eye), -Dot(y, eye), -Dot(z, eye), 1.0f
+		};
+		memcpy(out, view, sizeof(view));
+	}
+
+	void Perspective(float fovY, float aspect, float nearZ, float farZ, float out[16])
+	{
+		float yScale = 1.0f / std::tan(fovY * 0.5f);
+		float q = farZ / (farZ - nearZ);
+		const float projection[16] =
+		{
+			yScale / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, yScale, 0.0f, 0.0f,
+			0.0f, 0.0f, q, 1.0f,
+			0.0f, 0.0f, -q * nearZ, 0.0f
+		};
+		memcpy(out, projection, sizeof(projection));
+	}
+
+	// Rotation about y followed by a translation.
+	void RotationTranslation(float angle, float x, float y, float z, float out[16])
+	{
+		float s = std::sin(angle), c = std::cos(angle);
+		const float world[16] =
+		{
+			c, 0.0f, -s, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			s, 0.0f, c, 0.0f,
+			x, y, z, 1.0f
+		};
+		memcpy(out, world, sizeof(world));
+	}
+
+	// GeometricPrimitive::CreateSphere with its defaults: diameter 1, tessellation 16,
+	// left handed (u mirrored).
+	void CreateSphere(std::vector<SoftwareRenderDevice::MeshVertex>& vertices, std::vector<uint16_t>& indices)
+	{
+		const size_t verticalSegments = 16;
+		const size_t horizontalSegments = verticalSegments * 2;
+		const float radius = 0.5f;
+
+		for (size_t i = 0; i <= verticalSegments; ++i)
+		{
+			float v = 1.0f - float(i) / verticalSegments;
+			float latitude = (float(i) * c_pi / verticalSegments) - c_pi / 2.0f;
+			float dy = std::sin(latitude), dxz = std::cos(latitude);
+
+			for (size_t j = 0; j <= horizontalSegments; ++j)
+			{
+				float u = float(j) / horizontalSegments;
+				float longitude = float(j) * 2.0f * c_pi / horizontalSegments;
+				float dx = std::sin(longitude) * dxz, dz = std::cos(longitude) * dxz;
+
+				SoftwareRenderDevice::MeshVertex vertex =
+				{
+					{ dx * radius, dy * radius, dz * radius }, { dx, dy, dz }, { 1.0f - u, v }
+				};
+				vertices.push_back(vertex);
+			}
+		}
+
+		const size_t stride = horizontalSegments + 1;
+		for (size_t i = 0; i < verticalSegments; ++i)
+		{
+			for (size_t j = 0; j <= horizontalSegments; ++j)
+			{
+				size_t nextI = i + 1;
+				size_t nextJ = (j + 1) % stride;
+				const size_t triangles[6] =
+				{
+					nextI * stride + j, i * stride + nextJ, i * stride + j,
+					nextI * stride + j, nextI * stride + nextJ, i * stride + nextJ
+				};
+				for (size_t index : triangles)
+					indices.push_back(uint16_t(index));
+			}
+		}
+	}
+
+	// Stand-in for galaxy.jpg, which the software backend can't decode.
+	std::vector<uint32_t> CreateBackground(uint32_t width, uint32_t height)
+	{
+		std::vector<uint32_t> texels(size_t(width) * height);
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				uint32_t hash = (x * 73856093u) ^ (y * 19349663u);
+				hash ^= hash >> 13;
+				hash *= 0x5bd1e995u;
+				hash ^= hash >> 15;
+				uint32_t star = (hash & 0x3ff) == 0 ? 255 : 0;
+				uint32_t r = std::max(star, 10 + 30 * y / height);
+				uint32_t g = std::max(star, 5 + 10 * x / width);
+				uint32_t b = std::max(star, 30 + 50 * y / height);
+				texels[size_t(y) * width + x] = r | (g << 8) | (b << 16) | 0xff000000u;
+			}
+		}
+		return texels;
+	}
+
+	std::vector<uint32_t> CreateChecker(uint32_t size)
+	{
+		std::vector<uint32_t> texels(size_t(size) * size);
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			for (uint32_t x = 0; x < size; ++x)
+				texels[size_t(y) * size + x] = ((x / 8 + y / 8) & 1) ? 0xffffffffu : 0xff4080c0u;
+		}
+		return texels;
+	}
+
+	uint64_t HashPixels(const uint32_t* pixels, size_t count)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < count; ++i)
+		{
+			hash ^= pixels[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	struct RunResult
+	{
+		double Seconds = 0.0;
+		SoftwareRenderDevice::Stats Stats;
+		uint64_t Hash = 0;
+	};
+
+	// Copies the last frame to image, if given.
+	RunResult RenderFrames(const SoftwareRenderBenchmark::Settings& settings, unsigned threads, bool saveImage,
+		std::vector<uint32_t>* image = nullptr)
+	{
+		JobSystem jobs(threads - 1);
+		SoftwareRenderDevice device(&jobs);
+
+		std::vector<SoftwareRenderDevice::MeshVertex> sphereVertices;
+		std::vector<uint16_t> sphereIndices;
+		CreateSphere(sphereVertices, sphereIndices);
+
+		SceneResources resources;
+		SoftwareRenderDevice::PipelineDesc grid;
+		grid.VertexColor = true;
+		grid.AlphaBlend = true;
+		resources.Grid = device.AddPipeline(grid);
+		SoftwareRenderDevice::PipelineDesc globe;
+		globe.Texture = true;
+		globe.Lighting = true;
+		memcpy(globe.LightDirection, c_lightDirection, sizeof(c_lightDirection));
+		resources.Globe = device.AddPipeline(globe);
+		resources.GlobeMesh = device.AddMesh(sphereVertices.data(), sphereVertices.size(),
+			sphereIndices.data(), sphereIndices.size());
+
+		SceneFrame frame;
+		frame.OutputWidth = settings.Width;
+		frame.OutputHeight = settings.Height;
+		frame.Upscale = settings.RenderScale < 1.0f;
+		frame.Width = frame.Upscale ? std::max(uint32_t(settings.Width * settings.RenderScale), 1u) : settings.Width;
+		frame.Height = frame.Upscale ? std::max(uint32_t(settings.Height * settings.RenderScale), 1u) : settings.Height;
+		frame.SceneColor = device.AddTexture(settings.Width, settings.Height);
+		frame.SceneDepth = device.AddDepthTexture(settings.Width, settings.Height);
+		frame.BackBuffer = device.AddTexture(settings.Width, settings.Height);
+		frame.GridVisible = 7;
+
+		std::vector<uint32_t> background = CreateBackground(256, 256);
+		frame.Background = device.AddTexture(256, 256, background.data());
+		frame.GlobeTexture = device.LoadTexture(settings.TextureFile);
+		if (!frame.GlobeTexture)
+		{
+			std::vector<uint32_t> checker = CreateChecker(64);
+			frame.GlobeTexture = device.AddTexture(64, 64, checker.data());
+		}
+		frame.Font = device.LoadFont(settings.FontFile);
+
+		// The camera the game starts with.
+		const float eye[3] = { 0.0f, 1.0f, -5.0f };
+		const float at[3] = { 0.0f, 0.0f, 0.0f };
+		const float up[3] = { 0.0f, 1.0f, 0.0f };
+		LookAt(eye, at, up, frame.View);
+		Perspective(0.25f * c_pi, float(settings.Width) / float(settings.Height), 1.0f, 1000.0f, frame.Projection);
+		RotationTranslation(0.0f, 0.0f, 0.0f, 0.0f, frame.GridWorld);
+
+		SceneRenderer renderer(resources);
+		CommandListPool pool(device, 2, 1);
+		auto pass = [&pool](Pass p) -> IRenderCommandList&
+		{
+			return IRenderDevice::GetRenderList(pool.BeginPass(p, 0));
+		};
+
+		RunResult result;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < settings.Frames; ++i)
+		{
+			// Game::Update's motion, one fixed step per frame.
+			float time = float(i) * c_frameSeconds;
+			RotationTranslation(time / 2.0f, std::cos(time) * 0.5f, 0.0f, std::sin(time) * 0.5f, frame.GlobeWorld);
+			const float gridOrigin = std::sin(time) * 0.25f;
+			for (float& o : frame.GridOrigin)
+				o = gridOrigin;
+
+			frame.Hud.clear();
+			char text[64];
+			snprintf(text, sizeof(text), "software renderer  frame %u", i);
+			SceneText line;
+			line.Text = text;
+			line.X = 5.0f;
+			line.Y = 5.0f;
+			frame.Hud.push_back(line);
+
+			pool.BeginFrame();
+			renderer.RecordClear(pass(ClearPass), frame);
+			renderer.RecordSprites(pass(SpritesPass), frame);
+			renderer.RecordGrids(pass(GridsPass), frame);
+			renderer.RecordGlobe(pass(GlobePass), frame);
+			renderer.RecordResolve(pass(ResolvePass), frame);
+			pool.Submit();
+		}
+		pool.WaitForIdle();
+		result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.Stats = device.GetStats();
+		const uint32_t* pixels = device.GetPixels(frame.BackBuffer);
+		result.Hash = HashPixels(pixels, size_t(settings.Width) * settings.Height);
+		if (image)
+			image->assign(pixels, pixels + size_t(settings.Width) * settings.Height);
+
+		if (saveImage && settings.ImageFile)
+			device.SaveTGA(frame.BackBuffer, settings.ImageFile);
+		return result;
+	}
+}
+
+std::string SoftwareRenderBenchmark::Run(const Settings& settings)
+{
+	unsigned maxThreads = settings.MaxThreads ? settings.MaxThreads : JobSystem::DefaultWorkerCount() + 1;
+
+	std::ostringstream out;
+	out << "software renderer " << settings.Width << 'x' << settings.Height << ", "
+		<< settings.Frames << " frames, " << SoftwareRenderDevice::TileSize << " pixel tiles";
+	if (settings.RenderScale < 1.0f)
+		out << ", scene at " << settings.RenderScale << " of the size";
+	out << "\n";
+	out << "threads,ms_per_frame,raster_ms_per_frame,mpixels_per_s,mtriangles_per_s,image_hash\n";
+
+	uint64_t firstHash = 0;
+	bool identical = true;
+	for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		RunResult result = RenderFrames(settings, threads, threads == 1);
+		if (threads == 1)
+			firstHash = result.Hash;
+		identical &= result.Hash == firstHash;
+
+		// Throughput of the tile jobs, which is what scales with the threads.
+		double raster = std::max(result.Stats.RasterSeconds, 1e-9);
+		char line[160];
+		snprintf(line, sizeof(line), "%u,%.3f,%.3f,%.1f,%.2f,%016llx\n", threads,
+			result.Seconds * 1000.0 / settings.Frames, raster * 1000.0 / settings.Frames,
+			result.Stats.Pixels / raster * 1e-6, result.Stats.Triangles / raster * 1e-6,
+			static_cast<unsigned long long>(result.Hash));
+		out << line;
+
+		if (threads >= maxThreads)
+			break;
+	}
+
+	out << (identical ? "images identical across thread counts\n" : "IMAGES DIFFER between thread counts\n");
+	return out.str();
+}
+
+std::vector<uint32_t> SoftwareRenderBenchmark::RenderLastFrame(const Settings& settings)
+{
+	unsigned threads = settings.MaxThreads ? settings.MaxThreads : JobSystem::DefaultWorkerCount() + 1;
+	std::vector<uint32_t> image;
+	RenderFrames(settings, threads, false, &image);
+	return image;
+}
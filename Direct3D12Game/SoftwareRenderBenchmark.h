@@ -0,0 +1,39 @@
+//
+// SoftwareRenderBenchmark.h - Renders the scene with the software backend at several thread counts
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Draws an animated version of the game's scene through SceneRenderer into a
+// SoftwareRenderDevice, once per thread count (1, 2, 4, ... up to MaxThreads), and
+// reports frame time, Mpixels/s and Mtriangles/s for each. The last frame of every run
+// must be the same image; it is written to ImageFile as the golden image of the run.
+// Needs no window or GPU.
+namespace SoftwareRenderBenchmark
+{
+	struct Settings
+	{
+		uint32_t Width = 800;
+		uint32_t Height = 600;
+		uint32_t Frames = 100;
+		// Below 1 the scene is drawn at this fraction of the size and upscaled, as with
+		// dynamic resolution.
+		float RenderScale = 1.0f;
+		unsigned MaxThreads = 0;		// 0: every hardware thread
+		// Missing files fall back to a checker texture and no text.
+		const char* TextureFile = "earth.bmp";
+		const char* FontFile = "courier.spritefont";
+		const char* ImageFile = "software_render.tga";	// null to skip
+	};
+
+	// Text report, one line per thread count.
+	std::string Run(const Settings& settings);
+
+	// Renders the frames once, with MaxThreads threads, and returns the back buffer of the
+	// last one: Width * Height pixels, rows top down, red in the low byte.
+	std::vector<uint32_t> RenderLastFrame(const Settings& settings);
+}
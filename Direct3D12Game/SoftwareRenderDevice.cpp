@@ -0,0 +1,1359 @@
+//
+// SoftwareRenderDevice.cpp
+//
+
+#include "SoftwareRenderDevice.h"
+
+#include "JobSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cwctype>
+#include <emmintrin.h>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	enum ObjectKind : char
+	{
+		TextureObject = 'T',
+		MeshObject = 'M',
+		PipelineObject = 'P',
+		FontObject = 'F'
+	};
+
+	const float c_identity[16] =
+	{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	// Row vectors, as in DirectXMath: out = a * b.
+	void Multiply(const float a[16], const float b[16], float out[16])
+	{
+		for (int row = 0; row < 4; ++row)
+		{
+			for (int column = 0; column < 4; ++column)
+			{
+				out[row * 4 + column] = a[row * 4 + 0] * b[0 * 4 + column] + a[row * 4 + 1] * b[1 * 4 + column]
+					+ a[row * 4 + 2] * b[2 * 4 + column] + a[row * 4 + 3] * b[3 * 4 + column];
+			}
+		}
+	}
+
+	void Transform(const float v[4], const float m[16], float out[4])
+	{
+		for (int column = 0; column < 4; ++column)
+			out[column] = v[0] * m[column] + v[1] * m[4 + column] + v[2] * m[8 + column] + v[3] * m[12 + column];
+	}
+
+	uint32_t Pack(const float color[4])
+	{
+		uint32_t packed = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			float c = std::min(std::max(color[i], 0.0f), 1.0f);
+			packed |= uint32_t(c * 255.0f + 0.5f) << (8 * i);
+		}
+		return packed;
+	}
+
+	void Unpack(uint32_t packed, float color[4])
+	{
+		for (int i = 0; i < 4; ++i)
+			color[i] = float((packed >> (8 * i)) & 0xff) * (1.0f / 255.0f);
+	}
+
+	// Bilinear filtering between texel centers, like the LinearWrap and LinearClamp samplers.
+	void Sample(const uint32_t* texels, uint32_t width, uint32_t height, float u, float v, bool wrap, float out[4])
+	{
+		float x = u * float(width) - 0.5f;
+		float y = v * float(height) - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		float tx = x - fx;
+		float ty = y - fy;
+
+		auto address = [wrap](int coordinate, uint32_t size)
+		{
+			int s = int(size);
+			if (wrap)
+				return uint32_t(((coordinate % s) + s) % s);
+			return uint32_t(std::min(std::max(coordinate, 0), s - 1));
+		};
+
+		// Texture coordinates far outside [0, 1] only happen on degenerate pixels.
+		fx = std::min(std::max(fx, -1048576.0f), 1048576.0f);
+		fy = std::min(std::max(fy, -1048576.0f), 1048576.0f);
+		uint32_t x0 = address(int(fx), width), x1 = address(int(fx) + 1, width);
+		uint32_t y0 = address(int(fy), height), y1 = address(int(fy) + 1, height);
+
+		float c00[4], c10[4], c01[4], c11[4];
+		Unpack(texels[y0 * width + x0], c00);
+		Unpack(texels[y0 * width + x1], c10);
+		Unpack(texels[y1 * width + x0], c01);
+		Unpack(texels[y1 * width + x1], c11);
+		for (int i = 0; i < 4; ++i)
+		{
+			float top = c00[i] + (c10[i] - c00[i]) * tx;
+			float bottom = c01[i] + (c11[i] - c01[i]) * tx;
+			out[i] = top + (bottom - top) * ty;
+		}
+	}
+
+	uint32_t Read32(const std::vector<char>& data, size_t offset)
+	{
+		uint32_t value = 0;
+		if (offset + 4 <= data.size())
+			memcpy(&value, data.data() + offset, 4);
+		return value;
+	}
+
+	bool ReadFile(const char* fileName, std::vector<char>& data)
+	{
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file)
+			return false;
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	uint32_t Expand565(uint16_t color)
+	{
+		uint32_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16);
+	}
+
+	uint32_t Mix(uint32_t a, uint32_t b, uint32_t weightA, uint32_t weightB)
+	{
+		uint32_t mixed = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32_t ca = (a >> (8 * i)) & 0xff, cb = (b >> (8 * i)) & 0xff;
+			mixed |= ((ca * weightA + cb * weightB) / (weightA + weightB)) << (8 * i);
+		}
+		return mixed;
+	}
+
+	// BC2: 4 bit explicit alpha followed by a four color BC1 block, per 4x4 texels.
+	void DecodeBC2(const unsigned char* blocks, uint32_t width, uint32_t height, uint32_t stride, uint32_t* texels)
+	{
+		for (uint32_t by = 0; by < (height + 3) / 4; ++by)
+		{
+			for (uint32_t bx = 0; bx < (width + 3) / 4; ++bx)
+			{
+				const unsigned char* block = blocks + by * stride + bx * 16;
+
+				uint64_t alpha;
+				uint16_t color0, color1;
+				uint32_t indices;
+				memcpy(&alpha, block, 8);
+				memcpy(&color0, block + 8, 2);
+				memcpy(&color1, block + 10, 2);
+				memcpy(&indices, block + 12, 4);
+
+				uint32_t colors[4] = { Expand565(color0), Expand565(color1) };
+				colors[2] = Mix(colors[0], colors[1], 2, 1);
+				colors[3] = Mix(colors[0], colors[1], 1, 2);
+
+				for (uint32_t i = 0; i < 16; ++i)
+				{
+					uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+					if (x >= width || y >= height)
+						continue;
+					uint32_t a = uint32_t((alpha >> (4 * i)) & 0xf) * 17;
+					texels[y * width + x] = colors[(indices >> (2 * i)) & 3] | (a << 24);
+				}
+			}
+		}
+	}
+}
+
+//
+// Allocator
+//
+
+void SoftwareRenderDevice::Allocator::Reset()
+{
+}
+
+//
+// List
+//
+
+SoftwareRenderDevice::List::List(SoftwareRenderDevice& device) :
+	mDevice(device),
+	mOpen(false)
+{
+}
+
+void SoftwareRenderDevice::List::Reset(ICommandAllocator& allocator)
+{
+	(void)allocator;
+	mOpen = true;
+	mCommands.clear();
+	mFloats.clear();
+	mText.clear();
+}
+
+void SoftwareRenderDevice::List::Close()
+{
+	RequireOpen();
+	mOpen = false;
+}
+
+// Execute finishes every command before the next, so textures have no states to track.
+void SoftwareRenderDevice::List::Transition(RenderTexture texture, ResourceState after)
+{
+	RequireOpen();
+	(void)texture; (void)after;
+}
+
+void SoftwareRenderDevice::List::BeginTransition(RenderTexture texture, ResourceState after)
+{
+	RequireOpen();
+	(void)texture; (void)after;
+}
+
+void SoftwareRenderDevice::List::SetRenderTargets(RenderTexture color, RenderTexture depth)
+{
+	Record(CommandType::SetRenderTargets, color.Id, depth.Id);
+}
+
+void SoftwareRenderDevice::List::SetViewport(uint32_t width, uint32_t height)
+{
+	Record(CommandType::SetViewport, width, height);
+}
+
+void SoftwareRenderDevice::List::ClearColor(RenderTexture target, const float color[4])
+{
+	Record(CommandType::ClearColor, target.Id, 0, color, 4);
+}
+
+void SoftwareRenderDevice::List::ClearDepth(RenderTexture target, float depth)
+{
+	Record(CommandType::ClearDepth, target.Id, 0, &depth, 1);
+}
+
+void SoftwareRenderDevice::List::SetPipeline(RenderPipeline pipeline)
+{
+	Record(CommandType::SetPipeline, pipeline.Id, 0);
+}
+
+void SoftwareRenderDevice::List::SetTexture(RenderTexture texture)
+{
+	Record(CommandType::SetTexture, texture.Id, 0);
+}
+
+void SoftwareRenderDevice::List::SetViewProjection(const float view[16], const float projection[16])
+{
+	Record(CommandType::SetViewProjection, 0, 0, view, 16);
+	mFloats.insert(mFloats.end(), projection, projection + 16);
+	mCommands.back().Count += 16;
+}
+
+void SoftwareRenderDevice::List::SetWorld(const float world[16])
+{
+	Record(CommandType::SetWorld, 0, 0, world, 16);
+}
+
+void SoftwareRenderDevice::List::DrawMesh(RenderMesh mesh)
+{
+	Record(CommandType::DrawMesh, mesh.Id, 0);
+}
+
+void SoftwareRenderDevice::List::DrawLines(const RenderVertex* vertices, size_t vertexCount)
+{
+	if (vertexCount % 2 != 0)
+		throw std::logic_error("lines need an even number of vertices");
+	Record(CommandType::DrawLines, uint32_t(vertexCount), 0, &vertices[0].Position[0],
+		vertexCount * sizeof(RenderVertex) / sizeof(float));
+}
+
+void SoftwareRenderDevice::List::DrawSprite(RenderTexture texture, float left, float top, float right, float bottom)
+{
+	const float rect[4] = { left, top, right, bottom };
+	Record(CommandType::DrawSprite, texture.Id, 0, rect, 4);
+}
+
+void SoftwareRenderDevice::List::DrawString(RenderFont font, const char* text, float x, float y)
+{
+	const float position[2] = { x, y };
+	Record(CommandType::DrawString, font.Id, uint32_t(mText.size()), position, 2);
+	mText += text;
+	mCommands.back().Count = uint32_t(mText.size() - mCommands.back().B);
+}
+
+void SoftwareRenderDevice::List::Resolve(RenderTexture dest, RenderTexture source)
+{
+	Record(CommandType::Resolve, dest.Id, source.Id);
+}
+
+void SoftwareRenderDevice::List::Copy(RenderTexture dest, RenderTexture source)
+{
+	Record(CommandType::Copy, dest.Id, source.Id);
+}
+
+void SoftwareRenderDevice::List::Upscale(RenderTexture dest, RenderTexture source, uint32_t sourceWidth, uint32_t sourceHeight)
+{
+	const float size[2] = { float(sourceWidth), float(sourceHeight) };
+	Record(CommandType::Upscale, dest.Id, source.Id, size, 2);
+}
+
+void SoftwareRenderDevice::List::Record(CommandType type, uint32_t a, uint32_t b, const float* floats, size_t count)
+{
+	RequireOpen();
+
+	Command command;
+	command.Type = type;
+	command.A = a;
+	command.B = b;
+	command.Offset = uint32_t(mFloats.size());
+	command.Count = uint32_t(count);
+	mCommands.push_back(command);
+
+	if (count > 0)
+		mFloats.insert(mFloats.end(), floats, floats + count);
+}
+
+void SoftwareRenderDevice::List::RequireOpen()const
+{
+	if (!mOpen)
+		throw std::logic_error("recording into a closed command list");
+}
+
+//
+// SoftwareRenderDevice
+//
+
+SoftwareRenderDevice::SoftwareRenderDevice(JobSystem* jobs) :
+	mJobs(jobs),
+	mFence(0),
+	mColorTarget(nullptr),
+	mDepthTarget(nullptr),
+	mViewportWidth(0),
+	mViewportHeight(0),
+	mTilesX(0),
+	mTilesY(0)
+{
+}
+
+void SoftwareRenderDevice::SetJobSystem(JobSystem* jobs)
+{
+	mJobs = jobs;
+}
+
+RenderTexture SoftwareRenderDevice::AddTexture(uint32_t width, uint32_t height, const uint32_t* pixels)
+{
+	Texture texture;
+	texture.Width = width;
+	texture.Height = height;
+	if (pixels)
+		texture.Color.assign(pixels, pixels + size_t(width) * height);
+	else
+		texture.Color.assign(size_t(width) * height, 0xff000000);
+
+	RenderTexture handle;
+	handle.Id = AddObject(TextureObject);
+	mTextures.push_back(std::move(texture));
+	return handle;
+}
+
+RenderTexture SoftwareRenderDevice::AddDepthTexture(uint32_t width, uint32_t height)
+{
+	Texture texture;
+	texture.Width = width;
+	texture.Height = height;
+	texture.Depth.assign(size_t(width) * height, 1.0f);
+
+	RenderTexture handle;
+	handle.Id = AddObject(TextureObject);
+	mTextures.push_back(std::move(texture));
+	return handle;
+}
+
+RenderTexture SoftwareRenderDevice::LoadTexture(const char* fileName)
+{
+	std::vector<char> data;
+	if (!ReadFile(fileName, data) || data.size() < 54 || data[0] != 'B' || data[1] != 'M')
+		return RenderTexture();
+
+	uint32_t offset = Read32(data, 10);
+	int32_t width = int32_t(Read32(data, 18));
+	int32_t height = int32_t(Read32(data, 22));
+	uint32_t bitsPerPixel = Read32(data, 28) & 0xffff;
+	uint32_t compression = Read32(data, 30);
+	if (width <= 0 || height == 0 || compression != 0 || (bitsPerPixel != 24 && bitsPerPixel != 32))
+		return RenderTexture();
+
+	// Rows are stored bottom up unless the height is negative.
+	bool bottomUp = height > 0;
+	uint32_t rows = uint32_t(bottomUp ? height : -height);
+	uint64_t stride = (uint64_t(width) * bitsPerPixel + 31) / 32 * 4;
+	// Divided rather than multiplied, so a corrupt header cannot wrap the size around in
+	// 32-bit builds.
+	if (offset > data.size() || stride > (data.size() - offset) / rows)
+		return RenderTexture();
+
+	std::vector<uint32_t> texels(size_t(width) * rows);
+	for (uint32_t y = 0; y < rows; ++y)
+	{
+		const unsigned char* row = reinterpret_cast<const unsigned char*>(data.data()) + offset
+			+ size_t(stride) * (bottomUp ? rows - 1 - y : y);
+		for (int32_t x = 0; x < width; ++x)
+		{
+			const unsigned char* bgr = row + x * (bitsPerPixel / 8);
+			texels[y * width + x] = bgr[2] | (bgr[1] << 8) | (bgr[0] << 16) | 0xff000000u;
+		}
+	}
+
+	return AddTexture(uint32_t(width), rows, texels.data());
+}
+
+RenderFont SoftwareRenderDevice::LoadFont(const char* fileName)
+{
+	std::vector<char> data;
+	if (!ReadFile(fileName, data) || data.size() < 12 || memcmp(data.data(), "DXTKfont", 8) != 0)
+		return RenderFont();
+
+	Font font;
+	uint32_t glyphCount = Read32(data, 8);
+	size_t offset = 12;
+	if (offset + size_t(glyphCount) * 32 + 32 > data.size())
+		return RenderFont();
+
+	for (uint32_t i = 0; i < glyphCount; ++i, offset += 32)
+	{
+		Glyph glyph;
+		glyph.Character = Read32(data, offset);
+		glyph.Left = int32_t(Read32(data, offset + 4));
+		glyph.Top = int32_t(Read32(data, offset + 8));
+		glyph.Right = int32_t(Read32(data, offset + 12));
+		glyph.Bottom = int32_t(Read32(data, offset + 16));
+		memcpy(&glyph.XOffset, data.data() + offset + 20, 4);
+		memcpy(&glyph.YOffset, data.data() + offset + 24, 4);
+		memcpy(&glyph.XAdvance, data.data() + offset + 28, 4);
+		font.Glyphs.push_back(glyph);
+	}
+	std::sort(font.Glyphs.begin(), font.Glyphs.end(), [](const Glyph& a, const Glyph& b)
+	{
+		return a.Character < b.Character;
+	});
+
+	memcpy(&font.LineSpacing, data.data() + offset, 4);
+	font.DefaultCharacter = Read32(data, offset + 4);
+	uint32_t width = Read32(data, offset + 8);
+	uint32_t height = Read32(data, offset + 12);
+	uint32_t format = Read32(data, offset + 16);
+	uint32_t stride = Read32(data, offset + 20);
+	uint32_t rows = Read32(data, offset + 24);
+	offset += 28;
+	if (width == 0 || height == 0 || offset + size_t(stride) * rows > data.size())
+		return RenderFont();
+
+	const unsigned char* source = reinterpret_cast<const unsigned char*>(data.data()) + offset;
+	std::vector<uint32_t> texels(size_t(width) * height);
+	switch (format)
+	{
+	case 28:	// DXGI_FORMAT_R8G8B8A8_UNORM
+	case 87:	// DXGI_FORMAT_B8G8R8A8_UNORM
+		if (rows < height || stride < width * 4)
+			return RenderFont();
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			memcpy(&texels[y * width], source + size_t(y) * stride, width * 4);
+			if (format == 87)
+			{
+				for (uint32_t x = 0; x < width; ++x)
+				{
+					uint32_t& t = texels[y * width + x];
+					t = (t & 0xff00ff00u) | ((t >> 16) & 0xff) | ((t & 0xff) << 16);
+				}
+			}
+		}
+		break;
+	case 74:	// DXGI_FORMAT_BC2_UNORM
+		if (rows < (height + 3) / 4 || stride < (width + 3) / 4 * 16)
+			return RenderFont();
+		DecodeBC2(source, width, height, stride, texels.data());
+		break;
+	default:
+		return RenderFont();
+	}
+
+	font.Texture = AddTexture(width, height, texels.data()).Id;
+
+	RenderFont handle;
+	handle.Id = AddObject(FontObject);
+	mFonts.push_back(std::move(font));
+	return handle;
+}
+
+RenderMesh SoftwareRenderDevice::AddMesh(const MeshVertex* vertices, size_t vertexCount, const uint16_t* indices, size_t indexCount)
+{
+	Mesh mesh;
+	mesh.Vertices.assign(vertices, vertices + vertexCount);
+	mesh.Indices.assign(indices, indices + indexCount - indexCount % 3);
+
+	RenderMesh handle;
+	handle.Id = AddObject(MeshObject);
+	mMeshes.push_back(std::move(mesh));
+	return handle;
+}
+
+RenderPipeline SoftwareRenderDevice::AddPipeline(const PipelineDesc& desc)
+{
+	Pipeline pipeline;
+	pipeline.Desc = desc;
+	memcpy(pipeline.View, c_identity, sizeof(c_identity));
+	memcpy(pipeline.Projection, c_identity, sizeof(c_identity));
+	memcpy(pipeline.World, c_identity, sizeof(c_identity));
+
+	RenderPipeline handle;
+	handle.Id = AddObject(PipelineObject);
+	mPipelines.push_back(pipeline);
+	return handle;
+}
+
+uint32_t SoftwareRenderDevice::GetWidth(RenderTexture texture)const
+{
+	return GetTexture(texture.Id).Width;
+}
+
+uint32_t SoftwareRenderDevice::GetHeight(RenderTexture texture)const
+{
+	return GetTexture(texture.Id).Height;
+}
+
+const uint32_t* SoftwareRenderDevice::GetPixels(RenderTexture texture)const
+{
+	const Texture& source = GetTexture(texture.Id);
+	if (source.Color.empty())
+		throw std::logic_error("not a color texture");
+	return source.Color.data();
+}
+
+bool SoftwareRenderDevice::SaveTGA(RenderTexture texture, const char* fileName)const
+{
+	const Texture& source = GetTexture(texture.Id);
+	if (source.Color.empty() || source.Width > 0xffff || source.Height > 0xffff)
+		return false;
+
+	// Uncompressed true color, 8 alpha bits, rows top to bottom.
+	unsigned char header[18] = {};
+	header[2] = 2;
+	header[12] = source.Width & 0xff;
+	header[13] = (source.Width >> 8) & 0xff;
+	header[14] = source.Height & 0xff;
+	header[15] = (source.Height >> 8) & 0xff;
+	header[16] = 32;
+	header[17] = 0x28;
+
+	std::vector<uint32_t> bgra(source.Color.size());
+	for (size_t i = 0; i < bgra.size(); ++i)
+	{
+		uint32_t c = source.Color[i];
+		bgra[i] = (c & 0xff00ff00u) | ((c >> 16) & 0xff) | ((c & 0xff) << 16);
+	}
+
+	std::ofstream file(fileName, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(bgra.data()), bgra.size() * sizeof(uint32_t));
+	return bool(file);
+}
+
+std::unique_ptr<ICommandAllocator> SoftwareRenderDevice::CreateAllocator()
+{
+	return std::make_unique<Allocator>();
+}
+
+std::unique_ptr<ICommandList> SoftwareRenderDevice::CreateList(ICommandAllocator& allocator)
+{
+	(void)allocator;
+	return std::make_unique<List>(*this);
+}
+
+void SoftwareRenderDevice::Execute(ICommandList* const* lists, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const List& list = static_cast<const List&>(*lists[i]);
+		if (list.mOpen)
+			throw std::logic_error("executing a command list that is still open");
+	}
+
+	for (size_t i = 0; i < count; ++i)
+		Replay(static_cast<const List&>(*lists[i]));
+	Flush();
+}
+
+uint64_t SoftwareRenderDevice::Signal()
+{
+	return ++mFence;
+}
+
+uint64_t SoftwareRenderDevice::GetCompletedFence()const
+{
+	return mFence;
+}
+
+void SoftwareRenderDevice::WaitForFence(uint64_t value)
+{
+	if (value > mFence)
+		throw std::logic_error("waiting for a fence value that was never signaled");
+}
+
+SoftwareRenderDevice::Stats SoftwareRenderDevice::GetStats()const
+{
+	return mStats;
+}
+
+void SoftwareRenderDevice::ResetStats()
+{
+	mStats = Stats();
+}
+
+// Lists start without targets or pipeline, like a freshly reset command list.
+void SoftwareRenderDevice::Replay(const List& list)
+{
+	Flush();
+	mColorTarget = nullptr;
+	mDepthTarget = nullptr;
+	uint32_t pipeline = 0;
+
+	for (const List::Command& command : list.mCommands)
+	{
+		const float* floats = list.mFloats.data() + command.Offset;
+
+		switch (command.Type)
+		{
+		case List::CommandType::SetRenderTargets:
+		{
+			Flush();
+			mColorTarget = &GetTexture(command.A);
+			mDepthTarget = command.B ? &GetTexture(command.B) : nullptr;
+			if (mColorTarget->Color.empty() || (mDepthTarget && mDepthTarget->Depth.empty()))
+				throw std::logic_error("render targets of the wrong kind");
+			if (mDepthTarget && (mDepthTarget->Width != mColorTarget->Width || mDepthTarget->Height != mColorTarget->Height))
+				throw std::logic_error("render targets of different sizes");
+			mViewportWidth = 0;
+			mViewportHeight = 0;
+			break;
+		}
+		case List::CommandType::SetViewport:
+		{
+			if (!mColorTarget)
+				throw std::logic_error("viewport without a render target");
+			SetViewport(command.A, command.B);
+			break;
+		}
+		case List::CommandType::ClearColor:
+		{
+			Flush();
+			Texture& target = GetTexture(command.A);
+			std::fill(target.Color.begin(), target.Color.end(), Pack(floats));
+			break;
+		}
+		case List::CommandType::ClearDepth:
+		{
+			Flush();
+			Texture& target = GetTexture(command.A);
+			std::fill(target.Depth.begin(), target.Depth.end(), floats[0]);
+			break;
+		}
+		case List::CommandType::SetPipeline:
+			GetPipeline(command.A);
+			pipeline = command.A;
+			break;
+		case List::CommandType::SetTexture:
+			GetTexture(command.A);
+			GetPipeline(pipeline).Texture = command.A;
+			break;
+		case List::CommandType::SetViewProjection:
+			memcpy(GetPipeline(pipeline).View, floats, 16 * sizeof(float));
+			memcpy(GetPipeline(pipeline).Projection, floats + 16, 16 * sizeof(float));
+			break;
+		case List::CommandType::SetWorld:
+			memcpy(GetPipeline(pipeline).World, floats, 16 * sizeof(float));
+			break;
+		case List::CommandType::DrawMesh:
+		{
+			if (mKinds.size() <= command.A || mKinds[command.A] != MeshObject)
+				throw std::logic_error("unknown mesh handle");
+			const Mesh& mesh = mMeshes[mIndices[command.A]];
+			const Pipeline& p = GetPipeline(pipeline);
+			uint32_t state = AddState(p.Desc, p.Texture);
+
+			float worldView[16], worldViewProjection[16];
+			Multiply(p.World, p.View, worldView);
+			Multiply(worldView, p.Projection, worldViewProjection);
+
+			mClipVertices.resize(mesh.Vertices.size());
+			for (size_t i = 0; i < mesh.Vertices.size(); ++i)
+			{
+				const MeshVertex& v = mesh.Vertices[i];
+				ClipVertex& out = mClipVertices[i];
+				const float position[4] = { v.Position[0], v.Position[1], v.Position[2], 1.0f };
+				Transform(position, worldViewProjection, out.Position);
+
+				// Normals go to world space with the world matrix, which has no scaling here.
+				const float normal[4] = { v.Normal[0], v.Normal[1], v.Normal[2], 0.0f };
+				float worldNormal[4];
+				Transform(normal, p.World, worldNormal);
+				out.Attributes[Red] = out.Attributes[Green] = out.Attributes[Blue] = out.Attributes[Alpha] = 1.0f;
+				out.Attributes[U] = v.TexCoord[0];
+				out.Attributes[V] = v.TexCoord[1];
+				out.Attributes[NormalX] = worldNormal[0];
+				out.Attributes[NormalY] = worldNormal[1];
+				out.Attributes[NormalZ] = worldNormal[2];
+			}
+
+			for (size_t i = 0; i < mesh.Indices.size(); i += 3)
+			{
+				const ClipVertex triangle[3] =
+				{
+					mClipVertices[mesh.Indices[i]], mClipVertices[mesh.Indices[i + 1]], mClipVertices[mesh.Indices[i + 2]]
+				};
+				BinTriangle(state, triangle);
+			}
+			break;
+		}
+		case List::CommandType::DrawLines:
+		{
+			const Pipeline& p = GetPipeline(pipeline);
+			uint32_t state = AddState(p.Desc, p.Texture);
+
+			float worldView[16], worldViewProjection[16];
+			Multiply(p.World, p.View, worldView);
+			Multiply(worldView, p.Projection, worldViewProjection);
+
+			for (uint32_t i = 0; i < command.A; i += 2)
+			{
+				ClipVertex line[2] = {};
+				for (int e = 0; e < 2; ++e)
+				{
+					const float* vertex = floats + (i + e) * 7;
+					const float position[4] = { vertex[0], vertex[1], vertex[2], 1.0f };
+					Transform(position, worldViewProjection, line[e].Position);
+					for (int c = 0; c < 4; ++c)
+						line[e].Attributes[Red + c] = vertex[3 + c];
+				}
+				BinLine(state, line);
+			}
+			break;
+		}
+		case List::CommandType::DrawSprite:
+		{
+			GetTexture(command.A);
+			PipelineDesc sprite;
+			sprite.Texture = true;
+			sprite.WrapTexture = false;
+			sprite.AlphaBlend = true;
+			sprite.DepthTest = false;
+			BinQuad(AddState(sprite, command.A), floats[0], floats[1], floats[2], floats[3], 0.0f, 0.0f, 1.0f, 1.0f);
+			break;
+		}
+		case List::CommandType::DrawString:
+		{
+			if (mKinds.size() <= command.A || mKinds[command.A] != FontObject)
+				throw std::logic_error("unknown font handle");
+			const Font& font = mFonts[mIndices[command.A]];
+			const Texture& atlas = GetTexture(font.Texture);
+			PipelineDesc text;
+			text.Texture = true;
+			text.WrapTexture = false;
+			text.AlphaBlend = true;
+			text.DepthTest = false;
+			uint32_t state = AddState(text, font.Texture);
+
+			// Glyph layout of SpriteFont::DrawString.
+			float x = 0.0f;
+			float y = 0.0f;
+			for (uint32_t i = 0; i < command.Count; ++i)
+			{
+				uint32_t character = static_cast<unsigned char>(list.mText[command.B + i]);
+				if (character == '\r')
+					continue;
+				if (character == '\n')
+				{
+					x = 0.0f;
+					y += font.LineSpacing;
+					continue;
+				}
+
+				auto find = [&font](uint32_t c)
+				{
+					auto glyph = std::lower_bound(font.Glyphs.begin(), font.Glyphs.end(), c,
+						[](const Glyph& g, uint32_t value) { return g.Character < value; });
+					return glyph != font.Glyphs.end() && glyph->Character == c ? &*glyph : nullptr;
+				};
+				const Glyph* glyph = find(character);
+				if (!glyph)
+					glyph = find(font.DefaultCharacter);
+				if (!glyph)
+					continue;
+
+				x = std::max(x + glyph->XOffset, 0.0f);
+				float width = float(glyph->Right - glyph->Left);
+				float height = float(glyph->Bottom - glyph->Top);
+				// Like SpriteFont, only whitespace without any pixels is skipped.
+				if (!iswspace(wint_t(character)) || width > 1.0f || height > 1.0f)
+				{
+					float left = floats[0] + x;
+					float top = floats[1] + y + glyph->YOffset;
+					BinQuad(state, left, top, left + width, top + height,
+						float(glyph->Left) / atlas.Width, float(glyph->Top) / atlas.Height,
+						float(glyph->Right) / atlas.Width, float(glyph->Bottom) / atlas.Height);
+				}
+				x += width + glyph->XAdvance;
+			}
+			break;
+		}
+		case List::CommandType::Resolve:
+		case List::CommandType::Copy:
+		{
+			Flush();
+			Texture& dest = GetTexture(command.A);
+			const Texture& source = GetTexture(command.B);
+			if (dest.Width != source.Width || dest.Height != source.Height || dest.Color.empty() != source.Color.empty())
+				throw std::logic_error("copy between textures of different sizes or kinds");
+			dest.Color = source.Color;
+			dest.Depth = source.Depth;
+			break;
+		}
+		case List::CommandType::Upscale:
+		{
+			// Binds the destination alone with a viewport of its size, like the D3D12 backend.
+			Flush();
+			mColorTarget = &GetTexture(command.A);
+			mDepthTarget = nullptr;
+			const Texture& source = GetTexture(command.B);
+			if (mColorTarget->Color.empty() || source.Color.empty())
+				throw std::logic_error("upscale between textures of the wrong kind");
+			if (floats[0] > float(source.Width) || floats[1] > float(source.Height))
+				throw std::logic_error("upscale source rectangle larger than the texture");
+			SetViewport(mColorTarget->Width, mColorTarget->Height);
+
+			PipelineDesc stretch;
+			stretch.Texture = true;
+			stretch.WrapTexture = false;
+			stretch.DepthTest = false;
+			BinQuad(AddState(stretch, command.B), 0.0f, 0.0f, float(mColorTarget->Width), float(mColorTarget->Height),
+				0.0f, 0.0f, floats[0] / source.Width, floats[1] / source.Height);
+			break;
+		}
+		}
+	}
+}
+
+void SoftwareRenderDevice::SetViewport(uint32_t width, uint32_t height)
+{
+	Flush();
+	mViewportWidth = std::min(width, mColorTarget->Width);
+	mViewportHeight = std::min(height, mColorTarget->Height);
+	mTilesX = (mViewportWidth + TileSize - 1) / TileSize;
+	mTilesY = (mViewportHeight + TileSize - 1) / TileSize;
+	mBins.resize(size_t(mTilesX) * mTilesY);
+}
+
+uint32_t SoftwareRenderDevice::AddState(const PipelineDesc& desc, uint32_t texture)
+{
+	if (!mColorTarget || mViewportWidth == 0 || mViewportHeight == 0)
+		throw std::logic_error("drawing without a render target and viewport");
+	if (desc.Texture && !texture)
+		throw std::logic_error("drawing with a textured pipeline without a texture");
+
+	DrawState state;
+	state.Desc = desc;
+	state.Source = desc.Texture ? &GetTexture(texture) : nullptr;
+	if (desc.DepthTest && !mDepthTarget)
+		state.Desc.DepthTest = false;
+
+	mStates.push_back(state);
+	return uint32_t(mStates.size() - 1);
+}
+
+// Clips against the near plane (z >= 0 in clip space), then fans the polygon.
+void SoftwareRenderDevice::BinTriangle(uint32_t state, const ClipVertex* vertices)
+{
+	ClipVertex polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		const ClipVertex& a = vertices[i];
+		const ClipVertex& b = vertices[(i + 1) % 3];
+		bool aInside = a.Position[2] >= 0.0f;
+		bool bInside = b.Position[2] >= 0.0f;
+
+		if (aInside)
+			polygon[count++] = a;
+		if (aInside != bInside)
+		{
+			float t = a.Position[2] / (a.Position[2] - b.Position[2]);
+			ClipVertex& v = polygon[count++];
+			for (int c = 0; c < 4; ++c)
+				v.Position[c] = a.Position[c] + (b.Position[c] - a.Position[c]) * t;
+			for (int c = 0; c < AttributeCount; ++c)
+				v.Attributes[c] = a.Attributes[c] + (b.Attributes[c] - a.Attributes[c]) * t;
+		}
+	}
+	if (count < 3)
+		return;
+
+	ScreenVertex screen[4];
+	for (int i = 0; i < count; ++i)
+	{
+		const ClipVertex& v = polygon[i];
+		if (v.Position[3] <= 0.0f)
+			return;
+		float invW = 1.0f / v.Position[3];
+		screen[i].X = (v.Position[0] * invW + 1.0f) * 0.5f * float(mViewportWidth);
+		screen[i].Y = (1.0f - v.Position[1] * invW) * 0.5f * float(mViewportHeight);
+		screen[i].Z = v.Position[2] * invW;
+		screen[i].InvW = invW;
+		for (int c = 0; c < AttributeCount; ++c)
+			screen[i].Attributes[c] = v.Attributes[c] * invW;
+	}
+
+	for (int i = 1; i + 1 < count; ++i)
+	{
+		const ScreenVertex triangle[3] = { screen[0], screen[i], screen[i + 1] };
+		Primitive primitive;
+		primitive.State = state;
+		primitive.Line = false;
+		AddPrimitive(primitive, triangle, 3);
+	}
+}
+
+void SoftwareRenderDevice::BinLine(uint32_t state, const ClipVertex* vertices)
+{
+	ClipVertex a = vertices[0];
+	ClipVertex b = vertices[1];
+	if (a.Position[2] < 0.0f && b.Position[2] < 0.0f)
+		return;
+	if (a.Position[2] < 0.0f || b.Position[2] < 0.0f)
+	{
+		ClipVertex& outside = a.Position[2] < 0.0f ? a : b;
+		const ClipVertex& inside = a.Position[2] < 0.0f ? b : a;
+		float t = inside.Position[2] / (inside.Position[2] - outside.Position[2]);
+		for (int c = 0; c < 4; ++c)
+			outside.Position[c] = inside.Position[c] + (outside.Position[c] - inside.Position[c]) * t;
+		for (int c = 0; c < AttributeCount; ++c)
+			outside.Attributes[c] = inside.Attributes[c] + (outside.Attributes[c] - inside.Attributes[c]) * t;
+	}
+
+	// Lines interpolate linearly in screen space.
+	ScreenVertex screen[2];
+	const ClipVertex* ends[2] = { &a, &b };
+	for (int i = 0; i < 2; ++i)
+	{
+		const ClipVertex& v = *ends[i];
+		if (v.Position[3] <= 0.0f)
+			return;
+		float invW = 1.0f / v.Position[3];
+		screen[i].X = (v.Position[0] * invW + 1.0f) * 0.5f * float(mViewportWidth);
+		screen[i].Y = (1.0f - v.Position[1] * invW) * 0.5f * float(mViewportHeight);
+		screen[i].Z = v.Position[2] * invW;
+		screen[i].InvW = 1.0f;
+		memcpy(screen[i].Attributes, v.Attributes, sizeof(v.Attributes));
+	}
+
+	Primitive primitive;
+	primitive.State = state;
+	primitive.Line = true;
+	AddPrimitive(primitive, screen, 2);
+}
+
+// Screen space rectangle as two triangles, white and at depth 0.
+void SoftwareRenderDevice::BinQuad(uint32_t state, float left, float top, float right, float bottom,
+	float u0, float v0, float u1, float v1)
+{
+	const float corners[4][4] =
+	{
+		{ left, top, u0, v0 }, { right, top, u1, v0 }, { right, bottom, u1, v1 }, { left, bottom, u0, v1 }
+	};
+
+	ScreenVertex quad[4] = {};
+	for (int i = 0; i < 4; ++i)
+	{
+		quad[i].X = corners[i][0];
+		quad[i].Y = corners[i][1];
+		quad[i].Z = 0.0f;
+		quad[i].InvW = 1.0f;
+		quad[i].Attributes[Red] = quad[i].Attributes[Green] = quad[i].Attributes[Blue] = quad[i].Attributes[Alpha] = 1.0f;
+		quad[i].Attributes[U] = corners[i][2];
+		quad[i].Attributes[V] = corners[i][3];
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		const ScreenVertex triangle[3] = { quad[0], quad[1 + i], quad[2 + i] };
+		Primitive primitive;
+		primitive.State = state;
+		primitive.Line = false;
+		AddPrimitive(primitive, triangle, 3);
+	}
+}
+
+// Sets up the edge functions and bounds and adds the primitive to the bins it touches.
+void SoftwareRenderDevice::AddPrimitive(Primitive& primitive, const ScreenVertex* vertices, size_t vertexCount)
+{
+	float minX = vertices[0].X, maxX = vertices[0].X;
+	float minY = vertices[0].Y, maxY = vertices[0].Y;
+	for (size_t i = 1; i < vertexCount; ++i)
+	{
+		minX = std::min(minX, vertices[i].X);
+		maxX = std::max(maxX, vertices[i].X);
+		minY = std::min(minY, vertices[i].Y);
+		maxY = std::max(maxY, vertices[i].Y);
+	}
+
+	// Also drops NaNs, which fail every comparison.
+	if (!(maxX >= 0.0f && maxY >= 0.0f && minX < float(mViewportWidth) && minY < float(mViewportHeight)))
+		return;
+	primitive.MinX = int(std::max(minX, 0.0f));
+	primitive.MinY = int(std::max(minY, 0.0f));
+	primitive.MaxX = int(std::min(maxX, float(mViewportWidth - 1)));
+	primitive.MaxY = int(std::min(maxY, float(mViewportHeight - 1)));
+
+	if (!primitive.Line)
+	{
+		const ScreenVertex& v0 = vertices[0];
+		const ScreenVertex& v1 = vertices[1];
+		const ScreenVertex& v2 = vertices[2];
+		float area = (v1.X - v0.X) * (v2.Y - v0.Y) - (v2.X - v0.X) * (v1.Y - v0.Y);
+		if (!(area != 0.0f))
+			return;
+
+		// Edge i runs between the other two vertices. The same edge of a neighbouring
+		// triangle has exactly the negated coefficients, so the tie rule below puts pixels
+		// on the shared edge into exactly one of the two.
+		float sign = area > 0.0f ? 1.0f : -1.0f;
+		primitive.Inclusive = 0;
+		for (int e = 0; e < 3; ++e)
+		{
+			const ScreenVertex& a = vertices[(e + 1) % 3];
+			const ScreenVertex& b = vertices[(e + 2) % 3];
+			primitive.A[e] = sign * (a.Y - b.Y);
+			primitive.B[e] = sign * (b.X - a.X);
+			primitive.C[e] = sign * (a.X * b.Y - a.Y * b.X);
+			if (primitive.A[e] > 0.0f || (primitive.A[e] == 0.0f && primitive.B[e] > 0.0f))
+				primitive.Inclusive |= 1u << e;
+		}
+		primitive.InvArea = 1.0f / (area * sign);
+		mStats.Triangles++;
+	}
+	else
+	{
+		mStats.Lines++;
+	}
+
+	primitive.Vertex = uint32_t(mVertices.size());
+	mVertices.insert(mVertices.end(), vertices, vertices + vertexCount);
+
+	uint32_t index = uint32_t(mPrimitives.size());
+	mPrimitives.push_back(primitive);
+
+	uint32_t tileX0 = uint32_t(primitive.MinX) / TileSize, tileX1 = uint32_t(primitive.MaxX) / TileSize;
+	uint32_t tileY0 = uint32_t(primitive.MinY) / TileSize, tileY1 = uint32_t(primitive.MaxY) / TileSize;
+	for (uint32_t ty = tileY0; ty <= tileY1; ++ty)
+	{
+		for (uint32_t tx = tileX0; tx <= tileX1; ++tx)
+			mBins[ty * mTilesX + tx].push_back(index);
+	}
+	mStats.BinnedPrimitives += uint64_t(tileX1 - tileX0 + 1) * (tileY1 - tileY0 + 1);
+}
+
+void SoftwareRenderDevice::Flush()
+{
+	if (mPrimitives.empty())
+	{
+		mStates.clear();
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	size_t tileCount = size_t(mTilesX) * mTilesY;
+	mTilePixels.assign(tileCount, 0);
+	auto rasterizeTile = [this](size_t tile)
+	{
+		RasterizeTile(uint32_t(tile));
+	};
+	if (mJobs)
+		mJobs->ParallelFor(0, tileCount, 1, rasterizeTile);
+	else
+		for (size_t tile = 0; tile < tileCount; ++tile)
+			rasterizeTile(tile);
+
+	mStats.RasterSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	for (uint64_t pixels : mTilePixels)
+		mStats.Pixels += pixels;
+
+	for (auto& bin : mBins)
+		bin.clear();
+	mPrimitives.clear();
+	mVertices.clear();
+	mStates.clear();
+}
+
+void SoftwareRenderDevice::RasterizeTile(uint32_t tile)
+{
+	const int tileX0 = int(tile % mTilesX * TileSize);
+	const int tileY0 = int(tile / mTilesX * TileSize);
+	const int tileX1 = std::min(tileX0 + int(TileSize), int(mViewportWidth)) - 1;
+	const int tileY1 = std::min(tileY0 + int(TileSize), int(mViewportHeight)) - 1;
+
+	uint64_t pixels = 0;
+	for (uint32_t index : mBins[tile])
+	{
+		const Primitive& primitive = mPrimitives[index];
+		int x0 = std::max(tileX0, primitive.MinX);
+		int y0 = std::max(tileY0, primitive.MinY);
+		int x1 = std::min(tileX1, primitive.MaxX);
+		int y1 = std::min(tileY1, primitive.MaxY);
+		if (x0 > x1 || y0 > y1)
+			continue;
+
+		if (primitive.Line)
+			RasterizeLine(primitive, x0, y0, x1, y1, pixels);
+		else
+			RasterizeTriangle(primitive, x0, y0, x1, y1, pixels);
+	}
+	mTilePixels[tile] = pixels;
+}
+
+namespace
+{
+	// Vertex color, texture and the per pixel diffuse term of BasicEffect, then the
+	// output merger. Attributes are already perspective divided.
+	void ShadePixel(const SoftwareRenderDevice::PipelineDesc& desc, const uint32_t* texels, uint32_t width, uint32_t height,
+		const float* attributes, uint32_t& target)
+	{
+		float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		if (desc.VertexColor)
+		{
+			for (int c = 0; c < 4; ++c)
+				color[c] = attributes[c];
+		}
+		if (desc.Texture)
+		{
+			float texel[4];
+			Sample(texels, width, height, attributes[4], attributes[5], desc.WrapTexture, texel);
+			for (int c = 0; c < 4; ++c)
+				color[c] *= texel[c];
+		}
+		if (desc.Lighting)
+		{
+			float nx = attributes[6], ny = attributes[7], nz = attributes[8];
+			float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+			float dotL = 0.0f;
+			if (length > 0.0f)
+			{
+				dotL = -(nx * desc.LightDirection[0] + ny * desc.LightDirection[1] + nz * desc.LightDirection[2]) / length;
+			}
+			float diffuse = std::max(dotL, 0.0f);
+			for (int c = 0; c < 3; ++c)
+				color[c] *= diffuse;
+		}
+		if (desc.AlphaBlend)
+		{
+			float dest[4];
+			Unpack(target, dest);
+			for (int c = 0; c < 4; ++c)
+				color[c] += dest[c] * (1.0f - color[3]);
+		}
+		target = Pack(color);
+	}
+}
+
+void SoftwareRenderDevice::RasterizeTriangle(const Primitive& primitive, int x0, int y0, int x1, int y1, uint64_t& pixels)
+{
+	const DrawState& state = mStates[primitive.State];
+	const ScreenVertex* v = &mVertices[primitive.Vertex];
+	const uint32_t width = mColorTarget->Width;
+	uint32_t* color = mColorTarget->Color.data();
+	float* depth = state.Desc.DepthTest ? mDepthTarget->Depth.data() : nullptr;
+	const uint32_t* texels = state.Source ? state.Source->Color.data() : nullptr;
+	const uint32_t texelWidth = state.Source ? state.Source->Width : 0;
+	const uint32_t texelHeight = state.Source ? state.Source->Height : 0;
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 end = _mm_set1_ps(float(x1 + 1));
+	const __m128 invArea = _mm_set1_ps(primitive.InvArea);
+
+	__m128 a[3], inclusive[3];
+	for (int e = 0; e < 3; ++e)
+	{
+		a[e] = _mm_set1_ps(primitive.A[e]);
+		inclusive[e] = _mm_castsi128_ps(_mm_set1_epi32((primitive.Inclusive >> e) & 1 ? -1 : 0));
+	}
+	const __m128 z0 = _mm_set1_ps(v[0].Z), z1 = _mm_set1_ps(v[1].Z), z2 = _mm_set1_ps(v[2].Z);
+	const __m128 w0 = _mm_set1_ps(v[0].InvW), w1 = _mm_set1_ps(v[1].InvW), w2 = _mm_set1_ps(v[2].InvW);
+
+	alignas(16) float weights[3][4];
+	alignas(16) float depths[4];
+	alignas(16) float invWs[4];
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		float py = float(y) + 0.5f;
+		__m128 row[3];
+		for (int e = 0; e < 3; ++e)
+			row[e] = _mm_set1_ps(primitive.B[e] * py + primitive.C[e]);
+
+		// Four pixels at a time from the 4 aligned column at or left of x0.
+		for (int x = x0 & ~3; x <= x1; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+
+			__m128 edge[3];
+			__m128 inside = _mm_and_ps(_mm_cmplt_ps(px, end), _mm_cmpge_ps(px, _mm_set1_ps(float(x0))));
+			for (int e = 0; e < 3; ++e)
+			{
+				edge[e] = _mm_add_ps(_mm_mul_ps(a[e], px), row[e]);
+				__m128 onEdge = _mm_and_ps(_mm_cmpeq_ps(edge[e], zero), inclusive[e]);
+				inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(edge[e], zero), onEdge));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			if (mask == 0)
+				continue;
+
+			__m128 l0 = _mm_mul_ps(edge[0], invArea);
+			__m128 l1 = _mm_mul_ps(edge[1], invArea);
+			__m128 l2 = _mm_mul_ps(edge[2], invArea);
+			__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, z0), _mm_mul_ps(l1, z1)), _mm_mul_ps(l2, z2));
+			__m128 invW = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l0, w0), _mm_mul_ps(l1, w1)), _mm_mul_ps(l2, w2));
+			_mm_store_ps(weights[0], l0);
+			_mm_store_ps(weights[1], l1);
+			_mm_store_ps(weights[2], l2);
+			_mm_store_ps(depths, z);
+			_mm_store_ps(invWs, invW);
+
+			for (; mask; mask &= mask - 1)
+			{
+				int lane = 0;
+				while (!((mask >> lane) & 1))
+					++lane;
+				size_t index = size_t(y) * width + size_t(x + lane);
+
+				if (depth)
+				{
+					if (!(depths[lane] <= depth[index]))
+						continue;
+					depth[index] = depths[lane];
+				}
+
+				float attributes[AttributeCount];
+				float w = 1.0f / invWs[lane];
+				for (int c = 0; c < AttributeCount; ++c)
+				{
+					attributes[c] = (weights[0][lane] * v[0].Attributes[c] + weights[1][lane] * v[1].Attributes[c]
+						+ weights[2][lane] * v[2].Attributes[c]) * w;
+				}
+
+				ShadePixel(state.Desc, texels, texelWidth, texelHeight, attributes, color[index]);
+				++pixels;
+			}
+		}
+	}
+}
+
+// One pixel per step along the major axis, leaving out the last pixel like a line strip
+// would. Only the steps that land in the tile are walked.
+void SoftwareRenderDevice::RasterizeLine(const Primitive& primitive, int x0, int y0, int x1, int y1, uint64_t& pixels)
+{
+	const DrawState& state = mStates[primitive.State];
+	const ScreenVertex& a = mVertices[primitive.Vertex];
+	const ScreenVertex& b = mVertices[primitive.Vertex + 1];
+	const uint32_t width = mColorTarget->Width;
+	uint32_t* color = mColorTarget->Color.data();
+	float* depth = state.Desc.DepthTest ? mDepthTarget->Depth.data() : nullptr;
+	const uint32_t* texels = state.Source ? state.Source->Color.data() : nullptr;
+	const uint32_t texelWidth = state.Source ? state.Source->Width : 0;
+	const uint32_t texelHeight = state.Source ? state.Source->Height : 0;
+
+	float dx = b.X - a.X;
+	float dy = b.Y - a.Y;
+	bool xMajor = std::abs(dx) >= std::abs(dy);
+	int steps = int(std::ceil(std::max(std::abs(dx), std::abs(dy))));
+	if (steps == 0)
+		return;
+
+	// Steps whose major coordinate can fall into [low, high].
+	float major = xMajor ? a.X : a.Y;
+	float delta = (xMajor ? dx : dy) / float(steps);
+	float low = float(xMajor ? x0 : y0);
+	float high = float(xMajor ? x1 + 1 : y1 + 1);
+	float t0 = (low - major) / delta;
+	float t1 = (high - major) / delta;
+	int first = std::max(0, int(std::floor(std::min(t0, t1))) - 1);
+	int last = std::min(steps - 1, int(std::ceil(std::max(t0, t1))) + 1);
+
+	for (int i = first; i <= last; ++i)
+	{
+		float t = float(i) / float(steps);
+		int x = int(std::floor(a.X + dx * t));
+		int y = int(std::floor(a.Y + dy * t));
+		if (x < x0 || x > x1 || y < y0 || y > y1)
+			continue;
+		size_t index = size_t(y) * width + size_t(x);
+
+		if (depth)
+		{
+			float z = a.Z + (b.Z - a.Z) * t;
+			if (!(z <= depth[index]))
+				continue;
+			depth[index] = z;
+		}
+
+		float attributes[AttributeCount];
+		for (int c = 0; c < AttributeCount; ++c)
+			attributes[c] = a.Attributes[c] + (b.Attributes[c] - a.Attributes[c]) * t;
+
+		ShadePixel(state.Desc, texels, texelWidth, texelHeight, attributes, color[index]);
+		++pixels;
+	}
+}
+
+SoftwareRenderDevice::Texture& SoftwareRenderDevice::GetTexture(uint32_t id)
+{
+	if (id >= mKinds.size() || mKinds[id] != TextureObject)
+		throw std::logic_error("unknown texture handle");
+	return mTextures[mIndices[id]];
+}
+
+const SoftwareRenderDevice::Texture& SoftwareRenderDevice::GetTexture(uint32_t id)const
+{
+	if (id >= mKinds.size() || mKinds[id] != TextureObject)
+		throw std::logic_error("unknown texture handle");
+	return mTextures[mIndices[id]];
+}
+
+SoftwareRenderDevice::Pipeline& SoftwareRenderDevice::GetPipeline(uint32_t id)
+{
+	if (id >= mKinds.size() || mKinds[id] != PipelineObject)
+		throw std::logic_error("unknown pipeline handle");
+	return mPipelines[mIndices[id]];
+}
+
+uint32_t SoftwareRenderDevice::AddObject(char kind)
+{
+	size_t index = 0;
+	switch (kind)
+	{
+	case TextureObject:		index = mTextures.size(); break;
+	case MeshObject:		index = mMeshes.size(); break;
+	case PipelineObject:	index = mPipelines.size(); break;
+	default:				index = mFonts.size(); break;
+	}
+	mKinds.push_back(kind);
+	mIndices.push_back(uint32_t(index));
+	return uint32_t(mKinds.size() - 1);
+}
@@ -0,0 +1,292 @@
+//
+// SoftwareRenderDevice.h - Render backend that rasterizes on the CPU
+//
+
+#pragma once
+
+#include "RenderDevice.h"
+
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+// Draws the render command stream into CPU textures, for seeing the scene without a
+// Direct3D 12 GPU and for comparing images between runs.
+//
+// Lists only record. Execute replays them in order on the calling thread: draws are
+// transformed, clipped against the near plane and binned into TileSize square screen
+// tiles, and every tile is then rasterized as its own job with SSE edge functions, four
+// pixels at a time. Tiles keep the submission order of their primitives, so the image
+// does not depend on the number of threads. Bins are flushed at the end of Execute and
+// before clears, resolves, copies and render target changes. Execute finishes the work
+// before it returns, so fences complete when they are signaled.
+//
+// Covered are the features the scene uses: the DirectXTK BasicEffect variants for
+// vertex colored lines and lit textured meshes (one directional light, per pixel),
+// premultiplied alpha blending, less-equal depth testing, sprites and SpriteFont text.
+// Render targets have one sample, so resolving is a copy; lines are one pixel wide.
+// Colors are RGBA8 with red in the low byte.
+class SoftwareRenderDevice : public IRenderDevice
+{
+public:
+	static const uint32_t TileSize = 64;
+
+	class Allocator : public ICommandAllocator
+	{
+	public:
+		void Reset() override;
+	};
+
+	class List : public IRenderCommandList
+	{
+	public:
+		explicit List(SoftwareRenderDevice& device);
+
+		void Reset(ICommandAllocator& allocator) override;
+		void Close() override;
+
+		void Transition(RenderTexture texture, ResourceState after) override;
+		void BeginTransition(RenderTexture texture, ResourceState after) override;
+		void SetRenderTargets(RenderTexture color, RenderTexture depth) override;
+		void SetViewport(uint32_t width, uint32_t height) override;
+		void ClearColor(RenderTexture target, const float color[4]) override;
+		void ClearDepth(RenderTexture target, float depth) override;
+		void SetPipeline(RenderPipeline pipeline) override;
+		void SetTexture(RenderTexture texture) override;
+		void SetViewProjection(const float view[16], const float projection[16]) override;
+		void SetWorld(const float world[16]) override;
+		void DrawMesh(RenderMesh mesh) override;
+		void DrawLines(const RenderVertex* vertices, size_t vertexCount) override;
+		void DrawSprite(RenderTexture texture, float left, float top, float right, float bottom) override;
+		void DrawString(RenderFont font, const char* text, float x, float y) override;
+		void Resolve(RenderTexture dest, RenderTexture source) override;
+		void Copy(RenderTexture dest, RenderTexture source) override;
+		void Upscale(RenderTexture dest, RenderTexture source, uint32_t sourceWidth, uint32_t sourceHeight) override;
+
+	private:
+		friend class SoftwareRenderDevice;
+
+		enum class CommandType : uint8_t
+		{
+			SetRenderTargets,
+			SetViewport,
+			ClearColor,
+			ClearDepth,
+			SetPipeline,
+			SetTexture,
+			SetViewProjection,
+			SetWorld,
+			DrawMesh,
+			DrawLines,
+			DrawSprite,
+			DrawString,
+			Resolve,
+			Copy,
+			Upscale
+		};
+
+		// A and B are handles or sizes; Offset and Count locate the command's floats in
+		// mFloats, or its characters in mText for DrawString.
+		struct Command
+		{
+			CommandType Type;
+			uint32_t A;
+			uint32_t B;
+			uint32_t Offset;
+			uint32_t Count;
+		};
+
+		void Record(CommandType type, uint32_t a, uint32_t b, const float* floats = nullptr, size_t count = 0);
+		void RequireOpen()const;
+
+		SoftwareRenderDevice& mDevice;
+		bool mOpen;
+		std::vector<Command> mCommands;
+		std::vector<float> mFloats;
+		std::string mText;
+	};
+
+	// Layout of DirectX::VertexPositionNormalTexture.
+	struct MeshVertex
+	{
+		float Position[3];
+		float Normal[3];
+		float TexCoord[2];
+	};
+
+	// The BasicEffect and CommonStates settings a pipeline stands for.
+	struct PipelineDesc
+	{
+		bool VertexColor = false;
+		bool Texture = false;
+		bool WrapTexture = true;		// otherwise clamp
+		bool Lighting = false;
+		float LightDirection[3] = { 0.0f, -1.0f, 0.0f };	// used as given, like BasicEffect
+		bool AlphaBlend = false;		// premultiplied
+		bool DepthTest = true;			// less-equal, with depth writes
+	};
+
+	explicit SoftwareRenderDevice(JobSystem* jobs = nullptr);
+
+	// Tile jobs; without a job system every tile is rasterized on the calling thread.
+	void SetJobSystem(JobSystem* jobs);
+
+	// A color texture, black when pixels is null, or a depth texture cleared to 1.
+	RenderTexture AddTexture(uint32_t width, uint32_t height, const uint32_t* pixels = nullptr);
+	RenderTexture AddDepthTexture(uint32_t width, uint32_t height);
+	// Uncompressed 24 or 32 bit BMP files and DirectXTK .spritefont files with RGBA8 or
+	// BC2 textures; a null handle if the file can't be read.
+	RenderTexture LoadTexture(const char* fileName);
+	RenderFont LoadFont(const char* fileName);
+	RenderMesh AddMesh(const MeshVertex* vertices, size_t vertexCount, const uint16_t* indices, size_t indexCount);
+	RenderPipeline AddPipeline(const PipelineDesc& desc);
+
+	uint32_t GetWidth(RenderTexture texture)const;
+	uint32_t GetHeight(RenderTexture texture)const;
+	// Rows of a color texture, top to bottom.
+	const uint32_t* GetPixels(RenderTexture texture)const;
+	// Uncompressed 32 bit TGA of a color texture. Returns false if it can't be written.
+	bool SaveTGA(RenderTexture texture, const char* fileName)const;
+
+	std::unique_ptr<ICommandAllocator> CreateAllocator() override;
+	std::unique_ptr<ICommandList> CreateList(ICommandAllocator& allocator) override;
+
+	void Execute(ICommandList* const* lists, size_t count) override;
+	uint64_t Signal() override;
+	uint64_t GetCompletedFence()const override;
+	void WaitForFence(uint64_t value) override;
+
+	// Counters of the executed work since the last ResetStats.
+	struct Stats
+	{
+		uint64_t Triangles = 0;		// after near plane clipping, including sprite and glyph quads
+		uint64_t Lines = 0;
+		uint64_t Pixels = 0;		// pixels written by draws, after the depth test
+		uint64_t BinnedPrimitives = 0;	// primitive and tile pairs
+		double RasterSeconds = 0.0;	// time spent in the tile jobs, wall clock
+	};
+	Stats GetStats()const;
+	void ResetStats();
+
+private:
+	struct Texture
+	{
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		std::vector<uint32_t> Color;
+		std::vector<float> Depth;
+	};
+
+	struct Mesh
+	{
+		std::vector<MeshVertex> Vertices;
+		std::vector<uint16_t> Indices;
+	};
+
+	// Settings and the transforms and texture set on a pipeline, kept across lists like
+	// the state of an effect.
+	struct Pipeline
+	{
+		PipelineDesc Desc;
+		uint32_t Texture = 0;
+		float View[16];
+		float Projection[16];
+		float World[16];
+	};
+
+	struct Glyph
+	{
+		uint32_t Character;
+		int32_t Left, Top, Right, Bottom;
+		float XOffset, YOffset, XAdvance;
+	};
+
+	struct Font
+	{
+		std::vector<Glyph> Glyphs;		// sorted by character
+		float LineSpacing = 0.0f;
+		uint32_t DefaultCharacter = 0;
+		uint32_t Texture = 0;
+	};
+
+	// Shading of a primitive: the pipeline settings and texture it was drawn with.
+	struct DrawState
+	{
+		PipelineDesc Desc;
+		const Texture* Source = nullptr;
+	};
+
+	// Screen position and attributes; for triangles the attributes are divided by w
+	// for perspective correct interpolation.
+	enum Attribute { Red, Green, Blue, Alpha, U, V, NormalX, NormalY, NormalZ, AttributeCount };
+	struct ScreenVertex
+	{
+		float X, Y, Z, InvW;
+		float Attributes[AttributeCount];
+	};
+
+	struct Primitive
+	{
+		uint32_t State;
+		uint32_t Vertex;			// first of three for triangles, two for lines
+		bool Line;
+		float A[3], B[3], C[3];		// edge i, opposite vertex i, positive inside
+		uint32_t Inclusive;			// bit i: pixels exactly on edge i are inside
+		float InvArea;
+		int MinX, MinY, MaxX, MaxY;	// inclusive pixel bounds within the viewport
+	};
+
+	// Clip space vertex before the near plane clip and the perspective divide.
+	struct ClipVertex
+	{
+		float Position[4];
+		float Attributes[AttributeCount];
+	};
+
+	void Replay(const List& list);
+	// Of the bound color target; flushes the primitives binned for the old viewport first.
+	void SetViewport(uint32_t width, uint32_t height);
+	uint32_t AddState(const PipelineDesc& desc, uint32_t texture);
+	void BinTriangle(uint32_t state, const ClipVertex* vertices);
+	void BinLine(uint32_t state, const ClipVertex* vertices);
+	void BinQuad(uint32_t state, float left, float top, float right, float bottom,
+		float u0, float v0, float u1, float v1);
+	void AddPrimitive(Primitive& primitive, const ScreenVertex* vertices, size_t vertexCount);
+	void Flush();
+	void RasterizeTile(uint32_t tile);
+	void RasterizeTriangle(const Primitive& primitive, int x0, int y0, int x1, int y1, uint64_t& pixels);
+	void RasterizeLine(const Primitive& primitive, int x0, int y0, int x1, int y1, uint64_t& pixels);
+
+	Texture& GetTexture(uint32_t id);
+	const Texture& GetTexture(uint32_t id)const;
+	Pipeline& GetPipeline(uint32_t id);
+	uint32_t AddObject(char kind);
+
+	JobSystem* mJobs;
+	uint64_t mFence;
+
+	// Objects by handle id; all kinds share the ids, mKinds tells them apart.
+	std::vector<char> mKinds{ 0 };
+	std::vector<uint32_t> mIndices{ 0 };		// index into the vector of the kind
+	std::vector<Texture> mTextures;
+	std::vector<Mesh> mMeshes;
+	std::vector<Pipeline> mPipelines;
+	std::vector<Font> mFonts;
+
+	// Replay state, only used by Execute.
+	Texture* mColorTarget;
+	Texture* mDepthTarget;
+	uint32_t mViewportWidth;
+	uint32_t mViewportHeight;
+	uint32_t mTilesX;
+	uint32_t mTilesY;
+	std::vector<DrawState> mStates;
+	std::vector<ScreenVertex> mVertices;
+	std::vector<Primitive> mPrimitives;
+	std::vector<std::vector<uint32_t>> mBins;
+	std::vector<uint64_t> mTilePixels;
+	std::vector<ClipVertex> mClipVertices;
+
+	Stats mStats;
+};
@@ -0,0 +1,283 @@
+//
+// SoftwareRenderDeviceTests.cpp
+//
+
+#include "CommandListPool.h"
+#include "JobSystem.h"
+#include "SelfTest.h"
+#include "SoftwareRenderBenchmark.h"
+#include "SoftwareRenderDevice.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const uint32_t c_red = 0xff0000ffu;
+	const uint32_t c_green = 0xff00ff00u;
+	const uint32_t c_blue = 0xffff0000u;
+
+	void Identity(float m[16])
+	{
+		for (int i = 0; i < 16; ++i)
+			m[i] = i % 5 == 0 ? 1.0f : 0.0f;
+	}
+
+	// A quad in clip space from (left, bottom) to (right, top) at depth z, drawn with
+	// identity transforms.
+	RenderMesh AddQuad(SoftwareRenderDevice& device, float left, float bottom, float right, float top, float z)
+	{
+		const SoftwareRenderDevice::MeshVertex vertices[4] =
+		{
+			{ { left, bottom, z }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f } },
+			{ { left, top, z }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 0.0f } },
+			{ { right, top, z }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f } },
+			{ { right, bottom, z }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 1.0f } }
+		};
+		const uint16_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+		return device.AddMesh(vertices, 4, indices, 6);
+	}
+
+	RenderTexture AddSolid(SoftwareRenderDevice& device, uint32_t color)
+	{
+		std::vector<uint32_t> texels(16, color);
+		return device.AddTexture(4, 4, texels.data());
+	}
+
+	const uint32_t c_goldenWidth = 160;
+	const uint32_t c_goldenHeight = 120;
+	const uint32_t c_goldenBlock = 8;
+	const int c_goldenTolerance = 4;
+
+	// The mean red, green and blue of each block of the image, as hex, one string per row
+	// of blocks.
+	std::vector<std::string> BlockRows(const std::vector<uint32_t>& image)
+	{
+		std::vector<std::string> rows;
+		for (uint32_t by = 0; by < c_goldenHeight; by += c_goldenBlock)
+		{
+			std::string row;
+			for (uint32_t bx = 0; bx < c_goldenWidth; bx += c_goldenBlock)
+			{
+				uint32_t sum[3] = {};
+				for (uint32_t y = by; y < by + c_goldenBlock; ++y)
+				{
+					for (uint32_t x = bx; x < bx + c_goldenBlock; ++x)
+					{
+						uint32_t pixel = image[size_t(y) * c_goldenWidth + x];
+						for (int c = 0; c < 3; ++c)
+							sum[c] += (pixel >> (8 * c)) & 0xff;
+					}
+				}
+				char hex[32];
+				const uint32_t count = c_goldenBlock * c_goldenBlock;
+				snprintf(hex, sizeof(hex), "%02x%02x%02x", (sum[0] + count / 2) / count, (sum[1] + count / 2) / count,
+					(sum[2] + count / 2) / count);
+				row += hex;
+			}
+			rows.push_back(row);
+		}
+		return rows;
+	}
+
+	size_t CountPixels(const SoftwareRenderDevice& device, RenderTexture texture, uint32_t color)
+	{
+		const uint32_t* pixels = device.GetPixels(texture);
+		size_t count = 0;
+		for (size_t i = 0; i < size_t(device.GetWidth(texture)) * device.GetHeight(texture); ++i)
+			count += pixels[i] == color ? 1 : 0;
+		return count;
+	}
+}
+
+SELF_TEST(SoftwareRenderDevice, CoverageAndDepth)
+{
+	// A target spanning several tiles, so primitives cross tile edges.
+	const uint32_t size = SoftwareRenderDevice::TileSize * 2;
+	JobSystem jobs(2);
+	SoftwareRenderDevice device(&jobs);
+	RenderTexture color = device.AddTexture(size, size);
+	RenderTexture depth = device.AddDepthTexture(size, size);
+
+	SoftwareRenderDevice::PipelineDesc desc;
+	desc.Texture = true;
+	RenderPipeline pipeline = device.AddPipeline(desc);
+	RenderTexture red = AddSolid(device, c_red);
+	RenderTexture green = AddSolid(device, c_green);
+	RenderTexture blue = AddSolid(device, c_blue);
+
+	// Red over the whole target at depth 0.5, then green over the left half behind it and
+	// blue over the top half in front of it.
+	RenderMesh full = AddQuad(device, -1.0f, -1.0f, 1.0f, 1.0f, 0.5f);
+	RenderMesh left = AddQuad(device, -1.0f, -1.0f, 0.0f, 1.0f, 0.8f);
+	RenderMesh top = AddQuad(device, -1.0f, 0.0f, 1.0f, 1.0f, 0.2f);
+
+	float identity[16];
+	Identity(identity);
+	const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	CommandListPool pool(device, 1, 1);
+	pool.BeginFrame();
+	IRenderCommandList& list = IRenderDevice::GetRenderList(pool.BeginPass(0, 0));
+	list.SetRenderTargets(color, depth);
+	list.SetViewport(size, size);
+	list.ClearColor(color, black);
+	list.ClearDepth(depth, 1.0f);
+	list.SetPipeline(pipeline);
+	list.SetViewProjection(identity, identity);
+	list.SetWorld(identity);
+	list.SetTexture(red);
+	list.DrawMesh(full);
+	list.SetTexture(green);
+	list.DrawMesh(left);
+	list.SetTexture(blue);
+	list.DrawMesh(top);
+	pool.Submit();
+	pool.WaitForIdle();
+
+	// Shared edges cover every pixel exactly once, and only what passed the depth test
+	// is written.
+	const size_t half = size_t(size) * size / 2;
+	SELF_CHECK(CountPixels(device, color, c_red) == half);
+	SELF_CHECK(CountPixels(device, color, c_green) == 0);
+	SELF_CHECK(CountPixels(device, color, c_blue) == half);
+	SELF_CHECK(device.GetPixels(color)[0] == c_blue);
+	SELF_CHECK(device.GetPixels(color)[size_t(size) * size - 1] == c_red);
+
+	SoftwareRenderDevice::Stats stats = device.GetStats();
+	SELF_CHECK(stats.Triangles == 6);
+	SELF_CHECK(stats.Pixels == 3 * half);
+	context.Log("%llu pixels, %llu primitive and tile pairs", (unsigned long long)stats.Pixels,
+		(unsigned long long)stats.BinnedPrimitives);
+}
+
+SELF_TEST(SoftwareRenderDevice, SpritesAndUpscale)
+{
+	SoftwareRenderDevice device;
+	RenderTexture scene = device.AddTexture(32, 32);
+	RenderTexture output = device.AddTexture(64, 64);
+	RenderTexture green = AddSolid(device, c_green);
+	const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	// A sprite on pixel edges covers exactly its rectangle; the 16x16 corner of the scene
+	// stretched over the output becomes the whole of it.
+	CommandListPool pool(device, 1, 1);
+	pool.BeginFrame();
+	IRenderCommandList& list = IRenderDevice::GetRenderList(pool.BeginPass(0, 0));
+	list.SetRenderTargets(scene, RenderTexture());
+	list.SetViewport(32, 32);
+	list.ClearColor(scene, black);
+	list.DrawSprite(green, 4.0f, 8.0f, 12.0f, 24.0f);
+	list.Upscale(output, scene, 16, 16);
+	pool.Submit();
+	pool.WaitForIdle();
+
+	SELF_CHECK(CountPixels(device, scene, c_green) == 8 * 16);
+	const uint32_t* pixels = device.GetPixels(scene);
+	SELF_CHECK(pixels[8 * 32 + 4] == c_green && pixels[23 * 32 + 11] == c_green);
+	SELF_CHECK(pixels[7 * 32 + 4] != c_green && pixels[8 * 32 + 12] != c_green);
+
+	const uint32_t* upscaled = device.GetPixels(output);
+	SELF_CHECK(upscaled[48 * 64 + 32] == c_green);
+	SELF_CHECK(upscaled[2 * 64 + 2] != c_green && upscaled[62 * 64 + 62] != c_green);
+}
+
+SELF_TEST(SoftwareRenderDevice, MatchesGoldenImage)
+{
+	// The -softrender scene at 160x120 after four frames, with the project's earth.bmp and
+	// courier.spritefont, must match c_golden: the mean color of each 8x8 block, one row
+	// of blocks per string, within a small tolerance for rounding differences between
+	// compilers and math libraries.
+	//
+	// To regenerate it after an intended change, run this test from the project directory
+	// (as ctest does); a failing run lists the new rows in the report. Look at the image
+	// -softrender writes before pasting them in.
+	static const char* const c_golden[c_goldenHeight / c_goldenBlock] =
+	{
+		"0c06200b051f0b061f0b061f0b071f0b071f0b081f0b081f0b091f0b091f0b0a1f0b0a1f0b0b1f0b0b1f0b0c1f0c0d200b0d1f0b0d1f0b0e1f0b0e1f",
+		"0d052238324a27213a231d374d495d3a364c2b273e2b273e2b283e27243a27253a27253a0e0d2425233827273a2b2a3e2f2f4127273a3a3b4c343546",
+		"0f05263028442d264229223e38324b29233e2d27413c364f5a566a302c4429253e3c384f0f0b2629263e29263d4341552a293f3c3a4f3434484e4e60",
+		"110529110529110629110629110729110744180858340a2b360929320929360a29370b2a320b29140b29110d2a110c2913102c110d29110e29110e29",
+		"13052d13052d13062d13062d13072d1307852c08e84e083064092d4a092d640a2d640a2d4a0c2d300b2d130c2d130c2d130d2d130d2d130e2d130e2d",
+		"1505301505301506301709321507301507811508e87b084a7b09306509307b0a2f7a1b336d1c35320b30150c30150c30150d30160f31150e30150e30",
+		"1705331908351706331706331707331707801708ec7c0a4b7c0933660933380b1f1724632f3a9b2b1952170c33170c33170d33170d33170e33170e33",
+		"1905361905361906361906361908371a096f1908ef67084f6809364f093607041210176e1825ad1d1c89190c36190c36190d36190d36190e36190e36",
+		"1b053a1b053a1b063a1b063a1c093b1c096f1b08e97e08587e0939690939360619111858181d851d135d1b0c3a1c0d3b1b0d3a1b0d3a1b0e3a1c0f3b",
+		"1d053d1d053d1f083f1d063d200a401d07741d08ea6a4b64714e3c634a3d714f3d4f4e33644c3c1d0f3d1d0c3d1d0c3d1d0d3d1d0e3e1d0e3d1d0e3d",
+		"1f05401f05401f06402007412009421f0770203cc91f97401f9f401f93401fa3401f9b401f9c401f40401f0c40200e421f0d411f0d401f0e401f0e40",
+		"220745210544210644210644210744210764217b84219f4321934321934321a343219443219843218d43210c44210c44210d44210d44210e44210e44",
+		"23054725074923064723064723074723165623324a233247232f47232f47233847233047233147233147241d48230c47230e48230d47230e47230e47",
+		"25054a25054a25064a25064a25074a25074b25084a25084a25094a25094b250a4a250a4a250c4b250b4a250c4a250c4b250d4a250d4a28124e250e4a",
+		"27054e27064e27064e27064e27074e27074e27084e27084e27094e27094e270a4e280b4f270b4e270b4e270c4e270c4e280f4f270d4e270e4e291150"
+	};
+
+	for (const char* file : { "earth.bmp", "courier.spritefont" })
+	{
+		if (!SELF_CHECK(std::ifstream(file).good()))
+		{
+			context.Log("%s not found; run from the project directory", file);
+			return;
+		}
+	}
+
+	SoftwareRenderBenchmark::Settings settings;
+	settings.Width = c_goldenWidth;
+	settings.Height = c_goldenHeight;
+	settings.Frames = 4;
+	settings.MaxThreads = 2;
+	settings.ImageFile = nullptr;
+	std::vector<uint32_t> image = SoftwareRenderBenchmark::RenderLastFrame(settings);
+	if (!SELF_CHECK(image.size() == size_t(c_goldenWidth) * c_goldenHeight))
+		return;
+
+	std::vector<std::string> rows = BlockRows(image);
+	int largest = 0;
+	for (size_t row = 0; row < rows.size(); ++row)
+	{
+		for (size_t i = 0; i < rows[row].size(); i += 2)
+		{
+			int expected = std::stoi(std::string(c_golden[row] + i, 2), nullptr, 16);
+			int actual = std::stoi(rows[row].substr(i, 2), nullptr, 16);
+			largest = std::max(largest, std::abs(actual - expected));
+		}
+	}
+	context.Log("largest difference from the golden image %d", largest);
+	if (!SELF_CHECK(largest <= c_goldenTolerance))
+	{
+		for (const std::string& row : rows)
+			context.Log("\"%s\",", row.c_str());
+	}
+}
+
+SELF_TEST(SoftwareRenderDevice, SceneIsIdenticalAcrossThreadCounts)
+{
+	// The -softrender scene rendered with one thread and with several must come out the
+	// same, bit for bit.
+	SoftwareRenderBenchmark::Settings settings;
+	settings.Width = 320;
+	settings.Height = 240;
+	settings.Frames = 4;
+	settings.MaxThreads = 4;
+	settings.ImageFile = nullptr;
+	for (float scale : { 1.0f, 0.5f })
+	{
+		settings.RenderScale = scale;
+		std::string report = SoftwareRenderBenchmark::Run(settings);
+		context.Log("%s", report.c_str());
+		SELF_CHECK(report.find("images identical across thread counts") != std::string::npos);
+	}
+}
+
+SELF_BENCHMARK(SoftwareRenderDevice, Throughput)
+{
+	// Mpixels/s and Mtriangles/s of the tile jobs at each thread count, as -softrender.
+	SoftwareRenderBenchmark::Settings settings;
+	settings.ImageFile = nullptr;
+	std::string report = SoftwareRenderBenchmark::Run(settings);
+	context.Log("%s", report.c_str());
+	SELF_CHECK(report.find("images identical across thread counts") != std::string::npos);
+}
@@ -4,40 +4,173 @@
 
 #pragma once
 
-#include <exception>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 #include <stdint.h>
 
+#include "FrameTimeStats.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <time.h>
+#endif
+
 namespace DX
 {
-    // Helper class for animation and simulation timing.
-    class StepTimer
+    // Clock sources for BasicStepTimer. A clock reports a monotonic time in its own
+    // units through GetTime() and how many of those units make a second through GetFrequency().
+
+#if defined(_WIN32)
+    // QueryPerformanceCounter, the default on Windows.
+    class QpcClock
+    {
+    public:
+        QpcClock()
+        {
+            LARGE_INTEGER frequency;
+            if (!QueryPerformanceFrequency(&frequency))
+            {
+                throw std::runtime_error("QueryPerformanceFrequency");
+            }
+            m_frequency = static_cast<uint64_t>(frequency.QuadPart);
+        }
+
+        uint64_t GetFrequency() const                       { return m_frequency; }
+
+        uint64_t GetTime() const
+        {
+            LARGE_INTEGER time;
+            if (!QueryPerformanceCounter(&time))
+            {
+                throw std::runtime_error("QueryPerformanceCounter");
+            }
+            return static_cast<uint64_t>(time.QuadPart);
+        }
+
+    private:
+        uint64_t m_frequency;
+    };
+#endif
+
+    // std::chrono::steady_clock, available on every platform.
+    class SteadyClock
+    {
+    public:
+        uint64_t GetFrequency() const
+        {
+            using Period = std::chrono::steady_clock::period;
+            return static_cast<uint64_t>(Period::den / Period::num);
+        }
+
+        uint64_t GetTime() const
+        {
+            return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        }
+    };
+
+#if defined(__linux__)
+    // clock_gettime(CLOCK_MONOTONIC_RAW) in nanoseconds, which is not slewed by NTP.
+    class MonotonicRawClock
     {
     public:
-        StepTimer() : 
+        uint64_t GetFrequency() const                       { return 1000000000; }
+
+        uint64_t GetTime() const
+        {
+            timespec time;
+            if (clock_gettime(CLOCK_MONOTONIC_RAW, &time) != 0)
+            {
+                throw std::runtime_error("clock_gettime");
+            }
+            return static_cast<uint64_t>(time.tv_sec) * 1000000000 + static_cast<uint64_t>(time.tv_nsec);
+        }
+    };
+#endif
+
+    // Clock that only moves when told to, for deterministic and faster than real time
+    // simulation runs. Time is in canonical StepTimer ticks unless another frequency is given.
+    class ManualClock
+    {
+    public:
+        explicit ManualClock(uint64_t frequency = 10000000) :
+            m_frequency(frequency),
+            m_time(0)
+        {
+        }
+
+        uint64_t GetFrequency() const                       { return m_frequency; }
+        uint64_t GetTime() const                            { return m_time; }
+
+        void Advance(uint64_t delta)                        { m_time += delta; }
+        void AdvanceSeconds(double seconds)                 { m_time += static_cast<uint64_t>(seconds * m_frequency); }
+
+    private:
+        uint64_t m_frequency;
+        uint64_t m_time;
+    };
+
+    // What a fixed timestep Tick does with the time left after it ran its maximum number of
+    // updates: Carry keeps it for the following ticks (the simulation catches up later),
+    // Drop discards the whole steps and reports them as dropped time (the simulation slows
+    // down instead of falling further behind).
+    enum class CatchUpPolicy
+    {
+        Carry,
+        Drop
+    };
+
+    // Helper class for animation and simulation timing, parameterized on its clock source.
+    // The fixed and variable timestep logic is the same for every clock.
+    template<typename TClock>
+    class BasicStepTimer
+    {
+    public:
+        explicit BasicStepTimer(const TClock& clock = TClock()) :
+            m_clock(clock),
             m_elapsedTicks(0),
             m_totalTicks(0),
             m_leftOverTicks(0),
             m_frameCount(0),
             m_framesPerSecond(0),
             m_framesThisSecond(0),
-            m_qpcSecondCounter(0),
+            m_ticksPerSecond(0),
+            m_ticksThisSecond(0),
+            m_clockSecondCounter(0),
             m_isFixedTimeStep(false),
-            m_targetElapsedTicks(TicksPerSecond / 60)
+            m_targetElapsedTicks(TicksPerSecond / 60),
+            m_maxUpdatesPerTick(0),
+            m_catchUpPolicy(CatchUpPolicy::Carry),
+            m_updatesLastTick(0),
+            m_budgetExceededCount(0),
+            m_droppedTicks(0),
+            m_timeDilation(1.0),
+            m_simTicksThisSecond(0),
+            m_wallTicksThisSecond(0)
         {
-            if (!QueryPerformanceFrequency(&m_qpcFrequency))
+            m_clockFrequency = m_clock.GetFrequency();
+            if (m_clockFrequency == 0)
             {
-                throw std::exception( "QueryPerformanceFrequency" );
+                throw std::runtime_error("Clock frequency");
             }
 
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            m_clockLastTime = m_clock.GetTime();
 
             // Initialize max delta to 1/10 of a second.
-            m_qpcMaxDelta = m_qpcFrequency.QuadPart / 10;
+            m_clockMaxDelta = m_clockFrequency / 10;
         }
 
+        // Access the clock source, e.g. to advance a ManualClock.
+        TClock& GetClock()                                  { return m_clock; }
+        const TClock& GetClock() const                      { return m_clock; }
+
         // Get elapsed time since the previous Update call.
         uint64_t GetElapsedTicks() const					{ return m_elapsedTicks; }
         double GetElapsedSeconds() const					{ return TicksToSeconds(m_elapsedTicks); }
@@ -46,12 +179,35 @@ namespace DX
         uint64_t GetTotalTicks() const						{ return m_totalTicks; }
         double GetTotalSeconds() const						{ return TicksToSeconds(m_totalTicks); }
 
+        // Get the time accumulated towards the next fixed timestep Update, and the same as
+        // a fraction of the step in [0, 1) for interpolating between the previous and the
+        // current simulation state when rendering. The fraction is 1 in variable timestep mode.
+        uint64_t GetLeftOverTicks() const                   { return m_leftOverTicks; }
+        double GetInterpolationAlpha() const
+        {
+            if (!m_isFixedTimeStep || m_targetElapsedTicks == 0)
+            {
+                return 1.0;
+            }
+            // Time carried over after hitting the update budget can exceed one step.
+            return std::min(1.0, static_cast<double>(m_leftOverTicks) / static_cast<double>(m_targetElapsedTicks));
+        }
+
         // Get total number of updates since start of the program.
         uint32_t GetFrameCount() const						{ return m_frameCount; }
 
         // Get the current framerate.
         uint32_t GetFramesPerSecond() const					{ return m_framesPerSecond; }
 
+        // Get the number of Tick calls during the last second. This is the render rate, which
+        // differs from GetFramesPerSecond (the Update rate) in fixed timestep mode.
+        uint32_t GetTicksPerSecond() const                  { return m_ticksPerSecond; }
+
+        // Get the wall clock duration of every Tick, including slow frames that the
+        // update logic clamps, for percentile and stutter analysis.
+        FrameTimeStats& GetFrameTimeStats()                 { return m_frameTimes; }
+        const FrameTimeStats& GetFrameTimeStats() const     { return m_frameTimes; }
+
         // Set whether to use fixed or variable timestep mode.
         void SetFixedTimeStep(bool isFixedTimestep)			{ m_isFixedTimeStep = isFixedTimestep; }
 
@@ -59,6 +215,26 @@ namespace DX
         void SetTargetElapsedTicks(uint64_t targetElapsed)	{ m_targetElapsedTicks = targetElapsed; }
         void SetTargetElapsedSeconds(double targetElapsed)	{ m_targetElapsedTicks = SecondsToTicks(targetElapsed); }
 
+        // Limit how many fixed timestep Updates a single Tick may run (0 = no limit), so a
+        // slow frame can't trigger a burst of updates that makes the next frame slow too.
+        void SetMaxUpdatesPerTick(uint32_t maxUpdates)      { m_maxUpdatesPerTick = maxUpdates; }
+        uint32_t GetMaxUpdatesPerTick() const               { return m_maxUpdatesPerTick; }
+        void SetCatchUpPolicy(CatchUpPolicy policy)         { m_catchUpPolicy = policy; }
+        CatchUpPolicy GetCatchUpPolicy() const              { return m_catchUpPolicy; }
+
+        // Catch-up reporting.
+        // Number of Updates run by the last Tick.
+        uint32_t GetUpdatesLastTick() const                 { return m_updatesLastTick; }
+        // Number of Ticks that stopped at the update limit.
+        uint64_t GetBudgetExceededCount() const             { return m_budgetExceededCount; }
+        // Wall clock time never simulated: dropped by the Drop policy or by the clamp on
+        // very long frames.
+        uint64_t GetDroppedTicks() const                    { return m_droppedTicks; }
+        double GetDroppedSeconds() const                    { return TicksToSeconds(m_droppedTicks); }
+        // Simulated time per wall clock time over the last second; below 1 when the
+        // simulation can't keep up.
+        double GetTimeDilation() const                      { return m_timeDilation; }
+
         // Integer format represents time using 10,000,000 ticks per second.
         static const uint64_t TicksPerSecond = 10000000;
 
@@ -71,15 +247,16 @@ namespace DX
 
         void ResetElapsedTime()
         {
-            if (!QueryPerformanceCounter(&m_qpcLastTime))
-            {
-                throw std::exception("QueryPerformanceCounter");
-            }
+            m_clockLastTime = m_clock.GetTime();
 
             m_leftOverTicks = 0;
             m_framesPerSecond = 0;
             m_framesThisSecond = 0;
-            m_qpcSecondCounter = 0;
+            m_ticksPerSecond = 0;
+            m_ticksThisSecond = 0;
+            m_clockSecondCounter = 0;
+            m_simTicksThisSecond = 0;
+            m_wallTicksThisSecond = 0;
         }
 
         // Update timer state, calling the specified Update function the appropriate number of times.
@@ -87,27 +264,30 @@ namespace DX
         void Tick(const TUpdate& update)
         {
             // Query the current time.
-            LARGE_INTEGER currentTime;
+            uint64_t currentTime = m_clock.GetTime();
 
-            if (!QueryPerformanceCounter(&currentTime))
-            {
-                throw std::exception( "QueryPerformanceCounter" );
-            }
+            uint64_t timeDelta = currentTime - m_clockLastTime;
 
-            uint64_t timeDelta = currentTime.QuadPart - m_qpcLastTime.QuadPart;
+            m_clockLastTime = currentTime;
+            m_clockSecondCounter += timeDelta;
 
-            m_qpcLastTime = currentTime;
-            m_qpcSecondCounter += timeDelta;
+            // Record the unclamped frame time, split to avoid overflowing on long stalls.
+            uint64_t wallTicks = (timeDelta / m_clockFrequency) * TicksPerSecond +
+                (timeDelta % m_clockFrequency) * TicksPerSecond / m_clockFrequency;
+            m_frameTimes.Record(wallTicks);
+            m_wallTicksThisSecond += wallTicks;
 
             // Clamp excessively large time deltas (e.g. after paused in the debugger).
-            if (timeDelta > m_qpcMaxDelta)
+            if (timeDelta > m_clockMaxDelta)
             {
-                timeDelta = m_qpcMaxDelta;
+                timeDelta = m_clockMaxDelta;
             }
 
-            // Convert QPC units into a canonical tick format. This cannot overflow due to the previous clamp.
+            // Convert clock units into a canonical tick format. This cannot overflow due to the previous clamp.
             timeDelta *= TicksPerSecond;
-            timeDelta /= m_qpcFrequency.QuadPart;
+            timeDelta /= m_clockFrequency;
+
+            m_droppedTicks += wallTicks - timeDelta;
 
             uint32_t lastFrameCount = m_frameCount;
 
@@ -122,7 +302,9 @@ namespace DX
                 // accumulate enough tiny errors that it would drop a frame. It is better to just round 
                 // small deviations down to zero to leave things running smoothly.
 
-                if (abs(static_cast<int64_t>(timeDelta - m_targetElapsedTicks)) < TicksPerSecond / 4000)
+                uint64_t deviation = timeDelta > m_targetElapsedTicks ?
+                    timeDelta - m_targetElapsedTicks : m_targetElapsedTicks - timeDelta;
+                if (deviation < TicksPerSecond / 4000)
                 {
                     timeDelta = m_targetElapsedTicks;
                 }
@@ -131,10 +313,25 @@ namespace DX
 
                 while (m_leftOverTicks >= m_targetElapsedTicks)
                 {
+                    if (m_maxUpdatesPerTick != 0 && m_frameCount - lastFrameCount >= m_maxUpdatesPerTick)
+                    {
+                        m_budgetExceededCount++;
+
+                        if (m_catchUpPolicy == CatchUpPolicy::Drop)
+                        {
+                            // Keep the partial step so interpolation stays continuous.
+                            uint64_t dropped = m_leftOverTicks - m_leftOverTicks % m_targetElapsedTicks;
+                            m_leftOverTicks -= dropped;
+                            m_droppedTicks += dropped;
+                        }
+                        break;
+                    }
+
                     m_elapsedTicks = m_targetElapsedTicks;
                     m_totalTicks += m_targetElapsedTicks;
                     m_leftOverTicks -= m_targetElapsedTicks;
                     m_frameCount++;
+                    m_simTicksThisSecond += m_targetElapsedTicks;
 
                     update();
                 }
@@ -146,29 +343,41 @@ namespace DX
                 m_totalTicks += timeDelta;
                 m_leftOverTicks = 0;
                 m_frameCount++;
+                m_simTicksThisSecond += timeDelta;
 
                 update();
             }
 
+            m_updatesLastTick = m_frameCount - lastFrameCount;
+
             // Track the current framerate.
             if (m_frameCount != lastFrameCount)
             {
                 m_framesThisSecond++;
             }
+            m_ticksThisSecond++;
 
-            if (m_qpcSecondCounter >= static_cast<uint64_t>(m_qpcFrequency.QuadPart))
+            if (m_clockSecondCounter >= m_clockFrequency)
             {
                 m_framesPerSecond = m_framesThisSecond;
                 m_framesThisSecond = 0;
-                m_qpcSecondCounter %= m_qpcFrequency.QuadPart;
+                m_ticksPerSecond = m_ticksThisSecond;
+                m_ticksThisSecond = 0;
+                m_timeDilation = m_wallTicksThisSecond ?
+                    static_cast<double>(m_simTicksThisSecond) / static_cast<double>(m_wallTicksThisSecond) : 1.0;
+                m_simTicksThisSecond = 0;
+                m_wallTicksThisSecond = 0;
+                m_clockSecondCounter %= m_clockFrequency;
             }
         }
 
     private:
-        // Source timing data uses QPC units.
-        LARGE_INTEGER m_qpcFrequency;
-        LARGE_INTEGER m_qpcLastTime;
-        uint64_t m_qpcMaxDelta;
+        TClock m_clock;
+
+        // Source timing data uses clock units.
+        uint64_t m_clockFrequency;
+        uint64_t m_clockLastTime;
+        uint64_t m_clockMaxDelta;
 
         // Derived timing data uses a canonical tick format.
         uint64_t m_elapsedTicks;
@@ -179,10 +388,29 @@ namespace DX
         uint32_t m_frameCount;
         uint32_t m_framesPerSecond;
         uint32_t m_framesThisSecond;
-        uint64_t m_qpcSecondCounter;
+        uint32_t m_ticksPerSecond;
+        uint32_t m_ticksThisSecond;
+        uint64_t m_clockSecondCounter;
+        FrameTimeStats m_frameTimes;
 
         // Members for configuring fixed timestep mode.
         bool m_isFixedTimeStep;
         uint64_t m_targetElapsedTicks;
+
+        // Members for the catch-up budget and its reporting.
+        uint32_t m_maxUpdatesPerTick;
+        CatchUpPolicy m_catchUpPolicy;
+        uint32_t m_updatesLastTick;
+        uint64_t m_budgetExceededCount;
+        uint64_t m_droppedTicks;
+        double m_timeDilation;
+        uint64_t m_simTicksThisSecond;
+        uint64_t m_wallTicksThisSecond;
     };
+
+#if defined(_WIN32)
+    using StepTimer = BasicStepTimer<QpcClock>;
+#else
+    using StepTimer = BasicStepTimer<SteadyClock>;
+#endif
 }
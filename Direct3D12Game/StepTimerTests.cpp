@@ -0,0 +1,250 @@
+//
+// StepTimerTests.cpp
+//
+
+#include "SelfTest.h"
+#include "StepTimer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+	using ManualTimer = DX::BasicStepTimer<DX::ManualClock>;
+	const uint64_t c_ticksPerSecond = ManualTimer::TicksPerSecond;
+
+	// A real clock runs forward and a timer on it measures a short sleep.
+	template<typename TClock>
+	bool MeasuresSleep(SelfTest::Context& context, const char* name)
+	{
+		DX::BasicStepTimer<TClock> timer;
+		uint64_t before = timer.GetClock().GetTime();
+		timer.Tick([]() {});
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		timer.Tick([]() {});
+		double elapsed = timer.GetElapsedSeconds();
+		context.Log("%s: %.2f ms for a 5 ms sleep", name, elapsed * 1000.0);
+		return timer.GetClock().GetTime() >= before && elapsed >= 0.005 && elapsed <= 0.1 && timer.GetFrameCount() == 2;
+	}
+}
+
+SELF_TEST(StepTimer, VariableStepFollowsClock)
+{
+	// Millisecond clock units are converted to canonical ticks.
+	ManualTimer timer(DX::ManualClock(1000));
+	int updates = 0;
+	timer.GetClock().Advance(16);
+	timer.Tick([&]() { updates++; });
+
+	SELF_CHECK(updates == 1);
+	SELF_CHECK(timer.GetElapsedTicks() == 16 * c_ticksPerSecond / 1000);
+	SELF_CHECK(timer.GetTotalTicks() == timer.GetElapsedTicks());
+	SELF_CHECK(timer.GetInterpolationAlpha() == 1.0);
+
+	// No time passing still updates once, with a zero step.
+	timer.Tick([&]() { updates++; });
+	SELF_CHECK(updates == 2);
+	SELF_CHECK(timer.GetElapsedTicks() == 0);
+
+	// A stall is clamped to a tenth of a second and the rest reported as dropped.
+	timer.GetClock().Advance(2500);
+	timer.Tick([&]() { updates++; });
+	SELF_CHECK(timer.GetElapsedTicks() == c_ticksPerSecond / 10);
+	SELF_CHECK(timer.GetDroppedTicks() == 2400 * c_ticksPerSecond / 1000);
+	SELF_CHECK(timer.GetTotalTicks() == 116 * c_ticksPerSecond / 1000);
+}
+
+SELF_TEST(StepTimer, FixedStepAcceleratedRun)
+{
+	// An hour of a 60 Hz simulation on a 59.94 Hz display: the near-target clamp keeps
+	// exactly one update per frame, and the run takes no real time at all.
+	ManualTimer timer;
+	timer.SetFixedTimeStep(true);
+	timer.SetTargetElapsedSeconds(1.0 / 60.0);
+
+	const uint32_t frames = 60 * 60 * 60;
+	uint32_t updates = 0;
+	uint32_t mostPerTick = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < frames; ++frame)
+	{
+		timer.GetClock().AdvanceSeconds(1001.0 / 60000.0);
+		timer.Tick([&]() { updates++; });
+		mostPerTick = std::max(mostPerTick, timer.GetUpdatesLastTick());
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	context.Log("%u ticks in %.1f ms", frames, seconds * 1000.0);
+	SELF_CHECK(updates == frames);
+	SELF_CHECK(timer.GetFrameCount() == frames);
+	SELF_CHECK(mostPerTick == 1);
+	SELF_CHECK(timer.GetTotalTicks() == uint64_t(frames) * (c_ticksPerSecond / 60));
+	SELF_CHECK(timer.GetFramesPerSecond() >= 59 && timer.GetFramesPerSecond() <= 60);
+}
+
+SELF_TEST(StepTimer, RealClocks)
+{
+	SELF_CHECK(MeasuresSleep<DX::SteadyClock>(context, "steady_clock"));
+#if defined(_WIN32)
+	SELF_CHECK(MeasuresSleep<DX::QpcClock>(context, "QueryPerformanceCounter"));
+#endif
+#if defined(__linux__)
+	SELF_CHECK(MeasuresSleep<DX::MonotonicRawClock>(context, "CLOCK_MONOTONIC_RAW"));
+#endif
+}
+
+namespace
+{
+	// A small nonlinear simulation, so any difference in the steps it is given shows up.
+	struct Orbit
+	{
+		double Angle = 0.0;
+		double Speed = 1.0;
+
+		void Step(double seconds)
+		{
+			Angle += Speed * seconds;
+			Speed += 0.1 * sin(Angle) * seconds;
+		}
+	};
+}
+
+SELF_TEST(StepTimer, FixedStepIndependentOfRenderRate)
+{
+	// Ten seconds of a 30 Hz simulation rendered at different display rates.
+	const uint32_t renderRates[] = { 30, 60, 144, 240 };
+	Orbit reference;
+	bool first = true;
+	for (uint32_t rate : renderRates)
+	{
+		ManualTimer timer;
+		timer.SetFixedTimeStep(true);
+		timer.SetTargetElapsedSeconds(1.0 / 30.0);
+
+		Orbit previous;
+		Orbit current;
+		double lastRendered = 0.0;
+		bool monotonic = true;
+		bool alphaInRange = true;
+		const uint64_t frames = 10 * rate;
+		for (uint64_t frame = 1; frame <= frames; ++frame)
+		{
+			// Whole clock ticks that never drift from the exact rate.
+			timer.GetClock().Advance(frame * c_ticksPerSecond / rate - (frame - 1) * c_ticksPerSecond / rate);
+			timer.Tick([&]()
+			{
+				previous = current;
+				current.Step(timer.GetElapsedSeconds());
+			});
+
+			// What Render would draw: the interpolated state between the last two steps.
+			double alpha = timer.GetInterpolationAlpha();
+			double rendered = previous.Angle + (current.Angle - previous.Angle) * alpha;
+			alphaInRange = alphaInRange && alpha >= 0.0 && alpha < 1.0;
+			monotonic = monotonic && rendered >= lastRendered;
+			lastRendered = rendered;
+		}
+
+		context.Log("%3u Hz: %llu frames, %u updates, %.3f updates per frame", rate,
+			(unsigned long long)frames, timer.GetFrameCount(), double(timer.GetFrameCount()) / frames);
+		SELF_CHECK(timer.GetFrameCount() == 300);
+		SELF_CHECK(alphaInRange);
+		SELF_CHECK(monotonic);
+		if (first)
+			reference = current;
+		SELF_CHECK(current.Angle == reference.Angle && current.Speed == reference.Speed);
+		first = false;
+	}
+}
+
+namespace
+{
+	struct LoadRun
+	{
+		uint32_t MostUpdatesPerTick = 0;
+		uint64_t MaxLeftOverTicks = 0;
+		uint64_t WallTicks = 0;		// up to the start of the last Tick
+	};
+
+	// 60 Hz steps where every update costs 25 ms and every frame 5 ms on top, so the
+	// simulation can never keep up.
+	LoadRun RunUnderLoad(ManualTimer& timer, int ticks)
+	{
+		timer.SetFixedTimeStep(true);
+		timer.SetTargetElapsedSeconds(1.0 / 60.0);
+
+		LoadRun run;
+		uint64_t start = timer.GetClock().GetTime();
+		for (int tick = 0; tick < ticks; ++tick)
+		{
+			timer.GetClock().Advance(5 * c_ticksPerSecond / 1000);
+			run.WallTicks = timer.GetClock().GetTime() - start;
+			timer.Tick([&]() { timer.GetClock().Advance(25 * c_ticksPerSecond / 1000); });
+			run.MostUpdatesPerTick = std::max(run.MostUpdatesPerTick, timer.GetUpdatesLastTick());
+			run.MaxLeftOverTicks = std::max(run.MaxLeftOverTicks, timer.GetLeftOverTicks());
+		}
+		return run;
+	}
+}
+
+SELF_TEST(StepTimer, CatchUpBudget)
+{
+	const uint64_t step = c_ticksPerSecond / 60;
+
+	// Without a budget every slow frame schedules more updates, until the clamp on long
+	// frames stops the spiral.
+	ManualTimer unlimited;
+	LoadRun spiral = RunUnderLoad(unlimited, 200);
+	context.Log("no budget: up to %u updates per tick", spiral.MostUpdatesPerTick);
+	SELF_CHECK(spiral.MostUpdatesPerTick >= 5);
+	SELF_CHECK(unlimited.GetBudgetExceededCount() == 0);
+
+	// Carry keeps the time past the budget: nothing is dropped, the backlog grows.
+	ManualTimer carry;
+	carry.SetMaxUpdatesPerTick(2);
+	LoadRun carried = RunUnderLoad(carry, 200);
+	SELF_CHECK(carried.MostUpdatesPerTick == 2);
+	SELF_CHECK(carry.GetBudgetExceededCount() > 0);
+	SELF_CHECK(carry.GetDroppedTicks() == 0);
+	SELF_CHECK(carried.MaxLeftOverTicks > 10 * step);
+	SELF_CHECK(carry.GetInterpolationAlpha() == 1.0);
+
+	// Drop keeps at most a partial step, and every wall clock tick is either simulated,
+	// pending or reported as dropped. The simulation runs slower than real time.
+	ManualTimer drop;
+	drop.SetMaxUpdatesPerTick(2);
+	drop.SetCatchUpPolicy(DX::CatchUpPolicy::Drop);
+	LoadRun dropped = RunUnderLoad(drop, 200);
+	context.Log("drop: %.2f s dropped, time dilation %.2f", drop.GetDroppedSeconds(), drop.GetTimeDilation());
+	SELF_CHECK(dropped.MostUpdatesPerTick == 2);
+	SELF_CHECK(dropped.MaxLeftOverTicks < step);
+	SELF_CHECK(drop.GetDroppedTicks() > 0);
+	SELF_CHECK(drop.GetTotalTicks() + drop.GetLeftOverTicks() + drop.GetDroppedTicks() == dropped.WallTicks);
+	SELF_CHECK(drop.GetTimeDilation() > 0.5 && drop.GetTimeDilation() < 0.7);
+
+	// Once the load is gone, Drop is back to one update per frame right away (the updates
+	// of the last slow tick still count), while Carry first works off its backlog at the
+	// budget, one step per frame net.
+	uint64_t backlog = carry.GetLeftOverTicks() / step;
+	for (ManualTimer* timer : { &carry, &drop })
+	{
+		int ticks = 0;
+		bool withinBudget = true;
+		do
+		{
+			timer->GetClock().Advance(step);
+			timer->Tick([]() {});
+			withinBudget = withinBudget && timer->GetUpdatesLastTick() <= 2;
+			ticks++;
+		} while ((timer->GetUpdatesLastTick() != 1 || timer->GetLeftOverTicks() >= step) && ticks < 100000);
+
+		context.Log("%s: one update per frame again after %d ticks", timer == &carry ? "carry" : "drop", ticks);
+		SELF_CHECK(withinBudget);
+		if (timer == &carry)
+			SELF_CHECK(ticks >= int(backlog) && ticks <= int(backlog) + 4);
+		else
+			SELF_CHECK(ticks <= 2);
+	}
+}
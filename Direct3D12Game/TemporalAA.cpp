@@ -0,0 +1,125 @@
+//
+// TemporalAA.cpp
+//
+
+#include "TemporalAA.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+float TemporalAA::Halton(uint32_t index, uint32_t base)
+{
+	float result = 0.0f;
+	float f = 1.0f;
+	while (index > 0)
+	{
+		f /= float(base);
+		result += f * float(index % base);
+		index /= base;
+	}
+	return result;
+}
+
+XMFLOAT2 TemporalAA::GetJitter(uint64_t frameIndex, uint32_t sampleCount)
+{
+	uint32_t index = static_cast<uint32_t>(frameIndex % std::max(sampleCount, 1u)) + 1;
+	return XMFLOAT2(Halton(index, 2) - 0.5f, Halton(index, 3) - 0.5f);
+}
+
+XMMATRIX XM_CALLCONV TemporalAA::JitterProjection(FXMMATRIX proj, XMFLOAT2 jitter, uint32_t width, uint32_t height)
+{
+	// With row vectors clip.w is view z, so adding to the third row shifts the
+	// post-divide NDC position by a constant amount.
+	XMFLOAT4X4 P;
+	XMStoreFloat4x4(&P, proj);
+	P(2, 0) += 2.0f * jitter.x / float(width);
+	P(2, 1) -= 2.0f * jitter.y / float(height);
+	return XMLoadFloat4x4(&P);
+}
+
+namespace
+{
+	XMVECTOR SampleBilinear(const XMFLOAT4* image, uint32_t width, uint32_t height, float u, float v)
+	{
+		float x = u * width - 0.5f;
+		float y = v * height - 0.5f;
+		int x0 = int(floorf(x));
+		int y0 = int(floorf(y));
+		float fx = x - x0;
+		float fy = y - y0;
+
+		auto texel = [&](int tx, int ty)
+		{
+			tx = std::max(0, std::min(tx, int(width) - 1));
+			ty = std::max(0, std::min(ty, int(height) - 1));
+			return XMLoadFloat4(&image[size_t(ty) * width + tx]);
+		};
+
+		XMVECTOR top = XMVectorLerp(texel(x0, y0), texel(x0 + 1, y0), fx);
+		XMVECTOR bottom = XMVectorLerp(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fx);
+		return XMVectorLerp(top, bottom, fy);
+	}
+}
+
+void TemporalAA::ResolveReference(const ResolveDesc& desc,
+	const XMFLOAT4* current, const float* depth,
+	const XMFLOAT4* history, XMFLOAT4* output)
+{
+	const uint32_t width = desc.Width;
+	const uint32_t height = desc.Height;
+	XMMATRIX invViewProj = XMLoadFloat4x4(&desc.InvViewProj);
+	XMMATRIX prevViewProj = XMLoadFloat4x4(&desc.PrevViewProj);
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			size_t i = size_t(y) * width + x;
+			XMVECTOR color = XMLoadFloat4(&current[i]);
+
+			// Neighborhood bounds of the current frame.
+			XMVECTOR minColor = color;
+			XMVECTOR maxColor = color;
+			for (int dy = -1; dy <= 1; ++dy)
+			{
+				for (int dx = -1; dx <= 1; ++dx)
+				{
+					int nx = std::max(0, std::min(int(x) + dx, int(width) - 1));
+					int ny = std::max(0, std::min(int(y) + dy, int(height) - 1));
+					XMVECTOR n = XMLoadFloat4(&current[size_t(ny) * width + nx]);
+					minColor = XMVectorMin(minColor, n);
+					maxColor = XMVectorMax(maxColor, n);
+				}
+			}
+
+			// The pixel center of a jittered frame saw the unjittered point center - jitter.
+			float sx = (float(x) + 0.5f - desc.Jitter.x) / float(width);
+			float sy = (float(y) + 0.5f - desc.Jitter.y) / float(height);
+			XMVECTOR ndc = XMVectorSet(sx * 2.0f - 1.0f, 1.0f - sy * 2.0f, depth[i], 1.0f);
+
+			XMVECTOR world = XMVector4Transform(ndc, invViewProj);
+			world = XMVectorDivide(world, XMVectorSplatW(world));
+
+			XMVECTOR prevClip = XMVector4Transform(world, prevViewProj);
+			float prevW = XMVectorGetW(prevClip);
+
+			XMVECTOR result = color;
+			if (prevW > 0.0f)
+			{
+				float pu = (XMVectorGetX(prevClip) / prevW) * 0.5f + 0.5f;
+				float pv = 0.5f - (XMVectorGetY(prevClip) / prevW) * 0.5f;
+
+				if (pu >= 0.0f && pu <= 1.0f && pv >= 0.0f && pv <= 1.0f)
+				{
+					XMVECTOR prev = SampleBilinear(history, width, height, pu, pv);
+					prev = XMVectorClamp(prev, minColor, maxColor);
+					result = XMVectorLerp(color, prev, desc.Feedback);
+				}
+			}
+
+			XMStoreFloat4(&output[i], result);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+//
+// TemporalAA.h - Sub-pixel jitter sequence and temporal accumulation math
+//
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+
+namespace TemporalAA
+{
+	// Element index (1-based) of the radical inverse Halton sequence in the given base.
+	float Halton(uint32_t index, uint32_t base);
+
+	// Sub-pixel jitter for a frame, in pixels within [-0.5, 0.5), from the Halton(2, 3)
+	// sequence repeating every sampleCount frames.
+	DirectX::XMFLOAT2 GetJitter(uint64_t frameIndex, uint32_t sampleCount = 8);
+
+	// Offset a projection matrix so the rendered image moves by jitter pixels
+	// (+x right, +y down) on a width x height target.
+	DirectX::XMMATRIX XM_CALLCONV JitterProjection(DirectX::FXMMATRIX proj, DirectX::XMFLOAT2 jitter, uint32_t width, uint32_t height);
+
+	// CPU reference of the temporal resolve, used to validate the jitter and reprojection math.
+	//
+	// For every pixel the world position is rebuilt from depth with the current (unjittered)
+	// inverse view-projection, reprojected with the previous frame's view-projection and the
+	// history is sampled bilinearly there. The history sample is clamped to the 3x3
+	// neighborhood of the current frame to reject disoccluded or changed content, then
+	// blended with the current sample. Pixels reprojecting outside the screen use the
+	// current sample only.
+	struct ResolveDesc
+	{
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		float Feedback = 0.9f;							// weight of the history
+		DirectX::XMFLOAT2 Jitter = { 0.0f, 0.0f };		// jitter the current frame was rendered with
+		DirectX::XMFLOAT4X4 InvViewProj;				// current frame, without jitter
+		DirectX::XMFLOAT4X4 PrevViewProj;				// previous frame, in the current frame's space
+	};
+
+	void ResolveReference(const ResolveDesc& desc,
+		const DirectX::XMFLOAT4* current, const float* depth,
+		const DirectX::XMFLOAT4* history, DirectX::XMFLOAT4* output);
+}
@@ -0,0 +1,183 @@
+//
+// TemporalAATests.cpp
+//
+
+#include "SelfTest.h"
+#include "TemporalAA.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const uint32_t c_width = 16;
+	const uint32_t c_height = 8;
+
+	struct Frame
+	{
+		std::vector<XMFLOAT4> Current;
+		std::vector<float> Depth;
+		std::vector<XMFLOAT4> History;
+		std::vector<XMFLOAT4> Output;
+
+		Frame() :
+			Current(c_width * c_height),
+			Depth(c_width * c_height, 0.5f),
+			History(c_width * c_height),
+			Output(c_width * c_height)
+		{
+		}
+
+		void Resolve(const TemporalAA::ResolveDesc& desc)
+		{
+			TemporalAA::ResolveReference(desc, Current.data(), Depth.data(), History.data(), Output.data());
+		}
+	};
+
+	XMFLOAT4 Gray(float value)
+	{
+		return XMFLOAT4(value, value, value, 1.0f);
+	}
+
+	// Orthographic view-projection where world x/y are pixel coordinates (y down).
+	XMMATRIX PixelProjection()
+	{
+		return XMMatrixOrthographicOffCenterLH(0.0f, float(c_width), float(c_height), 0.0f, 0.0f, 1.0f);
+	}
+}
+
+SELF_TEST(TemporalAA, JitterFollowsHalton)
+{
+	SELF_CHECK(TemporalAA::Halton(1, 2) == 0.5f);
+	SELF_CHECK(TemporalAA::Halton(2, 2) == 0.25f);
+	SELF_CHECK(TemporalAA::Halton(3, 2) == 0.75f);
+	SELF_CHECK(fabsf(TemporalAA::Halton(1, 3) - 1.0f / 3.0f) < 1e-6f);
+	SELF_CHECK(fabsf(TemporalAA::Halton(5, 3) - 7.0f / 9.0f) < 1e-6f);
+
+	for (uint64_t frame = 0; frame < 32; ++frame)
+	{
+		XMFLOAT2 jitter = TemporalAA::GetJitter(frame, 8);
+		XMFLOAT2 repeat = TemporalAA::GetJitter(frame + 8, 8);
+		SELF_CHECK(jitter.x >= -0.5f && jitter.x < 0.5f && jitter.y >= -0.5f && jitter.y < 0.5f);
+		SELF_CHECK(jitter.x == repeat.x && jitter.y == repeat.y);
+	}
+}
+
+SELF_TEST(TemporalAA, JitterMovesImageByPixels)
+{
+	const uint32_t width = 1280;
+	const uint32_t height = 720;
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f * XM_PI, float(width) / float(height), 0.1f, 100.0f);
+	XMFLOAT2 jitter(0.3125f, -0.1875f);
+	XMMATRIX jittered = TemporalAA::JitterProjection(proj, jitter, width, height);
+
+	// Pixels are +x right and +y down.
+	for (XMVECTOR point : { XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), XMVectorSet(3.0f, -2.0f, 7.0f, 1.0f) })
+	{
+		XMVECTOR a = XMVector3TransformCoord(point, proj);
+		XMVECTOR b = XMVector3TransformCoord(point, jittered);
+		float dx = (XMVectorGetX(b) - XMVectorGetX(a)) * 0.5f * width;
+		float dy = -(XMVectorGetY(b) - XMVectorGetY(a)) * 0.5f * height;
+		SELF_CHECK(fabsf(dx - jitter.x) < 1e-3f);
+		SELF_CHECK(fabsf(dy - jitter.y) < 1e-3f);
+		SELF_CHECK(XMVectorGetZ(a) == XMVectorGetZ(b));
+	}
+}
+
+SELF_TEST(TemporalAA, ResolveBlendsAndClampsHistory)
+{
+	// Static perspective camera: every pixel reprojects onto itself, whatever its depth.
+	XMMATRIX viewProj = XMMatrixMultiply(
+		XMMatrixLookAtLH(XMVectorSet(1.0f, 2.0f, -5.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)),
+		XMMatrixPerspectiveFovLH(0.25f * XM_PI, 2.0f, 0.1f, 100.0f));
+	TemporalAA::ResolveDesc desc;
+	desc.Width = c_width;
+	desc.Height = c_height;
+	desc.Feedback = 0.75f;
+	XMStoreFloat4x4(&desc.InvViewProj, XMMatrixInverse(nullptr, viewProj));
+	XMStoreFloat4x4(&desc.PrevViewProj, viewProj);
+
+	// A checkerboard, so every 3x3 neighborhood spans [0, 1].
+	Frame frame;
+	for (uint32_t y = 0; y < c_height; ++y)
+	{
+		for (uint32_t x = 0; x < c_width; ++x)
+		{
+			size_t i = y * c_width + x;
+			frame.Current[i] = Gray(float((x + y) & 1));
+			frame.Depth[i] = 0.9f + 0.1f * float(i) / (c_width * c_height);
+		}
+	}
+
+	// History inside the neighborhood is blended as is, outside it is clamped first.
+	for (float history : { 0.5f, 3.0f, -2.0f })
+	{
+		std::fill(frame.History.begin(), frame.History.end(), Gray(history));
+		frame.Resolve(desc);
+
+		float clamped = std::max(0.0f, std::min(history, 1.0f));
+		float worst = 0.0f;
+		for (size_t i = 0; i < frame.Output.size(); ++i)
+		{
+			float expected = frame.Current[i].x + (clamped - frame.Current[i].x) * desc.Feedback;
+			worst = std::max(worst, fabsf(frame.Output[i].x - expected));
+		}
+		SELF_CHECK(worst < 1e-3f);
+	}
+
+	// Without history weight the current frame passes through.
+	desc.Feedback = 0.0f;
+	frame.Resolve(desc);
+	bool same = true;
+	for (size_t i = 0; i < frame.Output.size(); ++i)
+		same = same && frame.Output[i].x == frame.Current[i].x;
+	SELF_CHECK(same);
+}
+
+SELF_TEST(TemporalAA, ResolveReprojectsMotionAndJitter)
+{
+	// The previous frame saw everything 3 pixels further right, and the current frame was
+	// rendered with a quarter pixel jitter. Current and history are ramps along x, so the
+	// reprojected, bilinearly sampled history is known exactly.
+	const int shift = 3;
+	const XMFLOAT2 jitter(0.25f, 0.0f);
+	XMMATRIX viewProj = PixelProjection();
+	TemporalAA::ResolveDesc desc;
+	desc.Width = c_width;
+	desc.Height = c_height;
+	desc.Feedback = 0.5f;
+	desc.Jitter = jitter;
+	XMStoreFloat4x4(&desc.InvViewProj, XMMatrixInverse(nullptr, viewProj));
+	XMStoreFloat4x4(&desc.PrevViewProj, XMMatrixMultiply(XMMatrixTranslation(float(shift), 0.0f, 0.0f), viewProj));
+
+	Frame frame;
+	for (uint32_t y = 0; y < c_height; ++y)
+	{
+		for (uint32_t x = 0; x < c_width; ++x)
+		{
+			frame.Current[y * c_width + x] = Gray(float(x));
+			frame.History[y * c_width + x] = Gray(float(int(x) - shift) + 0.5f);
+		}
+	}
+	frame.Resolve(desc);
+
+	float worst = 0.0f;
+	for (uint32_t y = 0; y < c_height; ++y)
+	{
+		for (uint32_t x = 0; x < c_width; ++x)
+		{
+			// History pixel x + shift - jitter holds x + 0.5 - jitter; pixels whose
+			// reprojection leaves the screen keep the current frame.
+			float current = float(x);
+			float expected = current;
+			if (int(x) + shift < int(c_width))
+				expected = current + (current + 0.5f - jitter.x - current) * desc.Feedback;
+			worst = std::max(worst, fabsf(frame.Output[y * c_width + x].x - expected));
+		}
+	}
+	context.Log("worst error %g", worst);
+	SELF_CHECK(worst < 1e-3f);
+}
@@ -0,0 +1,27 @@
+//
+// TemporalResolve.hlsli - Shared declarations of the temporal anti-aliasing resolve pass
+//
+
+#define TemporalResolveRS \
+"RootFlags ( DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS | DENY_GEOMETRY_SHADER_ROOT_ACCESS )," \
+"RootConstants ( num32BitConstants = 20, b0, visibility = SHADER_VISIBILITY_PIXEL )," \
+"DescriptorTable ( SRV ( t0, numDescriptors = 2 ), visibility = SHADER_VISIBILITY_PIXEL )," \
+"DescriptorTable ( SRV ( t2 ), visibility = SHADER_VISIBILITY_PIXEL )," \
+"StaticSampler ( s0, filter = FILTER_MIN_MAG_MIP_LINEAR," \
+"                addressU = TEXTURE_ADDRESS_CLAMP, addressV = TEXTURE_ADDRESS_CLAMP, addressW = TEXTURE_ADDRESS_CLAMP," \
+"                visibility = SHADER_VISIBILITY_PIXEL )"
+
+// Must match TemporalAA::ResolvePass::Constants.
+cbuffer Constants : register(b0)
+{
+    float4x4 Reprojection;  // current NDC -> previous frame clip space
+    float2 Jitter;          // jitter of the current frame in UV units
+    float Feedback;         // weight of the history
+    float Padding;
+};
+
+struct VSOutput
+{
+    float4 Position : SV_Position;
+    float2 TexCoord : TEXCOORD0;
+};
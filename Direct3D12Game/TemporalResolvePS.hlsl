@@ -0,0 +1,47 @@
+//
+// TemporalResolvePS.hlsl - Reproject, clamp and accumulate the history.
+// Same algorithm as TemporalAA::ResolveReference.
+//
+
+#include "TemporalResolve.hlsli"
+
+Texture2D<float4> Current : register(t0);
+Texture2D<float> Depth : register(t1);
+Texture2D<float4> History : register(t2);
+SamplerState LinearClamp : register(s0);
+
+[RootSignature(TemporalResolveRS)]
+float4 main(VSOutput input) : SV_Target0
+{
+    int3 pixel = int3(input.Position.xy, 0);
+    float4 color = Current.Load(pixel);
+
+    // Neighborhood bounds of the current frame.
+    float4 minColor = color;
+    float4 maxColor = color;
+    [unroll]
+    for (int y = -1; y <= 1; ++y)
+    {
+        [unroll]
+        for (int x = -1; x <= 1; ++x)
+        {
+            float4 n = Current.Load(pixel, int2(x, y));
+            minColor = min(minColor, n);
+            maxColor = max(maxColor, n);
+        }
+    }
+
+    // The pixel center of a jittered frame saw the unjittered point center - jitter.
+    float2 uv = input.TexCoord - Jitter;
+    float4 ndc = float4(uv.x * 2 - 1, 1 - uv.y * 2, Depth.Load(pixel), 1);
+    float4 prevClip = mul(ndc, Reprojection);
+    if (prevClip.w <= 0)
+        return color;
+
+    float2 prevUV = float2(0.5, -0.5) * prevClip.xy / prevClip.w + 0.5;
+    if (any(prevUV < 0) || any(prevUV > 1))
+        return color;
+
+    float4 history = clamp(History.Sample(LinearClamp, prevUV), minColor, maxColor);
+    return lerp(color, history, Feedback);
+}
@@ -0,0 +1,57 @@
+//
+// TemporalResolvePass.cpp
+//
+
+#include "pch.h"
+#include "TemporalResolvePass.h"
+
+// Shader bytecode generated by FXC from TemporalResolveVS.hlsl and TemporalResolvePS.hlsl.
+#include "TemporalResolveVS.inc"
+#include "TemporalResolvePS.inc"
+
+using namespace DirectX;
+
+TemporalAA::ResolvePass::ResolvePass(ID3D12Device* device, DXGI_FORMAT renderTargetFormat)
+{
+	// The root signature is embedded in the shaders.
+	DX::ThrowIfFailed(device->CreateRootSignature(0, g_pTemporalResolvePS, sizeof(g_pTemporalResolvePS),
+		IID_PPV_ARGS(mRootSignature.ReleaseAndGetAddressOf())));
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+	psoDesc.pRootSignature = mRootSignature.Get();
+	psoDesc.VS = { g_pTemporalResolveVS, sizeof(g_pTemporalResolveVS) };
+	psoDesc.PS = { g_pTemporalResolvePS, sizeof(g_pTemporalResolvePS) };
+	psoDesc.BlendState = CommonStates::Opaque;
+	psoDesc.SampleMask = UINT_MAX;
+	psoDesc.RasterizerState = CommonStates::CullNone;
+	psoDesc.DepthStencilState = CommonStates::DepthNone;
+	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	psoDesc.NumRenderTargets = 1;
+	psoDesc.RTVFormats[0] = renderTargetFormat;
+	psoDesc.SampleDesc.Count = 1;
+
+	DX::ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDesc,
+		IID_PPV_ARGS(mPipelineState.ReleaseAndGetAddressOf())));
+}
+
+void TemporalAA::ResolvePass::Process(ID3D12GraphicsCommandList* commandList, const ResolveDesc& desc,
+	D3D12_GPU_DESCRIPTOR_HANDLE sceneTable, D3D12_GPU_DESCRIPTOR_HANDLE history)
+{
+	// One matrix from current NDC to previous clip space; the shader divides by w.
+	XMMATRIX reprojection = XMMatrixMultiply(
+		XMLoadFloat4x4(&desc.InvViewProj), XMLoadFloat4x4(&desc.PrevViewProj));
+
+	Constants constants;
+	XMStoreFloat4x4(&constants.Reprojection, XMMatrixTranspose(reprojection));
+	constants.Jitter = XMFLOAT2(desc.Jitter.x / float(desc.Width), desc.Jitter.y / float(desc.Height));
+	constants.Feedback = desc.Feedback;
+	constants.Padding = 0.0f;
+
+	commandList->SetGraphicsRootSignature(mRootSignature.Get());
+	commandList->SetPipelineState(mPipelineState.Get());
+	commandList->SetGraphicsRoot32BitConstants(0, sizeof(Constants) / sizeof(uint32_t), &constants, 0);
+	commandList->SetGraphicsRootDescriptorTable(1, sceneTable);
+	commandList->SetGraphicsRootDescriptorTable(2, history);
+	commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	commandList->DrawInstanced(3, 1, 0, 0);
+}
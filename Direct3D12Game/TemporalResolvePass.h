@@ -0,0 +1,38 @@
+//
+// TemporalResolvePass.h - Temporal anti-aliasing resolve on the GPU
+//
+
+#pragma once
+
+#include "pch.h"
+#include "TemporalAA.h"
+
+namespace TemporalAA
+{
+	// The same resolve as a full screen pixel shader pass (TemporalResolvePS.hlsl).
+	class ResolvePass
+	{
+	public:
+		ResolvePass(ID3D12Device* device, DXGI_FORMAT renderTargetFormat);
+
+		// Resolve into the currently bound render target. sceneTable holds the SRVs of the
+		// current color and depth (R32_FLOAT) in two consecutive descriptors; history is the
+		// SRV of the previous resolved frame. The caller sets the descriptor heap, viewport
+		// and scissor rect, and the width/height in desc are the size of that target.
+		void Process(ID3D12GraphicsCommandList* commandList, const ResolveDesc& desc,
+			D3D12_GPU_DESCRIPTOR_HANDLE sceneTable, D3D12_GPU_DESCRIPTOR_HANDLE history);
+
+	private:
+		// Must match the cbuffer in TemporalResolve.hlsli.
+		struct Constants
+		{
+			DirectX::XMFLOAT4X4 Reprojection;
+			DirectX::XMFLOAT2 Jitter;
+			float Feedback;
+			float Padding;
+		};
+
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> mPipelineState;
+	};
+}
@@ -0,0 +1,14 @@
+//
+// TemporalResolveVS.hlsl - Full screen triangle for the temporal resolve
+//
+
+#include "TemporalResolve.hlsli"
+
+[RootSignature(TemporalResolveRS)]
+VSOutput main(uint id : SV_VertexID)
+{
+    VSOutput output;
+    output.TexCoord = float2((id << 1) & 2, id & 2);
+    output.Position = float4(output.TexCoord * float2(2, -2) + float2(-1, 1), 0, 1);
+    return output;
+}
@@ -0,0 +1,78 @@
+//
+// TripleBuffer.h - Lock-free single producer / single consumer value handoff
+//
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace DX
+{
+    // Three copies of T are rotated between a writer, a reader and a shared middle slot.
+    // The writer fills its private slot and swaps it with the middle one; the reader swaps
+    // its private slot with the middle one when a newer value has been published. Neither
+    // side ever blocks, and the reader always sees a complete value (never a torn one).
+    //
+    // Exactly one thread may call the writer methods and one thread the reader methods.
+    template<typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() :
+            m_middle(1),
+            m_writeIndex(0),
+            m_readIndex(2)
+        {
+        }
+
+        TripleBuffer(const TripleBuffer&) = delete;
+        TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+        // Writer: slot to fill before calling Publish().
+        T& WriteBuffer()                                    { return m_buffers[m_writeIndex]; }
+
+        // Writer: make the write slot the newest value and take over the old middle slot.
+        void Publish()
+        {
+            uint32_t previous = m_middle.exchange(m_writeIndex | c_freshBit, std::memory_order_acq_rel);
+            m_writeIndex = previous & c_indexMask;
+        }
+
+        void Publish(const T& value)
+        {
+            WriteBuffer() = value;
+            Publish();
+        }
+
+        // Reader: take the newest published value, if any. Returns false if nothing new
+        // was published since the last call, in which case ReadBuffer() is unchanged.
+        bool Acquire()
+        {
+            if ((m_middle.load(std::memory_order_relaxed) & c_freshBit) == 0)
+            {
+                return false;
+            }
+
+            uint32_t previous = m_middle.exchange(m_readIndex, std::memory_order_acq_rel);
+            m_readIndex = previous & c_indexMask;
+            return true;
+        }
+
+        // Reader: the most recently acquired value (default constructed before the first publish).
+        const T& ReadBuffer() const                         { return m_buffers[m_readIndex]; }
+
+    private:
+        static const uint32_t c_indexMask = 0x3;
+        static const uint32_t c_freshBit = 0x4;
+
+        T m_buffers[3];
+
+        // Index of the shared middle slot plus a flag set while it holds an unread value.
+        std::atomic<uint32_t> m_middle;
+
+        // Slots privately owned by the writer and the reader.
+        uint32_t m_writeIndex;
+        uint32_t m_readIndex;
+    };
+}
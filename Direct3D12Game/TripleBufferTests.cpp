@@ -0,0 +1,131 @@
+//
+// TripleBufferTests.cpp
+//
+
+#include "Camera.h"
+#include "SelfTest.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+	// Every float of the snapshot holds the same sequence number, so a snapshot that mixes
+	// two publishes shows up as differing fields.
+	void Fill(CameraSnapshot& snapshot, uint64_t sequence)
+	{
+		float value = float(sequence % (1 << 24));
+		XMFLOAT4X4 matrix(
+			value, value, value, value,
+			value, value, value, value,
+			value, value, value, value,
+			value, value, value, value);
+		snapshot.Position = XMFLOAT3(value, value, value);
+		snapshot.View = matrix;
+		snapshot.Proj = matrix;
+		snapshot.ViewProj = matrix;
+		snapshot.InvViewProj = matrix;
+		for (auto& plane : snapshot.FrustumPlanes)
+			plane = XMFLOAT4(value, value, value, value);
+		snapshot.Version = sequence;
+	}
+
+	bool IsConsistent(const CameraSnapshot& snapshot)
+	{
+		float value = float(snapshot.Version % (1 << 24));
+		const XMFLOAT4X4* matrices[] = { &snapshot.View, &snapshot.Proj, &snapshot.ViewProj, &snapshot.InvViewProj };
+		for (const XMFLOAT4X4* matrix : matrices)
+		{
+			for (int r = 0; r < 4; ++r)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					if ((*matrix)(r, c) != value)
+						return false;
+				}
+			}
+		}
+		for (const auto& plane : snapshot.FrustumPlanes)
+		{
+			if (plane.x != value || plane.y != value || plane.z != value || plane.w != value)
+				return false;
+		}
+		return snapshot.Position.x == value && snapshot.Position.y == value && snapshot.Position.z == value;
+	}
+}
+
+SELF_TEST(TripleBuffer, NothingNewBeforePublish)
+{
+	DX::TripleBuffer<int> buffer;
+	SELF_CHECK(!buffer.Acquire());
+
+	buffer.Publish(1);
+	buffer.Publish(2);
+	SELF_CHECK(buffer.Acquire());
+	SELF_CHECK(buffer.ReadBuffer() == 2);
+	SELF_CHECK(!buffer.Acquire());
+	SELF_CHECK(buffer.ReadBuffer() == 2);
+}
+
+SELF_TEST(TripleBuffer, StressNoTornSnapshots)
+{
+	// The reader stops after enough snapshots or a second, whichever comes first.
+	const uint64_t target = 200000;
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	DX::TripleBuffer<CameraSnapshot> buffer;
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> published(0);
+
+	std::thread writer([&]()
+	{
+		uint64_t sequence = 0;
+		while (!stop)
+		{
+			Fill(buffer.WriteBuffer(), ++sequence);
+			buffer.Publish();
+			published = sequence;
+			// Give a reader on the same core a chance to run in the middle of the writes.
+			if (sequence % 16 == 0)
+				std::this_thread::yield();
+		}
+	});
+
+	uint64_t acquired = 0;
+	uint64_t torn = 0;
+	uint64_t backwards = 0;
+	uint64_t last = 0;
+	while (acquired < target && std::chrono::steady_clock::now() < deadline)
+	{
+		if (!buffer.Acquire())
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		const CameraSnapshot& snapshot = buffer.ReadBuffer();
+		torn += IsConsistent(snapshot) ? 0 : 1;
+		backwards += snapshot.Version > last ? 0 : 1;
+		last = snapshot.Version;
+		acquired++;
+	}
+	stop = true;
+	writer.join();
+
+	// Whatever the writer published last is still there to take.
+	uint64_t lastPublished = published;
+	if (buffer.Acquire())
+	{
+		torn += IsConsistent(buffer.ReadBuffer()) ? 0 : 1;
+		last = buffer.ReadBuffer().Version;
+	}
+
+	context.Log("%llu snapshots acquired of %llu published", (unsigned long long)acquired, (unsigned long long)lastPublished);
+	SELF_CHECK(acquired > 1000);
+	SELF_CHECK(torn == 0);
+	SELF_CHECK(backwards == 0);
+	SELF_CHECK(last == lastPublished);
+}
@@ -43,6 +43,7 @@
 #include "d3dx12.h"
 
 #include <algorithm>
+#include <chrono>
 #include <exception>
 #include <memory>
 #include <stdexcept>